@@ -0,0 +1,75 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_OPQUEUE_H
+#define CEPH_COMMON_OPQUEUE_H
+
+#include "common/Formatter.h"
+
+#include <list>
+#include <functional>
+
+/**
+ * Abstract interface for an op queue
+ *
+ * This is what a user of PrioritizedQueue needs from it, so that a
+ * different scheduling discipline (e.g., mClockQueue) can be dropped
+ * in behind it.
+ *
+ * Items queued with enqueue_strict/enqueue_strict_front are served in
+ * strict priority order before anything else.  How the remaining items
+ * are ordered is up to the implementation, except that items of the
+ * same class K come out in the order they were queued.
+ */
+template <typename T, typename K>
+class OpQueue {
+public:
+  virtual ~OpQueue() {}
+
+  /// number of items queued
+  virtual unsigned length() const = 0;
+
+  /// remove the items for which f is true, appending them to *removed
+  virtual void remove_by_filter(std::function<bool (T)> f,
+				std::list<T> *removed = 0) = 0;
+
+  /// remove all items of class k, appending them to *out
+  virtual void remove_by_class(K k, std::list<T> *out = 0) = 0;
+
+  virtual void enqueue_strict(K cl, unsigned priority, T item) = 0;
+  virtual void enqueue_strict_front(K cl, unsigned priority, T item) = 0;
+  virtual void enqueue(K cl, unsigned priority, unsigned cost, T item) = 0;
+  virtual void enqueue_front(K cl, unsigned priority, unsigned cost,
+			     T item) = 0;
+
+  virtual bool empty() const = 0;
+
+  /// remove and return the next item; the queue must not be empty
+  virtual T dequeue() = 0;
+
+  /**
+   * remove an item for which f is true, out of the normal order
+   *
+   * Only the head of each class is considered, looking at no more than
+   * max_scan of them, so items of one class still come out in order.
+   * Unlike dequeue(), this leaves the queue's scheduling state (tokens,
+   * tags, round robin position) alone: the item is served on the side.
+   *
+   * @return true if an item matched; it is appended to *out
+   */
+  virtual bool dequeue_head_if(std::function<bool (T)> f, unsigned max_scan,
+			       std::list<T> *out) = 0;
+
+  virtual void dump(Formatter *f) const = 0;
+};
+
+#endif
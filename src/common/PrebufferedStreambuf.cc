@@ -1,6 +1,8 @@
 
 #include "common/PrebufferedStreambuf.h"
 
+#include <string.h>
+
 PrebufferedStreambuf::PrebufferedStreambuf(char *buf, size_t len)
   : m_buf(buf), m_buf_len(len)
 {
@@ -61,3 +63,20 @@ std::string PrebufferedStreambuf::get_str() const
     return std::string(m_buf, this->pptr() - m_buf);
   }  
 }
+
+size_t PrebufferedStreambuf::size() const
+{
+  if (m_overflow.size())
+    return m_buf_len + (this->pptr() - &m_overflow[0]);
+  return this->pptr() - m_buf;
+}
+
+void PrebufferedStreambuf::copy_to(char *dst) const
+{
+  if (m_overflow.size()) {
+    memcpy(dst, m_buf, m_buf_len);
+    memcpy(dst + m_buf_len, &m_overflow[0], this->pptr() - &m_overflow[0]);
+  } else {
+    memcpy(dst, m_buf, this->pptr() - m_buf);
+  }
+}
@@ -37,6 +37,12 @@ public:
 
   /// return a string copy (inefficiently)
   std::string get_str() const;
+
+  /// number of bytes written so far
+  size_t size() const;
+
+  /// copy the contents to dst, which must have room for size() bytes
+  void copy_to(char *dst) const;
 };    
 
 #endif
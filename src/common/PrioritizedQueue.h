@@ -17,6 +17,7 @@
 
 #include "common/Mutex.h"
 #include "common/Formatter.h"
+#include "common/OpQueue.h"
 
 #include <map>
 #include <utility>
@@ -44,7 +45,7 @@
  * to provide fairness for different clients.
  */
 template <typename T, typename K>
-class PrioritizedQueue {
+class PrioritizedQueue : public OpQueue<T, K> {
   int64_t total_priority;
   int64_t max_tokens_per_subqueue;
   int64_t min_cost;
@@ -168,6 +169,34 @@ class PrioritizedQueue {
       if (cur == q.end())
 	cur = q.begin();
     }
+    /// take the first class head, starting at cur, for which f is true
+    template <class F>
+    bool take_head_if(F f, unsigned *max_scan, std::list<T> *out) {
+      if (q.empty())
+	return false;
+      typename Classes::iterator i = cur;
+      do {
+	if (*max_scan == 0)
+	  return false;
+	--*max_scan;
+	if (f(i->second.front().second)) {
+	  out->push_back(i->second.front().second);
+	  i->second.pop_front();
+	  if (i->second.empty()) {
+	    if (cur == i)
+	      ++cur;
+	    q.erase(i);
+	    if (cur == q.end())
+	      cur = q.begin();
+	  }
+	  size--;
+	  return true;
+	}
+	if (++i == q.end())
+	  i = q.begin();
+      } while (i != cur);
+      return false;
+    }
     void remove_by_class(K k, std::list<T> *out) {
       typename Classes::iterator i = q.find(k);
       if (i == q.end())
@@ -253,8 +282,8 @@ public:
     return total;
   }
 
-  template <class F>
-  void remove_by_filter(F f, std::list<T> *removed = 0) {
+  void remove_by_filter(std::function<bool (T)> f,
+			std::list<T> *removed = 0) {
     for (typename SubQueues::iterator i = queue.begin();
 	 i != queue.end();
 	 ) {
@@ -376,6 +405,29 @@ public:
     return ret;
   }
 
+  bool dequeue_head_if(std::function<bool (T)> f, unsigned max_scan,
+		       std::list<T> *out) {
+    for (typename SubQueues::reverse_iterator i = high_queue.rbegin();
+	 i != high_queue.rend();
+	 ++i) {
+      if (i->second.take_head_if(f, &max_scan, out)) {
+	if (i->second.empty())
+	  high_queue.erase(i->first);
+	return true;
+      }
+    }
+    for (typename SubQueues::reverse_iterator i = queue.rbegin();
+	 i != queue.rend();
+	 ++i) {
+      if (i->second.take_head_if(f, &max_scan, out)) {
+	if (i->second.empty())
+	  remove_queue(i->first);
+	return true;
+      }
+    }
+    return false;
+  }
+
   void dump(Formatter *f) const {
     f->dump_int("total_priority", total_priority);
     f->dump_int("max_tokens_per_subqueue", max_tokens_per_subqueue);
@@ -289,7 +289,8 @@ void ThreadPool::set_ioprio(int cls, int priority)
 ShardedThreadPool::ShardedThreadPool(CephContext *pcct_, string nm, 
   uint32_t pnum_threads): cct(pcct_),name(nm),lockname(nm + "::lock"), 
   shardedpool_lock(lockname.c_str()),num_threads(pnum_threads),stop_threads(0), 
-  pause_threads(0),drain_threads(0), num_paused(0), num_drained(0), wq(NULL) {}
+  pause_threads(0),drain_threads(0), num_paused(0), num_drained(0),
+  work_stealing(false), wq(NULL) {}
 
 void ShardedThreadPool::shardedthreadpool_worker(uint32_t thread_index)
 {
@@ -347,6 +348,35 @@ void ShardedThreadPool::shardedthreadpool_worker(uint32_t thread_index)
 
 }
 
+bool ShardedThreadPool::steal(uint32_t shard_index, heartbeat_handle_d *hb)
+{
+  if (!work_stealing)
+    return false;
+  uint32_t num_shards = wq->get_num_shards();
+  for (uint32_t i = 1; i < num_shards; ++i) {
+    uint32_t victim = (shard_index + i) % num_shards;
+    if (wq->has_idle_threads(victim))
+      continue;  // its own threads will get to it
+    if (wq->_steal_from(victim, hb)) {
+      ldout(cct, 20) << "shard " << shard_index << " stole from " << victim
+		     << dendl;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ShardedThreadPool::wake_thief(uint32_t shard_index)
+{
+  if (!work_stealing)
+    return;
+  uint32_t num_shards = wq->get_num_shards();
+  for (uint32_t i = 1; i < num_shards; ++i) {
+    if (wq->_wake_idle((shard_index + i) % num_shards))
+      return;
+  }
+}
+
 void ShardedThreadPool::start_threads()
 {
   assert(shardedpool_lock.is_locked());
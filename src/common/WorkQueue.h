@@ -531,6 +531,7 @@ class ShardedThreadPool {
   atomic_t drain_threads;
   uint32_t num_paused;
   uint32_t num_drained;
+  bool work_stealing;
 
 public:
 
@@ -544,6 +545,30 @@ public:
     virtual void _process(uint32_t thread_index, heartbeat_handle_d *hb ) = 0;
     virtual void return_waiting_threads() = 0;
     virtual bool is_shard_empty(uint32_t thread_index) = 0;
+
+    // work stealing hooks; see ShardedThreadPool::set_work_stealing()
+
+    /// number of shards; thread i serves shard i % get_num_shards()
+    virtual uint32_t get_num_shards() {
+      return 1;
+    }
+    /// true if some of the shard's own threads are waiting for work
+    virtual bool has_idle_threads(uint32_t shard_index) {
+      return true;
+    }
+    /**
+     * take one item from the shard that may run on any thread and run
+     * it on the calling one
+     *
+     * @return false if there was no such item
+     */
+    virtual bool _steal_from(uint32_t shard_index, heartbeat_handle_d *hb) {
+      return false;
+    }
+    /// wake one of the shard's idle threads; false if it has none
+    virtual bool _wake_idle(uint32_t shard_index) {
+      return false;
+    }
   };      
 
   template <typename T>
@@ -572,7 +597,16 @@ public:
     void drain() {
       sharded_pool->drain();
     }
-    
+
+  protected:
+    /// our shard is empty: run an item from a busy one, if stealing
+    bool steal(uint32_t shard_index, heartbeat_handle_d *hb) {
+      return sharded_pool->steal(shard_index, hb);
+    }
+    /// we queued to a shard with no idle threads: wake a thief, if stealing
+    void wake_thief(uint32_t shard_index) {
+      sharded_pool->wake_thief(shard_index);
+    }
   };
 
 private:
@@ -618,6 +652,32 @@ public:
   /// wait for all work to complete
   void drain();
 
+  /**
+   * enable or disable work stealing
+   *
+   * In work stealing mode a thread whose own shard is empty may run
+   * an item from another shard whose threads are all busy, and queueing
+   * to such a shard wakes an idle thread elsewhere to come and get it.
+   * The queue takes part through the BaseShardedWQ stealing hooks and
+   * decides which items may move; it is up to it to preserve whatever
+   * ordering it needs (e.g., by locking the item's PG).
+   */
+  void set_work_stealing(bool b) {
+    work_stealing = b;
+  }
+  bool is_work_stealing() const {
+    return work_stealing;
+  }
+
+  /**
+   * run one item from some other busy shard on the calling thread
+   *
+   * @param shard_index the caller's own (empty) shard
+   * @return true if an item was run
+   */
+  bool steal(uint32_t shard_index, heartbeat_handle_d *hb);
+  /// wake an idle thread of some other shard to steal from shard_index
+  void wake_thief(uint32_t shard_index);
 };
 
 
@@ -29,7 +29,9 @@
 #endif
 
 #include <errno.h>
+#include <pthread.h>
 #include <fstream>
+#include <set>
 #include <sstream>
 #include <sys/uio.h>
 #include <limits.h>
@@ -189,6 +191,31 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
       crc_lock.unlock();
       return true;
     }
+    typedef pair<pair<size_t, size_t>, pair<uint32_t, uint32_t> > crc_tile_t;
+    /*
+     * collect cached ranges that lie within [from, to), in order and
+     * without overlap, preferring the longest range at each start.
+     */
+    void get_crc_tiles(size_t from, size_t to,
+		       vector<crc_tile_t> *tiles) const {
+      crc_lock.get_read();
+      map<pair<size_t, size_t>, pair<uint32_t, uint32_t> >::const_iterator i =
+	crc_map.lower_bound(make_pair(from, (size_t)0));
+      while (i != crc_map.end() && i->first.first < to) {
+	size_t start = i->first.first;
+	map<pair<size_t, size_t>, pair<uint32_t, uint32_t> >::const_iterator
+	  best = crc_map.end();
+	for (; i != crc_map.end() && i->first.first == start; ++i) {
+	  if (i->first.second <= to && i->first.second > start)
+	    best = i;
+	}
+	if (best != crc_map.end()) {
+	  tiles->push_back(*best);
+	  i = crc_map.lower_bound(make_pair(best->first.second, (size_t)0));
+	}
+      }
+      crc_lock.unlock();
+    }
     void set_crc(const pair<size_t, size_t> &fromto,
          const pair<uint32_t, uint32_t> &crc) {
       crc_lock.get_write();
@@ -547,6 +574,265 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     }
   };
 
+  /*
+   * per-thread raw pool
+   *
+   * small buffers are carved from malloc'd chunks in power-of-two size
+   * classes, each chunk prefixed by a tag recording its class so it can
+   * be freed without knowing its size.  page-multiple buffers (up to
+   * POOL_PAGE_CLASSES pages) come from page-aligned slabs, one class per
+   * page count.  freed chunks go on the freeing thread's cache, up to
+   * buffer_pool_thread_cache_bytes, and otherwise back to the heap.
+   */
+  static const unsigned POOL_SMALL_MIN_SHIFT = 8;   // 256 bytes
+  static const unsigned POOL_SMALL_CLASSES = 6;     // .. 8 KB
+  static const unsigned POOL_PAGE_CLASSES = 16;     // 1 .. 16 pages
+  static const unsigned POOL_TAG_SIZE = 16;         // keeps data 16-aligned
+
+  static bool buffer_pool_enabled = true;
+  static uint64_t buffer_pool_thread_cache_bytes = 1 << 20;
+
+  struct buffer_pool_cache {
+    struct freelist {
+      void *head;
+      unsigned count;
+    };
+    freelist small[POOL_SMALL_CLASSES];
+    freelist pages[POOL_PAGE_CLASSES];
+    uint64_t hits, misses, cached_bytes;
+
+    buffer_pool_cache() : hits(0), misses(0), cached_bytes(0) {
+      memset(small, 0, sizeof(small));
+      memset(pages, 0, sizeof(pages));
+    }
+    ~buffer_pool_cache() {
+      for (unsigned i = 0; i < POOL_SMALL_CLASSES; ++i)
+	drain(&small[i]);
+      for (unsigned i = 0; i < POOL_PAGE_CLASSES; ++i)
+	drain(&pages[i]);
+    }
+    void drain(freelist *fl) {
+      while (fl->head) {
+	void *p = fl->head;
+	fl->head = *(void **)p;
+	::free(p);
+      }
+      fl->count = 0;
+    }
+  };
+
+  // all live thread caches, so the counters can be summed
+  static simple_spinlock_t buffer_pool_lock = SIMPLE_SPINLOCK_INITIALIZER;
+  static std::set<buffer_pool_cache*> *buffer_pool_caches;
+  static uint64_t buffer_pool_retired_hits, buffer_pool_retired_misses;
+  static pthread_key_t buffer_pool_key;
+  static pthread_once_t buffer_pool_key_once = PTHREAD_ONCE_INIT;
+  static __thread buffer_pool_cache *buffer_pool_tls;
+
+  static void buffer_pool_thread_exit(void *p)
+  {
+    buffer_pool_cache *c = static_cast<buffer_pool_cache*>(p);
+    simple_spin_lock(&buffer_pool_lock);
+    buffer_pool_caches->erase(c);
+    buffer_pool_retired_hits += c->hits;
+    buffer_pool_retired_misses += c->misses;
+    simple_spin_unlock(&buffer_pool_lock);
+    buffer_pool_tls = NULL;
+    delete c;
+  }
+
+  static void buffer_pool_make_key()
+  {
+    buffer_pool_caches = new std::set<buffer_pool_cache*>;
+    pthread_key_create(&buffer_pool_key, buffer_pool_thread_exit);
+  }
+
+  static buffer_pool_cache *buffer_pool_get_cache()
+  {
+    if (likely(buffer_pool_tls != NULL))
+      return buffer_pool_tls;
+    pthread_once(&buffer_pool_key_once, buffer_pool_make_key);
+    buffer_pool_cache *c = new buffer_pool_cache;
+    simple_spin_lock(&buffer_pool_lock);
+    buffer_pool_caches->insert(c);
+    simple_spin_unlock(&buffer_pool_lock);
+    pthread_setspecific(buffer_pool_key, c);
+    buffer_pool_tls = c;
+    return c;
+  }
+
+  static unsigned buffer_pool_max_count(unsigned chunk_size)
+  {
+    // split the per-thread budget evenly across the classes
+    uint64_t n = buffer_pool_thread_cache_bytes /
+      (POOL_SMALL_CLASSES + POOL_PAGE_CLASSES) / chunk_size;
+    return n > 2 ? n : 2;
+  }
+
+  static void *buffer_pool_get(buffer_pool_cache *c,
+			       buffer_pool_cache::freelist *fl,
+			       unsigned chunk_size, bool page)
+  {
+    if (fl->head) {
+      void *p = fl->head;
+      fl->head = *(void **)p;
+      --fl->count;
+      c->cached_bytes -= chunk_size;
+      ++c->hits;
+      return p;
+    }
+    ++c->misses;
+    void *p = NULL;
+    if (page) {
+      if (::posix_memalign(&p, CEPH_PAGE_SIZE, chunk_size))
+	p = NULL;
+    } else {
+      p = ::malloc(chunk_size);
+    }
+    if (!p)
+      throw buffer::bad_alloc();
+    return p;
+  }
+
+  static void buffer_pool_put(buffer_pool_cache::freelist *fl,
+			      unsigned chunk_size, void *p)
+  {
+    buffer_pool_cache *c = buffer_pool_get_cache();
+    if (fl->count >= buffer_pool_max_count(chunk_size)) {
+      ::free(p);
+      return;
+    }
+    *(void **)p = fl->head;
+    fl->head = p;
+    ++fl->count;
+    c->cached_bytes += chunk_size;
+  }
+
+  // small chunk with a class tag in front; returns the usable area
+  static void *buffer_pool_alloc_small(unsigned cls)
+  {
+    buffer_pool_cache *c = buffer_pool_get_cache();
+    unsigned chunk_size = 1 << (POOL_SMALL_MIN_SHIFT + cls);
+    char *p = (char *)buffer_pool_get(c, &c->small[cls], chunk_size, false);
+    *(uint32_t *)p = cls;
+    return p + POOL_TAG_SIZE;
+  }
+
+  static void buffer_pool_free_small(void *ptr)
+  {
+    char *p = (char *)ptr - POOL_TAG_SIZE;
+    unsigned cls = *(uint32_t *)p;
+    assert(cls < POOL_SMALL_CLASSES);
+    buffer_pool_put(&buffer_pool_get_cache()->small[cls],
+		    1 << (POOL_SMALL_MIN_SHIFT + cls), p);
+  }
+
+  // smallest small class whose usable area holds len bytes, or -1
+  static int buffer_pool_small_class(size_t len)
+  {
+    for (unsigned cls = 0; cls < POOL_SMALL_CLASSES; ++cls)
+      if (len <= (1u << (POOL_SMALL_MIN_SHIFT + cls)) - POOL_TAG_SIZE)
+	return cls;
+    return -1;
+  }
+
+  uint64_t buffer::get_pool_hits() {
+    simple_spin_lock(&buffer_pool_lock);
+    uint64_t r = buffer_pool_retired_hits;
+    if (buffer_pool_caches)
+      for (std::set<buffer_pool_cache*>::iterator p = buffer_pool_caches->begin();
+	   p != buffer_pool_caches->end(); ++p)
+	r += (*p)->hits;
+    simple_spin_unlock(&buffer_pool_lock);
+    return r;
+  }
+  uint64_t buffer::get_pool_misses() {
+    simple_spin_lock(&buffer_pool_lock);
+    uint64_t r = buffer_pool_retired_misses;
+    if (buffer_pool_caches)
+      for (std::set<buffer_pool_cache*>::iterator p = buffer_pool_caches->begin();
+	   p != buffer_pool_caches->end(); ++p)
+	r += (*p)->misses;
+    simple_spin_unlock(&buffer_pool_lock);
+    return r;
+  }
+  uint64_t buffer::get_pool_cached_bytes() {
+    simple_spin_lock(&buffer_pool_lock);
+    uint64_t r = 0;
+    if (buffer_pool_caches)
+      for (std::set<buffer_pool_cache*>::iterator p = buffer_pool_caches->begin();
+	   p != buffer_pool_caches->end(); ++p)
+	r += (*p)->cached_bytes;
+    simple_spin_unlock(&buffer_pool_lock);
+    return r;
+  }
+  void buffer::set_pool_enabled(bool b) {
+    buffer_pool_enabled = b;
+  }
+  void buffer::set_pool_thread_cache_bytes(uint64_t bytes) {
+    buffer_pool_thread_cache_bytes = bytes;
+  }
+
+  /*
+   * raw header and data co-allocated in one small pool chunk
+   */
+  class buffer::raw_combined : public buffer::raw {
+  public:
+    static unsigned header_size() {
+      return (sizeof(raw_combined) + 15) & ~15;
+    }
+    static raw_combined *create(unsigned len, int cls) {
+      char *p = (char *)buffer_pool_alloc_small(cls);
+      return new (p) raw_combined(p + header_size(), len);
+    }
+    raw_combined(char *d, unsigned l) : raw(d, l) {
+      inc_total_alloc(len);
+      bdout << "raw_combined " << this << " alloc " << (void *)data << " " << l << " " << buffer::get_total_alloc() << bendl;
+    }
+    ~raw_combined() {
+      dec_total_alloc(len);
+      bdout << "raw_combined " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
+    }
+    static void operator delete(void *p) {
+      buffer_pool_free_small(p);
+    }
+    raw* clone_empty() {
+      return buffer::create(len);
+    }
+  };
+
+  /*
+   * page-multiple data from a page-aligned pool slab; the header itself
+   * comes from a small pool chunk.
+   */
+  class buffer::raw_page_pool : public buffer::raw {
+    unsigned cls;  // page count - 1
+  public:
+    raw_page_pool(unsigned l) : raw(l), cls(l / CEPH_PAGE_SIZE - 1) {
+      assert(cls < POOL_PAGE_CLASSES);
+      buffer_pool_cache *c = buffer_pool_get_cache();
+      data = (char *)buffer_pool_get(c, &c->pages[cls], len, true);
+      inc_total_alloc(len);
+      bdout << "raw_page_pool " << this << " alloc " << (void *)data << " " << l << " " << buffer::get_total_alloc() << bendl;
+    }
+    ~raw_page_pool() {
+      buffer_pool_put(&buffer_pool_get_cache()->pages[cls], len, data);
+      dec_total_alloc(len);
+      bdout << "raw_page_pool " << this << " free " << (void *)data << " " << buffer::get_total_alloc() << bendl;
+    }
+    static void *operator new(size_t size) {
+      int c = buffer_pool_small_class(size);
+      assert(c >= 0);
+      return buffer_pool_alloc_small(c);
+    }
+    static void operator delete(void *p) {
+      buffer_pool_free_small(p);
+    }
+    raw* clone_empty() {
+      return new raw_page_pool(len);
+    }
+  };
+
 #if defined(HAVE_XIO)
   class buffer::xio_msg_buffer : public buffer::raw {
   private:
@@ -601,11 +887,16 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 #endif /* HAVE_XIO */
 
   buffer::raw* buffer::copy(const char *c, unsigned len) {
-    raw* r = new raw_char(len);
+    raw* r = create(len);
     memcpy(r->data, c, len);
     return r;
   }
   buffer::raw* buffer::create(unsigned len) {
+    if (buffer_pool_enabled && len) {
+      int cls = buffer_pool_small_class(raw_combined::header_size() + len);
+      if (cls >= 0)
+	return raw_combined::create(len, cls);
+    }
     return new raw_char(len);
   }
   buffer::raw* buffer::claim_char(unsigned len, char *buf) {
@@ -621,6 +912,11 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     return new raw_static(buf, len);
   }
   buffer::raw* buffer::create_aligned(unsigned len, unsigned align) {
+    if (buffer_pool_enabled &&
+	len && (len & ~CEPH_PAGE_MASK) == 0 &&
+	len <= POOL_PAGE_CLASSES * CEPH_PAGE_SIZE &&
+	align <= CEPH_PAGE_SIZE && (CEPH_PAGE_SIZE % align) == 0)
+      return new raw_page_pool(len);
 #ifndef __CYGWIN__
     //return new raw_mmap_pages(len);
     return new raw_posix_aligned(len, align);
@@ -1015,6 +1311,166 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     return _raw->zero_copy_to_fd(fd, (loff_t*)offset);
   }
 
+  // -- buffer::ptr_vector --
+
+  buffer::ptr_vector::ptr_vector(const ptr_vector& other)
+    : _data(reinterpret_cast<ptr*>(_inline)), _size(0),
+      _cap(INLINE_SEGMENTS)
+  {
+    reserve(other._size);
+    for (unsigned i = 0; i < other._size; ++i)
+      new (&_data[i]) ptr(other._data[i]);
+    _size = other._size;
+  }
+
+  buffer::ptr_vector& buffer::ptr_vector::operator=(const ptr_vector& other)
+  {
+    if (this != &other) {
+      clear();
+      reserve(other._size);
+      for (unsigned i = 0; i < other._size; ++i)
+	new (&_data[i]) ptr(other._data[i]);
+      _size = other._size;
+    }
+    return *this;
+  }
+
+  buffer::ptr_vector::~ptr_vector()
+  {
+    clear();
+    if (!is_inline())
+      ::operator delete(_data);
+  }
+
+  void buffer::ptr_vector::reserve_slow(unsigned n)
+  {
+    unsigned cap = _cap;
+    while (cap < n)
+      cap *= 2;
+    ptr *data = static_cast<ptr*>(::operator new(cap * sizeof(ptr)));
+    // "move" by swapping with a default ptr so no refcounts are touched
+    for (unsigned i = 0; i < _size; ++i) {
+      new (&data[i]) ptr();
+      data[i].swap(_data[i]);
+      _data[i].~ptr();
+    }
+    if (!is_inline())
+      ::operator delete(_data);
+    _data = data;
+    _cap = cap;
+  }
+
+  // make room for n default ptrs at pos, shifting the tail back
+  void buffer::ptr_vector::open_gap(unsigned pos, unsigned n)
+  {
+    assert(pos <= _size);
+    reserve(_size + n);
+    for (unsigned i = _size; i < _size + n; ++i)
+      new (&_data[i]) ptr();
+    for (unsigned i = _size; i > pos; --i)
+      _data[i - 1 + n].swap(_data[i - 1]);
+    _size += n;
+  }
+
+  // we are empty; take over other's segments, leaving it empty
+  void buffer::ptr_vector::take(ptr_vector& other)
+  {
+    assert(_size == 0);
+    if (!other.is_inline()) {
+      if (!is_inline())
+	::operator delete(_data);
+      _data = other._data;
+      _cap = other._cap;
+      _size = other._size;
+      other._data = reinterpret_cast<ptr*>(other._inline);
+      other._cap = INLINE_SEGMENTS;
+      other._size = 0;
+      return;
+    }
+    for (unsigned i = 0; i < other._size; ++i) {
+      new (&_data[i]) ptr();
+      _data[i].swap(other._data[i]);
+      other._data[i].~ptr();
+    }
+    _size = other._size;
+    other._size = 0;
+  }
+
+  void buffer::ptr_vector::push_front(const ptr& bp)
+  {
+    ptr tmp(bp);  // bp may live in our own storage
+    open_gap(0, 1);
+    _data[0].swap(tmp);
+  }
+
+  buffer::ptr_vector::iterator buffer::ptr_vector::insert(iterator pos,
+							  const ptr& bp)
+  {
+    assert(pos.v == this);
+    ptr tmp(bp);
+    open_gap(pos.i, 1);
+    _data[pos.i].swap(tmp);
+    return pos;
+  }
+
+  buffer::ptr_vector::iterator buffer::ptr_vector::erase(iterator pos)
+  {
+    assert(pos.v == this && pos.i < _size);
+    for (unsigned i = pos.i; i + 1 < _size; ++i)
+      _data[i].swap(_data[i + 1]);
+    --_size;
+    _data[_size].~ptr();
+    return pos;
+  }
+
+  void buffer::ptr_vector::clear()
+  {
+    for (unsigned i = 0; i < _size; ++i)
+      _data[i].~ptr();
+    _size = 0;
+  }
+
+  void buffer::ptr_vector::swap(ptr_vector& other)
+  {
+    if (!is_inline() && !other.is_inline()) {
+      std::swap(_data, other._data);
+      std::swap(_size, other._size);
+      std::swap(_cap, other._cap);
+      return;
+    }
+    ptr_vector tmp;
+    tmp.take(*this);
+    take(other);
+    other.take(tmp);
+  }
+
+  void buffer::ptr_vector::claim_append(ptr_vector& other)
+  {
+    if (_size == 0) {
+      take(other);
+      return;
+    }
+    reserve(_size + other._size);
+    for (unsigned i = 0; i < other._size; ++i) {
+      new (&_data[_size + i]) ptr();
+      _data[_size + i].swap(other._data[i]);
+    }
+    _size += other._size;
+    other.clear();
+  }
+
+  void buffer::ptr_vector::claim_prepend(ptr_vector& other)
+  {
+    if (_size == 0) {
+      take(other);
+      return;
+    }
+    open_gap(0, other._size);
+    for (unsigned i = 0; i < other._size; ++i)
+      _data[i].swap(other._data[i]);
+    other.clear();
+  }
+
   // -- buffer::list::iterator --
   /*
   buffer::list::iterator operator=(const buffer::list::iterator& other)
@@ -1205,7 +1661,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     if (p == ls->end())
       seek(off);
     unsigned left = len;
-    for (std::list<ptr>::const_iterator i = otherl._buffers.begin();
+    for (buffers_t::const_iterator i = otherl._buffers.begin();
 	 i != otherl._buffers.end();
 	 ++i) {
       unsigned l = (*i).length();
@@ -1239,8 +1695,8 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
     // buffer-wise comparison
     if (true) {
-      std::list<ptr>::const_iterator a = _buffers.begin();
-      std::list<ptr>::const_iterator b = other._buffers.begin();
+      buffers_t::const_iterator a = _buffers.begin();
+      buffers_t::const_iterator b = other._buffers.begin();
       unsigned aoff = 0, boff = 0;
       while (a != _buffers.end()) {
 	unsigned len = a->length() - aoff;
@@ -1279,7 +1735,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   bool buffer::list::can_zero_copy() const
   {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it)
       if (!it->can_zero_copy())
@@ -1289,7 +1745,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   bool buffer::list::is_aligned(unsigned align) const
   {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) 
       if (!it->is_aligned(align))
@@ -1299,7 +1755,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   bool buffer::list::is_n_align_sized(unsigned align) const
   {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) 
       if (!it->is_n_align_sized(align))
@@ -1308,7 +1764,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   }
 
   bool buffer::list::is_zero() const {
-    for (std::list<ptr>::const_iterator it = _buffers.begin();
+    for (buffers_t::const_iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) {
       if (!it->is_zero()) {
@@ -1320,7 +1776,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
 
   void buffer::list::zero()
   {
-    for (std::list<ptr>::iterator it = _buffers.begin();
+    for (buffers_t::iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it)
       it->zero();
@@ -1330,7 +1786,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   {
     assert(o+l <= _len);
     unsigned p = 0;
-    for (std::list<ptr>::iterator it = _buffers.begin();
+    for (buffers_t::iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) {
       if (p + it->length() > o) {
@@ -1360,7 +1816,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   
   bool buffer::list::is_contiguous()
   {
-    return &(*_buffers.begin()) == &(*_buffers.rbegin());
+    return _buffers.size() <= 1;
   }
 
   bool buffer::list::is_n_page_sized() const
@@ -1386,7 +1842,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
   void buffer::list::rebuild(ptr& nb)
   {
     unsigned pos = 0;
-    for (std::list<ptr>::iterator it = _buffers.begin();
+    for (buffers_t::iterator it = _buffers.begin();
 	 it != _buffers.end();
 	 ++it) {
       nb.copy_in(pos, it->length(), it->c_str(), false);
@@ -1395,6 +1851,7 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
     _memcopy_count += pos;
     _buffers.clear();
     _buffers.push_back(nb);
+    last_p = begin();
     invalidate_crc();
   }
 
@@ -1406,7 +1863,7 @@ void buffer::list::rebuild_aligned(unsigned align)
 void buffer::list::rebuild_aligned_size_and_memory(unsigned align_size,
 						   unsigned align_memory)
 {
-  std::list<ptr>::iterator p = _buffers.begin();
+  buffers_t::iterator p = _buffers.begin();
   while (p != _buffers.end()) {
     // keep anything that's already align and sized aligned
     if (p->is_aligned(align_memory) && p->is_n_align_sized(align_size)) {
@@ -1431,7 +1888,7 @@ void buffer::list::rebuild_aligned_size_and_memory(unsigned align_size,
       */
       offset += p->length();
       unaligned.push_back(*p);
-      _buffers.erase(p++);
+      p = _buffers.erase(p);
     } while (p != _buffers.end() &&
 	     (!p->is_aligned(align_memory) ||
 	      !p->is_n_align_sized(align_size) ||
@@ -1441,8 +1898,10 @@ void buffer::list::rebuild_aligned_size_and_memory(unsigned align_size,
       unaligned.rebuild(nb);
       _memcopy_count += unaligned._len;
     }
-    _buffers.insert(p, unaligned._buffers.front());
+    p = _buffers.insert(p, unaligned._buffers.front());
+    ++p;
   }
+  last_p = begin();  // segment indices shifted
 }
 
 void buffer::list::rebuild_page_aligned()
@@ -1464,7 +1923,7 @@ void buffer::list::rebuild_page_aligned()
     _len += bl._len;
     if (!(flags & CLAIM_ALLOW_NONSHAREABLE))
       bl.make_shareable();
-    _buffers.splice(_buffers.end(), bl._buffers );
+    _buffers.claim_append(bl._buffers);
     bl._len = 0;
     bl.last_p = bl.begin();
   }
@@ -1475,9 +1934,10 @@ void buffer::list::rebuild_page_aligned()
     _len += bl._len;
     if (!(flags & CLAIM_ALLOW_NONSHAREABLE))
       bl.make_shareable();
-    _buffers.splice(_buffers.begin(), bl._buffers );
+    _buffers.claim_prepend(bl._buffers);
     bl._len = 0;
     bl.last_p = bl.begin();
+    last_p = begin();  // segment indices shifted
   }
 
   void buffer::list::copy(unsigned off, unsigned len, char *dest) const
@@ -1584,7 +2044,8 @@ void buffer::list::rebuild_page_aligned()
   void buffer::list::append(const list& bl)
   {
     _len += bl._len;
-    for (std::list<ptr>::const_iterator p = bl._buffers.begin();
+    _buffers.reserve(_buffers.size() + bl._buffers.size());
+    for (buffers_t::const_iterator p = bl._buffers.begin();
 	 p != bl._buffers.end();
 	 ++p) 
       _buffers.push_back(*p);
@@ -1617,7 +2078,7 @@ void buffer::list::rebuild_page_aligned()
     if (n >= _len)
       throw end_of_buffer();
     
-    for (std::list<ptr>::const_iterator p = _buffers.begin();
+    for (buffers_t::const_iterator p = _buffers.begin();
 	 p != _buffers.end();
 	 ++p) {
       if (n >= p->length()) {
@@ -1637,7 +2098,7 @@ void buffer::list::rebuild_page_aligned()
     if (_buffers.empty())
       return 0;                         // no buffers
 
-    std::list<ptr>::const_iterator iter = _buffers.begin();
+    buffers_t::const_iterator iter = _buffers.begin();
     ++iter;
 
     if (iter != _buffers.end())
@@ -1655,7 +2116,7 @@ void buffer::list::rebuild_page_aligned()
     }
 
     unsigned off = orig_off;
-    std::list<ptr>::iterator curbuf = _buffers.begin();
+    buffers_t::iterator curbuf = _buffers.begin();
     while (off > 0 && off >= curbuf->length()) {
       off -= curbuf->length();
       ++curbuf;
@@ -1679,6 +2140,7 @@ void buffer::list::rebuild_page_aligned()
 
       tmp.rebuild();
       _buffers.insert(curbuf, tmp._buffers.front());
+      last_p = begin();  // segment indices shifted
       return tmp.c_str() + off;
     }
 
@@ -1693,7 +2155,7 @@ void buffer::list::rebuild_page_aligned()
     clear();
 
     // skip off
-    std::list<ptr>::const_iterator curbuf = other._buffers.begin();
+    buffers_t::const_iterator curbuf = other._buffers.begin();
     while (off > 0 &&
 	   off >= curbuf->length()) {
       // skip this buffer
@@ -1736,7 +2198,7 @@ void buffer::list::rebuild_page_aligned()
     //cout << "splice off " << off << " len " << len << " ... mylen = " << length() << std::endl;
       
     // skip off
-    std::list<ptr>::iterator curbuf = _buffers.begin();
+    buffers_t::iterator curbuf = _buffers.begin();
     while (off > 0) {
       assert(curbuf != _buffers.end());
       if (off >= (*curbuf).length()) {
@@ -1755,7 +2217,8 @@ void buffer::list::rebuild_page_aligned()
       // add a reference to the front bit
       //  insert it before curbuf (which we'll hose)
       //cout << "keeping front " << off << " of " << *curbuf << std::endl;
-      _buffers.insert( curbuf, ptr( *curbuf, 0, off ) );
+      curbuf = _buffers.insert( curbuf, ptr( *curbuf, 0, off ) );
+      ++curbuf;
       _len += off;
     }
     
@@ -1778,7 +2241,7 @@ void buffer::list::rebuild_page_aligned()
       if (claim_by) 
 	claim_by->append( *curbuf, off, howmuch );
       _len -= (*curbuf).length();
-      _buffers.erase( curbuf++ );
+      curbuf = _buffers.erase( curbuf );
       len -= howmuch;
       off = 0;
     }
@@ -1792,7 +2255,7 @@ void buffer::list::rebuild_page_aligned()
   {
     list s;
     s.substr_of(*this, off, len);
-    for (std::list<ptr>::const_iterator it = s._buffers.begin(); 
+    for (buffers_t::const_iterator it = s._buffers.begin(); 
 	 it != s._buffers.end(); 
 	 ++it)
       if (it->length())
@@ -1938,7 +2401,7 @@ int buffer::list::write_fd(int fd) const
   int iovlen = 0;
   ssize_t bytes = 0;
 
-  std::list<ptr>::const_iterator p = _buffers.begin();
+  buffers_t::const_iterator p = _buffers.begin();
   while (p != _buffers.end()) {
     if (p->length() > 0) {
       iov[iovlen].iov_base = (void *)p->c_str();
@@ -1987,7 +2450,7 @@ void buffer::list::prepare_iov(std::vector<iovec> *piov) const
 {
   piov->resize(_buffers.size());
   unsigned n = 0;
-  for (std::list<buffer::ptr>::const_iterator p = _buffers.begin();
+  for (buffers_t::const_iterator p = _buffers.begin();
        p != _buffers.end();
        ++p, ++n) {
     (*piov)[n].iov_base = (void *)p->c_str();
@@ -2008,7 +2471,7 @@ int buffer::list::write_fd_zero_copy(int fd) const
     return (int) offset;
   if (offset == ESPIPE)
     off_p = NULL;
-  for (std::list<ptr>::const_iterator it = _buffers.begin();
+  for (buffers_t::const_iterator it = _buffers.begin();
        it != _buffers.end(); ++it) {
     int r = it->zero_copy_to_fd(fd, off_p);
     if (r < 0)
@@ -2019,9 +2482,32 @@ int buffer::list::write_fd_zero_copy(int fd) const
   return 0;
 }
 
+/*
+ * If we have cached crc32c(buf, v) for initial value v,
+ * we can convert this to a different initial value v' by:
+ * crc32c(buf, v') = crc32c(buf, v) ^ adjustment
+ * where adjustment = crc32c(0*len(buf), v ^ v')
+ *
+ * http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
+ * note, u for our crc32c implementation is 0
+ */
+static inline uint32_t crc32c_from_cached(const pair<uint32_t, uint32_t> &ccrc,
+					  uint32_t crc, size_t len)
+{
+  if (ccrc.first == crc) {
+    // got it already
+    if (buffer_track_crc)
+      buffer_cached_crc.inc();
+    return ccrc.second;
+  }
+  if (buffer_track_crc)
+    buffer_cached_crc_adjusted.inc();
+  return ccrc.second ^ ceph_crc32c_zeros(ccrc.first ^ crc, len);
+}
+
 __u32 buffer::list::crc32c(__u32 crc) const
 {
-  for (std::list<ptr>::const_iterator it = _buffers.begin();
+  for (buffers_t::const_iterator it = _buffers.begin();
        it != _buffers.end();
        ++it) {
     if (it->length()) {
@@ -2029,27 +2515,25 @@ __u32 buffer::list::crc32c(__u32 crc) const
       pair<size_t, size_t> ofs(it->offset(), it->offset() + it->length());
       pair<uint32_t, uint32_t> ccrc;
       if (r->get_crc(ofs, &ccrc)) {
-	if (ccrc.first == crc) {
-	  // got it already
-	  crc = ccrc.second;
-	  if (buffer_track_crc)
-	    buffer_cached_crc.inc();
-	} else {
-	  /* If we have cached crc32c(buf, v) for initial value v,
-	   * we can convert this to a different initial value v' by:
-	   * crc32c(buf, v') = crc32c(buf, v) ^ adjustment
-	   * where adjustment = crc32c(0*len(buf), v ^ v')
-	   *
-	   * http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
-	   * note, u for our crc32c implementation is 0
-	   */
-	  crc = ccrc.second ^ ceph_crc32c(ccrc.first ^ crc, NULL, it->length());
-	  if (buffer_track_crc)
-	    buffer_cached_crc_adjusted.inc();
-	}
+	crc = crc32c_from_cached(ccrc, crc, it->length());
       } else {
+	// stitch together any cached sub-ranges, computing only the gaps
 	uint32_t base = crc;
-	crc = ceph_crc32c(crc, (unsigned char*)it->c_str(), it->length());
+	const unsigned char *p = (const unsigned char*)it->c_str();
+	vector<raw::crc_tile_t> tiles;
+	r->get_crc_tiles(ofs.first, ofs.second, &tiles);
+	size_t pos = ofs.first;
+	for (vector<raw::crc_tile_t>::iterator t = tiles.begin();
+	     t != tiles.end();
+	     ++t) {
+	  if (t->first.first > pos)
+	    crc = ceph_crc32c(crc, p + (pos - ofs.first), t->first.first - pos);
+	  crc = crc32c_from_cached(t->second, crc,
+				   t->first.second - t->first.first);
+	  pos = t->first.second;
+	}
+	if (pos < ofs.second)
+	  crc = ceph_crc32c(crc, p + (pos - ofs.first), ofs.second - pos);
 	r->set_crc(ofs, make_pair(base, crc));
       }
     }
@@ -2059,7 +2543,7 @@ __u32 buffer::list::crc32c(__u32 crc) const
 
 void buffer::list::invalidate_crc()
 {
-  for (std::list<ptr>::const_iterator p = _buffers.begin(); p != _buffers.end(); ++p) {
+  for (buffers_t::const_iterator p = _buffers.begin(); p != _buffers.end(); ++p) {
     raw *r = p->get_raw();
     if (r) {
       r->invalidate_crc();
@@ -2072,7 +2556,7 @@ void buffer::list::invalidate_crc()
  */
 void buffer::list::write_stream(std::ostream &out) const
 {
-  for (std::list<ptr>::const_iterator p = _buffers.begin(); p != _buffers.end(); ++p) {
+  for (buffers_t::const_iterator p = _buffers.begin(); p != _buffers.end(); ++p) {
     if (p->length() > 0) {
       out.write(p->c_str(), p->length());
     }
@@ -2132,7 +2616,7 @@ std::ostream& operator<<(std::ostream& out, const buffer::ptr& bp) {
 std::ostream& operator<<(std::ostream& out, const buffer::list& bl) {
   out << "buffer::list(len=" << bl.length() << "," << std::endl;
 
-  std::list<buffer::ptr>::const_iterator it = bl.buffers().begin();
+  buffer::list::buffers_t::const_iterator it = bl.buffers().begin();
   while (it != bl.buffers().end()) {
     out << "\t" << *it;
     if (++it == bl.buffers().end()) break;
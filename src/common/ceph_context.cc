@@ -72,6 +72,39 @@ private:
   bool m_registered;
 };
 
+/**
+ * observe buffer pool config changes
+ *
+ * Like the log, the buffer code sits below the config subsystem and
+ * has no context of its own, so feed it the relevant settings.
+ */
+class BufferPoolObs : public md_config_obs_t {
+public:
+  const char** get_tracked_conf_keys() const {
+    static const char *KEYS[] = {
+      "buffer_pool",
+      "buffer_pool_thread_cache_bytes",
+      NULL
+    };
+    return KEYS;
+  }
+
+  void handle_conf_change(const md_config_t *conf,
+                          const std::set <std::string> &changed) {
+    if (changed.count("buffer_pool"))
+      buffer::set_pool_enabled(conf->buffer_pool);
+    if (changed.count("buffer_pool_thread_cache_bytes"))
+      buffer::set_pool_thread_cache_bytes(conf->buffer_pool_thread_cache_bytes);
+  }
+};
+
+enum {
+  l_buffer_first = 70300,
+  l_buffer_pool_hit,
+  l_buffer_pool_miss,
+  l_buffer_pool_cached_bytes,
+  l_buffer_last,
+};
 
 } // anonymous namespace
 
@@ -149,6 +182,7 @@ public:
   const char** get_tracked_conf_keys() const {
     static const char *KEYS[] = {
       "log_file",
+      "log_binary",
       "log_max_new",
       "log_max_recent",
       "log_to_syslog",
@@ -175,7 +209,10 @@ public:
     }
 
     // file
-    if (changed.count("log_file")) {
+    if (changed.count("log_binary")) {
+      log->set_log_binary(conf->log_binary);
+    }
+    if (changed.count("log_file") || changed.count("log_binary")) {
       log->set_log_file(conf->log_file);
       log->reopen_log_file();
     }
@@ -281,6 +318,7 @@ void CephContext::do_command(std::string command, cmdmap_t& cmdmap,
 			 << ss.str() << dendl;
   if (command == "perfcounters_dump" || command == "1" ||
       command == "perf dump") {
+    refresh_buffer_perf_counters();
     std::string logger;
     std::string counter;
     cmd_getval(this, cmdmap, "logger", logger);
@@ -408,7 +446,9 @@ CephContext::CephContext(uint32_t module_type_)
     _heartbeat_map(NULL),
     _crypto_none(NULL),
     _crypto_aes(NULL),
-    _lockdep_obs(NULL)
+    _lockdep_obs(NULL),
+    _buffer_obs(NULL),
+    _buffer_perf(NULL)
 {
   ceph_spin_init(&_service_thread_lock);
   ceph_spin_init(&_associated_objs_lock);
@@ -426,7 +466,17 @@ CephContext::CephContext(uint32_t module_type_)
   _lockdep_obs = new LockdepObs(this);
   _conf->add_observer(_lockdep_obs);
 
+  _buffer_obs = new BufferPoolObs;
+  _conf->add_observer(_buffer_obs);
+
   _perf_counters_collection = new PerfCountersCollection(this);
+
+  PerfCountersBuilder b(this, "buffer", l_buffer_first, l_buffer_last);
+  b.add_u64(l_buffer_pool_hit, "pool_hit", "Buffer allocations served from a thread cache");
+  b.add_u64(l_buffer_pool_miss, "pool_miss", "Pool sized buffer allocations that went to the heap");
+  b.add_u64(l_buffer_pool_cached_bytes, "pool_cached_bytes", "Free buffer memory held in thread caches");
+  _buffer_perf = b.create_perf_counters();
+  _perf_counters_collection->add(_buffer_perf);
   _admin_socket = new AdminSocket(this);
   _heartbeat_map = new HeartbeatMap(this);
 
@@ -479,6 +529,10 @@ CephContext::~CephContext()
 
   delete _heartbeat_map;
 
+  _perf_counters_collection->remove(_buffer_perf);
+  delete _buffer_perf;
+  _buffer_perf = NULL;
+
   delete _perf_counters_collection;
   _perf_counters_collection = NULL;
 
@@ -497,6 +551,10 @@ CephContext::~CephContext()
   delete _lockdep_obs;
   _lockdep_obs = NULL;
 
+  _conf->remove_observer(_buffer_obs);
+  delete _buffer_obs;
+  _buffer_obs = NULL;
+
   _log->stop();
   delete _log;
   _log = NULL;
@@ -572,6 +630,13 @@ uint32_t CephContext::get_module_type() const
   return _module_type;
 }
 
+void CephContext::refresh_buffer_perf_counters()
+{
+  _buffer_perf->set(l_buffer_pool_hit, buffer::get_pool_hits());
+  _buffer_perf->set(l_buffer_pool_miss, buffer::get_pool_misses());
+  _buffer_perf->set(l_buffer_pool_cached_bytes, buffer::get_pool_cached_bytes());
+}
+
 PerfCountersCollection *CephContext::get_perfcounters_collection()
 {
   return _perf_counters_collection;
@@ -27,6 +27,7 @@
 
 class AdminSocket;
 class CephContextServiceThread;
+class PerfCounters;
 class PerfCountersCollection;
 class md_config_obs_t;
 struct md_config_t;
@@ -138,6 +139,9 @@ private:
   /* Stop and join the Ceph Context's service thread */
   void join_service_thread();
 
+  /* Copy the buffer pool counters into the "buffer" perf counters */
+  void refresh_buffer_perf_counters();
+
   uint32_t _module_type;
 
   bool _crypto_inited;
@@ -178,6 +182,9 @@ private:
 
   md_config_obs_t *_lockdep_obs;
 
+  md_config_obs_t *_buffer_obs;
+  PerfCounters *_buffer_perf;
+
   friend class CephContextObs;
 };
 
@@ -0,0 +1,176 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_CLOCKCACHE_H
+#define CEPH_CLOCKCACHE_H
+
+#include <vector>
+#include "include/memory.h"
+#include "include/atomic.h"
+#include "include/intarith.h"
+#include "include/unordered_map.h"
+#include "common/RWLock.h"
+
+/**
+ * SharedClock
+ *
+ * A read-mostly alternative to SharedLRU.  Entries live in a fixed ring
+ * of slots and are evicted with the CLOCK algorithm: a hit only sets the
+ * slot's reference bit, so lookups take the lock shared and never
+ * reorder anything.  Adds, purges and evictions take it exclusive.
+ *
+ * Unlike SharedLRU, a value that has been evicted is not found again
+ * while someone still holds a reference to it; a later add() simply
+ * creates a new one.
+ */
+template <class K, class V, class H = std::hash<K> >
+class SharedClock {
+  typedef ceph::shared_ptr<V> VPtr;
+
+  struct Slot {
+    K key;
+    VPtr val;
+    ceph::atomic_t referenced;
+    Slot() : referenced(0) {}
+  };
+
+  RWLock lock;
+  std::vector<Slot> slots;
+  ceph::unordered_map<K, size_t, H> contents;
+  size_t hand;
+
+  /// find a free slot, evicting the first unreferenced entry under the hand
+  size_t get_victim(std::vector<VPtr> *to_release) {
+    while (true) {
+      Slot &s = slots[hand];
+      size_t r = hand;
+      hand = (hand + 1) % slots.size();
+      if (!s.val)
+	return r;
+      if (s.referenced.read()) {
+	s.referenced.set(0);
+	continue;
+      }
+      contents.erase(s.key);
+      to_release->push_back(VPtr());
+      to_release->back().swap(s.val);
+      return r;
+    }
+  }
+
+public:
+  SharedClock(size_t max_size = 20)
+    : lock("SharedClock::lock", false), slots(MAX(max_size, 1)), hand(0) {}
+
+  void set_cct(CephContext *c) {}
+
+  /// resize the ring; drops every entry that no longer fits
+  void set_size(size_t new_size) {
+    std::vector<VPtr> to_release;
+    {
+      RWLock::WLocker l(lock);
+      new_size = MAX(new_size, 1);
+      if (new_size == slots.size())
+	return;
+      std::vector<Slot> old(new_size);
+      old.swap(slots);
+      contents.clear();
+      hand = 0;
+      for (size_t i = 0; i < old.size(); ++i) {
+	if (!old[i].val)
+	  continue;
+	if (hand < slots.size()) {
+	  slots[hand].key = old[i].key;
+	  slots[hand].val.swap(old[i].val);
+	  contents[slots[hand].key] = hand;
+	  ++hand;
+	} else {
+	  to_release.push_back(VPtr());
+	  to_release.back().swap(old[i].val);
+	}
+      }
+      hand %= slots.size();
+    }
+  }
+
+  VPtr lookup(const K &key) {
+    RWLock::RLocker l(lock);
+    typename ceph::unordered_map<K, size_t, H>::iterator i = contents.find(key);
+    if (i == contents.end())
+      return VPtr();
+    Slot &s = slots[i->second];
+    if (!s.referenced.read())
+      s.referenced.set(1);
+    return s.val;
+  }
+
+  /**
+   * Insert value for key unless key is already cached, in which case the
+   * cached one is returned with *existed set and value is left to the
+   * caller, as SharedLRU::add does.
+   */
+  VPtr add(const K &key, V *value, bool *existed = 0) {
+    VPtr val;
+    std::vector<VPtr> to_release;
+    {
+      RWLock::WLocker l(lock);
+      typename ceph::unordered_map<K, size_t, H>::iterator i =
+	contents.find(key);
+      if (i != contents.end()) {
+	if (existed)
+	  *existed = true;
+	slots[i->second].referenced.set(1);
+	return slots[i->second].val;
+      }
+      if (existed)
+	*existed = false;
+      val = VPtr(value);
+      size_t slot = get_victim(&to_release);
+      slots[slot].key = key;
+      slots[slot].val = val;
+      slots[slot].referenced.set(0);
+      contents[key] = slot;
+    }
+    return val;
+  }
+
+  void purge(const K &key) {
+    VPtr val;
+    {
+      RWLock::WLocker l(lock);
+      typename ceph::unordered_map<K, size_t, H>::iterator i =
+	contents.find(key);
+      if (i == contents.end())
+	return;
+      val.swap(slots[i->second].val);
+      slots[i->second].referenced.set(0);
+      contents.erase(i);
+    }
+  }
+
+  void clear() {
+    std::vector<VPtr> to_release;
+    {
+      RWLock::WLocker l(lock);
+      for (size_t i = 0; i < slots.size(); ++i) {
+	if (!slots[i].val)
+	  continue;
+	to_release.push_back(VPtr());
+	to_release.back().swap(slots[i].val);
+	slots[i].referenced.set(0);
+      }
+      contents.clear();
+    }
+  }
+};
+
+#endif
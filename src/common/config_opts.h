@@ -45,6 +45,7 @@ OPTION(log_to_syslog, OPT_BOOL, false)
 OPTION(err_to_syslog, OPT_BOOL, false)
 OPTION(log_flush_on_exit, OPT_BOOL, true) // default changed by common_preinit()
 OPTION(log_stop_at_utilization, OPT_FLOAT, .97)  // stop logging at (near) full
+OPTION(log_binary, OPT_BOOL, false)  // write log_file as binary records; read with ceph-log-decode
 
 // options will take k/v pairs, or single-item that will be assumed as general
 // default for all, regardless of channel.
@@ -65,6 +66,9 @@ OPTION(mon_cluster_log_file_level, OPT_STR, "info")
 
 OPTION(enable_experimental_unrecoverable_data_corrupting_features, OPT_STR, "")
 
+OPTION(buffer_pool, OPT_BOOL, true) // serve small and page-multiple buffers from per-thread caches
+OPTION(buffer_pool_thread_cache_bytes, OPT_U64, 1 << 20) // max free buffer memory each thread keeps cached
+
 OPTION(xio_trace_mempool, OPT_BOOL, false) // mempool allocation counters
 OPTION(xio_trace_msgcnt, OPT_BOOL, false) // incoming/outgoing msg counters
 OPTION(xio_trace_xcon, OPT_BOOL, false) // Xio message encode/decode trace
@@ -142,6 +146,7 @@ OPTION(perf, OPT_BOOL, true)       // enable internal perf counters
 OPTION(ms_type, OPT_STR, "simple")   // messenger backend
 OPTION(ms_tcp_nodelay, OPT_BOOL, true)
 OPTION(ms_tcp_rcvbuf, OPT_INT, 0)
+OPTION(ms_tcp_busy_poll, OPT_INT, 0) // SO_BUSY_POLL usec for async messenger sockets, 0 to leave unset
 OPTION(ms_tcp_prefetch_max_size, OPT_INT, 4096) // max prefetch size, we limit this to avoid extra memcpy
 OPTION(ms_initial_backoff, OPT_DOUBLE, .2)
 OPTION(ms_max_backoff, OPT_DOUBLE, 15.0)
@@ -169,6 +174,7 @@ OPTION(ms_inject_delay_probability, OPT_DOUBLE, 0) // range [0, 1]
 OPTION(ms_inject_internal_delays, OPT_DOUBLE, 0)   // seconds
 OPTION(ms_dump_on_send, OPT_BOOL, false)           // hexdump msg to log on send
 OPTION(ms_dump_corrupt_message_level, OPT_INT, 1)  // debug level to hexdump undecodeable messages at
+OPTION(ms_message_freelist, OPT_BOOL, false)     // recycle OSD op message objects through per-type free lists
 OPTION(ms_async_op_threads, OPT_INT, 2)
 OPTION(ms_async_set_affinity, OPT_BOOL, true)
 // example: ms_async_affinity_cores = 0,1
@@ -177,6 +183,23 @@ OPTION(ms_async_set_affinity, OPT_BOOL, true)
 // If ms_async_affinity_cores is empty, all threads will be bind to current running
 // core
 OPTION(ms_async_affinity_cores, OPT_STR, "")
+// if ms_async_affinity_cores is empty, spread op threads over the cpus of
+// this NUMA node instead; -1 disables
+OPTION(ms_async_affinity_numa_node, OPT_INT, -1)
+// seconds between attempts to move a connection off the busiest op thread,
+// 0 disables; a move is made when the busiest thread's connections carried
+// more than ms_async_rebalance_threshold times the idlest's traffic
+OPTION(ms_async_rebalance_interval, OPT_DOUBLE, 0)
+OPTION(ms_async_rebalance_threshold, OPT_DOUBLE, 2)
+// coalesce queued messages into one sendmsg until one of these limits is hit;
+// 0 bytes or 0 messages sends each message on its own
+OPTION(ms_async_send_batch_bytes, OPT_U64, 65536)
+OPTION(ms_async_send_batch_messages, OPT_INT, 64)
+OPTION(ms_async_send_batch_us, OPT_INT, 100)   // max time spent encoding one batch, 0 means no limit
+OPTION(ms_async_recv_batch_messages, OPT_INT, 64) // messages read per event before yielding to other connections
+// spin on the event loop for up to this many usec before blocking, 0 disables
+OPTION(ms_async_busy_poll_us, OPT_INT, 0)
+OPTION(ms_async_busy_poll_budget, OPT_DOUBLE, 0.5) // max seconds per second each worker may spend spinning
 
 OPTION(inject_early_sigterm, OPT_BOOL, false)
 
@@ -592,6 +615,26 @@ OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
 OPTION(osd_peering_wq_batch_size, OPT_U64, 20)
 OPTION(osd_op_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(osd_op_pq_min_cost, OPT_U64, 65536)
+OPTION(osd_op_queue, OPT_STR, "prio") // op queue discipline: prio (PrioritizedQueue) or mclock_opclass
+
+// mclock_opclass: reservation and limit are in ops/sec (0 for none),
+// weight is relative to the other classes
+OPTION(osd_op_queue_mclock_client_op_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_client_op_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_op_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_osd_subop_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_osd_subop_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_osd_subop_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_recov_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_scrub_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_snap_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_cost_unit, OPT_U64, 65536) // bytes of op cost charged as one op; 0 charges every op as one
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_disk_thread_ioprio_class, OPT_STR, "") // rt realtime be best effort idle
 OPTION(osd_disk_thread_ioprio_priority, OPT_INT, -1) // 0-7
@@ -599,6 +642,7 @@ OPTION(osd_recovery_threads, OPT_INT, 1)
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
 OPTION(osd_op_num_threads_per_shard, OPT_INT, 2)
 OPTION(osd_op_num_shards, OPT_INT, 5)
+OPTION(osd_op_shard_steal, OPT_BOOL, false) // let idle op threads steal work from busy shards
 
 OPTION(osd_read_eio_on_bad_digest, OPT_BOOL, true) // return EIO if object digest is bad
 
@@ -722,6 +766,7 @@ OPTION(leveldb_compression, OPT_BOOL, true) // leveldb uses compression
 OPTION(leveldb_paranoid, OPT_BOOL, false) // leveldb paranoid flag
 OPTION(leveldb_log, OPT_STR, "/dev/null")  // enable leveldb log file
 OPTION(leveldb_compact_on_mount, OPT_BOOL, false)
+OPTION(leveldb_compact_on_rm_range, OPT_INT, 10000) // compact a removed range in the background once it held this many keys; 0 to disable
 
 OPTION(kinetic_host, OPT_STR, "") // hostname or ip address of a kinetic drive to use
 OPTION(kinetic_port, OPT_INT, 8123) // port number of the kinetic drive
@@ -734,8 +779,16 @@ OPTION(kinetic_use_ssl, OPT_BOOL, false) // whether to secure kinetic traffic wi
 OPTION(keyvaluestore_rocksdb_options, OPT_STR, "")
 // rocksdb options that will be used for omap(if omap_backend is rocksdb)
 OPTION(filestore_rocksdb_options, OPT_STR, "")
+// rocksdb column families for keyvaluestore and omap, separated by spaces, each
+// name:prefix[|prefix...][:option=value,...]; keys whose prefix starts with
+// one of the prefixes go to that family.  Besides the rocksdb column family
+// options, block_cache_size and bloom_bits are understood.  Opening a store
+// whose keys sit in other families than configured fails.
+OPTION(keyvaluestore_rocksdb_column_families, OPT_STR, "")
+OPTION(filestore_rocksdb_column_families, OPT_STR, "")
 // rocksdb options that will be used in monstore
 OPTION(mon_rocksdb_options, OPT_STR, "")
+OPTION(rocksdb_compact_on_rm_range, OPT_INT, 10000) // compact a removed range in the background once it held this many keys; 0 to disable
 
 /**
  * osd_*_priority adjust the relative priority of client io, recovery io,
@@ -780,6 +833,7 @@ OPTION(osd_bench_max_block_size, OPT_U64, 64 << 20) // cap the block size at 64M
 OPTION(osd_bench_duration, OPT_U32, 30) // duration of 'osd bench', capped at 30s to avoid triggering timeouts
 
 OPTION(memstore_device_bytes, OPT_U64, 1024*1024*1024)
+OPTION(memstore_page_size, OPT_U64, 64 << 10)  // granularity of object data; also the unit of copy-on-write and of holes
 
 OPTION(filestore_omap_backend, OPT_STR, "leveldb")
 
@@ -797,6 +851,12 @@ OPTION(filestore_wbthrottle_xfs_bytes_hard_limit, OPT_U64, 419430400)
 OPTION(filestore_wbthrottle_xfs_ios_start_flusher, OPT_U64, 500)
 OPTION(filestore_wbthrottle_xfs_ios_hard_limit, OPT_U64, 5000)
 OPTION(filestore_wbthrottle_xfs_inodes_start_flusher, OPT_U64, 500)
+OPTION(filestore_wbthrottle_flusher_threads, OPT_INT, 1)
+/// pace writers by measured flush throughput between the start_flusher and
+/// hard limits instead of blocking them at start_flusher
+OPTION(filestore_wbthrottle_adaptive, OPT_BOOL, false)
+OPTION(filestore_wbthrottle_adaptive_batch, OPT_INT, 16)  // objects per flush pass, flushed in inode order
+OPTION(filestore_wbthrottle_adaptive_max_delay, OPT_DOUBLE, 1)  // max seconds one write can hold back writers
 
 /// These must be less than the fd limit
 OPTION(filestore_wbthrottle_btrfs_inodes_hard_limit, OPT_U64, 5000)
@@ -810,6 +870,12 @@ OPTION(filestore_debug_inject_read_err, OPT_BOOL, false)
 
 OPTION(filestore_debug_omap_check, OPT_BOOL, 0) // Expensive debugging check on sync
 OPTION(filestore_omap_header_cache_size, OPT_INT, 1024)
+OPTION(filestore_omap_header_shards, OPT_INT, 8)  // DBObjectMap header cache and lock shards; the cache size is split among them
+OPTION(filestore_omap_group_commit, OPT_BOOL, false)  // submit omap updates of concurrent callers as one KeyValueDB transaction
+OPTION(filestore_omap_group_commit_max_latency, OPT_DOUBLE, 0)  // seconds a group commit may wait for more callers to join
+OPTION(filestore_omap_group_commit_max_txns, OPT_INT, 64)  // ... but stop waiting once this many are queued
+OPTION(filestore_omap_prefetch_threads, OPT_INT, 0)  // threads reading ahead for long omap scans; 0 disables read-ahead (read at mount)
+OPTION(filestore_omap_prefetch_max_batch, OPT_INT, 1024)  // most omap entries a single read-ahead fetches
 
 // Use omap for xattrs for attrs over
 // filestore_max_inline_xattr_size or
@@ -853,16 +919,20 @@ OPTION(filestore_queue_max_bytes, OPT_INT, 100 << 20)
 OPTION(filestore_queue_committing_max_ops, OPT_INT, 500)        // this is ON TOP of filestore_queue_max_*
 OPTION(filestore_queue_committing_max_bytes, OPT_INT, 100 << 20) //  "
 OPTION(filestore_op_threads, OPT_INT, 2)
+OPTION(filestore_op_batch_max_ops, OPT_INT, 1)   // apply up to this many queued ops of a sequencer in one pass; 1 disables batching
+OPTION(filestore_op_batch_max_bytes, OPT_INT, 4 << 20)  // ... totalling no more than this
 OPTION(filestore_op_thread_timeout, OPT_INT, 60)
 OPTION(filestore_op_thread_suicide_timeout, OPT_INT, 180)
 OPTION(filestore_commit_timeout, OPT_FLOAT, 600)
 OPTION(filestore_fiemap_threshold, OPT_INT, 4096)
 OPTION(filestore_merge_threshold, OPT_INT, 10)
 OPTION(filestore_split_multiple, OPT_INT, 2)
+OPTION(filestore_index_dir_cache_size, OPT_INT, 4096)  // directories cached per collection for lookups; 0 to disable
 OPTION(filestore_update_to, OPT_INT, 1000)
 OPTION(filestore_blackhole, OPT_BOOL, false)     // drop any new transactions on the floor
 OPTION(filestore_fd_cache_size, OPT_INT, 128)    // FD lru size
 OPTION(filestore_fd_cache_shards, OPT_INT, 16)   // FD number of shards
+OPTION(filestore_fd_cache_clock, OPT_BOOL, false) // CLOCK eviction with shared-lock lookups instead of LRU
 OPTION(filestore_dump_file, OPT_STR, "")         // file onto which store transaction dumps
 OPTION(filestore_kill_at, OPT_INT, 0)            // inject a failure at the n'th opportunity
 OPTION(filestore_inject_stall, OPT_INT, 0)       // artificially stall for N seconds in op queue thread
@@ -870,6 +940,7 @@ OPTION(filestore_fail_eio, OPT_BOOL, true)       // fail/crash on EIO
 OPTION(filestore_debug_verify_split, OPT_BOOL, false)
 OPTION(journal_dio, OPT_BOOL, true)
 OPTION(journal_aio, OPT_BOOL, true)
+OPTION(journal_aio_queue_depth, OPT_INT, 0)  // aio writes to keep in flight; 0 to scale with the amount queued
 OPTION(journal_force_aio, OPT_BOOL, false)
 
 OPTION(keyvaluestore_queue_max_ops, OPT_INT, 50)
@@ -881,6 +952,7 @@ OPTION(keyvaluestore_op_thread_suicide_timeout, OPT_INT, 180)
 OPTION(keyvaluestore_default_strip_size, OPT_INT, 4096) // Only affect new object
 OPTION(keyvaluestore_max_expected_write_size, OPT_U64, 1ULL << 24) // bytes
 OPTION(keyvaluestore_header_cache_size, OPT_INT, 4096)    // Header cache size
+OPTION(keyvaluestore_strip_cache_size, OPT_INT, 4096)    // recently read or written strips to cache; 0 to disable
 OPTION(keyvaluestore_backend, OPT_STR, "leveldb")
 OPTION(keyvaluestore_dump_file, OPT_STR, "")         // file onto which store transaction dumps
 
@@ -895,6 +967,10 @@ OPTION(journal_queue_max_bytes, OPT_INT, 32 << 20)
 OPTION(journal_align_min_size, OPT_INT, 64 << 10)  // align data payloads >= this.
 OPTION(journal_replay_from, OPT_INT, 0)
 OPTION(journal_zero_on_create, OPT_BOOL, false)
+OPTION(journal_compression, OPT_STR, "")  // compress entries with this compressor (e.g. snappy); empty to disable
+OPTION(journal_compress_min_size, OPT_INT, 4096)  // don't compress smaller entries
+OPTION(journal_compress_max_ratio, OPT_DOUBLE, .875)  // keep compressed entries at most this fraction of the original size
+OPTION(journal_zero_skip, OPT_BOOL, false)  // don't write zero-filled pages of entries
 OPTION(journal_ignore_corruption, OPT_BOOL, false) // assume journal is not corrupt
 OPTION(journal_discard, OPT_BOOL, false) //using ssd disk as journal, whether support discard nouse journal-data.
 
@@ -9,6 +9,7 @@
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_baseline.h"
 #include "common/crc32c_intel_fast.h"
+#include "common/crc32c_intel_pclmul.h"
 #include "common/crc32c_aarch64.h"
 
 /*
@@ -26,6 +27,13 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
     return ceph_crc32c_intel_fast;
   }
 
+  // otherwise the interleaved intrinsics version, if we can fold
+  // the streams back together with pclmul.
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists()) {
+    return ceph_crc32c_intel_pclmul;
+  }
+
   if (ceph_arch_aarch64_crc32){
     return ceph_crc32c_aarch64;
   }
@@ -45,3 +53,62 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+
+
+/*
+ * crc32c over zeros
+ *
+ * Feeding n zero bytes through the (reflected, un-inverted) crc register
+ * multiplies its contents by x^(8n) modulo the Castagnoli polynomial.  We
+ * do that multiplication directly, using a table of x^(2^k) mod P so the
+ * cost is one modular multiply per set bit of 8n.  See zlib's
+ * crc32_combine for the same construction.
+ */
+#define CRC32C_POLY 0x82f63b78u	/* reflected */
+
+/*
+ * x^(2^k) mod P, k = 0..30; x^0 is 0x80000000 in reflected form.  The
+ * sequence has period 31 (x^(2^31) == x mod P), so entry k % 31 serves
+ * any k.
+ */
+static const uint32_t crc32c_x2n_table[31] = {
+  0x40000000, 0x20000000, 0x08000000, 0x00800000,
+  0x00008000, 0x82f63b78, 0x6ea2d55c, 0x18b8ea18,
+  0x510ac59a, 0xb82be955, 0xb8fdb1e7, 0x88e56f72,
+  0x74c360a4, 0xe4172b16, 0x0d65762a, 0x35d73a62,
+  0x28461564, 0xbf455269, 0xe2ea32dc, 0xfe7740e6,
+  0xf946610b, 0x3c204f8f, 0x538586e3, 0x59726915,
+  0x734d5309, 0xbc1ac763, 0x7d0722cc, 0xd289cabe,
+  0xe94ca9bc, 0x05b74f3f, 0xa51e1f42,
+};
+
+/* a * b mod P, both in reflected form */
+static uint32_t crc32c_multmodp(uint32_t a, uint32_t b)
+{
+  uint32_t m = 1u << 31, p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+	break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+  }
+  return p;
+}
+
+uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length)
+{
+  if (!crc)
+    return 0;
+  // walk the set bits of 8 * length, starting at table entry 3
+  unsigned k = 3;
+  while (length) {
+    if (length & 1)
+      crc = crc32c_multmodp(crc32c_x2n_table[k % 31], crc);
+    length >>= 1;
+    k++;
+  }
+  return crc;
+}
@@ -0,0 +1,118 @@
+/*
+ * crc32c using the SSE 4.2 crc32 instruction over three interleaved
+ * streams, recombined with a carry-less multiply (PCLMULQDQ).
+ *
+ * The crc32 instruction has a latency of three cycles but a throughput
+ * of one per cycle, so a single dependency chain leaves two thirds of
+ * the unit idle.  We split each chunk into three equal blocks, run an
+ * independent chain over each, and then fold the partial crcs back
+ * together.  Folding crc c forward over n bytes is c * x^(8n) mod P;
+ * with a precomputed constant K = x^(8n-33) mod P a single pclmul
+ * followed by a crc32 of the 64-bit product does the reduction.
+ *
+ * This is only used when the yasm kernel is not compiled in.
+ */
+
+#include "include/int_types.h"
+#include "include/crc32c.h"
+#include "common/crc32c_intel_pclmul.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+  (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+
+#include <string.h>
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+
+#define CRC32C_TARGET __attribute__((target("sse4.2,pclmul")))
+
+/* per-stream block sizes and their fold constants, x^(8n-33) mod P */
+#define LONG_BLOCK   8192
+#define SHORT_BLOCK  256
+#define LONG_K1      0x54a86326u   /* n = LONG_BLOCK */
+#define LONG_K2      0x1dc403ccu   /* n = 2 * LONG_BLOCK */
+#define SHORT_K1     0xb9e02b86u   /* n = SHORT_BLOCK */
+#define SHORT_K2     0xdd7e3b0cu   /* n = 2 * SHORT_BLOCK */
+
+static inline uint64_t load64(unsigned char const *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+CRC32C_TARGET
+static inline uint32_t fold(uint32_t crc, uint32_t k)
+{
+	__m128i a = _mm_cvtsi32_si128(crc);
+	__m128i b = _mm_cvtsi32_si128(k);
+	uint64_t prod = _mm_cvtsi128_si64(_mm_clmulepi64_si128(a, b, 0));
+	return (uint32_t)_mm_crc32_u64(0, prod);
+}
+
+CRC32C_TARGET
+static inline uint32_t crc_3way(uint32_t crc, unsigned char const *p,
+				unsigned block, uint32_t k1, uint32_t k2)
+{
+	uint64_t c0 = crc, c1 = 0, c2 = 0;
+	unsigned char const *end = p + block;
+	for (; p < end; p += 8) {
+		c0 = _mm_crc32_u64(c0, load64(p));
+		c1 = _mm_crc32_u64(c1, load64(p + block));
+		c2 = _mm_crc32_u64(c2, load64(p + 2 * block));
+	}
+	return fold((uint32_t)c0, k2) ^ fold((uint32_t)c1, k1) ^ (uint32_t)c2;
+}
+
+CRC32C_TARGET
+uint32_t ceph_crc32c_intel_pclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	uint64_t c;
+
+	if (!buffer)
+		return ceph_crc32c_zeros(crc, len);
+
+	/* align to 8 bytes so the streams use aligned loads */
+	while (len && ((unsigned long)buffer & 7)) {
+		crc = _mm_crc32_u8(crc, *buffer++);
+		len--;
+	}
+
+	while (len >= 3 * LONG_BLOCK) {
+		crc = crc_3way(crc, buffer, LONG_BLOCK, LONG_K1, LONG_K2);
+		buffer += 3 * LONG_BLOCK;
+		len -= 3 * LONG_BLOCK;
+	}
+	while (len >= 3 * SHORT_BLOCK) {
+		crc = crc_3way(crc, buffer, SHORT_BLOCK, SHORT_K1, SHORT_K2);
+		buffer += 3 * SHORT_BLOCK;
+		len -= 3 * SHORT_BLOCK;
+	}
+
+	c = crc;
+	for (; len >= 8; len -= 8, buffer += 8)
+		c = _mm_crc32_u64(c, load64(buffer));
+	crc = (uint32_t)c;
+	while (len--)
+		crc = _mm_crc32_u8(crc, *buffer++);
+	return crc;
+}
+
+int ceph_crc32c_intel_pclmul_exists(void)
+{
+	return 1;
+}
+
+#else
+
+int ceph_crc32c_intel_pclmul_exists(void)
+{
+	return 0;
+}
+
+uint32_t ceph_crc32c_intel_pclmul(uint32_t crc, unsigned char const *buffer, unsigned len)
+{
+	return 0;
+}
+
+#endif
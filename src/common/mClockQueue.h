@@ -0,0 +1,433 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_MCLOCKQUEUE_H
+#define CEPH_COMMON_MCLOCKQUEUE_H
+
+#include "include/assert.h"
+#include "common/Clock.h"
+#include "common/OpQueue.h"
+
+#include <map>
+#include <list>
+#include <sstream>
+#include <utility>
+
+/// QoS parameters for one mClockQueue client
+struct mClockClientInfo {
+  double reservation;  ///< guaranteed cost units/sec; 0 for none
+  double weight;       ///< share of what is left over after reservations
+  double limit;        ///< max cost units/sec; 0 for no limit
+  mClockClientInfo(double r = 0, double w = 1, double l = 0)
+    : reservation(r), weight(w), limit(l) {}
+};
+
+/**
+ * Op queue implementing the mClock scheduling algorithm
+ *
+ * Each class K is an mClock client with a reservation, weight and
+ * limit (see mClockClientInfo; info_func is asked for them the first
+ * time a class is seen).  Every request is tagged on arrival with
+ *
+ *   R = max(R' + cost / reservation, now)
+ *   P = max(P' + cost / weight, now)
+ *   L = max(L' + cost / limit, now)
+ *
+ * where R', P', L' are the tags of the client's previous request.  On
+ * dequeue we first serve, in R order, any client whose head request
+ * is due by its reservation (R <= now).  Failing that, we serve in P
+ * order among the clients that are under their limit (L <= now), and
+ * pull the client's remaining R tags back by cost / reservation so
+ * that work done out of the weight share does not count against its
+ * reservation.  This is the single-server form of dmClock.
+ *
+ * dequeue() must return something, so when every client is over its
+ * limit we serve the one that will come under it soonest instead of
+ * idling (a "limit break"); limits are therefore only enforced while
+ * some other client has work.
+ *
+ * Strict items are kept apart and served first, highest priority
+ * first, as with PrioritizedQueue.  Selection is a linear scan over
+ * clients, which is fine for the handful of clients per queue we
+ * expect.
+ */
+template <typename T, typename K>
+class mClockQueue : public OpQueue<T, K> {
+public:
+  typedef std::function<mClockClientInfo (const K&)> ClientInfoFunc;
+
+  /// how a request was selected by dequeue()
+  enum phase_t {
+    PHASE_STRICT = 0,
+    PHASE_RESERVATION,
+    PHASE_WEIGHT,
+    PHASE_LIMIT_BREAK,
+    PHASE_MAX,
+  };
+  static const char *get_phase_name(phase_t p) {
+    switch (p) {
+    case PHASE_STRICT: return "strict";
+    case PHASE_RESERVATION: return "reservation";
+    case PHASE_WEIGHT: return "weight";
+    case PHASE_LIMIT_BREAK: return "limit_break";
+    default: return "???";
+    }
+  }
+
+private:
+  struct Request {
+    T item;
+    double cost;
+    double r, p, l;  ///< tags; r is raw, see Client::r_adjust
+    Request(T item, double cost, double r, double p, double l)
+      : item(item), cost(cost), r(r), p(p), l(l) {}
+  };
+
+  struct Client {
+    mClockClientInfo info;
+    std::list<Request> requests;
+    double prev_r, prev_p, prev_l;  ///< tags of the last request queued
+    /// reservation credit returned by weight-phase service; the
+    /// effective R tag of a request is its raw tag minus this
+    double r_adjust;
+    uint64_t served[PHASE_MAX];
+    Client(const mClockClientInfo &info)
+      : info(info), prev_r(0), prev_p(0), prev_l(0), r_adjust(0) {
+      for (int i = 0; i < PHASE_MAX; ++i)
+	served[i] = 0;
+    }
+    double eff_r(const Request &req) const {
+      return req.r - r_adjust;
+    }
+    /// true if we can forget this client without losing anything
+    bool idle(double now) const {
+      return requests.empty() &&
+	prev_r - r_adjust <= now && prev_p <= now && prev_l <= now;
+    }
+  };
+
+  typedef std::map<K, Client> Clients;
+  typedef std::list<std::pair<K, T> > StrictList;
+  typedef std::map<unsigned, StrictList> StrictQueues;
+
+  ClientInfoFunc info_func;
+  Clients clients;
+  StrictQueues high_queue;
+  unsigned size;
+  unsigned strict_size;
+
+  Client &get_client(const K &cl) {
+    typename Clients::iterator p = clients.find(cl);
+    if (p == clients.end())
+      p = clients.insert(std::make_pair(cl, Client(info_func(cl)))).first;
+    return p->second;
+  }
+
+  static double tag(double prev, double cost, double rate, double now) {
+    if (rate <= 0)
+      return 0;
+    double t = prev + cost / rate;
+    return t > now ? t : now;
+  }
+
+  void _enqueue(K cl, double cost, T item, bool front) {
+    double t = now();
+    Client &c = get_client(cl);
+    if (front && !c.requests.empty()) {
+      // a requeue; go just ahead of the current head
+      const Request &h = c.requests.front();
+      c.requests.push_front(Request(item, cost, h.r, h.p, h.l));
+    } else {
+      double r = 0;
+      if (c.info.reservation > 0)
+	r = tag(c.prev_r - c.r_adjust, cost, c.info.reservation, t) +
+	  c.r_adjust;
+      double p = tag(c.prev_p, cost, c.info.weight, t);
+      double l = tag(c.prev_l, cost, c.info.limit, t);
+      c.requests.push_back(Request(item, cost, r, p, l));
+      c.prev_r = r;
+      c.prev_p = p;
+      c.prev_l = l;
+    }
+    ++size;
+  }
+
+  void _filter_strict(std::function<bool (const std::pair<K, T>&)> f,
+		      std::list<T> *out) {
+    for (typename StrictQueues::iterator i = high_queue.begin();
+	 i != high_queue.end(); ) {
+      for (typename StrictList::iterator j = i->second.begin();
+	   j != i->second.end(); ) {
+	if (f(*j)) {
+	  if (out)
+	    out->push_back(j->second);
+	  i->second.erase(j++);
+	  --size;
+	  --strict_size;
+	} else {
+	  ++j;
+	}
+      }
+      if (i->second.empty())
+	high_queue.erase(i++);
+      else
+	++i;
+    }
+  }
+
+  struct KeyIs {
+    K k;
+    KeyIs(const K &k) : k(k) {}
+    bool operator()(const std::pair<K, T> &i) const {
+      return i.first == k;
+    }
+  };
+  struct ItemIs {
+    std::function<bool (T)> f;
+    ItemIs(std::function<bool (T)> f) : f(f) {}
+    bool operator()(const std::pair<K, T> &i) const {
+      return f(i.second);
+    }
+  };
+
+protected:
+  /// the current time, in seconds; overridden by tests
+  virtual double now() const {
+    return (double)ceph_clock_now(NULL);
+  }
+
+public:
+  mClockQueue(ClientInfoFunc info_func)
+    : info_func(info_func), size(0), strict_size(0) {}
+
+  unsigned length() const {
+    return size;
+  }
+
+  bool empty() const {
+    return size == 0;
+  }
+
+  void remove_by_filter(std::function<bool (T)> f,
+			std::list<T> *removed = 0) {
+    for (typename Clients::iterator i = clients.begin();
+	 i != clients.end();
+	 ++i) {
+      std::list<Request> &l = i->second.requests;
+      for (typename std::list<Request>::iterator j = l.begin();
+	   j != l.end(); ) {
+	if (f(j->item)) {
+	  if (removed)
+	    removed->push_back(j->item);
+	  l.erase(j++);
+	  --size;
+	} else {
+	  ++j;
+	}
+      }
+    }
+    _filter_strict(ItemIs(f), removed);
+  }
+
+  void remove_by_class(K k, std::list<T> *out = 0) {
+    typename Clients::iterator i = clients.find(k);
+    if (i != clients.end()) {
+      for (typename std::list<Request>::iterator j =
+	     i->second.requests.begin();
+	   j != i->second.requests.end();
+	   ++j) {
+	if (out)
+	  out->push_back(j->item);
+      }
+      size -= i->second.requests.size();
+      clients.erase(i);
+    }
+    _filter_strict(KeyIs(k), out);
+  }
+
+  void enqueue_strict(K cl, unsigned priority, T item) {
+    high_queue[priority].push_back(std::make_pair(cl, item));
+    ++size;
+    ++strict_size;
+  }
+
+  void enqueue_strict_front(K cl, unsigned priority, T item) {
+    high_queue[priority].push_front(std::make_pair(cl, item));
+    ++size;
+    ++strict_size;
+  }
+
+  /// cost is in the units of the reservation and limit rates
+  void enqueue(K cl, unsigned priority, unsigned cost, T item) {
+    _enqueue(cl, cost, item, false);
+  }
+
+  void enqueue_front(K cl, unsigned priority, unsigned cost, T item) {
+    _enqueue(cl, cost, item, true);
+  }
+
+  T dequeue() {
+    return dequeue(NULL);
+  }
+
+  /**
+   * remove and return the next item
+   *
+   * @param phase [out] if not NULL, how the item was selected
+   * @param cl [out] if not NULL, the class of the item
+   */
+  T dequeue(phase_t *phase, K *cl = NULL) {
+    assert(!empty());
+
+    if (strict_size) {
+      StrictList &l = high_queue.rbegin()->second;
+      std::pair<K, T> ret = l.front();
+      l.pop_front();
+      if (l.empty())
+	high_queue.erase(high_queue.rbegin()->first);
+      --size;
+      --strict_size;
+      if (phase)
+	*phase = PHASE_STRICT;
+      if (cl)
+	*cl = ret.first;
+      return ret.second;
+    }
+
+    double t = now();
+    typename Clients::iterator best_r = clients.end();
+    typename Clients::iterator best_p = clients.end();
+    typename Clients::iterator best_l = clients.end();
+    for (typename Clients::iterator i = clients.begin();
+	 i != clients.end(); ) {
+      Client &c = i->second;
+      if (c.requests.empty()) {
+	if (c.idle(t))
+	  clients.erase(i++);
+	else
+	  ++i;
+	continue;
+      }
+      const Request &h = c.requests.front();
+      if (c.info.reservation > 0 && c.eff_r(h) <= t &&
+	  (best_r == clients.end() ||
+	   c.eff_r(h) < best_r->second.eff_r(best_r->second.requests.front())))
+	best_r = i;
+      if (h.l <= t) {
+	if (best_p == clients.end() ||
+	    h.p < best_p->second.requests.front().p)
+	  best_p = i;
+      } else if (best_l == clients.end() ||
+		 h.l < best_l->second.requests.front().l) {
+	best_l = i;
+      }
+      ++i;
+    }
+
+    typename Clients::iterator which;
+    phase_t ph;
+    if (best_r != clients.end()) {
+      which = best_r;
+      ph = PHASE_RESERVATION;
+    } else if (best_p != clients.end()) {
+      which = best_p;
+      ph = PHASE_WEIGHT;
+    } else {
+      assert(best_l != clients.end());
+      which = best_l;
+      ph = PHASE_LIMIT_BREAK;
+    }
+
+    Client &c = which->second;
+    Request req = c.requests.front();
+    c.requests.pop_front();
+    --size;
+    if (ph != PHASE_RESERVATION && c.info.reservation > 0)
+      c.r_adjust += req.cost / c.info.reservation;
+    c.served[ph]++;
+    if (phase)
+      *phase = ph;
+    if (cl)
+      *cl = which->first;
+    return req.item;
+  }
+
+  // the tags of the client's later requests already account for this
+  // one, so taking it out of turn needs no adjustment.  of the strict
+  // queues only the front of each priority is considered.
+  bool dequeue_head_if(std::function<bool (T)> f, unsigned max_scan,
+		       std::list<T> *out) {
+    for (typename StrictQueues::reverse_iterator i = high_queue.rbegin();
+	 i != high_queue.rend() && max_scan;
+	 ++i, --max_scan) {
+      if (f(i->second.front().second)) {
+	out->push_back(i->second.front().second);
+	i->second.pop_front();
+	if (i->second.empty())
+	  high_queue.erase(i->first);
+	--size;
+	--strict_size;
+	return true;
+      }
+    }
+    for (typename Clients::iterator i = clients.begin();
+	 i != clients.end() && max_scan;
+	 ++i) {
+      std::list<Request> &l = i->second.requests;
+      if (l.empty())
+	continue;
+      --max_scan;
+      if (f(l.front().item)) {
+	out->push_back(l.front().item);
+	l.pop_front();
+	--size;
+	return true;
+      }
+    }
+    return false;
+  }
+
+  void dump(Formatter *f) const {
+    f->dump_int("size", size);
+    f->dump_int("strict_size", strict_size);
+    f->open_array_section("high_queues");
+    for (typename StrictQueues::const_iterator p = high_queue.begin();
+	 p != high_queue.end();
+	 ++p) {
+      f->open_object_section("subqueue");
+      f->dump_int("priority", p->first);
+      f->dump_int("size", p->second.size());
+      f->close_section();
+    }
+    f->close_section();
+    f->open_array_section("clients");
+    for (typename Clients::const_iterator p = clients.begin();
+	 p != clients.end();
+	 ++p) {
+      const Client &c = p->second;
+      f->open_object_section("client");
+      std::ostringstream ss;
+      ss << p->first;
+      f->dump_string("client", ss.str());
+      f->dump_float("reservation", c.info.reservation);
+      f->dump_float("weight", c.info.weight);
+      f->dump_float("limit", c.info.limit);
+      f->dump_int("queued", c.requests.size());
+      for (int i = PHASE_RESERVATION; i < PHASE_MAX; ++i)
+	f->dump_unsigned(get_phase_name((phase_t)i), c.served[i]);
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
@@ -37,6 +37,10 @@ class SimpleLRU {
   }
 
   void _add(K key, V value) {
+    typename map<K, typename list<pair<K, V> >::iterator, C>::iterator i =
+      contents.find(key);
+    if (i != contents.end())
+      lru.erase(i->second);
     lru.push_front(make_pair(key, value));
     contents[key] = lru.begin();
     trim_cache();
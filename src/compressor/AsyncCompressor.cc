@@ -26,6 +26,7 @@ AsyncCompressor::AsyncCompressor(CephContext *c):
   compress_tp(g_ceph_context, "AsyncCompressor::compressor_tp", cct->_conf->async_compressor_threads, "async_compressor_threads"),
   job_lock("AsyncCompressor::job_lock"),
   compress_wq(this, c->_conf->async_compressor_thread_timeout, c->_conf->async_compressor_thread_suicide_timeout, &compress_tp) {
+  assert(compressor);
 }
 
 void AsyncCompressor::init()
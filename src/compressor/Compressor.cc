@@ -21,5 +21,5 @@ Compressor* Compressor::create(const string &type)
   if (type == "snappy")
     return new SnappyCompressor();
 
-  assert(0);
+  return NULL;
 }
@@ -24,6 +24,7 @@ class Compressor {
   virtual int compress(bufferlist &in, bufferlist &out) = 0;
   virtual int decompress(bufferlist &in, bufferlist &out) = 0;
 
+  /// @return NULL if type is unknown
   static Compressor *create(const string &type);
 };
 
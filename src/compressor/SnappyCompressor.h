@@ -21,7 +21,7 @@
 #include "Compressor.h"
 
 class BufferlistSource : public snappy::Source {
-  list<bufferptr>::const_iterator pb;
+  bufferlist::buffers_t::const_iterator pb;
   size_t pb_off;
   size_t left;
 
@@ -39,6 +39,8 @@
 
 #include <iosfwd>
 #include <iomanip>
+#include <iterator>
+#include <new>
 #include <list>
 #include <vector>
 #include <string>
@@ -123,6 +125,17 @@ public:
   /// enable/disable tracking of buffer::ptr::c_str() calls
   static void track_c_str(bool b);
 
+  /// count of raw allocations served from a per-thread pool cache
+  static uint64_t get_pool_hits();
+  /// count of pool-sized raw allocations that had to go to the heap
+  static uint64_t get_pool_misses();
+  /// bytes currently held in per-thread pool caches
+  static uint64_t get_pool_cached_bytes();
+  /// enable/disable the per-thread raw pool for new allocations
+  static void set_pool_enabled(bool b);
+  /// max bytes of free buffers each thread may keep cached
+  static void set_pool_thread_cache_bytes(uint64_t bytes);
+
 private:
  
   /* hack for memory utilization debugging. */
@@ -141,6 +154,8 @@ private:
   class raw_char;
   class raw_pipe;
   class raw_unshareable; // diagnostic, unshareable char buffer
+  class raw_combined;    // header and data in one pooled chunk
+  class raw_page_pool;   // page-multiple data from the per-thread pool
 
   friend std::ostream& operator<<(std::ostream& out, const raw &r);
 
@@ -253,23 +268,173 @@ public:
 
   friend std::ostream& operator<<(std::ostream& out, const buffer::ptr& bp);
 
+  /*
+   * ptr_vector - segment storage for list.
+   *
+   * behaves like the subset of std::list<ptr> that list needs, but the
+   * first INLINE_SEGMENTS ptrs live inside the object itself and larger
+   * lists spill to one contiguous array.  appending a segment to a small
+   * list therefore does no heap allocation, and walking the segments
+   * does not chase node pointers.
+   *
+   * iterators are (container, index) pairs: they survive push_back and
+   * reallocation, but (like std::vector) insert/erase shift the elements
+   * behind them.  unlike std::list, an iterator does not follow its
+   * element: after push_front, claim_prepend or an insert/erase in front
+   * of it, it refers to whatever segment now sits at its old index.
+   */
+  class CEPH_BUFFER_API ptr_vector {
+  public:
+    static const unsigned INLINE_SEGMENTS = 4;
+
+  private:
+    ptr *_data;      // points at _inline or at a heap array
+    unsigned _size;
+    unsigned _cap;
+    union {
+      char _inline[INLINE_SEGMENTS * sizeof(ptr)];
+      void *_align;
+    };
+
+    bool is_inline() const {
+      return _data == reinterpret_cast<const ptr*>(_inline);
+    }
+    void reserve_slow(unsigned n);
+    void open_gap(unsigned pos, unsigned n);
+    void take(ptr_vector& other);
+
+  public:
+    class const_iterator;
+
+    class CEPH_BUFFER_API iterator {
+      friend class ptr_vector;
+      friend class const_iterator;
+      ptr_vector *v;
+      unsigned i;
+    public:
+      typedef std::bidirectional_iterator_tag iterator_category;
+      typedef ptr value_type;
+      typedef ptrdiff_t difference_type;
+      typedef ptr* pointer;
+      typedef ptr& reference;
+
+      iterator() : v(0), i(0) {}
+      iterator(ptr_vector *_v, unsigned _i) : v(_v), i(_i) {}
+      ptr& operator*() const { return v->_data[i]; }
+      ptr* operator->() const { return &v->_data[i]; }
+      iterator& operator++() { ++i; return *this; }
+      iterator operator++(int) { iterator t = *this; ++i; return t; }
+      iterator& operator--() { --i; return *this; }
+      iterator operator--(int) { iterator t = *this; --i; return t; }
+      bool operator==(const iterator& o) const { return i == o.i && v == o.v; }
+      bool operator!=(const iterator& o) const { return !(*this == o); }
+      unsigned index() const { return i; }
+    };
+
+    class CEPH_BUFFER_API const_iterator {
+      const ptr_vector *v;
+      unsigned i;
+    public:
+      typedef std::bidirectional_iterator_tag iterator_category;
+      typedef ptr value_type;
+      typedef ptrdiff_t difference_type;
+      typedef const ptr* pointer;
+      typedef const ptr& reference;
+
+      const_iterator() : v(0), i(0) {}
+      const_iterator(const ptr_vector *_v, unsigned _i) : v(_v), i(_i) {}
+      const_iterator(const iterator& o) : v(o.v), i(o.i) {}
+      const ptr& operator*() const { return v->_data[i]; }
+      const ptr* operator->() const { return &v->_data[i]; }
+      const_iterator& operator++() { ++i; return *this; }
+      const_iterator operator++(int) { const_iterator t = *this; ++i; return t; }
+      const_iterator& operator--() { --i; return *this; }
+      const_iterator operator--(int) { const_iterator t = *this; --i; return t; }
+      bool operator==(const const_iterator& o) const {
+	return i == o.i && v == o.v;
+      }
+      bool operator!=(const const_iterator& o) const { return !(*this == o); }
+      unsigned index() const { return i; }
+    };
+
+    ptr_vector()
+      : _data(reinterpret_cast<ptr*>(_inline)), _size(0),
+	_cap(INLINE_SEGMENTS) {}
+    ptr_vector(const ptr_vector& other);
+    ptr_vector& operator=(const ptr_vector& other);
+    ~ptr_vector();
+
+    unsigned size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    unsigned capacity() const { return _cap; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, _size); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, _size); }
+
+    ptr& front() { return _data[0]; }
+    const ptr& front() const { return _data[0]; }
+    ptr& back() { return _data[_size - 1]; }
+    const ptr& back() const { return _data[_size - 1]; }
+    ptr& operator[](unsigned n) { return _data[n]; }
+    const ptr& operator[](unsigned n) const { return _data[n]; }
+
+    void reserve(unsigned n) {
+      if (n > _cap)
+	reserve_slow(n);
+    }
+    void push_back(const ptr& bp) {
+      if (_size == _cap) {
+	ptr tmp(bp);  // bp may live in our own storage
+	reserve_slow(_cap * 2);
+	new (&_data[_size]) ptr();
+	_data[_size].swap(tmp);
+      } else {
+	new (&_data[_size]) ptr(bp);
+      }
+      ++_size;
+    }
+    void push_front(const ptr& bp);
+    iterator insert(iterator pos, const ptr& bp);
+    iterator erase(iterator pos);
+    void clear();
+    void swap(ptr_vector& other);
+
+    /// move all of other's segments to our tail (or head); other is emptied
+    void claim_append(ptr_vector& other);
+    void claim_prepend(ptr_vector& other);
+  };
+
   /*
    * list - the useful bit!
    */
 
   class CEPH_BUFFER_API list {
+  public:
+    typedef ptr_vector buffers_t;
+
+  private:
     // my private bits
-    std::list<ptr> _buffers;
+    buffers_t _buffers;
     unsigned _len;
     unsigned _memcopy_count; //the total of memcopy using rebuild().
     ptr append_buffer;  // where i put small appends.
 
   public:
+    /*
+     * iterator - a byte position in a list.
+     *
+     * remains valid across appends (push_back, append, claim_append), but
+     * anything that adds or removes segments ahead of it (push_front,
+     * claim_prepend, splice, rebuild, ...) invalidates it: it then points
+     * into a different segment than its offset says.  re-seek it.
+     */
     class CEPH_BUFFER_API iterator {
       list *bl;
-      std::list<ptr> *ls; // meh.. just here to avoid an extra pointer dereference..
+      buffers_t *ls; // meh.. just here to avoid an extra pointer dereference..
       unsigned off;  // in bl
-      std::list<ptr>::iterator p;
+      buffers_t::iterator p;
       unsigned p_off; // in *p
     public:
       // constructor.  position.
@@ -279,7 +444,7 @@ public:
 	bl(l), ls(&bl->_buffers), off(0), p(ls->begin()), p_off(0) {
 	advance(o);
       }
-      iterator(list *l, unsigned o, std::list<ptr>::iterator ip, unsigned po) : 
+      iterator(list *l, unsigned o, buffers_t::iterator ip, unsigned po) : 
 	bl(l), ls(&bl->_buffers), off(o), p(ip), p_off(po) { }
 
       /// get current iterator offset in buffer::list
@@ -337,18 +502,19 @@ public:
         _buffers = other._buffers;
         _len = other._len;
 	make_shareable();
+	last_p = begin();
       }
       return *this;
     }
 
     unsigned get_memcopy_count() const {return _memcopy_count; }
-    const std::list<ptr>& buffers() const { return _buffers; }
+    const buffers_t& buffers() const { return _buffers; }
     void swap(list& other);
     unsigned length() const {
 #if 0
       // DEBUG: verify _len
       unsigned len = 0;
-      for (std::list<ptr>::const_iterator it = _buffers.begin();
+      for (buffers_t::const_iterator it = _buffers.begin();
 	   it != _buffers.end();
 	   it++) {
 	len += (*it).length();
@@ -379,6 +545,7 @@ public:
 	return;
       _buffers.push_front(bp);
       _len += bp.length();
+      last_p = begin();  // segment indices shifted
     }
     void push_front(raw *r) {
       ptr bp(r);
@@ -416,7 +583,7 @@ public:
 
     // clone non-shareable buffers (make shareable)
     void make_shareable() {
-      std::list<buffer::ptr>::iterator pb;
+      buffers_t::iterator pb;
       for (pb = _buffers.begin(); pb != _buffers.end(); ++pb) {
         (void) pb->make_shareable();
       }
@@ -427,7 +594,7 @@ public:
     {
       if (this != &bl) {
         clear();
-        std::list<buffer::ptr>::const_iterator pb;
+        buffers_t::const_iterator pb;
         for (pb = bl._buffers.begin(); pb != bl._buffers.end(); ++pb) {
           push_back(*pb);
         }
@@ -29,4 +29,39 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
 	return ceph_crc32c_func(crc, data, length);
 }
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * calculate crc32c over a run of zeros
+ *
+ * Equivalent to ceph_crc32c(crc, NULL, length), but computed in
+ * O(log length) time rather than by walking the zeros.
+ *
+ * @param crc initial value
+ * @param length number of zero bytes
+ */
+extern uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length);
+
+/**
+ * combine the crcs of two adjacent buffers
+ *
+ * Given crc_a = ceph_crc32c(crc, A, len_a) and
+ * crc_b = ceph_crc32c(0, B, length_b), return
+ * ceph_crc32c(crc, A+B, len_a + length_b).
+ *
+ * @param crc_a crc of the first buffer (with any initial value)
+ * @param crc_b crc of the second buffer, seeded with 0
+ * @param length_b length of the second buffer
+ */
+static inline uint32_t ceph_crc32c_combine(uint32_t crc_a, uint32_t crc_b, unsigned length_b)
+{
+	return ceph_crc32c_zeros(crc_a, length_b) ^ crc_b;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,87 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "BinaryFormat.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <iostream>
+#include <string>
+
+namespace ceph {
+namespace log {
+
+int decode_binary_log(FILE *in, std::ostream &out, std::ostream &err)
+{
+  std::string payload;
+  char buf[80];
+  bool first = true;
+  uint64_t offset = 0;
+
+  while (true) {
+    binary_record_t h;
+    size_t r = fread(&h, 1, sizeof(h), in);
+    if (r == 0 && !ferror(in))
+      break;
+    if (r < sizeof(h)) {
+      if (ferror(in))
+	return -EIO;
+      err << "truncated record header at offset " << offset << std::endl;
+      break;
+    }
+    uint32_t len = h.len;
+    if (len > CEPH_LOG_BINARY_MAX_PAYLOAD ||
+	(first && h.type != BINARY_RECORD_HEADER)) {
+      err << "bad record at offset " << offset
+	  << "; not a binary log?" << std::endl;
+      return -EINVAL;
+    }
+    payload.resize(len);
+    if (len && fread(&payload[0], 1, len, in) < len) {
+      if (ferror(in))
+	return -EIO;
+      err << "truncated record at offset " << offset << std::endl;
+      break;
+    }
+    offset += sizeof(h) + len;
+    first = false;
+
+    switch (h.type) {
+    case BINARY_RECORD_HEADER:
+      if (payload != CEPH_LOG_BINARY_MAGIC) {
+	err << "unrecognized header '" << payload << "'" << std::endl;
+	return -EINVAL;
+      }
+      break;
+
+    case BINARY_RECORD_ENTRY:
+    case BINARY_RECORD_CRASH:
+      {
+	int buflen = format_entry_prefix(buf, sizeof(buf),
+					 utime_t(h.sec, h.nsec),
+					 (unsigned long)(uint64_t)h.thread,
+					 (short)(uint16_t)h.prio,
+					 h.type == BINARY_RECORD_CRASH,
+					 (int32_t)(uint32_t)h.crash_idx);
+	out.write(buf, buflen);
+	out.write(payload.data(), payload.size());
+	out << '\n';
+      }
+      break;
+
+    case BINARY_RECORD_LINE:
+      out.write(payload.data(), payload.size());
+      out << '\n';
+      break;
+
+    default:
+      // skip types we don't know about
+      break;
+    }
+  }
+  return 0;
+}
+
+}
+}
@@ -0,0 +1,91 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef __CEPH_LOG_BINARYFORMAT_H
+#define __CEPH_LOG_BINARYFORMAT_H
+
+#include <stdio.h>
+#include <iosfwd>
+
+#include "include/byteorder.h"
+#include "include/utime.h"
+
+/*
+ * Binary log file format
+ *
+ * With log_binary enabled the log file is a sequence of records, each a
+ * fixed header followed by len bytes of payload.  Nothing is formatted
+ * on the way out: the payload is the entry text exactly as the dout
+ * statement produced it, and the timestamp, thread and level stay
+ * binary.  ceph-log-decode renders the records back into the usual text
+ * format.
+ *
+ * Every (re)open of the log file starts with a HEADER record, so a file
+ * that has been rotated or reopened still decodes from the beginning.
+ */
+
+namespace ceph {
+namespace log {
+
+#define CEPH_LOG_BINARY_MAGIC "ceph log binary v1"
+
+enum {
+  BINARY_RECORD_HEADER = 1,  ///< payload is CEPH_LOG_BINARY_MAGIC
+  BINARY_RECORD_ENTRY = 2,   ///< a log entry
+  BINARY_RECORD_CRASH = 3,   ///< a log entry from a crash dump
+  BINARY_RECORD_LINE = 4,    ///< a bare line of text (e.g. dump banners)
+};
+
+struct binary_record_t {
+  ceph_le32 len;        ///< payload bytes following this header
+  __u8 type;            ///< BINARY_RECORD_*
+  __u8 reserved;
+  ceph_le16 subsys;
+  ceph_le16 prio;       ///< signed
+  ceph_le16 reserved2;
+  ceph_le32 crash_idx;  ///< signed; position in a crash dump
+  ceph_le64 thread;
+  ceph_le32 sec;
+  ceph_le32 nsec;
+} __attribute__ ((packed));
+
+/// upper bound on a sane record payload; anything larger is corruption
+#define CEPH_LOG_BINARY_MAX_PAYLOAD (64 << 20)
+
+/**
+ * format the text prefix for a log entry
+ *
+ * This is shared by the text writer and the binary decoder so that a
+ * decoded binary log matches what text mode would have written.
+ *
+ * @param crash_idx if crash, the entry's position in the dump
+ * @return bytes written, as snprintf
+ */
+static inline int format_entry_prefix(char *buf, int len, utime_t stamp,
+				      unsigned long thread, int prio,
+				      bool crash, int crash_idx)
+{
+  int r = 0;
+  if (crash)
+    r += snprintf(buf, len, "%6d> ", crash_idx);
+  r += stamp.sprintf(buf + r, len - r);
+  r += snprintf(buf + r, len - r, " %lx %2d ", thread, prio);
+  return r;
+}
+
+/**
+ * render a binary log file as text
+ *
+ * @param in binary log, positioned at a HEADER record
+ * @param out where to write the text
+ * @param err where to describe any problem with the input
+ * @return 0 on success, -EINVAL if the input is not a binary log or is
+ *   corrupt, -EIO on read error.  A record truncated at end of file is
+ *   reported on err but is not an error (the writer may still be going).
+ */
+int decode_binary_log(FILE *in, std::ostream &out, std::ostream &err);
+
+}
+}
+
+#endif
@@ -2,6 +2,7 @@
 // vim: ts=8 sw=2 smarttab
 
 #include "Log.h"
+#include "BinaryFormat.h"
 
 #include <errno.h>
 #include <syslog.h>
@@ -21,6 +22,9 @@
 
 #define PREALLOC 1000000
 
+// write out pending binary records once we have this many bytes
+#define BINARY_WRITE_BYTES (64 << 10)
+
 namespace ceph {
 namespace log {
 
@@ -39,13 +43,16 @@ Log::Log(SubsystemMap *s)
     m_subs(s),
     m_queue_mutex_holder(0),
     m_flush_mutex_holder(0),
-    m_new(), m_recent(),
+    m_new_head(NULL), m_new_len(0),
+    m_flusher_waiting(0), m_loggers_waiting(0),
+    m_recent(),
     m_fd(-1),
     m_syslog_log(-2), m_syslog_crash(-2),
     m_stderr_log(1), m_stderr_crash(-1),
     m_stop(false),
     m_max_new(DEFAULT_MAX_NEW),
     m_max_recent(DEFAULT_MAX_RECENT),
+    m_binary(false),
     m_inject_segv(false)
 {
   int ret;
@@ -75,6 +82,11 @@ Log::~Log()
   }
 
   assert(!is_started());
+  while (m_new_head) {
+    Entry *e = m_new_head;
+    m_new_head = e->m_next;
+    delete e;
+  }
   if (m_fd >= 0)
     VOID_TEMP_FAILURE_RETRY(::close(m_fd));
 
@@ -118,10 +130,21 @@ void Log::set_log_file(string fn)
   m_log_file = fn;
 }
 
+void Log::set_log_binary(bool b)
+{
+  pthread_mutex_lock(&m_flush_mutex);
+  m_flush_mutex_holder = pthread_self();
+  _binary_write();
+  m_binary = b;
+  m_flush_mutex_holder = 0;
+  pthread_mutex_unlock(&m_flush_mutex);
+}
+
 void Log::reopen_log_file()
 {
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
+  _binary_write();
   if (m_fd >= 0)
     VOID_TEMP_FAILURE_RETRY(::close(m_fd));
   if (m_log_file.length()) {
@@ -129,6 +152,11 @@ void Log::reopen_log_file()
   } else {
     m_fd = -1;
   }
+  if (m_fd >= 0 && m_binary) {
+    _binary_append(BINARY_RECORD_HEADER, NULL, 0, CEPH_LOG_BINARY_MAGIC,
+		   strlen(CEPH_LOG_BINARY_MAGIC));
+    _binary_write();
+  }
   m_flush_mutex_holder = 0;
   pthread_mutex_unlock(&m_flush_mutex);
 }
@@ -149,24 +177,89 @@ void Log::set_stderr_level(int log, int crash)
   pthread_mutex_unlock(&m_flush_mutex);
 }
 
+/*
+ * Submission is lock-free: entries are pushed onto a singly linked
+ * stack with a CAS, and the flusher takes the whole stack at once and
+ * reverses it.  Because the flusher never pops individual entries there
+ * is no ABA hazard, and the reversal restores submission order (so each
+ * thread's entries stay in order).
+ *
+ * We only touch m_queue_mutex on the slow paths: to wake a sleeping
+ * flusher, or to block when more than m_max_new entries are pending.
+ * Both sides do a full barrier (the CAS, or __sync_synchronize) between
+ * publishing their state and reading the other side's, so a wakeup
+ * can't be lost.
+ */
 void Log::submit_entry(Entry *e)
 {
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   if (m_inject_segv)
     *(int *)(0) = 0xdead;
 
   // wait for flush to catch up
-  while (m_new.m_len > m_max_new)
-    pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+  if (m_new_len > m_max_new)
+    _wait_for_flush();
+
+  Entry *head;
+  do {
+    head = m_new_head;
+    e->m_next = head;
+  } while (!__sync_bool_compare_and_swap(&m_new_head, head, e));
+  __sync_fetch_and_add(&m_new_len, 1);
+
+  if (m_flusher_waiting) {
+    pthread_mutex_lock(&m_queue_mutex);
+    pthread_cond_signal(&m_cond_flusher);
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+}
 
-  m_new.enqueue(e);
-  pthread_cond_signal(&m_cond_flusher);
+void Log::_wait_for_flush()
+{
+  pthread_mutex_lock(&m_queue_mutex);
+  m_queue_mutex_holder = pthread_self();
+  __sync_fetch_and_add(&m_loggers_waiting, 1);
+  while (m_new_len > m_max_new) {
+    pthread_cond_signal(&m_cond_flusher);
+    pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
+  }
+  __sync_fetch_and_sub(&m_loggers_waiting, 1);
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
 }
 
+/// move all submitted entries, oldest first, onto q
+void Log::_take_new(EntryQueue *q)
+{
+  Entry *head;
+  do {
+    head = m_new_head;
+  } while (head && !__sync_bool_compare_and_swap(&m_new_head, head, (Entry*)NULL));
+  if (!head)
+    return;
+
+  Entry *prev = NULL;
+  int n = 0;
+  while (head) {
+    Entry *next = head->m_next;
+    head->m_next = prev;
+    prev = head;
+    head = next;
+    n++;
+  }
+  while (prev) {
+    Entry *next = prev->m_next;
+    q->enqueue(prev);
+    prev = next;
+  }
+
+  __sync_fetch_and_sub(&m_new_len, n);
+  if (m_loggers_waiting) {
+    pthread_mutex_lock(&m_queue_mutex);
+    pthread_cond_broadcast(&m_cond_loggers);
+    pthread_mutex_unlock(&m_queue_mutex);
+  }
+}
+
 Entry *Log::create_entry(int level, int subsys)
 {
   if (true) {
@@ -188,13 +281,8 @@ void Log::flush()
 {
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
   EntryQueue t;
-  t.swap(m_new);
-  pthread_cond_broadcast(&m_cond_loggers);
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+  _take_new(&t);
   _flush(&t, &m_recent, false);
 
   // trim
@@ -215,22 +303,25 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
 
     bool should_log = crash || m_subs->get_log_level(sub) >= e->m_prio;
     bool do_fd = m_fd >= 0 && should_log;
+    bool do_text_fd = do_fd && !m_binary;
     bool do_syslog = m_syslog_crash >= e->m_prio && should_log;
     bool do_stderr = m_stderr_crash >= e->m_prio && should_log;
 
-    if (do_fd || do_syslog || do_stderr) {
-      int buflen = 0;
+    if (do_fd && m_binary) {
+      // no formatting at all; the decoder does that offline
+      _binary_append(crash ? BINARY_RECORD_CRASH : BINARY_RECORD_ENTRY,
+		     e, -t->m_len, NULL, 0);
+    }
 
-      if (crash)
-	buflen += snprintf(buf, sizeof(buf), "%6d> ", -t->m_len);
-      buflen += e->m_stamp.sprintf(buf + buflen, sizeof(buf)-buflen);
-      buflen += snprintf(buf + buflen, sizeof(buf)-buflen, " %lx %2d ",
-			(unsigned long)e->m_thread, e->m_prio);
+    if (do_text_fd || do_syslog || do_stderr) {
+      int buflen = format_entry_prefix(buf, sizeof(buf), e->m_stamp,
+				       (unsigned long)e->m_thread, e->m_prio,
+				       crash, -t->m_len);
 
       // FIXME: this is slow
       string s = e->get_str();
 
-      if (do_fd) {
+      if (do_text_fd) {
 	int r = safe_write(m_fd, buf, buflen);
 	if (r >= 0)
 	  r = safe_write(m_fd, s.data(), s.size());
@@ -251,11 +342,56 @@ void Log::_flush(EntryQueue *t, EntryQueue *requeue, bool crash)
 
     requeue->enqueue(e);
   }
+  _binary_write();
 }
 
-void Log::_log_message(const char *s, bool crash)
+void Log::_binary_append(int type, const Entry *e, int crash_idx,
+			 const char *s, size_t len)
+{
+  binary_record_t h;
+  memset(&h, 0, sizeof(h));
+  h.type = type;
+  if (e) {
+    len = e->m_streambuf.size();
+    h.subsys = e->m_subsys;
+    h.prio = e->m_prio;
+    h.thread = (uint64_t)e->m_thread;
+    h.sec = e->m_stamp.sec();
+    h.nsec = e->m_stamp.nsec();
+  }
+  h.crash_idx = crash_idx;
+  h.len = len;
+
+  size_t off = m_binary_buf.size();
+  m_binary_buf.resize(off + sizeof(h) + len);
+  memcpy(&m_binary_buf[off], &h, sizeof(h));
+  if (e)
+    e->m_streambuf.copy_to(&m_binary_buf[off + sizeof(h)]);
+  else if (len)
+    memcpy(&m_binary_buf[off + sizeof(h)], s, len);
+
+  if (m_binary_buf.size() >= BINARY_WRITE_BYTES)
+    _binary_write();
+}
+
+void Log::_binary_write()
 {
+  if (m_binary_buf.empty())
+    return;
   if (m_fd >= 0) {
+    int r = safe_write(m_fd, m_binary_buf.data(), m_binary_buf.size());
+    if (r < 0)
+      cerr << "problem writing to " << m_log_file << ": " << cpp_strerror(r) << std::endl;
+  }
+  m_binary_buf.clear();
+}
+
+void Log::_log_message(const char *s, bool crash)
+{
+  if (m_fd >= 0 && m_binary) {
+    _binary_append(BINARY_RECORD_LINE, NULL, 0, s, strlen(s));
+    _binary_write();
+  } else if (m_fd >= 0) {
     int r = safe_write(m_fd, s, strlen(s));
     if (r >= 0)
       r = safe_write(m_fd, "\n", 1);
@@ -276,14 +412,8 @@ void Log::dump_recent()
   pthread_mutex_lock(&m_flush_mutex);
   m_flush_mutex_holder = pthread_self();
 
-  pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
-
   EntryQueue t;
-  t.swap(m_new);
-
-  m_queue_mutex_holder = 0;
-  pthread_mutex_unlock(&m_queue_mutex);
+  _take_new(&t);
   _flush(&t, &m_recent, false);
 
   EntryQueue old;
@@ -341,7 +471,7 @@ void *Log::entry()
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
   while (!m_stop) {
-    if (!m_new.empty()) {
+    if (m_new_head) {
       m_queue_mutex_holder = 0;
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
@@ -350,7 +480,13 @@ void *Log::entry()
       continue;
     }
 
-    pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
+    // advertise that we are going to sleep, then recheck; a submitter
+    // either sees the flag or we see its entry.
+    m_flusher_waiting = 1;
+    __sync_synchronize();
+    if (!m_new_head)
+      pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
+    m_flusher_waiting = 0;
   }
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
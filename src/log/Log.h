@@ -29,7 +29,12 @@ class Log : private Thread
   pthread_t m_queue_mutex_holder;
   pthread_t m_flush_mutex_holder;
 
-  EntryQueue m_new;    ///< new entries
+  /// new entries, pushed lock-free by submitters (newest first) and
+  /// taken in bulk by the flusher
+  Entry * volatile m_new_head;
+  volatile int m_new_len;
+  volatile int m_flusher_waiting;  ///< flusher is (about to be) asleep
+  volatile int m_loggers_waiting;  ///< submitters blocked on m_max_new
   EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
 
   std::string m_log_file;
@@ -42,14 +47,23 @@ class Log : private Thread
 
   int m_max_new, m_max_recent;
 
+  bool m_binary;              ///< write m_fd as binary records
+  std::string m_binary_buf;   ///< pending binary records
+
   bool m_inject_segv;
 
   void *entry();
 
+  void _take_new(EntryQueue *q);
+  void _wait_for_flush();
   void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
 
   void _log_message(const char *s, bool crash);
 
+  void _binary_append(int type, const Entry *e, int crash_idx,
+		      const char *s, size_t len);
+  void _binary_write();
+
 public:
   Log(SubsystemMap *s);
   virtual ~Log();
@@ -59,6 +73,7 @@ public:
   void set_max_new(int n);
   void set_max_recent(int n);
   void set_log_file(std::string fn);
+  void set_log_binary(bool b);
   void reopen_log_file();
 
   void flush(); 
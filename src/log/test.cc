@@ -1,6 +1,11 @@
 #include <gtest/gtest.h>
 
+#include <fstream>
+#include <map>
+#include <stdio.h>
+
 #include "log/Log.h"
+#include "log/BinaryFormat.h"
 #include "common/Clock.h"
 #include "common/PrebufferedStreambuf.h"
 
@@ -188,6 +193,155 @@ TEST(Log, ManyGather)
   log.stop();
 }
 
+static void log_some(const char *fn, bool binary, bool dump)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 20);
+  subs.add(2, "bar", 5, 5);
+  Log log(&subs);
+  log.set_stderr_level(-1, -1);
+  log.set_log_binary(binary);
+  log.start();
+  log.set_log_file(fn);
+  log.reopen_log_file();
+  utime_t stamp(1234567890, 123456789);
+  for (int i=0; i<100; i++) {
+    Entry *e = new Entry(stamp, (pthread_t)(0x1000 + i % 3), i % 20,
+			 1 + i % 2);
+    ostream os(&e->m_streambuf);
+    os << "entry " << i;
+    if (i % 10 == 0)
+      os << " and a line long enough to overflow the preallocated buffer "
+	 << std::string(200, 'x');
+    log.submit_entry(e);
+  }
+  log.flush();
+  if (dump)
+    log.dump_recent();
+  log.stop();
+}
+
+static std::string read_file(const char *fn)
+{
+  std::ifstream in(fn);
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+TEST(Log, BinaryDecode)
+{
+  // the dump includes the log file name, so write both under one name
+  const char *fn = "/tmp/log_decode";
+  const char *text_fn = "/tmp/log_decode.txt";
+  const char *bin_fn = "/tmp/log_decode.bin";
+  for (int dump = 0; dump < 2; dump++) {
+    ::unlink(fn);
+    log_some(fn, false, dump);
+    ASSERT_EQ(0, ::rename(fn, text_fn));
+    log_some(fn, true, dump);
+    ASSERT_EQ(0, ::rename(fn, bin_fn));
+
+    FILE *f = fopen(bin_fn, "r");
+    ASSERT_TRUE(f != NULL);
+    std::ostringstream out, err;
+    ASSERT_EQ(0, decode_binary_log(f, out, err));
+    fclose(f);
+    ASSERT_EQ("", err.str());
+    std::string text = read_file(text_fn);
+    ASSERT_NE(0u, text.size());
+    ASSERT_EQ(text, out.str());
+  }
+
+  // a text log is rejected
+  FILE *f = fopen(text_fn, "r");
+  ASSERT_TRUE(f != NULL);
+  std::ostringstream out, err;
+  ASSERT_EQ(-EINVAL, decode_binary_log(f, out, err));
+  fclose(f);
+  ::unlink(text_fn);
+  ::unlink(bin_fn);
+}
+
+TEST(Log, ManyGatherBinary)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 10);
+  Log log(&subs);
+  log.set_log_binary(true);
+  log.start();
+  log.set_log_file("/tmp/big.bin");
+  log.reopen_log_file();
+  for (int i=0; i<many; i++) {
+    int l = 10;
+    if (subs.should_gather(1, l))
+      log.submit_entry(new Entry(ceph_clock_now(NULL), pthread_self(), l, 1,
+				 "this is a long string asdf asdf asdf asdf asdf asdf asd fasd fasdf "));
+  }
+  log.flush();
+  log.stop();
+}
+
+struct OrderArg {
+  Log *log;
+  int id;
+};
+
+static void *submit_ordered(void *p)
+{
+  OrderArg *a = (OrderArg *)p;
+  for (int i=0; i<many; i++) {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "t %d %d", a->id, i);
+    a->log->submit_entry(new Entry(ceph_clock_now(NULL), pthread_self(), 10, 1,
+				   buf));
+  }
+  return NULL;
+}
+
+TEST(Log, ManyThreadsOrdered)
+{
+  const char *fn = "/tmp/log_ordered";
+  ::unlink(fn);
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 20);
+  Log log(&subs);
+  log.set_max_new(10);  // exercise the blocking path too
+  log.start();
+  log.set_log_file(fn);
+  log.reopen_log_file();
+
+  const int nthreads = 8;
+  pthread_t tids[nthreads];
+  OrderArg args[nthreads];
+  for (int t=0; t<nthreads; t++) {
+    args[t].log = &log;
+    args[t].id = t;
+    ASSERT_EQ(0, pthread_create(&tids[t], NULL, submit_ordered, &args[t]));
+  }
+  for (int t=0; t<nthreads; t++)
+    pthread_join(tids[t], NULL);
+  log.flush();
+  log.stop();
+
+  // every entry is written exactly once, in per-thread order
+  std::map<int, int> next;
+  std::ifstream in(fn);
+  std::string line;
+  int total = 0;
+  while (std::getline(in, line)) {
+    size_t pos = line.find(" t ");
+    ASSERT_NE(std::string::npos, pos);
+    int id, seq;
+    ASSERT_EQ(2, sscanf(line.c_str() + pos, " t %d %d", &id, &seq));
+    ASSERT_EQ(next[id], seq);
+    next[id]++;
+    total++;
+  }
+  ASSERT_EQ(nthreads * many, total);
+  ::unlink(fn);
+}
+
 void do_segv()
 {
   SubsystemMap subs;
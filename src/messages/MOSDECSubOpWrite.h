@@ -16,6 +16,7 @@
 #define MOSDECSUBOPWRITE_H
 
 #include "msg/Message.h"
+#include "msg/MessageFreeList.h"
 #include "osd/osd_types.h"
 #include "osd/ECMsgTypes.h"
 
@@ -32,6 +33,8 @@ public:
     return 0;
   }
 
+  MESSAGE_FREELIST(MOSDECSubOpWrite)
+
   MOSDECSubOpWrite()
     : Message(MSG_OSD_EC_WRITE, HEAD_VERSION, COMPAT_VERSION)
     {}
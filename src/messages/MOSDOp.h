@@ -17,6 +17,7 @@
 #define CEPH_MOSDOP_H
 
 #include "msg/Message.h"
+#include "msg/MessageFreeList.h"
 #include "osd/osd_types.h"
 #include "include/ceph_features.h"
 
@@ -100,6 +101,8 @@ public:
   
   utime_t get_mtime() { return mtime; }
 
+  MESSAGE_FREELIST(MOSDOp)
+
   MOSDOp()
     : Message(CEPH_MSG_OSD_OP, HEAD_VERSION, COMPAT_VERSION) { }
   MOSDOp(int inc, long tid,
@@ -17,6 +17,7 @@
 #define CEPH_MOSDOPREPLY_H
 
 #include "msg/Message.h"
+#include "msg/MessageFreeList.h"
 
 #include "MOSDOp.h"
 #include "os/ObjectStore.h"
@@ -123,6 +124,8 @@ public:
   */
 
 public:
+  MESSAGE_FREELIST(MOSDOpReply)
+
   MOSDOpReply()
     : Message(CEPH_MSG_OSD_OPREPLY, HEAD_VERSION, COMPAT_VERSION) { }
   MOSDOpReply(MOSDOp *req, int r, epoch_t e, int acktype, bool ignore_out_data)
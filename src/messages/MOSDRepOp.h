@@ -17,6 +17,7 @@
 #define CEPH_MOSDREPOP_H
 
 #include "msg/Message.h"
+#include "msg/MessageFreeList.h"
 #include "osd/osd_types.h"
 
 /*
@@ -103,6 +104,8 @@ public:
     ::encode(pg_trim_rollback_to, payload);
   }
 
+  MESSAGE_FREELIST(MOSDRepOp)
+
   MOSDRepOp()
     : Message(MSG_OSD_REPOP, HEAD_VERSION, COMPAT_VERSION),
       map_epoch(0), acks_wanted (0) {}
@@ -151,6 +151,26 @@ public:
    */
   virtual void ms_handle_remote_reset(Connection *con) = 0;
   
+  /**
+   * Offer a buffer to receive the data payload of an incoming message
+   * into, in place of the one the messenger would allocate.  The payload
+   * is read straight into it, so a dispatcher can hand out memory laid
+   * out the way it will finally be consumed (e.g. page aligned for
+   * direct IO).  A buffer posted for the message's tid with
+   * Connection::post_rx_buffer takes precedence.
+   *
+   * This is called from the messenger's reader and must not block.
+   *
+   * @param con The Connection the message arrives on
+   * @param header The header of the incoming message
+   * @param bl Output param: the buffer; it is extended if shorter than
+   * the payload
+   *
+   * @return True if bl was filled in, false to leave it to the messenger
+   */
+  virtual bool ms_get_rx_buffer(Connection *con, const ceph_msg_header &header,
+				bufferlist *bl) { return false; }
+
   /**
    * @defgroup Authentication
    * @{
@@ -174,6 +174,8 @@ using namespace std;
 
 #define dout_subsys ceph_subsys_ms
 
+bool message_freelist_enabled = false;
+
 void Message::encode(uint64_t features, int crcflags)
 {
   // encode and copy out of *m
@@ -0,0 +1,96 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MESSAGEFREELIST_H
+#define CEPH_MESSAGEFREELIST_H
+
+#include <stddef.h>
+#include <new>
+#include "common/simple_spin.h"
+
+/**
+ * MessageFreeList<T>
+ *
+ * Keeps the memory of up to MAX_FREE released messages of type T and
+ * hands it to the next message of that type, so that a message decoded
+ * on a messenger thread and put for the last time on an op thread does
+ * not cost a malloc/free pair of a several hundred byte object each.
+ *
+ * A message class opts in with MESSAGE_FREELIST(T) in a public section.
+ * The lists are shared by all threads and live until exit.  They are
+ * only used while message_freelist_enabled is set (ms_message_freelist,
+ * applied by Messenger::create); otherwise allocation goes straight to
+ * the global operator new/delete.  Either way the memory comes from
+ * ::operator new, so the switch may be flipped at any time.
+ */
+extern bool message_freelist_enabled;
+
+template <class T>
+class MessageFreeList {
+  static const unsigned MAX_FREE = 256;
+
+  struct Node {
+    Node *next;
+  };
+  static simple_spinlock_t lock;
+  static Node *head;
+  static unsigned count;
+
+public:
+  static void *alloc(size_t size) {
+    if (size == sizeof(T) && message_freelist_enabled) {
+      simple_spin_lock(&lock);
+      Node *n = head;
+      if (n) {
+	head = n->next;
+	--count;
+      }
+      simple_spin_unlock(&lock);
+      if (n)
+	return n;
+    }
+    return ::operator new(size);
+  }
+
+  static void release(void *p, size_t size) {
+    if (size == sizeof(T) && message_freelist_enabled) {
+      simple_spin_lock(&lock);
+      if (count < MAX_FREE) {
+	Node *n = static_cast<Node*>(p);
+	n->next = head;
+	head = n;
+	++count;
+	simple_spin_unlock(&lock);
+	return;
+      }
+      simple_spin_unlock(&lock);
+    }
+    ::operator delete(p);
+  }
+};
+
+template <class T>
+simple_spinlock_t MessageFreeList<T>::lock = SIMPLE_SPINLOCK_INITIALIZER;
+template <class T>
+typename MessageFreeList<T>::Node *MessageFreeList<T>::head = 0;
+template <class T>
+unsigned MessageFreeList<T>::count = 0;
+
+#define MESSAGE_FREELIST(T)					\
+  static void *operator new(size_t size) {			\
+    return MessageFreeList<T>::alloc(size);			\
+  }								\
+  static void operator delete(void *p, size_t size) {		\
+    MessageFreeList<T>::release(p, size);			\
+  }
+
+#endif
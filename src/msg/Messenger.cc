@@ -3,6 +3,7 @@
 
 #include "include/types.h"
 #include "Messenger.h"
+#include "MessageFreeList.h"
 
 #include "msg/simple/SimpleMessenger.h"
 #include "msg/async/AsyncMessenger.h"
@@ -14,6 +15,7 @@ Messenger *Messenger::create(CephContext *cct, const string &type,
 			     entity_name_t name, string lname,
 			     uint64_t nonce, uint64_t features)
 {
+  message_freelist_enabled = cct->_conf->ms_message_freelist;
   int r = -1;
   if (type == "random")
     r = rand() % 2; // random does not include xio
@@ -672,6 +672,23 @@ public:
     }
     return NULL;
   }
+  /**
+   * Ask the Dispatchers for a buffer to read a message's data payload
+   * into. See Dispatcher::ms_get_rx_buffer.
+   *
+   * @return True if a Dispatcher filled in *bl, false otherwise.
+   */
+  bool ms_deliver_get_rx_buffer(Connection *con,
+				const ceph_msg_header &header,
+				bufferlist *bl) {
+    for (list<Dispatcher*>::iterator p = dispatchers.begin();
+	 p != dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_get_rx_buffer(con, header, bl))
+	return true;
+    }
+    return false;
+  }
   /**
    * Verify that the authorizer on a new incoming Connection is correct.
    *
@@ -172,14 +172,15 @@ static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
   }
 }
 
-AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCenter *c, PerfCounters *p)
-  : Connection(cct, m), async_msgr(m), logger(p), global_seq(0), connect_seq(0), peer_global_seq(0),
-    out_seq(0), ack_left(0), in_seq(0), state(STATE_NONE), state_after_send(0), sd(-1), port(-1),
+AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, Worker *w)
+  : Connection(cct, m), async_msgr(m), logger(w->get_perf_counter()), global_seq(0), connect_seq(0), peer_global_seq(0),
+    out_seq(0), ack_left(0), in_seq(0), recent_bytes(0), state(STATE_NONE), state_after_send(0), sd(-1), port(-1),
     write_lock("AsyncConnection::write_lock"), can_write(NOWRITE),
-    open_write(false), keepalive(false), lock("AsyncConnection::lock"), recv_buf(NULL),
+    open_write(false), outcoming_msgs(0), keepalive(false), lock("AsyncConnection::lock"), recv_buf(NULL),
     recv_max_prefetch(MIN(msgr->cct->_conf->ms_tcp_prefetch_max_size, TCP_PREFETCH_MIN_SIZE)),
-    recv_start(0), recv_end(0), got_bad_auth(false), authorizer(NULL), replacing(false),
-    is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0), net(cct), center(c)
+    recv_start(0), recv_end(0), rx_buffer_version(0), got_bad_auth(false), authorizer(NULL), replacing(false),
+    is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0), net(cct), worker(w), counted(true),
+    center(&w->center)
 {
   read_handler.reset(new C_handle_read(this));
   write_handler.reset(new C_handle_write(this));
@@ -193,6 +194,7 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCente
   recv_buf = new char[2*recv_max_prefetch];
   state_buffer = new char[4096];
   logger->inc(l_msgr_created_connections);
+  worker->num_connections.inc();
 }
 
 AsyncConnection::~AsyncConnection()
@@ -204,6 +206,39 @@ AsyncConnection::~AsyncConnection()
     delete[] recv_buf;
   if (state_buffer)
     delete[] state_buffer;
+  if (counted)
+    worker->num_connections.dec();
+}
+
+/*
+ * Called with Connection::lock held while reading the data payload into
+ * a posted rx buffer.  If the buffer was revoked (or replaced) its owner
+ * may reuse it at any time, so keep what has arrived and read the rest
+ * into a buffer of our own, as Pipe does.
+ */
+bool AsyncConnection::rx_buffer_revoked()
+{
+  map<ceph_tid_t,pair<bufferlist,int> >::iterator p =
+    rx_buffers.find(current_header.tid);
+  if (p != rx_buffers.end() && p->second.second == rx_buffer_version)
+    return false;
+
+  uint64_t data_len = le32_to_cpu(current_header.data_len);
+  uint64_t offset = data_len - msg_left;
+  ldout(async_msgr->cct, 10) << __func__ << " rx buffer v " << rx_buffer_version
+                             << " revoked at offset " << offset + state_offset << dendl;
+  if (state_offset) {
+    data.append(data_blp.get_current_ptr(), 0, state_offset);
+    offset += state_offset;
+    msg_left -= state_offset;
+    state_offset = 0;
+  }
+  data_buf.clear();
+  alloc_aligned_buffer(data_buf, data_len, le32_to_cpu(current_header.data_off));
+  data_blp = data_buf.begin();
+  data_blp.advance(offset);
+  rx_buffer_version = 0;
+  return true;
 }
 
 /* return -1 means `fd` occurs error or closed, it should be closed
@@ -211,6 +246,7 @@ AsyncConnection::~AsyncConnection()
 int AsyncConnection::read_bulk(int fd, char *buf, int len)
 {
   int nread = ::read(fd, buf, len);
+  logger->inc(l_msgr_recv_syscalls);
   if (nread == -1) {
     if (errno == EAGAIN || errno == EINTR) {
       nread = 0;
@@ -233,6 +269,7 @@ int AsyncConnection::do_sendmsg(struct msghdr &msg, int len, bool more)
 {
   while (len > 0) {
     int r = ::sendmsg(sd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+    logger->inc(l_msgr_send_syscalls);
 
     if (r == 0) {
       ldout(async_msgr->cct, 10) << __func__ << " sendmsg got r==0!" << dendl;
@@ -290,8 +327,13 @@ int AsyncConnection::_try_send(bufferlist &send_bl, bool send)
     }
   }
 
+  if (outcoming_msgs) {
+    logger->inc(l_msgr_send_batch, outcoming_msgs);
+    outcoming_msgs = 0;
+  }
+
   uint64_t sent_bytes = 0;
-  list<bufferptr>::const_iterator pb = outcoming_bl.buffers().begin();
+  bufferlist::buffers_t::const_iterator pb = outcoming_bl.buffers().begin();
   uint64_t left_pbrs = outcoming_bl.buffers().size();
   while (left_pbrs) {
     struct msghdr msg;
@@ -435,6 +477,7 @@ void AsyncConnection::process()
 {
   int r = 0;
   int prev_state = state;
+  unsigned recv_msgs = 0;  // messages dispatched during this event
   Mutex::Locker l(lock);
   do {
     ldout(async_msgr->cct, 20) << __func__ << " state is " << get_state_name(state)
@@ -585,6 +628,7 @@ void AsyncConnection::process()
 
           // Reset state
           data_buf.clear();
+          rx_buffer_version = 0;
           front.clear();
           middle.clear();
           data.clear();
@@ -695,21 +739,29 @@ void AsyncConnection::process()
           int data_off = le32_to_cpu(current_header.data_off);
           if (data_len) {
             // get a buffer
+            Connection::lock.Lock();
             map<ceph_tid_t,pair<bufferlist,int> >::iterator p = rx_buffers.find(current_header.tid);
             if (p != rx_buffers.end()) {
               ldout(async_msgr->cct,10) << __func__ << " seleting rx buffer v " << p->second.second
                                   << " at offset " << data_off
                                   << " len " << p->second.first.length() << dendl;
               data_buf = p->second.first;
-              // make sure it's big enough
-              if (data_buf.length() < data_len)
-                data_buf.push_back(buffer::create(data_len - data_buf.length()));
-              data_blp = data_buf.begin();
-            } else {
-              ldout(async_msgr->cct,20) << __func__ << " allocating new rx buffer at offset " << data_off << dendl;
-              alloc_aligned_buffer(data_buf, data_len, data_off);
-              data_blp = data_buf.begin();
+              rx_buffer_version = p->second.second;
+            }
+            Connection::lock.Unlock();
+            if (!rx_buffer_version) {
+              if (async_msgr->ms_deliver_get_rx_buffer(this, current_header, &data_buf)) {
+                ldout(async_msgr->cct,20) << __func__ << " using dispatcher rx buffer len "
+                                          << data_buf.length() << dendl;
+              } else {
+                ldout(async_msgr->cct,20) << __func__ << " allocating new rx buffer at offset " << data_off << dendl;
+                alloc_aligned_buffer(data_buf, data_len, data_off);
+              }
             }
+            // make sure it's big enough
+            if (data_buf.length() < data_len)
+              data_buf.push_back(buffer::create(data_len - data_buf.length()));
+            data_blp = data_buf.begin();
           }
 
           msg_left = data_len;
@@ -720,9 +772,20 @@ void AsyncConnection::process()
       case STATE_OPEN_MESSAGE_READ_DATA:
         {
           while (msg_left > 0) {
+            // a posted buffer is only written while it stays posted
+            bool posted = rx_buffer_version;
+            if (posted) {
+              Connection::lock.Lock();
+              if (rx_buffer_revoked()) {
+                Connection::lock.Unlock();
+                continue;
+              }
+            }
             bufferptr bp = data_blp.get_current_ptr();
             uint64_t read = MIN(bp.length(), msg_left);
             r = read_until(read, bp.c_str());
+            if (posted)
+              Connection::lock.Unlock();
             if (r < 0) {
               ldout(async_msgr->cct, 1) << __func__ << " read data error " << dendl;
               goto fail;
@@ -858,7 +921,17 @@ void AsyncConnection::process()
           }
           logger->inc(l_msgr_recv_messages);
           logger->inc(l_msgr_recv_bytes, message_size + sizeof(ceph_msg_header) + sizeof(ceph_msg_footer));
-
+          recent_bytes.add(message_size + sizeof(ceph_msg_header) + sizeof(ceph_msg_footer));
+
+          // keep draining whatever has been read ahead, but don't let one
+          // busy connection starve the others sharing this event thread
+          ++recv_msgs;
+          if (async_msgr->cct->_conf->ms_async_recv_batch_messages > 0 &&
+              recv_msgs >= (unsigned)async_msgr->cct->_conf->ms_async_recv_batch_messages) {
+            logger->inc(l_msgr_recv_batch, recv_msgs);
+            center->dispatch_event_external(read_handler);
+            return ;
+          }
           break;
         }
 
@@ -899,6 +972,8 @@ void AsyncConnection::process()
     }
   } while (prev_state != state);
 
+  if (recv_msgs)
+    logger->inc(l_msgr_recv_batch, recv_msgs);
   return;
 
  fail:
@@ -1760,6 +1835,7 @@ int AsyncConnection::handle_connect_msg(ceph_msg_connect &connect, bufferlist &a
 
     // Clean up output buffer
     existing->outcoming_bl.clear();
+    existing->outcoming_msgs = 0;
     existing->requeue_sent();
 
     swap(existing->sd, sd);
@@ -2034,6 +2110,7 @@ void AsyncConnection::discard_out_queue()
     }
   out_q.clear();
   outcoming_bl.clear();
+  outcoming_msgs = 0;
 }
 
 int AsyncConnection::randomize_out_seq()
@@ -2085,6 +2162,7 @@ void AsyncConnection::fault()
   replacing = false;
   is_reset_from_peer = false;
   outcoming_bl.clear();
+  outcoming_msgs = 0;
   if (!once_ready && !is_queued() &&
       state >=STATE_ACCEPTING && state <= STATE_ACCEPTING_WAIT_CONNECT_MSG_AUTH) {
     ldout(async_msgr->cct, 0) << __func__ << " with nothing to send and in the half "
@@ -2166,6 +2244,10 @@ void AsyncConnection::_stop()
 
   discard_out_queue();
   async_msgr->unregister_conn(this);
+  if (counted) {
+    worker->num_connections.dec();
+    counted = false;
+  }
 
   state = STATE_CLOSED;
   open_write = false;
@@ -2203,7 +2285,9 @@ void AsyncConnection::prepare_send_message(uint64_t features, Message *m, buffer
   bl.append(m->get_data());
 }
 
-int AsyncConnection::write_message(Message *m, bufferlist& bl)
+// if "more" is true the encoded message is only appended to outcoming_bl,
+// the caller is expected to flush it (with the next messages) later
+int AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
 {
   assert(can_write == CANWRITE);
   m->set_seq(out_seq.inc());
@@ -2282,12 +2366,16 @@ int AsyncConnection::write_message(Message *m, bufferlist& bl)
   }
 
   logger->inc(l_msgr_send_bytes, complete_bl.length());
+  recent_bytes.add(complete_bl.length());
   ldout(async_msgr->cct, 20) << __func__ << " sending " << m->get_seq()
                              << " " << m << dendl;
-  int rc = _try_send(complete_bl);
+  ++outcoming_msgs;
+  int rc = _try_send(complete_bl, !more);
   if (rc < 0) {
     ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
                               << cpp_strerror(errno) << dendl;
+  } else if (more) {
+    ldout(async_msgr->cct, 10) << __func__ << " sending " << m << " batched." << dendl;
   } else if (rc == 0) {
     ldout(async_msgr->cct, 10) << __func__ << " sending " << m << " done." << dendl;
   } else {
@@ -2323,6 +2411,44 @@ void AsyncConnection::send_keepalive()
   }
 }
 
+/*
+ * Move the socket to another event center.  Only done from the current
+ * center's thread and only while the connection is open with nothing
+ * buffered in either direction and no time event pending, so no handler
+ * is halfway through a message or left armed on the old center.
+ */
+bool AsyncConnection::migrate(Worker *w)
+{
+  Mutex::Locker l(lock);
+  Mutex::Locker wl(write_lock);
+  if (w == worker)
+    return true;
+  if (state != STATE_OPEN || sd < 0 || is_queued() || open_write ||
+      recv_end > recv_start || !register_time_events.empty() ||
+      center->get_owner() != pthread_self()) {
+    ldout(async_msgr->cct, 10) << __func__ << " busy, state " << get_state_name(state) << dendl;
+    return false;
+  }
+
+  ldout(async_msgr->cct, 10) << __func__ << " moving from worker " << worker->get_id()
+                             << " to " << w->get_id() << dendl;
+  center->delete_file_event(sd, EVENT_READABLE);
+  logger->dec(l_msgr_active_connections);
+  w->get_perf_counter()->inc(l_msgr_active_connections);
+  w->get_perf_counter()->inc(l_msgr_migrations);
+  if (counted) {
+    worker->num_connections.dec();
+    w->num_connections.inc();
+  }
+  worker = w;
+  center = &w->center;
+  logger = w->get_perf_counter();
+  center->create_file_event(sd, EVENT_READABLE, read_handler);
+  // pick up whatever arrived while neither center was watching
+  center->dispatch_event_external(read_handler);
+  return true;
+}
+
 void AsyncConnection::mark_down()
 {
   ldout(async_msgr->cct, 10) << __func__ << " started." << dendl;
@@ -2369,6 +2495,12 @@ void AsyncConnection::handle_write()
       keepalive = false;
     }
 
+    // Cork small messages: keep appending to outcoming_bl while more
+    // messages (or an ack) are waiting and the batch is within budget, so
+    // that a burst of small messages goes out in a single sendmsg.
+    const md_config_t *conf = async_msgr->cct->_conf;
+    utime_t deadline;
+    unsigned batched = 0;
     while (1) {
       bufferlist data;
       Message *m = _get_next_outgoing(&data);
@@ -2379,7 +2511,20 @@ void AsyncConnection::handle_write()
       if (!data.length())
         prepare_send_message(get_features(), m, data);
 
-      r = write_message(m, data);
+      if (!batched && conf->ms_async_send_batch_us > 0) {
+        deadline = ceph_clock_now(async_msgr->cct);
+        deadline += (double)conf->ms_async_send_batch_us / 1000000;
+      }
+      ++batched;
+      bool more = (!out_q.empty() || ack_left.read()) &&
+                  batched < (unsigned)conf->ms_async_send_batch_messages &&
+                  outcoming_bl.length() + data.length() < conf->ms_async_send_batch_bytes &&
+                  outcoming_bl.buffers().size() + data.buffers().size() + 3 < IOV_MAX &&
+                  (deadline == utime_t() || ceph_clock_now(async_msgr->cct) < deadline);
+      if (!more)
+        batched = 0;
+
+      r = write_message(m, data, more);
       if (r < 0) {
         ldout(async_msgr->cct, 1) << __func__ << " send msg failed" << dendl;
         write_lock.Unlock();
@@ -34,6 +34,7 @@ using namespace std;
 #include "net_handler.h"
 
 class AsyncMessenger;
+class Worker;
 
 /*
  * AsyncConnection maintains a logic session between two endpoints. In other
@@ -56,6 +57,7 @@ class AsyncConnection : public Connection {
   int _send(Message *m);
   void prepare_send_message(uint64_t features, Message *m, bufferlist &bl);
   int read_until(uint64_t needed, char *p);
+  bool rx_buffer_revoked();
   int _process_connection();
   void _connect();
   void _stop();
@@ -69,7 +71,7 @@ class AsyncConnection : public Connection {
   int randomize_out_seq();
   void handle_ack(uint64_t seq);
   void _send_keepalive_or_ack(bool ack=false, utime_t *t=NULL);
-  int write_message(Message *m, bufferlist& bl);
+  int write_message(Message *m, bufferlist& bl, bool more=false);
   int _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
                     bufferlist authorizer_reply) {
     bufferlist reply_bl;
@@ -114,7 +116,7 @@ class AsyncConnection : public Connection {
   }
 
  public:
-  AsyncConnection(CephContext *cct, AsyncMessenger *m, EventCenter *c, PerfCounters *p);
+  AsyncConnection(CephContext *cct, AsyncMessenger *m, Worker *w);
   ~AsyncConnection();
 
   ostream& _conn_prefix(std::ostream *_dout);
@@ -221,6 +223,7 @@ class AsyncConnection : public Connection {
   __u32 connect_seq, peer_global_seq;
   atomic_t out_seq;
   atomic_t ack_left, in_seq;
+  atomic64_t recent_bytes;  // traffic since the last worker rebalance
   int state;
   int state_after_send;
   int sd;
@@ -238,6 +241,7 @@ class AsyncConnection : public Connection {
   list<Message*> sent; // the first bufferlist need to inject seq
   list<Message*> local_messages;    // local deliver
   bufferlist outcoming_bl;
+  unsigned outcoming_msgs;  // messages appended to outcoming_bl since last sendmsg
   bool keepalive;
 
   Mutex lock;
@@ -265,6 +269,7 @@ class AsyncConnection : public Connection {
   ceph_msg_header current_header;
   bufferlist data_buf;
   bufferlist::iterator data_blp;
+  int rx_buffer_version;  ///< of the posted rx buffer in data_buf, 0 if it is ours
   bufferlist front, middle, data;
   ceph_msg_connect connect_msg;
   // Connecting state
@@ -288,6 +293,8 @@ class AsyncConnection : public Connection {
   // used only by "read_until"
   uint64_t state_offset;
   NetHandler net;
+  Worker *worker;
+  bool counted;      // included in worker's live connection count
   EventCenter *center;
   ceph::shared_ptr<AuthSessionHandler> session_security;
 
@@ -316,6 +323,15 @@ class AsyncConnection : public Connection {
   PerfCounters *get_perf_counter() {
     return logger;
   }
+  EventCenter *get_center() {
+    return center;
+  }
+  uint64_t take_recent_bytes() {
+    uint64_t b = recent_bytes.read();
+    recent_bytes.sub(b);
+    return b;
+  }
+  bool migrate(Worker *w);
 }; /* AsyncConnection */
 
 typedef boost::intrusive_ptr<AsyncConnection> AsyncConnectionRef;
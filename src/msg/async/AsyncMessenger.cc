@@ -27,6 +27,8 @@
 #include "common/config.h"
 #include "common/Timer.h"
 #include "common/errno.h"
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
 #include "auth/Crypto.h"
 #include "include/Spinlock.h"
 
@@ -298,6 +300,9 @@ void *Worker::entry()
   while (!done) {
     ldout(cct, 20) << __func__ << " calling event process" << dendl;
 
+    if (cct->_conf->ms_async_busy_poll_us > 0 && busy_poll() > 0)
+      continue;
+
     int r = center.process_events(EventMaxWaitUs);
     if (r < 0) {
       ldout(cct, 20) << __func__ << " process events failed: "
@@ -309,14 +314,100 @@ void *Worker::entry()
   return 0;
 }
 
+/*
+ * Poll the event center without blocking for up to spin_us, unless this
+ * worker has already spent ms_async_busy_poll_budget of the current second
+ * spinning.  The window doubles after a poll that found events and halves
+ * after one that didn't, so an idle worker soon goes back to sleeping in
+ * the driver.  Returns the number of events processed.
+ */
+int Worker::busy_poll()
+{
+  int max_us = cct->_conf->ms_async_busy_poll_us;
+  utime_t start = ceph_clock_now(cct);
+  if (start - spin_window_start >= utime_t(1, 0)) {
+    spin_window_start = start;
+    spin_window_used = utime_t();
+  }
+  if ((double)spin_window_used >= cct->_conf->ms_async_busy_poll_budget)
+    return 0;
+
+  int min_us = MAX(max_us / 16, 1);
+  spin_us = MIN(MAX(spin_us, min_us), max_us);
+  utime_t limit = start;
+  limit += (double)spin_us / 1000000;
+  utime_t now;
+  int r;
+  do {
+    r = center.process_events(0);
+    now = ceph_clock_now(cct);
+  } while (r == 0 && !done && now < limit);
+
+  utime_t spent = now - start;
+  spin_window_used += spent;
+  perf_logger->tinc(l_msgr_poll_spin_time, spent);
+  if (r > 0) {
+    perf_logger->inc(l_msgr_poll_spin_hits);
+    spin_us = MIN(spin_us * 2, max_us);
+  } else {
+    perf_logger->inc(l_msgr_poll_spin_misses);
+    spin_us = MAX(spin_us / 2, min_us);
+  }
+  return r;
+}
+
 /*******************
  * WorkerPool
  *******************/
 const string WorkerPool::name = "AsyncMessenger::WorkerPool";
 
+// read the cpus of a NUMA node from sysfs, e.g. "0-7,16-23"
+static int get_numa_node_cpus(int node, vector<int> *cpus)
+{
+  char fn[64];
+  snprintf(fn, sizeof(fn), "/sys/devices/system/node/node%d/cpulist", node);
+  std::ifstream in(fn);
+  string line;
+  if (!getline(in, line))
+    return -ENOENT;
+
+  vector<string> ranges;
+  get_str_vec(line, ",", ranges);
+  for (vector<string>::iterator it = ranges.begin(); it != ranges.end(); ++it) {
+    string err;
+    size_t dash = it->find('-');
+    int first = strict_strtol(it->substr(0, dash).c_str(), 10, &err);
+    int last = first;
+    if (err == "" && dash != string::npos)
+      last = strict_strtol(it->substr(dash + 1).c_str(), 10, &err);
+    if (err != "")
+      return -EINVAL;
+    for (int i = first; i <= last; ++i)
+      cpus->push_back(i);
+  }
+  return cpus->empty() ? -EINVAL : 0;
+}
+
+class WorkerPoolSocketHook : public AdminSocketHook {
+  WorkerPool *pool;
+public:
+  explicit WorkerPoolSocketHook(WorkerPool *p) : pool(p) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    Formatter *f = Formatter::create(format, "json-pretty", "json-pretty");
+    pool->dump(f);
+    stringstream ss;
+    f->flush(ss);
+    delete f;
+    out.append(ss);
+    return true;
+  }
+};
+
 WorkerPool::WorkerPool(CephContext *c): cct(c), seq(0), started(false),
                                         barrier_lock("WorkerPool::WorkerPool::barrier_lock"),
-                                        barrier_count(0)
+                                        barrier_count(0), lock("WorkerPool::lock"),
+                                        asok_hook(NULL)
 {
   assert(cct->_conf->ms_async_op_threads > 0);
   for (int i = 0; i < cct->_conf->ms_async_op_threads; ++i) {
@@ -334,11 +425,31 @@ WorkerPool::WorkerPool(CephContext *c): cct(c), seq(0), started(false),
     else
       lderr(cct) << __func__ << " failed to parse " << *it << " in " << cct->_conf->ms_async_affinity_cores << dendl;
   }
+  if (coreids.empty() && cct->_conf->ms_async_affinity_numa_node >= 0) {
+    int r = get_numa_node_cpus(cct->_conf->ms_async_affinity_numa_node, &coreids);
+    if (r < 0)
+      lderr(cct) << __func__ << " failed to get cpus of numa node "
+                 << cct->_conf->ms_async_affinity_numa_node << ": " << cpp_strerror(r) << dendl;
+  }
 
+  asok_hook = new WorkerPoolSocketHook(this);
+  int r = cct->get_admin_socket()->register_command(
+    "dump_messenger_workers", "dump_messenger_workers", asok_hook,
+    "dump load and placement of async messenger worker threads");
+  if (r < 0) {
+    ldout(cct, 1) << __func__ << " not registering dump_messenger_workers: "
+                  << cpp_strerror(r) << dendl;
+    delete asok_hook;
+    asok_hook = NULL;
+  }
 }
 
 WorkerPool::~WorkerPool()
 {
+  if (asok_hook) {
+    cct->get_admin_socket()->unregister_command("dump_messenger_workers");
+    delete asok_hook;
+  }
   for (uint64_t i = 0; i < workers.size(); ++i) {
     if (workers[i]->is_started()) {
       workers[i]->stop();
@@ -358,6 +469,83 @@ void WorkerPool::start()
   }
 }
 
+void WorkerPool::_update_load(utime_t now)
+{
+  assert(lock.is_locked());
+  for (vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+    Worker *w = *it;
+    double elapsed = now - w->load_stamp;
+    if (elapsed < 1.0)
+      continue;
+    PerfCounters *p = w->get_perf_counter();
+    uint64_t bytes = p->get(l_msgr_recv_bytes) + p->get(l_msgr_send_bytes);
+    double rate = bytes > w->load_bytes ? (bytes - w->load_bytes) / elapsed : 0;
+    w->load_rate = (w->load_rate + rate) / 2;
+    w->load_bytes = bytes;
+    w->load_stamp = now;
+  }
+}
+
+/*
+ * Pick the worker with the smallest share of recent traffic plus share of
+ * live connections.  A connection counts against its worker from
+ * construction until it is stopped, so a burst of new connections is
+ * still spread out.  Ties go round robin, which is what an idle pool does.
+ */
+Worker *WorkerPool::get_worker()
+{
+  Mutex::Locker l(lock);
+  _update_load(ceph_clock_now(cct));
+
+  double total_rate = 0, total_conns = 0;
+  vector<double> conns(workers.size());
+  for (size_t i = 0; i < workers.size(); ++i) {
+    conns[i] = workers[i]->num_connections.read();
+    total_conns += conns[i];
+    total_rate += workers[i]->load_rate;
+  }
+
+  size_t start = seq++ % workers.size();
+  size_t best = start;
+  double best_score = 0;
+  for (size_t n = 0; n < workers.size(); ++n) {
+    size_t i = (start + n) % workers.size();
+    double score = 0;
+    if (total_rate > 0)
+      score += workers[i]->load_rate / total_rate;
+    if (total_conns > 0)
+      score += conns[i] / total_conns;
+    if (n == 0 || score < best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return workers[best];
+}
+
+void WorkerPool::dump(Formatter *f)
+{
+  Mutex::Locker l(lock);
+  _update_load(ceph_clock_now(cct));
+  f->open_array_section("workers");
+  for (vector<Worker*>::iterator it = workers.begin(); it != workers.end(); ++it) {
+    Worker *w = *it;
+    PerfCounters *p = w->get_perf_counter();
+    f->open_object_section("worker");
+    f->dump_int("id", w->get_id());
+    f->dump_int("cpu", cct->_conf->ms_async_set_affinity ? get_cpuid(w->get_id()) : -1);
+    f->dump_unsigned("connections", w->num_connections.read());
+    f->dump_unsigned("migrations", p->get(l_msgr_migrations));
+    f->dump_unsigned("recv_messages", p->get(l_msgr_recv_messages));
+    f->dump_unsigned("send_messages", p->get(l_msgr_send_messages));
+    f->dump_unsigned("recv_bytes", p->get(l_msgr_recv_bytes));
+    f->dump_unsigned("send_bytes", p->get(l_msgr_send_bytes));
+    f->dump_float("bytes_per_sec", w->load_rate);
+    f->close_section();
+  }
+  f->close_section();
+}
+
 void WorkerPool::barrier()
 {
   ldout(cct, 10) << __func__ << " started." << dendl;
@@ -380,6 +568,27 @@ void WorkerPool::barrier()
  * AsyncMessenger
  */
 
+class C_rebalance_workers : public EventCallback {
+  AsyncMessenger *msgr;
+
+ public:
+  C_rebalance_workers(AsyncMessenger *m): msgr(m) {}
+  void do_request(int id) {
+    msgr->rebalance_workers();
+  }
+};
+
+class C_migrate_connection : public EventCallback {
+  AsyncConnectionRef conn;
+  Worker *to;
+
+ public:
+  C_migrate_connection(AsyncConnectionRef c, Worker *w): conn(c), to(w) {}
+  void do_request(int id) {
+    conn->migrate(to);
+  }
+};
+
 AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
                                string mname, uint64_t _nonce, uint64_t features)
   : SimplePolicyMessenger(cct, name,mname, _nonce),
@@ -387,12 +596,13 @@ AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
     lock("AsyncMessenger::lock"),
     nonce(_nonce), need_addr(true), listen_sd(-1), did_bind(false),
     global_seq(0), deleted_lock("AsyncMessenger::deleted_lock"),
-    cluster_protocol(0), stopped(true)
+    cluster_protocol(0), stopped(true), rebalance_center(NULL), rebalance_event(0)
 {
   ceph_spin_init(&global_seq_lock);
+  rebalance_handler.reset(new C_rebalance_workers(this));
   cct->lookup_or_create_singleton_object<WorkerPool>(pool, WorkerPool::name);
   Worker *w = pool->get_worker();
-  local_connection = new AsyncConnection(cct, this, &w->center, w->get_perf_counter());
+  local_connection = new AsyncConnection(cct, this, w);
   local_features = features;
   init_local_connection();
 }
@@ -414,6 +624,12 @@ void AsyncMessenger::ready()
   Mutex::Locker l(lock);
   Worker *w = pool->get_worker();
   processor.start(w);
+
+  if (cct->_conf->ms_async_rebalance_interval > 0 && !rebalance_center) {
+    rebalance_center = &pool->get_worker()->center;
+    rebalance_event = rebalance_center->create_time_event(
+      cct->_conf->ms_async_rebalance_interval * 1000000, rebalance_handler);
+  }
 }
 
 int AsyncMessenger::shutdown()
@@ -424,6 +640,13 @@ int AsyncMessenger::shutdown()
   processor.stop();
   mark_down_all();
   local_connection->set_priv(NULL);
+  lock.Lock();
+  if (rebalance_center) {
+    rebalance_center->delete_time_event(rebalance_event);
+    rebalance_center = NULL;
+  }
+  lock.Unlock();
+  // also waits out a rebalance round that was already running
   pool->barrier();
   lock.Lock();
   stop_cond.Signal();
@@ -519,7 +742,7 @@ AsyncConnectionRef AsyncMessenger::add_accept(int sd)
 {
   lock.Lock();
   Worker *w = pool->get_worker();
-  AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center, w->get_perf_counter());
+  AsyncConnectionRef conn = new AsyncConnection(cct, this, w);
   conn->accept(sd);
   accepting_conns.insert(conn);
   lock.Unlock();
@@ -536,7 +759,7 @@ AsyncConnectionRef AsyncMessenger::create_connect(const entity_addr_t& addr, int
 
   // create connection
   Worker *w = pool->get_worker();
-  AsyncConnectionRef conn = new AsyncConnection(cct, this, &w->center, w->get_perf_counter());
+  AsyncConnectionRef conn = new AsyncConnection(cct, this, w);
   conn->connect(addr, type);
   assert(!conns.count(addr));
   conns[addr] = conn;
@@ -650,6 +873,81 @@ int AsyncMessenger::send_keepalive(Connection *con)
   return 0;
 }
 
+/*
+ * Only connections this messenger owns are moved, and load is measured
+ * as their traffic since the last round.  The connection moved must
+ * carry less than the difference between the two workers, so the move
+ * narrows the gap instead of just swapping the two.
+ */
+bool AsyncMessenger::_rebalance_workers()
+{
+  assert(lock.is_locked());
+  const vector<Worker*> &workers = pool->get_workers();
+  map<EventCenter*, uint64_t> load;
+  for (vector<Worker*>::const_iterator it = workers.begin(); it != workers.end(); ++it)
+    load[&(*it)->center] = 0;
+  list<pair<uint64_t, AsyncConnectionRef> > candidates;
+  for (ceph::unordered_map<entity_addr_t, AsyncConnectionRef>::iterator it = conns.begin();
+       it != conns.end(); ++it) {
+    uint64_t bytes = it->second->take_recent_bytes();
+    load[it->second->get_center()] += bytes;
+    candidates.push_back(make_pair(bytes, it->second));
+  }
+
+  map<EventCenter*, uint64_t>::iterator busiest = load.begin(), idlest = load.begin();
+  for (map<EventCenter*, uint64_t>::iterator it = load.begin(); it != load.end(); ++it) {
+    if (it->second > busiest->second)
+      busiest = it;
+    if (it->second < idlest->second)
+      idlest = it;
+  }
+
+  if (busiest != idlest &&
+      busiest->second > cct->_conf->ms_async_rebalance_threshold * MAX(idlest->second, 1)) {
+    uint64_t gap = busiest->second - idlest->second;
+    AsyncConnectionRef conn;
+    uint64_t conn_bytes = 0;
+    for (list<pair<uint64_t, AsyncConnectionRef> >::iterator it = candidates.begin();
+         it != candidates.end(); ++it) {
+      if (it->second->get_center() == busiest->first &&
+          it->first > conn_bytes && it->first < gap) {
+        conn = it->second;
+        conn_bytes = it->first;
+      }
+    }
+    Worker *to = NULL;
+    for (vector<Worker*>::const_iterator it = workers.begin(); it != workers.end(); ++it)
+      if (&(*it)->center == idlest->first)
+        to = *it;
+    if (conn && to) {
+      ldout(cct, 10) << __func__ << " moving " << conn << " (" << conn_bytes
+                     << " bytes) to worker " << to->get_id() << ", busiest worker "
+                     << busiest->second << " bytes, idlest " << idlest->second << dendl;
+      busiest->first->dispatch_event_external(
+        EventCallbackRef(new C_migrate_connection(conn, to)));
+      return true;
+    }
+  }
+  return false;
+}
+
+void AsyncMessenger::rebalance_workers()
+{
+  Mutex::Locker l(lock);
+  if (!rebalance_center)
+    return;
+
+  _rebalance_workers();
+  rebalance_event = rebalance_center->create_time_event(
+    cct->_conf->ms_async_rebalance_interval * 1000000, rebalance_handler);
+}
+
+bool AsyncMessenger::rebalance_once()
+{
+  Mutex::Locker l(lock);
+  return _rebalance_workers();
+}
+
 void AsyncMessenger::mark_down_all()
 {
   ldout(cct,1) << __func__ << " " << dendl;
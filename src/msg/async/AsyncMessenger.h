@@ -40,6 +40,7 @@ using namespace std;
 
 class AsyncMessenger;
 class WorkerPool;
+class AdminSocketHook;
 
 enum {
   l_msgr_first = 94000,
@@ -49,6 +50,14 @@ enum {
   l_msgr_send_bytes,
   l_msgr_created_connections,
   l_msgr_active_connections,
+  l_msgr_send_syscalls,
+  l_msgr_recv_syscalls,
+  l_msgr_send_batch,
+  l_msgr_recv_batch,
+  l_msgr_poll_spin_time,
+  l_msgr_poll_spin_hits,
+  l_msgr_poll_spin_misses,
+  l_msgr_migrations,
   l_msgr_last,
 };
 
@@ -61,11 +70,24 @@ class Worker : public Thread {
   bool done;
   int id;
   PerfCounters *perf_logger;
+  int spin_us;               // current busy poll window
+  utime_t spin_window_start; // busy poll CPU budget is accounted per second
+  utime_t spin_window_used;
+
+  int busy_poll();
 
  public:
   EventCenter center;
+  // recent load, maintained by WorkerPool under its lock
+  uint64_t load_bytes;   // traffic counters at load_stamp
+  utime_t load_stamp;
+  double load_rate;      // bytes per second, decaying average
+  atomic_t num_connections; // live AsyncConnections, kept by AsyncConnection
+
   Worker(CephContext *c, WorkerPool *p, int i)
-    : cct(c), pool(p), done(false), id(i), perf_logger(NULL), center(c) {
+    : cct(c), pool(p), done(false), id(i), perf_logger(NULL),
+      spin_us(c->_conf->ms_async_busy_poll_us), center(c),
+      load_bytes(0), load_rate(0), num_connections(0) {
     center.init(InitEventNumber);
     char name[128];
     sprintf(name, "AsyncMessenger::Worker-%d", id);
@@ -78,6 +100,14 @@ class Worker : public Thread {
     plb.add_u64_counter(l_msgr_send_bytes, "msgr_send_bytes", "Network received bytes");
     plb.add_u64_counter(l_msgr_created_connections, "msgr_active_connections", "Active connection number");
     plb.add_u64_counter(l_msgr_active_connections, "msgr_created_connections", "Created connection number");
+    plb.add_u64_counter(l_msgr_send_syscalls, "msgr_send_syscalls", "Network sendmsg calls");
+    plb.add_u64_counter(l_msgr_recv_syscalls, "msgr_recv_syscalls", "Network read calls");
+    plb.add_u64_avg(l_msgr_send_batch, "msgr_send_batch", "Messages sent per sendmsg batch");
+    plb.add_u64_avg(l_msgr_recv_batch, "msgr_recv_batch", "Messages received per read event");
+    plb.add_time(l_msgr_poll_spin_time, "msgr_poll_spin_time", "Time spent busy polling");
+    plb.add_u64_counter(l_msgr_poll_spin_hits, "msgr_poll_spin_hits", "Busy polls that found events");
+    plb.add_u64_counter(l_msgr_poll_spin_misses, "msgr_poll_spin_misses", "Busy polls that timed out and blocked");
+    plb.add_u64_counter(l_msgr_migrations, "msgr_migrations", "Connections moved to this worker by rebalancing");
 
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
@@ -91,6 +121,7 @@ class Worker : public Thread {
   void *entry();
   void stop();
   PerfCounters *get_perf_counter() { return perf_logger; }
+  int get_id() const { return id; }
 };
 
 /**
@@ -126,6 +157,10 @@ class WorkerPool: CephContext::AssociatedSingletonObject {
   Mutex barrier_lock;
   Cond barrier_cond;
   atomic_t barrier_count;
+  Mutex lock;  // protects seq and the workers' load
+  AdminSocketHook *asok_hook;
+
+  void _update_load(utime_t now);
 
   class C_barrier : public EventCallback {
     WorkerPool *pool;
@@ -142,8 +177,9 @@ class WorkerPool: CephContext::AssociatedSingletonObject {
   WorkerPool(CephContext *c);
   virtual ~WorkerPool();
   void start();
-  Worker *get_worker() {
-    return workers[(seq++)%workers.size()];
+  Worker *get_worker();
+  const vector<Worker*>& get_workers() const {
+    return workers;
   }
   int get_cpuid(int id) {
     if (coreids.empty())
@@ -151,6 +187,7 @@ class WorkerPool: CephContext::AssociatedSingletonObject {
     return coreids[id % coreids.size()];
   }
   void barrier();
+  void dump(Formatter *f);
   // uniq name for CephContext to distinguish differnt object
   static const string name;
 };
@@ -251,7 +288,7 @@ public:
   Connection *create_anon_connection() {
     Mutex::Locker l(lock);
     Worker *w = pool->get_worker();
-    return new AsyncConnection(cct, this, &w->center, w->get_perf_counter());
+    return new AsyncConnection(cct, this, w);
   }
 
   /**
@@ -374,6 +411,14 @@ private:
   Cond  stop_cond;
   bool stopped;
 
+  /// worker running the periodic rebalance, NULL when it isn't scheduled
+  EventCenter *rebalance_center;
+  uint64_t rebalance_event;
+  EventCallbackRef rebalance_handler;
+
+  /// pick a connection to move and queue the move, with lock held
+  bool _rebalance_workers();
+
   AsyncConnectionRef _lookup_conn(const entity_addr_t& k) {
     assert(lock.is_locked());
     ceph::unordered_map<entity_addr_t, AsyncConnectionRef>::iterator p = conns.find(k);
@@ -496,6 +541,19 @@ public:
     Mutex::Locker l(deleted_lock);
     deleted_conns.insert(conn);
   }
+
+  /**
+   * Move a connection from the worker whose connections carried the most
+   * traffic since the last round to the one that carried the least, and
+   * schedule the next round.
+   */
+  void rebalance_workers();
+  /**
+   * Run one round of rebalance_workers now, without scheduling another.
+   *
+   * @return true if a connection move was queued
+   */
+  bool rebalance_once();
   /**
    * @} // AsyncMessenger Internals
    */
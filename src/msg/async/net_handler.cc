@@ -90,6 +90,16 @@ void NetHandler::set_socket_options(int sd)
       ldout(cct, 0) << "couldn't set SO_RCVBUF to " << size << ": " << cpp_strerror(r) << dendl;
     }
   }
+#ifdef SO_BUSY_POLL
+  if (cct->_conf->ms_tcp_busy_poll) {
+    int usec = cct->_conf->ms_tcp_busy_poll;
+    int r = ::setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, (void*)&usec, sizeof(usec));
+    if (r < 0)  {
+      r = -errno;
+      ldout(cct, 0) << "couldn't set SO_BUSY_POLL to " << usec << ": " << cpp_strerror(r) << dendl;
+    }
+  }
+#endif
 
   // block ESIGPIPE
 #ifdef CEPH_USE_SO_NOSIGPIPE
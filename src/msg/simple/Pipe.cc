@@ -2000,7 +2000,16 @@ int Pipe::read_message(Message **pm, AuthSessionHandler* auth_handler)
     bufferlist newbuf, rxbuf;
     bufferlist::iterator blp;
     int rxbuf_version = 0;
-	
+    bool in_newbuf = false;
+
+    if (msgr->ms_deliver_get_rx_buffer(connection_state.get(), header,
+				       &newbuf)) {
+      ldout(msgr->cct,20) << "reader using dispatcher rx buffer len "
+			  << newbuf.length() << dendl;
+      if (newbuf.length() < data_len)
+	newbuf.push_back(buffer::create(data_len - newbuf.length()));
+    }
+
     while (left > 0) {
       // wait for data
       if (tcp_read_wait() < 0)
@@ -2021,13 +2030,17 @@ int Pipe::read_message(Message **pm, AuthSessionHandler* auth_handler)
 	    rxbuf.push_back(buffer::create(data_len - rxbuf.length()));
 	  blp = p->second.first.begin();
 	  blp.advance(offset);
+	  in_newbuf = false;
 	}
       } else {
 	if (!newbuf.length()) {
 	  ldout(msgr->cct,20) << "reader allocating new rx buffer at offset " << offset << dendl;
 	  alloc_aligned_buffer(newbuf, data_len, data_off);
+	}
+	if (!in_newbuf) {
 	  blp = newbuf.begin();
 	  blp.advance(offset);
+	  in_newbuf = true;
 	}
       }
       bufferptr bp = blp.get_current_ptr();
@@ -2282,7 +2295,7 @@ int Pipe::write_message(const ceph_msg_header& header, const ceph_msg_footer& fo
   }
 
   // payload (front+data)
-  list<bufferptr>::const_iterator pb = blist.buffers().begin();
+  bufferlist::buffers_t::const_iterator pb = blist.buffers().begin();
   int b_off = 0;  // carry-over buffer offset, if any
   int bl_pos = 0; // blist pos
   int left = blist.length();
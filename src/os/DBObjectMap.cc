@@ -17,6 +17,7 @@
 
 #include "common/debug.h"
 #include "common/config.h"
+#include "common/perf_counters.h"
 #include "include/assert.h"
 
 #define dout_subsys ceph_subsys_filestore
@@ -36,6 +37,78 @@ const string DBObjectMap::HOBJECT_TO_SEQ = "_HOBJTOSEQ_";
 const string DBObjectMap::LEAF_PREFIX = "_LEAF_";
 const string DBObjectMap::REVERSE_LEAF_PREFIX = "_REVLEAF_";
 
+DBObjectMap::DBObjectMap(KeyValueDB *db)
+  : db(db), header_lock("DBOBjectMap"),
+    group_lock("DBObjectMap::group_lock"),
+    group_committing(false), group_flush(false)
+{
+  unsigned shards = MAX(1, g_conf->filestore_omap_header_shards);
+  size_t cache_size = MAX(1, g_conf->filestore_omap_header_cache_size / shards);
+  for (unsigned i = 0; i < shards; ++i) {
+    header_shards.push_back(new HeaderShard);
+    map_header_shards.push_back(new MapHeaderShard(cache_size));
+  }
+
+  PerfCountersBuilder plb(g_ceph_context, "dbobjectmap",
+			  l_dbom_first, l_dbom_last);
+  plb.add_u64_counter(l_dbom_group_commit, "group_commit",
+		      "Group commits");
+  plb.add_u64_counter(l_dbom_group_commit_sync, "group_commit_sync",
+		      "Group commits submitted synchronously");
+  plb.add_u64_avg(l_dbom_group_commit_txns, "group_commit_txns",
+		  "Transactions per group commit");
+  plb.add_u64_avg(l_dbom_group_commit_ops, "group_commit_ops",
+		  "Key operations per group commit");
+  plb.add_time_avg(l_dbom_group_commit_lat, "group_commit_lat",
+		   "Group commit submit latency");
+  logger = plb.create_perf_counters();
+  g_ceph_context->get_perfcounters_collection()->add(logger);
+}
+
+DBObjectMap::~DBObjectMap()
+{
+  assert(group_queue.empty());
+  g_ceph_context->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  for (unsigned i = 0; i < header_shards.size(); ++i) {
+    delete header_shards[i];
+    delete map_header_shards[i];
+  }
+}
+
+DBObjectMap::MapHeaderShard *DBObjectMap::get_map_header_shard(
+  const ghobject_t &oid)
+{
+  // objects in a pg share the low bits of their hash; mix in the rest
+  uint32_t h = oid.hobj.get_hash();
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  return map_header_shards[h % map_header_shards.size()];
+}
+
+DBObjectMap::MapHeaderLock::MapHeaderLock(DBObjectMap *db,
+					  const ghobject_t &oid)
+  : db(db), locked(oid)
+{
+  MapHeaderShard *s = db->get_map_header_shard(oid);
+  Mutex::Locker l(s->lock);
+  while (s->in_use.count(oid))
+    s->cond.Wait(s->lock);
+  s->in_use.insert(oid);
+}
+
+DBObjectMap::MapHeaderLock::~MapHeaderLock()
+{
+  if (locked) {
+    MapHeaderShard *s = db->get_map_header_shard(*locked);
+    Mutex::Locker l(s->lock);
+    assert(s->in_use.count(*locked));
+    s->in_use.erase(*locked);
+    s->cond.SignalAll();
+  }
+}
+
 static void append_escaped(const string &in, string *out)
 {
   for (string::const_iterator i = in.begin(); i != in.end(); ++i) {
@@ -442,7 +515,7 @@ int DBObjectMap::set_keys(const ghobject_t &oid,
 			  const map<string, bufferlist> &set,
 			  const SequencerPosition *spos)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   MapHeaderLock hl(this, oid);
   Header header = lookup_create_map_header(hl, oid, t);
   if (!header)
@@ -452,14 +525,14 @@ int DBObjectMap::set_keys(const ghobject_t &oid,
 
   t->set(user_prefix(header), set);
 
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 int DBObjectMap::set_header(const ghobject_t &oid,
 			    const bufferlist &bl,
 			    const SequencerPosition *spos)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   MapHeaderLock hl(this, oid);
   Header header = lookup_create_map_header(hl, oid, t);
   if (!header)
@@ -467,7 +540,7 @@ int DBObjectMap::set_header(const ghobject_t &oid,
   if (check_spos(oid, header, spos))
     return 0;
   _set_header(header, bl, t);
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 void DBObjectMap::_set_header(Header header, const bufferlist &bl,
@@ -516,7 +589,7 @@ int DBObjectMap::_get_header(Header header,
 int DBObjectMap::clear(const ghobject_t &oid,
 		       const SequencerPosition *spos)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   MapHeaderLock hl(this, oid);
   Header header = lookup_map_header(hl, oid);
   if (!header)
@@ -529,7 +602,7 @@ int DBObjectMap::clear(const ghobject_t &oid,
   int r = _clear(header, t);
   if (r < 0)
     return r;
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 int DBObjectMap::_clear(Header header,
@@ -642,12 +715,12 @@ int DBObjectMap::rm_keys(const ghobject_t &oid,
   Header header = lookup_map_header(hl, oid);
   if (!header)
     return -ENOENT;
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   if (check_spos(oid, header, spos))
     return 0;
   t->rmkeys(user_prefix(header), to_clear);
   if (!header->parent) {
-    return db->submit_transaction(t);
+    return submit_transaction(t);
   }
 
   // Copy up keys from parent around to_clear
@@ -706,13 +779,13 @@ int DBObjectMap::rm_keys(const ghobject_t &oid,
     set_map_header(hl, oid, *header, t);
     t->rmkeys_by_prefix(complete_prefix(header));
   }
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 int DBObjectMap::clear_keys_header(const ghobject_t &oid,
 				   const SequencerPosition *spos)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   MapHeaderLock hl(this, oid);
   Header header = lookup_map_header(hl, oid);
   if (!header)
@@ -743,7 +816,7 @@ int DBObjectMap::clear_keys_header(const ghobject_t &oid,
   set_map_header(hl, oid, *newheader, t);
   if (!attrs.empty())
     t->set(xattr_prefix(newheader), attrs);
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 int DBObjectMap::get(const ghobject_t &oid,
@@ -854,7 +927,7 @@ int DBObjectMap::set_xattrs(const ghobject_t &oid,
 			    const map<string, bufferlist> &to_set,
 			    const SequencerPosition *spos)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   MapHeaderLock hl(this, oid);
   Header header = lookup_create_map_header(hl, oid, t);
   if (!header)
@@ -862,14 +935,14 @@ int DBObjectMap::set_xattrs(const ghobject_t &oid,
   if (check_spos(oid, header, spos))
     return 0;
   t->set(xattr_prefix(header), to_set);
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 int DBObjectMap::remove_xattrs(const ghobject_t &oid,
 			       const set<string> &to_remove,
 			       const SequencerPosition *spos)
 {
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   MapHeaderLock hl(this, oid);
   Header header = lookup_map_header(hl, oid);
   if (!header)
@@ -877,7 +950,7 @@ int DBObjectMap::remove_xattrs(const ghobject_t &oid,
   if (check_spos(oid, header, spos))
     return 0;
   t->rmkeys(xattr_prefix(header), to_remove);
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 int DBObjectMap::clone(const ghobject_t &oid,
@@ -898,7 +971,7 @@ int DBObjectMap::clone(const ghobject_t &oid,
     ltarget= &_l2;
   }
 
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   {
     Header destination = lookup_map_header(*ltarget, target);
     if (destination) {
@@ -912,7 +985,7 @@ int DBObjectMap::clone(const ghobject_t &oid,
 
   Header parent = lookup_map_header(*lsource, oid);
   if (!parent)
-    return db->submit_transaction(t);
+    return submit_transaction(t);
 
   Header source = generate_new_header(oid, parent);
   Header destination = generate_new_header(target, parent);
@@ -933,7 +1006,7 @@ int DBObjectMap::clone(const ghobject_t &oid,
   t->set(xattr_prefix(source), to_set);
   t->set(xattr_prefix(destination), to_set);
   t->rmkeys_by_prefix(xattr_prefix(parent));
-  return db->submit_transaction(t);
+  return submit_transaction(t);
 }
 
 int DBObjectMap::upgrade_to_v2()
@@ -1032,7 +1105,7 @@ int DBObjectMap::init(bool do_upgrade)
 
 int DBObjectMap::sync(const ghobject_t *oid,
 		      const SequencerPosition *spos) {
-  KeyValueDB::Transaction t = db->get_transaction();
+  KeyValueDB::Transaction t = get_transaction();
   if (oid) {
     assert(spos);
     MapHeaderLock hl(this, *oid);
@@ -1052,11 +1125,11 @@ int DBObjectMap::sync(const ghobject_t *oid,
      */
     Mutex::Locker l(header_lock);
     write_state(t);
-    return db->submit_transaction_sync(t);
+    return submit_transaction(t, true);
   } else {
     Mutex::Locker l(header_lock);
     write_state(t);
-    return db->submit_transaction_sync(t);
+    return submit_transaction(t, true);
   }
 }
 
@@ -1072,21 +1145,144 @@ int DBObjectMap::write_state(KeyValueDB::Transaction _t) {
   return _t ? 0 : db->submit_transaction(t);
 }
 
+void DBObjectMap::GroupTransactionImpl::apply(KeyValueDB::Transaction t) const
+{
+  for (list<Op>::const_iterator i = ops.begin(); i != ops.end(); ++i) {
+    switch (i->type) {
+    case OP_SET:
+      t->set(i->prefix, i->key, i->bl);
+      break;
+    case OP_RMKEY:
+      t->rmkey(i->prefix, i->key);
+      break;
+    case OP_RMKEYS_BY_PREFIX:
+      t->rmkeys_by_prefix(i->prefix);
+      break;
+    case OP_RM_RANGE:
+      t->rm_range(i->prefix, i->key, i->end);
+      break;
+    }
+  }
+}
+
+KeyValueDB::Transaction DBObjectMap::get_transaction()
+{
+  if (g_conf->filestore_omap_group_commit)
+    return KeyValueDB::Transaction(new GroupTransactionImpl);
+  return db->get_transaction();
+}
+
+int DBObjectMap::submit_transaction(KeyValueDB::Transaction t, bool sync)
+{
+  if (!dynamic_cast<GroupTransactionImpl*>(t.get()))
+    return sync ? db->submit_transaction_sync(t) : db->submit_transaction(t);
+
+  GroupWaiter w(t, sync);
+  Mutex::Locker l(group_lock);
+  group_queue.push_back(&w);
+  if (group_committing) {
+    if (sync ||
+	group_queue.size() >=
+	(unsigned)g_conf->filestore_omap_group_commit_max_txns) {
+      group_flush = group_flush || sync;
+      group_cond.Signal();
+    }
+    while (!w.done && group_committing)
+      w.cond.Wait(group_lock);
+    if (w.done)
+      return w.r;
+  }
+
+  // lead the next group
+  group_committing = true;
+  double max_latency = g_conf->filestore_omap_group_commit_max_latency;
+  if (max_latency > 0 && !sync) {
+    utime_t until = ceph_clock_now(g_ceph_context);
+    until += max_latency;
+    while (!group_flush &&
+	   group_queue.size() <
+	   (unsigned)g_conf->filestore_omap_group_commit_max_txns) {
+      if (group_cond.WaitUntil(group_lock, until) == ETIMEDOUT)
+	break;
+    }
+  }
+  list<GroupWaiter*> group;
+  group.swap(group_queue);
+  group_flush = false;
+
+  group_lock.Unlock();
+  _submit_group(group);
+  group_lock.Lock();
+
+  for (list<GroupWaiter*>::iterator i = group.begin(); i != group.end(); ++i) {
+    (*i)->done = true;
+    if (*i != &w)
+      (*i)->cond.Signal();
+  }
+  group_committing = false;
+  if (!group_queue.empty())
+    group_queue.front()->cond.Signal();
+  return w.r;
+}
+
+int DBObjectMap::_submit_group(list<GroupWaiter*> &group)
+{
+  utime_t start = ceph_clock_now(g_ceph_context);
+  bool sync = false;
+  uint64_t ops = 0;
+  for (list<GroupWaiter*>::iterator i = group.begin(); i != group.end(); ++i)
+    sync = sync || (*i)->sync;
+
+  KeyValueDB::Transaction t = db->get_transaction();
+  list<GroupWaiter*>::iterator first = group.begin();
+  int r = 0;
+  for (list<GroupWaiter*>::iterator i = group.begin(); i != group.end(); ++i) {
+    GroupTransactionImpl *gt = static_cast<GroupTransactionImpl*>((*i)->t.get());
+    if (gt->has_rmkeys_by_prefix && i != first) {
+      // rmkeys_by_prefix removes the keys that are in the db when it
+      // is applied, so what is ahead of it has to be there already
+      r = db->submit_transaction(t);
+      for (; first != i; ++first)
+	(*first)->r = r;
+      t = db->get_transaction();
+    }
+    gt->apply(t);
+    ops += gt->ops.size();
+  }
+  r = sync ? db->submit_transaction_sync(t) : db->submit_transaction(t);
+  for (; first != group.end(); ++first)
+    (*first)->r = r;
+
+  dout(20) << __func__ << " " << group.size() << " txns, " << ops << " ops"
+	   << (sync ? ", sync" : "") << " = " << r << dendl;
+  logger->inc(l_dbom_group_commit);
+  if (sync)
+    logger->inc(l_dbom_group_commit_sync);
+  logger->inc(l_dbom_group_commit_txns, group.size());
+  logger->inc(l_dbom_group_commit_ops, ops);
+  logger->tinc(l_dbom_group_commit_lat, ceph_clock_now(g_ceph_context) - start);
+  return r;
+}
+
 
-DBObjectMap::Header DBObjectMap::_lookup_map_header(
+DBObjectMap::Header DBObjectMap::lookup_map_header(
   const MapHeaderLock &l,
   const ghobject_t &oid)
 {
   assert(l.get_locked() == oid);
 
+  // the leaf mapping for oid only changes under its MapHeaderLock, which
+  // we hold, so neither the cache nor the db read need header_lock
+  MapHeaderShard *s = get_map_header_shard(oid);
   _Header *header = new _Header();
+  bool hit;
   {
-    Mutex::Locker l(cache_lock);
-    if (caches.lookup(oid, header)) {
-      assert(!in_use.count(header->seq));
-      in_use.insert(header->seq);
-      return Header(header, RemoveOnDelete(this));
-    }
+    Mutex::Locker l(s->lock);
+    hit = s->cache.lookup(oid, header);
+  }
+  if (hit) {
+    set_header_in_use(header->seq);
+    return Header(header, RemoveOnDelete(this));
   }
 
   map<string, bufferlist> out;
@@ -1098,17 +1294,15 @@ DBObjectMap::Header DBObjectMap::_lookup_map_header(
     return Header();
   }
 
-  Header ret(header, RemoveOnDelete(this));
   bufferlist::iterator iter = out.begin()->second.begin();
-  ret->decode(iter);
+  header->decode(iter);
   {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, *ret);
+    Mutex::Locker l(s->lock);
+    s->cache.add(oid, *header);
   }
 
-  assert(!in_use.count(header->seq));
-  in_use.insert(header->seq);
-  return ret;
+  set_header_in_use(header->seq);
+  return Header(header, RemoveOnDelete(this));
 }
 
 DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
@@ -1122,8 +1316,7 @@ DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
   }
   header->num_children = 1;
   header->oid = oid;
-  assert(!in_use.count(header->seq));
-  in_use.insert(header->seq);
+  set_header_in_use(header->seq);
 
   write_state();
   return header;
@@ -1131,9 +1324,16 @@ DBObjectMap::Header DBObjectMap::_generate_new_header(const ghobject_t &oid,
 
 DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
 {
-  Mutex::Locker l(header_lock);
-  while (in_use.count(input->parent))
-    header_cond.Wait(header_lock);
+  HeaderShard *s = get_header_shard(input->parent);
+  {
+    Mutex::Locker l(s->lock);
+    while (s->in_use.count(input->parent))
+      s->cond.Wait(s->lock);
+    s->in_use.insert(input->parent);
+  }
+  Header header = Header(new _Header(), RemoveOnDelete(this));
+  header->seq = input->parent;
+
   map<string, bufferlist> out;
   set<string> keys;
   keys.insert(HEADER_KEY);
@@ -1150,13 +1350,10 @@ DBObjectMap::Header DBObjectMap::lookup_parent(Header input)
     return Header();
   }
 
-  Header header = Header(new _Header(), RemoveOnDelete(this));
-  header->seq = input->parent;
   bufferlist::iterator iter = out.begin()->second.begin();
   header->decode(iter);
   dout(20) << "lookup_parent: parent seq is " << header->seq << " with parent "
        << header->parent << dendl;
-  in_use.insert(header->seq);
   return header;
 }
 
@@ -1165,10 +1362,9 @@ DBObjectMap::Header DBObjectMap::lookup_create_map_header(
   const ghobject_t &oid,
   KeyValueDB::Transaction t)
 {
-  Mutex::Locker l(header_lock);
-  Header header = _lookup_map_header(hl, oid);
+  Header header = lookup_map_header(hl, oid);
   if (!header) {
-    header = _generate_new_header(oid, Header());
+    header = generate_new_header(oid, Header());
     set_map_header(hl, oid, *header, t);
   }
   return header;
@@ -1177,10 +1373,10 @@ DBObjectMap::Header DBObjectMap::lookup_create_map_header(
 void DBObjectMap::clear_header(Header header, KeyValueDB::Transaction t)
 {
   dout(20) << "clear_header: clearing seq " << header->seq << dendl;
-  t->rmkeys_by_prefix(user_prefix(header));
-  t->rmkeys_by_prefix(sys_prefix(header));
-  t->rmkeys_by_prefix(complete_prefix(header));
-  t->rmkeys_by_prefix(xattr_prefix(header));
+  t->rm_range(user_prefix(header), string(), string());
+  t->rm_range(sys_prefix(header), string(), string());
+  t->rm_range(complete_prefix(header), string(), string());
+  t->rm_range(xattr_prefix(header), string(), string());
   set<string> keys;
   keys.insert(header_key(header->seq));
   t->rmkeys(USER_PREFIX, keys);
@@ -1207,8 +1403,9 @@ void DBObjectMap::remove_map_header(
   to_remove.insert(map_header_key(oid));
   t->rmkeys(HOBJECT_TO_SEQ, to_remove);
   {
-    Mutex::Locker l(cache_lock);
-    caches.clear(oid);
+    MapHeaderShard *s = get_map_header_shard(oid);
+    Mutex::Locker l(s->lock);
+    s->cache.clear(oid);
   }
 }
 
@@ -1225,8 +1422,9 @@ void DBObjectMap::set_map_header(
   header.encode(to_set[map_header_key(oid)]);
   t->set(HOBJECT_TO_SEQ, to_set);
   {
-    Mutex::Locker l(cache_lock);
-    caches.add(oid, header);
+    MapHeaderShard *s = get_map_header_shard(oid);
+    Mutex::Locker l(s->lock);
+    s->cache.add(oid, header);
   }
 }
 
@@ -8,6 +8,7 @@
 #include <string>
 
 #include <vector>
+#include <list>
 #include "include/memory.h"
 #include <boost/scoped_ptr.hpp>
 
@@ -19,6 +20,18 @@
 #include "common/simple_cache.hpp"
 #include <boost/optional/optional_io.hpp>
 
+class PerfCounters;
+
+enum {
+  l_dbom_first = 34500,
+  l_dbom_group_commit,
+  l_dbom_group_commit_sync,
+  l_dbom_group_commit_txns,
+  l_dbom_group_commit_ops,
+  l_dbom_group_commit_lat,
+  l_dbom_last,
+};
+
 /**
  * DBObjectMap: Implements ObjectMap in terms of KeyValueDB
  *
@@ -58,21 +71,39 @@ public:
   boost::scoped_ptr<KeyValueDB> db;
 
   /**
-   * Serializes access to next_seq as well as the in_use set
+   * Serializes access to next_seq
    */
   Mutex header_lock;
-  Cond header_cond;
-  Cond map_header_cond;
 
   /**
-   * Set of headers currently in use
+   * Set of headers currently in use, sharded by seq
    */
-  set<uint64_t> in_use;
-  set<ghobject_t, ghobject_t::BitwiseComparator> map_header_in_use;
+  struct HeaderShard {
+    Mutex lock;
+    Cond cond;
+    set<uint64_t> in_use;
+    HeaderShard() : lock("DBObjectMap::HeaderShard::lock") {}
+  };
+  vector<HeaderShard*> header_shards;
+
+  HeaderShard *get_header_shard(uint64_t seq) {
+    return header_shards[seq % header_shards.size()];
+  }
+
+  /// mark header seq in use; it must not be already
+  void set_header_in_use(uint64_t seq) {
+    HeaderShard *s = get_header_shard(seq);
+    Mutex::Locker l(s->lock);
+    assert(!s->in_use.count(seq));
+    s->in_use.insert(seq);
+  }
+
+  struct MapHeaderShard;
+  MapHeaderShard *get_map_header_shard(const ghobject_t &oid);
 
   /**
-   * Takes the map_header_in_use entry in constructor, releases in
-   * destructor
+   * Takes the in_use entry for the object in its MapHeaderShard in
+   * constructor, releases in destructor
    */
   class MapHeaderLock {
     DBObjectMap *db;
@@ -82,12 +113,7 @@ public:
     MapHeaderLock &operator=(const MapHeaderLock &);
   public:
     MapHeaderLock(DBObjectMap *db) : db(db) {}
-    MapHeaderLock(DBObjectMap *db, const ghobject_t &oid) : db(db), locked(oid) {
-      Mutex::Locker l(db->header_lock);
-      while (db->map_header_in_use.count(*locked))
-	db->map_header_cond.Wait(db->header_lock);
-      db->map_header_in_use.insert(*locked);
-    }
+    MapHeaderLock(DBObjectMap *db, const ghobject_t &oid);
 
     const ghobject_t &get_locked() const {
       assert(locked);
@@ -103,20 +129,11 @@ public:
       locked = _locked;
     }
 
-    ~MapHeaderLock() {
-      if (locked) {
-	Mutex::Locker l(db->header_lock);
-	assert(db->map_header_in_use.count(*locked));
-	db->map_header_cond.Signal();
-	db->map_header_in_use.erase(*locked);
-      }
-    }
+    ~MapHeaderLock();
   };
 
-  DBObjectMap(KeyValueDB *db) : db(db), header_lock("DBOBjectMap"),
-                                cache_lock("DBObjectMap::CacheLock"),
-                                caches(g_conf->filestore_omap_header_cache_size)
-    {}
+  DBObjectMap(KeyValueDB *db);
+  ~DBObjectMap();
 
   int set_keys(
     const ghobject_t &oid,
@@ -215,6 +232,10 @@ public:
   /// Ensure that all previous operations are durable
   int sync(const ghobject_t *oid=0, const SequencerPosition *spos=0);
 
+  PerfCounters *get_perf_counters() {
+    return logger;
+  }
+
   /// Util, list all objects, there must be no other concurrent access
   int list_objects(vector<ghobject_t> *objs ///< [out] objects
     );
@@ -323,11 +344,25 @@ public:
   static string ghobject_key(const ghobject_t &oid);
   static string ghobject_key_v0(coll_t c, const ghobject_t &oid);
   static int is_buggy_ghobject_key_v1(const string &in);
+
+  /**
+   * Objects whose MapHeaderLock is held, and cached leaf headers,
+   * sharded by hash of the object so that ops on different objects
+   * rarely contend (filestore_omap_header_shards)
+   */
+  struct MapHeaderShard {
+    Mutex lock;
+    Cond cond;
+    set<ghobject_t, ghobject_t::BitwiseComparator> in_use;
+    SimpleLRU<ghobject_t, _Header, ghobject_t::BitwiseComparator> cache;
+    MapHeaderShard(size_t cache_size)
+      : lock("DBObjectMap::MapHeaderShard::lock"), cache(cache_size) {}
+  };
+  vector<MapHeaderShard*> map_header_shards;
+
 private:
   /// Implicit lock on Header->seq
   typedef ceph::shared_ptr<_Header> Header;
-  Mutex cache_lock;
-  SimpleLRU<ghobject_t, _Header, ghobject_t::BitwiseComparator> caches;
 
   string map_header_key(const ghobject_t &oid);
   string header_key(uint64_t seq);
@@ -458,20 +493,106 @@ private:
   }
 
   /// Lookup leaf header for c oid
-  Header _lookup_map_header(
+  Header lookup_map_header(
     const MapHeaderLock &l,
     const ghobject_t &oid);
-  Header lookup_map_header(
-    const MapHeaderLock &l2,
-    const ghobject_t &oid) {
-    Mutex::Locker l(header_lock);
-    return _lookup_map_header(l2, oid);
-  }
 
   /// Lookup header node for input
   Header lookup_parent(Header input);
 
 
+  /**
+   * Group commit
+   *
+   * With filestore_omap_group_commit set, updates record their
+   * operations in a GroupTransactionImpl instead of building a
+   * KeyValueDB transaction directly, and submit_transaction() queues
+   * them.  The first caller to find no commit in progress becomes the
+   * leader: it optionally waits up to
+   * filestore_omap_group_commit_max_latency for others to join, then
+   * replays everything queued into a single KeyValueDB transaction and
+   * submits it, synchronously if any of the callers asked for a sync.
+   * Callers that queued meanwhile wait for the leader and return its
+   * result; the next one in line leads the following batch.
+   *
+   * Every caller still holds its MapHeaderLock until its batch is
+   * submitted, so the transactions in a batch touch disjoint headers
+   * and replaying them in queue order is equivalent to submitting them
+   * one by one.
+   */
+  class GroupTransactionImpl : public KeyValueDB::TransactionImpl {
+  public:
+    enum op_type_t {
+      OP_SET,
+      OP_RMKEY,
+      OP_RMKEYS_BY_PREFIX,
+      OP_RM_RANGE,
+    };
+    struct Op {
+      op_type_t type;
+      string prefix;
+      string key;
+      bufferlist bl;
+      string end;  ///< OP_RM_RANGE only
+      Op(op_type_t type, const string &prefix, const string &key,
+	 const bufferlist &bl)
+	: type(type), prefix(prefix), key(key), bl(bl) {}
+    };
+    list<Op> ops;
+    bool has_rmkeys_by_prefix;
+
+    GroupTransactionImpl() : has_rmkeys_by_prefix(false) {}
+
+    void set(const string &prefix, const string &k, const bufferlist &bl) {
+      ops.push_back(Op(OP_SET, prefix, k, bl));
+    }
+    void rmkey(const string &prefix, const string &k) {
+      ops.push_back(Op(OP_RMKEY, prefix, k, bufferlist()));
+    }
+    void rmkeys_by_prefix(const string &prefix) {
+      ops.push_back(Op(OP_RMKEYS_BY_PREFIX, prefix, string(), bufferlist()));
+      has_rmkeys_by_prefix = true;
+    }
+    void rm_range(const string &prefix, const string &start,
+		  const string &end) {
+      ops.push_back(Op(OP_RM_RANGE, prefix, start, bufferlist()));
+      ops.back().end = end;
+      has_rmkeys_by_prefix = true;  // same ordering constraint
+    }
+
+    /// add our operations to t
+    void apply(KeyValueDB::Transaction t) const;
+  };
+
+  struct GroupWaiter {
+    KeyValueDB::Transaction t;  ///< a GroupTransactionImpl
+    bool sync;
+    bool done;
+    int r;
+    Cond cond;
+    GroupWaiter(KeyValueDB::Transaction t, bool sync)
+      : t(t), sync(sync), done(false), r(0) {}
+  };
+
+  /// protects the group_* state
+  Mutex group_lock;
+  /// wakes a leader waiting for its group to fill
+  Cond group_cond;
+  list<GroupWaiter*> group_queue;
+  bool group_committing;  ///< there is a leader
+  bool group_flush;       ///< a sync is queued; the leader should not wait
+
+  PerfCounters *logger;
+
+  /// a transaction for an update; batched if group commit is on
+  KeyValueDB::Transaction get_transaction();
+
+  /// submit a transaction from get_transaction()
+  int submit_transaction(KeyValueDB::Transaction t, bool sync = false);
+
+  /// submit the queued transactions as one; called by the leader
+  int _submit_group(list<GroupWaiter*> &group);
+
   /// Helpers
   int _get_header(Header header, bufferlist *bl);
 
@@ -517,10 +638,13 @@ private:
     RemoveOnDelete(DBObjectMap *db) :
       db(db) {}
     void operator() (_Header *header) {
-      Mutex::Locker l(db->header_lock);
-      assert(db->in_use.count(header->seq));
-      db->in_use.erase(header->seq);
-      db->header_cond.Signal();
+      HeaderShard *s = db->get_header_shard(header->seq);
+      {
+	Mutex::Locker l(s->lock);
+	assert(s->in_use.count(header->seq));
+	s->in_use.erase(header->seq);
+	s->cond.SignalAll();
+      }
       delete header;
     }
   };
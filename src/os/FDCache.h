@@ -22,11 +22,16 @@
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/shared_cache.hpp"
+#include "common/clock_cache.hpp"
 #include "include/compat.h"
 #include "include/intarith.h"
 
 /**
  * FD Cache
+ *
+ * Sharded by object hash.  Each shard is a SharedLRU by default, or a
+ * SharedClock when filestore_fd_cache_clock is set, so that hits only
+ * take the shard lock shared.  The choice is made at construction.
  */
 class FDCache : public md_config_obs_t {
 public:
@@ -53,39 +58,56 @@ private:
   CephContext *cct;
   const int registry_shards;
   SharedLRU<ghobject_t, FD, ghobject_t::BitwiseComparator> *registry;
+  SharedClock<ghobject_t, FD> *clock_registry;
 
 public:
   FDCache(CephContext *cct) : cct(cct),
-  registry_shards(cct->_conf->filestore_fd_cache_shards) {
+  registry_shards(cct->_conf->filestore_fd_cache_shards),
+  registry(NULL), clock_registry(NULL) {
     assert(cct);
     cct->_conf->add_observer(this);
-    registry = new SharedLRU<ghobject_t, FD, ghobject_t::BitwiseComparator>[registry_shards];
-    for (int i = 0; i < registry_shards; ++i) {
-      registry[i].set_cct(cct);
-      registry[i].set_size(
-          MAX((cct->_conf->filestore_fd_cache_size / registry_shards), 1));
+    size_t shard_size =
+      MAX((cct->_conf->filestore_fd_cache_size / registry_shards), 1);
+    if (cct->_conf->filestore_fd_cache_clock) {
+      clock_registry = new SharedClock<ghobject_t, FD>[registry_shards];
+      for (int i = 0; i < registry_shards; ++i)
+	clock_registry[i].set_size(shard_size);
+    } else {
+      registry = new SharedLRU<ghobject_t, FD, ghobject_t::BitwiseComparator>[registry_shards];
+      for (int i = 0; i < registry_shards; ++i) {
+	registry[i].set_cct(cct);
+	registry[i].set_size(shard_size);
+      }
     }
   }
   ~FDCache() {
     cct->_conf->remove_observer(this);
     delete[] registry;
+    delete[] clock_registry;
   }
   typedef ceph::shared_ptr<FD> FDRef;
 
   FDRef lookup(const ghobject_t &hoid) {
     int registry_id = hoid.hobj.get_hash() % registry_shards;
+    if (clock_registry)
+      return clock_registry[registry_id].lookup(hoid);
     return registry[registry_id].lookup(hoid);
   }
 
   FDRef add(const ghobject_t &hoid, int fd, bool *existed) {
     int registry_id = hoid.hobj.get_hash() % registry_shards;
+    if (clock_registry)
+      return clock_registry[registry_id].add(hoid, new FD(fd), existed);
     return registry[registry_id].add(hoid, new FD(fd), existed);
   }
 
   /// clear cached fd for hoid, subsequent lookups will get an empty FD
   void clear(const ghobject_t &hoid) {
     int registry_id = hoid.hobj.get_hash() % registry_shards;
-    registry[registry_id].purge(hoid);
+    if (clock_registry)
+      clock_registry[registry_id].purge(hoid);
+    else
+      registry[registry_id].purge(hoid);
   }
 
   /// md_config_obs_t
@@ -99,9 +121,14 @@ public:
   void handle_conf_change(const md_config_t *conf,
 			  const std::set<std::string> &changed) {
     if (changed.count("filestore_fd_cache_size")) {
-      for (int i = 0; i < registry_shards; ++i)
-        registry[i].set_size(
-              MAX((conf->filestore_fd_cache_size / registry_shards), 1));
+      size_t shard_size =
+	MAX((conf->filestore_fd_cache_size / registry_shards), 1);
+      for (int i = 0; i < registry_shards; ++i) {
+	if (clock_registry)
+	  clock_registry[i].set_size(shard_size);
+	else
+	  registry[i].set_size(shard_size);
+      }
     }
   }
 
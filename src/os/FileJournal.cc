@@ -97,7 +97,9 @@ int FileJournal::_open(bool forwrite, bool create)
 #ifdef HAVE_LIBAIO
   if (aio) {
     aio_ctx = 0;
-    ret = io_setup(128, &aio_ctx);
+    // room for the configured queue depth, plus the extra iocbs of a
+    // batch that is split at the end of the journal or by IOV_MAX
+    ret = io_setup(MAX(128, 2 * g_conf->journal_aio_queue_depth), &aio_ctx);
     if (ret < 0) {
       ret = errno;
       derr << "FileJournal::_open: unable to setup io_context " << cpp_strerror(ret) << dendl;
@@ -365,6 +367,8 @@ int FileJournal::create()
   // write empty header
   header = header_t();
   header.flags = header_t::FLAG_CRC;  // enable crcs on any new journal.
+  if (compressor || g_conf->journal_zero_skip)
+    header.flags |= header_t::FLAG_ENTRY_FLAGS;
   header.fsid = fsid;
   header.max_size = max_size;
   header.block_size = block_size;
@@ -766,17 +770,10 @@ int FileJournal::read_header(header_t *hdr) const
     return -EINVAL;
   }
 
-  
-  /*
-   * Unfortunately we weren't initializing the flags field for new
-   * journals!  Aie.  This is safe(ish) now that we have only one
-   * flag.  Probably around when we add the next flag we need to
-   * remove this or else this (eventually old) code will clobber newer
-   * code's flags.
-   */
-  if (hdr->flags > 3) {
-    derr << "read_header appears to have gibberish flags; assuming 0" << dendl;
-    hdr->flags = 0;
+  if (hdr->flags & ~header_t::FLAGS_KNOWN) {
+    derr << "read_header unknown flags " << std::hex << hdr->flags
+	 << std::dec << "; refusing to use journal" << dendl;
+    return -EINVAL;
   }
 
   print_header(*hdr);
@@ -878,7 +875,7 @@ int FileJournal::prepare_multi_write(bufferlist& bl, uint64_t& orig_ops, uint64_
 	// throw out what we have so far
 	full_state = FULL_FULL;
 	while (!writeq_empty()) {
-	  put_throttle(1, peek_write().bl.length());
+	  put_throttle(1, peek_write().orig_len);
 	  pop_write();
 	}  
 	print_header(header);
@@ -958,10 +955,21 @@ int FileJournal::prepare_single_write(bufferlist& bl, off64_t& queue_pos, uint64
   write_item &next_write = peek_write();
   uint64_t seq = next_write.seq;
   bufferlist &ebl = next_write.bl;
+  uint64_t orig_len = next_write.orig_len;
   unsigned head_size = sizeof(entry_header_t);
+
+  // encode first, since that changes the length.  the encoding stays
+  // with the write_item if we turn out not to have room for it.
+  if (!next_write.encoded) {
+    if (has_entry_flags())
+      next_write.flags = encode_entry(ebl);
+    next_write.encoded = true;
+  }
   off64_t base_size = 2*head_size + ebl.length();
 
   int alignment = next_write.alignment; // we want to start ebl with this alignment
+  if (next_write.flags)
+    alignment = -1;  // the payload no longer maps to the caller's data
   unsigned pre_pad = 0;
   if (alignment >= 0)
     pre_pad = ((unsigned int)alignment - (unsigned int)head_size) & ~CEPH_PAGE_MASK;
@@ -972,7 +980,7 @@ int FileJournal::prepare_single_write(bufferlist& bl, off64_t& queue_pos, uint64
   if (r < 0)
     return r;   // ENOSPC or EAGAIN
 
-  orig_bytes += ebl.length();
+  orig_bytes += orig_len;
   orig_ops++;
 
   // add to write buffer
@@ -981,13 +989,14 @@ int FileJournal::prepare_single_write(bufferlist& bl, off64_t& queue_pos, uint64
 	   << " (head " << head_size << " pre_pad " << pre_pad
 	   << " ebl " << ebl.length() << " post_pad " << post_pad << " tail " << head_size << ")"
 	   << " (ebl alignment " << alignment << ")"
+	   << " flags " << next_write.flags << " orig len " << orig_len
 	   << dendl;
     
   // add it this entry
   entry_header_t h;
   memset(&h, 0, sizeof(h));
   h.seq = seq;
-  h.pre_pad = pre_pad;
+  h.set_pre_pad(pre_pad, next_write.flags);
   h.len = ebl.length();
   h.post_pad = post_pad;
   h.make_magic(queue_pos, header.get_fsid64());
@@ -1021,6 +1030,128 @@ int FileJournal::prepare_single_write(bufferlist& bl, off64_t& queue_pos, uint64
   return 0;
 }
 
+/*
+ * An entry with ENTRY_ZERO_SKIP set is
+ *
+ *   __u32 original length
+ *   map<__u32,__u32> offset -> length of the non-zero extents
+ *   the data of those extents, back to back
+ *
+ * and one with ENTRY_COMPRESSED set is the compressor type, as an
+ * encoded string, followed by the compressor output.  Zero pages are
+ * elided first, so both may be set.
+ */
+unsigned FileJournal::encode_entry(bufferlist& ebl)
+{
+  unsigned flags = 0;
+
+  if (g_conf->journal_zero_skip && ebl.length() >= CEPH_PAGE_SIZE) {
+    uint32_t len = ebl.length();
+    map<uint32_t,uint32_t> extents;
+    bufferlist data;
+    for (uint32_t off = 0; off < len; off += CEPH_PAGE_SIZE) {
+      uint32_t l = MIN(CEPH_PAGE_SIZE, len - off);
+      bufferlist page;
+      page.substr_of(ebl, off, l);
+      if (page.is_zero())
+	continue;
+      if (!extents.empty() &&
+	  extents.rbegin()->first + extents.rbegin()->second == off)
+	extents.rbegin()->second += l;
+      else
+	extents[off] = l;
+      data.claim_append(page);
+    }
+    if (data.length() < len) {
+      if (logger)
+	logger->inc(l_os_j_zero_skip, len - data.length());
+      bufferlist sparse;
+      ::encode(len, sparse);
+      ::encode(extents, sparse);
+      sparse.claim_append(data);
+      ebl.swap(sparse);
+      flags |= entry_header_t::ENTRY_ZERO_SKIP;
+    }
+  }
+
+  if (compressor &&
+      ebl.length() >= (unsigned)g_conf->journal_compress_min_size) {
+    utime_t start = ceph_clock_now(g_ceph_context);
+    bufferlist out;
+    ::encode(compressor_type, out);
+    unsigned prefix = out.length();
+    int r = compressor->compress(ebl, out);
+    if (logger) {
+      logger->tinc(l_os_j_compress_lat, ceph_clock_now(g_ceph_context) - start);
+      logger->inc(l_os_j_compress_in, ebl.length());
+      logger->inc(l_os_j_compress_out, out.length() - prefix);
+    }
+    if (r == 0 &&
+	out.length() < ebl.length() * g_conf->journal_compress_max_ratio) {
+      ebl.swap(out);
+      flags |= entry_header_t::ENTRY_COMPRESSED;
+    }
+  }
+  return flags;
+}
+
+int FileJournal::decode_entry(unsigned flags, bufferlist& ebl) const
+{
+  if (flags & ~(entry_header_t::ENTRY_ZERO_SKIP |
+		entry_header_t::ENTRY_COMPRESSED)) {
+    derr << "decode_entry unknown entry flags " << flags << dendl;
+    return -EOPNOTSUPP;
+  }
+
+  try {
+    if (flags & entry_header_t::ENTRY_COMPRESSED) {
+      bufferlist::iterator p = ebl.begin();
+      string type;
+      ::decode(type, p);
+      Compressor *c = Compressor::create(type);
+      if (!c) {
+	derr << "decode_entry unknown compressor '" << type << "'" << dendl;
+	return -EOPNOTSUPP;
+      }
+      bufferlist in, out;
+      in.substr_of(ebl, p.get_off(), ebl.length() - p.get_off());
+      int r = c->decompress(in, out);
+      delete c;
+      if (r < 0)
+	return -EIO;
+      ebl.swap(out);
+    }
+
+    if (flags & entry_header_t::ENTRY_ZERO_SKIP) {
+      bufferlist::iterator p = ebl.begin();
+      uint32_t len;
+      map<uint32_t,uint32_t> extents;
+      ::decode(len, p);
+      ::decode(extents, p);
+      bufferlist out;
+      uint32_t pos = 0;
+      for (map<uint32_t,uint32_t>::iterator i = extents.begin();
+	   i != extents.end();
+	   ++i) {
+	if (i->first < pos || i->first + i->second > len)
+	  return -EIO;
+	if (i->first > pos)
+	  out.append_zero(i->first - pos);
+	bufferlist extent;
+	p.copy(i->second, extent);
+	out.claim_append(extent);
+	pos = i->first + i->second;
+      }
+      if (pos < len)
+	out.append_zero(len - pos);
+      ebl.swap(out);
+    }
+  } catch (buffer::error& e) {
+    return -EIO;
+  }
+  return 0;
+}
+
 void FileJournal::align_bl(off64_t pos, bufferlist& bl)
 {
   // make sure list segments are page aligned
@@ -1242,7 +1373,18 @@ void FileJournal::write_thread_entry()
     }
     
 #ifdef HAVE_LIBAIO
-    if (aio) {
+    if (aio && g_conf->journal_aio_queue_depth > 0) {
+      // fixed queue depth: submit whatever is queued as soon as there
+      // is a free slot, so that the next batch is in flight while the
+      // previous ones complete.
+      Mutex::Locker locker(aio_lock);
+      while (aio_num >= g_conf->journal_aio_queue_depth) {
+	dout(20) << "write_thread_entry aio queue depth " << aio_num
+		 << " >= " << g_conf->journal_aio_queue_depth
+		 << ", waiting" << dendl;
+	aio_cond.Wait(aio_lock);
+      }
+    } else if (aio) {
       Mutex::Locker locker(aio_lock);
       // should we back off to limit aios in flight?  try to do this
       // adaptively so that we submit larger aios once we have lots of
@@ -1285,7 +1427,7 @@ void FileJournal::write_thread_entry()
       if (write_stop) {
 	dout(20) << "write_thread_entry full and stopping, throw out queue and finish up" << dendl;
 	while (!writeq_empty()) {
-	  put_throttle(1, peek_write().bl.length());
+	  put_throttle(1, peek_write().orig_len);
 	  pop_write();
 	}  
 	print_header(header);
@@ -1415,7 +1557,7 @@ int FileJournal::write_aio_bl(off64_t& pos, bufferlist& bl, uint64_t seq)
     iovec *iov = new iovec[max];
     int n = 0;
     unsigned len = 0;
-    for (std::list<buffer::ptr>::const_iterator p = bl.buffers().begin();
+    for (bufferlist::buffers_t::const_iterator p = bl.buffers().begin();
 	 n < max;
 	 ++p, ++n) {
       assert(p != bl.buffers().end());
@@ -1479,8 +1621,8 @@ void FileJournal::write_finish_thread_entry()
     }
     
     dout(20) << "write_finish_thread_entry waiting for aio(s)" << dendl;
-    io_event event[16];
-    int r = io_getevents(aio_ctx, 1, 16, event, NULL);
+    io_event event[64];
+    int r = io_getevents(aio_ctx, 1, 64, event, NULL);
     if (r < 0) {
       if (r == -EINTR) {
 	dout(0) << "io_getevents got " << cpp_strerror(r) << dendl;
@@ -1720,9 +1862,9 @@ void FileJournal::committed_thru(uint64_t seq)
   // committed but unjournaled items
   while (!writeq_empty() && peek_write().seq <= seq) {
     dout(15) << " dropping committed but unwritten seq " << peek_write().seq 
-	     << " len " << peek_write().bl.length()
+	     << " len " << peek_write().orig_len
 	     << dendl;
-    put_throttle(1, peek_write().bl.length());
+    put_throttle(1, peek_write().orig_len);
     pop_write();
   }
   
@@ -1764,6 +1906,11 @@ int FileJournal::make_writeable()
     write_pos = get_top();
   read_pos = 0;
 
+  if ((compressor || g_conf->journal_zero_skip) && !has_entry_flags())
+    dout(0) << __func__ << " journal was created without entry flags;"
+	    << " not compressing or skipping zero pages until it is recreated"
+	    << dendl;
+
   must_write_header = true;
   start_writer();
   return 0;
@@ -1893,8 +2040,8 @@ FileJournal::read_entry_result FileJournal::do_read_entry(
   cur_pos = _next_pos;
 
   // pad + body + pad
-  if (h->pre_pad)
-    cur_pos += h->pre_pad;
+  unsigned flags = h->get_flags(has_entry_flags());
+  cur_pos += h->get_pre_pad(has_entry_flags());
 
   bl->clear();
   wrap_read_bl(cur_pos, h->len, bl, &cur_pos);
@@ -1928,9 +2075,22 @@ FileJournal::read_entry_result FileJournal::do_read_entry(
     }
   }
 
+  if (flags) {
+    int r = decode_entry(flags, *bl);
+    if (r < 0) {
+      if (ss)
+	*ss << "unable to decode entry with flags " << flags
+	    << ": " << cpp_strerror(r);
+      if (next_pos)
+	*next_pos = cur_pos;
+      return MAYBE_CORRUPT;
+    }
+  }
+
   // yay!
   dout(2) << "read_entry " << init_pos << " : seq " << h->seq
 	  << " " << h->len << " bytes"
+	  << (flags ? " encoded" : "")
 	  << dendl;
 
   // ok!
@@ -2019,7 +2179,7 @@ void FileJournal::corrupt_payload(
   entry_header_t h;
   get_header(seq, &pos, &h);
   off64_t corrupt_at =
-    pos + sizeof(entry_header_t) + h.pre_pad;
+    pos + sizeof(entry_header_t) + h.get_pre_pad(has_entry_flags());
   corrupt(wfd, corrupt_at);
 }
 
@@ -2033,7 +2193,7 @@ void FileJournal::corrupt_footer_magic(
   entry_header_t h;
   get_header(seq, &pos, &h);
   off64_t corrupt_at =
-    pos + sizeof(entry_header_t) + h.pre_pad +
+    pos + sizeof(entry_header_t) + h.get_pre_pad(has_entry_flags()) +
     h.len + h.post_pad +
     (reinterpret_cast<char*>(&h.magic2) - reinterpret_cast<char*>(&h));
   corrupt(wfd, corrupt_at);
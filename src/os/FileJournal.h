@@ -24,6 +24,7 @@ using std::deque;
 #include "common/Mutex.h"
 #include "common/Thread.h"
 #include "common/Throttle.h"
+#include "compressor/Compressor.h"
 
 #ifdef HAVE_LIBAIO
 # include <libaio.h>
@@ -50,13 +51,18 @@ public:
   struct write_item {
     uint64_t seq;
     bufferlist bl;
+    uint32_t orig_len;  ///< of bl before encode_entry(); what we throttle on
     int alignment;
+    bool encoded;       ///< bl has been through encode_entry()
+    unsigned flags;     ///< ENTRY_* from encode_entry()
     TrackedOpRef tracked_op;
     write_item(uint64_t s, bufferlist& b, int al, TrackedOpRef opref) :
-      seq(s), alignment(al), tracked_op(opref) {
+      seq(s), orig_len(b.length()), alignment(al), encoded(false), flags(0),
+      tracked_op(opref) {
       bl.claim(b, buffer::list::CLAIM_ALLOW_NONSHAREABLE); // potential zero-copy
     }
-    write_item() : seq(0), alignment(0) {}
+    write_item() : seq(0), orig_len(0), alignment(0), encoded(false),
+		   flags(0) {}
   };
 
   Mutex finisher_lock;
@@ -99,8 +105,9 @@ public:
   struct header_t {
     enum {
       FLAG_CRC = (1<<0),
-      // NOTE: remove kludgey weirdness in read_header() next time a flag is added.
+      FLAG_ENTRY_FLAGS = (1<<1),  ///< entries carry ENTRY_* flags; see entry_header_t
     };
+    static const uint64_t FLAGS_KNOWN = FLAG_CRC | FLAG_ENTRY_FLAGS;
 
     uint64_t flags;
     uuid_d fsid;
@@ -196,12 +203,34 @@ public:
   } header;
 
   struct entry_header_t {
+    enum {
+      ENTRY_ZERO_SKIP = (1<<0),   ///< zero pages elided; see encode_entry()
+      ENTRY_COMPRESSED = (1<<1),  ///< compressor type + compressed payload
+    };
+
     uint64_t seq;     // fs op seq #
     uint32_t crc32c;  // payload only.  not header, pre_pad, post_pad, or footer.
-    uint32_t len;
-    uint32_t pre_pad, post_pad;
+    uint32_t len;     // on disk, after any encoding
+    uint32_t pre_pad; // if the journal has FLAG_ENTRY_FLAGS, the pad is the
+		      // low 16 bits and the ENTRY_* flags the high 16 bits
+    uint32_t post_pad;
     uint64_t magic1;
     uint64_t magic2;
+
+    static const unsigned PRE_PAD_BITS = 16;
+    static const uint32_t PRE_PAD_MASK = (1 << PRE_PAD_BITS) - 1;
+
+    unsigned get_pre_pad(bool entry_flags) const {
+      return entry_flags ? pre_pad & PRE_PAD_MASK : pre_pad;
+    }
+    unsigned get_flags(bool entry_flags) const {
+      return entry_flags ? pre_pad >> PRE_PAD_BITS : 0;
+    }
+    void set_pre_pad(unsigned pad, unsigned flags) {
+      assert(pad <= PRE_PAD_MASK);
+      assert(flags <= PRE_PAD_MASK);
+      pre_pad = pad | (flags << PRE_PAD_BITS);
+    }
     
     void make_magic(off64_t pos, uint64_t fsid) {
       magic1 = pos;
@@ -357,6 +386,21 @@ private:
     return ROUND_UP_TO(sizeof(header), block_size);
   }
 
+  /// journal_compression, or NULL
+  Compressor *compressor;
+  /// what compressor was created from; recorded in each compressed entry
+  string compressor_type;
+
+  /// entry headers carry ENTRY_* flags
+  bool has_entry_flags() const {
+    return header.flags & header_t::FLAG_ENTRY_FLAGS;
+  }
+
+  /// elide zero pages of and compress an entry payload; @return ENTRY_* flags
+  unsigned encode_entry(bufferlist& ebl);
+  /// undo encode_entry() in place; @return 0 or a negative error code
+  int decode_entry(unsigned flags, bufferlist& ebl) const;
+
  public:
   FileJournal(uuid_d fsid, Finisher *fin, Cond *sync_cond, const char *f, bool dio=false, bool ai=true, bool faio=false) :
     Journal(fsid, fin, sync_cond),
@@ -389,7 +433,8 @@ private:
     write_stop(true),
     aio_stop(true),
     write_thread(this),
-    write_finish_thread(this) {
+    write_finish_thread(this),
+    compressor(NULL) {
 
       if (aio && !directio) {
         derr << "FileJournal::_open_any: aio not supported without directio; disabling aio" << dendl;
@@ -401,10 +446,19 @@ private:
         aio = false;
       }
 #endif
+      if (g_conf->journal_compression.length()) {
+	compressor = Compressor::create(g_conf->journal_compression);
+	if (compressor)
+	  compressor_type = g_conf->journal_compression;
+	else
+	  derr << "FileJournal: unknown journal_compression '"
+	       << g_conf->journal_compression << "'; not compressing" << dendl;
+      }
   }
   ~FileJournal() {
     assert(fd == -1);
     delete[] zero_buf;
+    delete compressor;
   }
 
   int check();
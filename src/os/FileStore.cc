@@ -69,6 +69,7 @@
 #include "common/fd.h"
 #include "HashIndex.h"
 #include "DBObjectMap.h"
+#include "PrefetchingObjectMapIterator.h"
 #include "KeyValueDB.h"
 
 #include "common/ceph_crypto.h"
@@ -533,6 +534,11 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   op_tp(g_ceph_context, "FileStore::op_tp", g_conf->filestore_op_threads, "filestore_op_threads"),
   op_wq(this, g_conf->filestore_op_thread_timeout,
 	g_conf->filestore_op_thread_suicide_timeout, &op_tp),
+  omap_prefetch_tp(g_ceph_context, "FileStore::omap_prefetch_tp",
+		   g_conf->filestore_omap_prefetch_threads),
+  omap_prefetch_wq("FileStore::omap_prefetch_wq",
+		   g_conf->filestore_op_thread_timeout, &omap_prefetch_tp),
+  omap_prefetch(false),
   logger(NULL),
   read_error_lock("FileStore::read_error_lock"),
   m_filestore_commit_timeout(g_conf->filestore_commit_timeout),
@@ -554,6 +560,8 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   m_filestore_queue_max_bytes(g_conf->filestore_queue_max_bytes),
   m_filestore_queue_committing_max_ops(g_conf->filestore_queue_committing_max_ops),
   m_filestore_queue_committing_max_bytes(g_conf->filestore_queue_committing_max_bytes),
+  m_filestore_op_batch_max_ops(g_conf->filestore_op_batch_max_ops),
+  m_filestore_op_batch_max_bytes(g_conf->filestore_op_batch_max_bytes),
   m_filestore_do_dump(false),
   m_filestore_dump_fmt(true),
   m_filestore_sloppy_crc(g_conf->filestore_sloppy_crc),
@@ -578,7 +586,7 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   omap_dir = omss.str();
 
   // initialize logger
-  PerfCountersBuilder plb(g_ceph_context, internal_name, l_os_first, l_os_last);
+  PerfCountersBuilder plb(g_ceph_context, internal_name, l_os_first, l_os_kv_header_cache_hit);
 
   plb.add_u64(l_os_jq_max_ops, "journal_queue_max_ops", "Max operations in journal queue");
   plb.add_u64(l_os_jq_ops, "journal_queue_ops", "Operations in journal queue");
@@ -602,7 +610,14 @@ FileStore::FileStore(const std::string &base, const std::string &jdev, osflagbit
   plb.add_time_avg(l_os_commit_len, "commitcycle_interval", "Average interval between commits");
   plb.add_time_avg(l_os_commit_lat, "commitcycle_latency", "Average latency of commit");
   plb.add_u64_counter(l_os_j_full, "journal_full", "Journal writes while full");
+  plb.add_u64_counter(l_os_j_compress_in, "journal_compress_in_bytes", "Journal entry bytes given to the compressor");
+  plb.add_u64_counter(l_os_j_compress_out, "journal_compress_out_bytes", "Journal entry bytes returned by the compressor");
+  plb.add_time_avg(l_os_j_compress_lat, "journal_compress_lat", "Journal entry compression latency");
+  plb.add_u64_counter(l_os_j_zero_skip, "journal_zero_skip_bytes", "Zero journal entry bytes not written");
   plb.add_time_avg(l_os_queue_lat, "queue_transaction_latency_avg", "Store operation queue latency");
+  plb.add_u64_avg(l_os_op_batch, "op_batch", "Ops applied per op thread pass");
+  plb.add_u64_counter(l_os_op_batch_merged_writes, "op_batch_merged_writes", "Writes merged into the previous write");
+  plb.add_u64_counter(l_os_op_batch_merged_omap, "op_batch_merged_omap", "Omap updates merged into the previous update");
 
   logger = plb.create_perf_counters();
 
@@ -1490,9 +1505,17 @@ int FileStore::mount()
       goto close_current_fd;
     }
 
-    if (superblock.omap_backend == "rocksdb")
+    if (superblock.omap_backend == "rocksdb") {
       omap_store->init(g_conf->filestore_rocksdb_options);
-    else
+      ret = omap_store->set_column_families(
+	g_conf->filestore_rocksdb_column_families);
+      if (ret < 0) {
+	delete omap_store;
+	derr << "Error setting up rocksdb column families: "
+	     << cpp_strerror(ret) << dendl;
+	goto close_current_fd;
+      }
+    } else
       omap_store->init();
 
     stringstream err;
@@ -1623,6 +1646,9 @@ int FileStore::mount()
 
   op_tp.start();
   op_finisher.start();
+  omap_prefetch = g_conf->filestore_omap_prefetch_threads > 0;
+  if (omap_prefetch)
+    omap_prefetch_tp.start();
   ondisk_finisher.start();
 
   timer.init();
@@ -1708,6 +1734,10 @@ int FileStore::umount()
   sync_thread.join();
   wbthrottle.stop();
   op_tp.stop();
+  if (omap_prefetch) {
+    omap_prefetch_tp.stop();
+    omap_prefetch = false;
+  }
 
   journal_stop();
   if (!(generic_flags & SKIP_JOURNAL_REPLAY))
@@ -1856,41 +1886,87 @@ void FileStore::_do_op(OpSequencer *osr, ThreadPool::TPHandle &handle)
   }
 
   osr->apply_lock.Lock();
-  Op *o = osr->peek_queue();
-  apply_manager.op_apply_start(o->op);
-  dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " start" << dendl;
-  int r = _do_transactions(o->tls, o->op, &handle);
-  apply_manager.op_apply_finish(o->op);
-  dout(10) << "_do_op " << o << " seq " << o->op << " r = " << r
-	   << ", finisher " << o->onreadable << " " << o->onreadable_sync << dendl;
+  if (osr->batched) {
+    // an earlier pass already applied the op this entry was queued for
+    osr->batched--;
+    osr->applying = 0;
+    dout(10) << "_do_op " << *osr << "/" << osr->parent
+	     << " already applied in batch, " << osr->batched << " left" << dendl;
+    return;
+  }
+
+  int max_ops = m_filestore_op_batch_max_ops;
+  if (max_ops <= 1) {
+    Op *o = osr->peek_queue();
+    apply_manager.op_apply_start(o->op);
+    dout(5) << "_do_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " start" << dendl;
+    int r = _do_transactions(o->tls, o->op, &handle);
+    apply_manager.op_apply_finish(o->op);
+    dout(10) << "_do_op " << o << " seq " << o->op << " r = " << r
+	     << ", finisher " << o->onreadable << " " << o->onreadable_sync << dendl;
+    osr->applying = 1;
+    return;
+  }
+
+  // Apply whatever else is already queued on this sequencer along with
+  // the op we were queued for.  The whole batch is a single apply as
+  // far as the ApplyManager is concerned, so a commit cannot slip in
+  // between an op and the flush of its deferred writes.
+  vector<Op*> ops;
+  osr->peek_queue(max_ops, m_filestore_op_batch_max_bytes, &ops);
+  assert(!ops.empty());
+  apply_manager.op_apply_start(ops.front()->op);
+  dout(5) << "_do_op " << *osr << "/" << osr->parent << " batch of " << ops.size()
+	  << " seq " << ops.front()->op << ".." << ops.back()->op << " start" << dendl;
+  OpBatch batch(m_filestore_op_batch_max_bytes);
+  for (vector<Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+    int r = _do_transactions((*p)->tls, (*p)->op, &handle, &batch);
+    dout(10) << "_do_op " << *p << " seq " << (*p)->op << " r = " << r
+	     << ", finisher " << (*p)->onreadable << " " << (*p)->onreadable_sync << dendl;
+  }
+  _flush_op_batch(&batch);
+  apply_manager.op_apply_finish(ops.back()->op);
+
+  logger->inc(l_os_op_batch, ops.size());
+  logger->inc(l_os_op_batch_merged_writes, batch.merged_writes);
+  logger->inc(l_os_op_batch_merged_omap, batch.merged_omap);
+  osr->applying = ops.size();
+  osr->batched += ops.size() - 1;
 }
 
 void FileStore::_finish_op(OpSequencer *osr)
 {
   list<Context*> to_queue;
-  Op *o = osr->dequeue(&to_queue);
-  
-  utime_t lat = ceph_clock_now(g_ceph_context);
-  lat -= o->start;
-
-  dout(10) << "_finish_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " lat " << lat << dendl;
+  vector<Op*> ops;
+  for (unsigned i = 0; i < osr->applying; ++i)
+    ops.push_back(osr->dequeue(&to_queue));
+  osr->applying = 0;
   osr->apply_lock.Unlock();  // locked in _do_op
 
-  // called with tp lock held
-  op_queue_release_throttle(o);
+  utime_t now = ceph_clock_now(g_ceph_context);
+  for (vector<Op*>::iterator p = ops.begin(); p != ops.end(); ++p) {
+    Op *o = *p;
+    utime_t lat = now;
+    lat -= o->start;
 
-  logger->tinc(l_os_apply_lat, lat);
+    dout(10) << "_finish_op " << o << " seq " << o->op << " " << *osr << "/" << osr->parent << " lat " << lat << dendl;
 
-  if (o->onreadable_sync) {
-    o->onreadable_sync->complete(0);
-  }
-  if (o->onreadable) {
-    op_finisher.queue(o->onreadable);
+    // called with tp lock held
+    op_queue_release_throttle(o);
+
+    logger->tinc(l_os_apply_lat, lat);
+
+    if (o->onreadable_sync) {
+      o->onreadable_sync->complete(0);
+    }
+    if (o->onreadable) {
+      op_finisher.queue(o->onreadable);
+    }
+    delete o;
   }
   if (!to_queue.empty()) {
     op_finisher.queue(to_queue);
   }
-  delete o;
 }
 
 
@@ -2054,7 +2130,8 @@ void FileStore::_journaled_ahead(OpSequencer *osr, Op *o, Context *ondisk)
 int FileStore::_do_transactions(
   list<Transaction*> &tls,
   uint64_t op_seq,
-  ThreadPool::TPHandle *handle)
+  ThreadPool::TPHandle *handle,
+  OpBatch *batch)
 {
   int r = 0;
   int trans_num = 0;
@@ -2062,7 +2139,7 @@ int FileStore::_do_transactions(
   for (list<Transaction*>::iterator p = tls.begin();
        p != tls.end();
        ++p, trans_num++) {
-    r = _do_transaction(**p, op_seq, trans_num, handle);
+    r = _do_transaction(**p, op_seq, trans_num, handle, batch);
     if (r < 0)
       break;
     if (handle)
@@ -2072,6 +2149,172 @@ int FileStore::_do_transactions(
   return r;
 }
 
+void FileStore::_batch_write(OpBatch *b, coll_t cid, const ghobject_t& oid,
+			     uint64_t off, size_t len, bufferlist& bl,
+			     uint32_t fadvise_flags)
+{
+  if (b->have_write &&
+      b->w_cid == cid && b->w_oid == oid &&
+      b->w_fadvise_flags == fadvise_flags &&
+      b->w_off + b->w_bl.length() == off &&
+      b->w_bl.length() + len <= b->max_bytes &&
+      bl.length() == len) {
+    dout(15) << "_batch_write " << cid << "/" << oid << " " << off << "~" << len
+	     << " merged into " << b->w_off << "~" << b->w_bl.length() << dendl;
+    b->w_bl.claim_append(bl);
+    b->merged_writes++;
+    return;
+  }
+  _flush_op_batch(b, true, false);
+  b->have_write = true;
+  b->w_cid = cid;
+  b->w_oid = oid;
+  b->w_off = off;
+  b->w_fadvise_flags = fadvise_flags;
+  if (bl.length() == len) {
+    b->w_bl.claim(bl);
+  } else {
+    // _write takes the first len bytes; keep exactly those
+    b->w_bl.substr_of(bl, 0, len);
+  }
+}
+
+void FileStore::_batch_omap_setkeys(OpBatch *b, coll_t cid,
+				    const ghobject_t &oid,
+				    map<string, bufferlist> &aset,
+				    const SequencerPosition &spos)
+{
+  if (b->omap_op != Transaction::OP_OMAP_SETKEYS ||
+      b->o_cid != cid || b->o_oid != oid) {
+    _flush_op_batch(b, false, true);
+    b->omap_op = Transaction::OP_OMAP_SETKEYS;
+    b->o_cid = cid;
+    b->o_oid = oid;
+    b->o_set.swap(aset);
+  } else {
+    // later values win
+    for (map<string, bufferlist>::iterator p = aset.begin();
+	 p != aset.end();
+	 ++p)
+      b->o_set[p->first].claim(p->second);
+    b->merged_omap++;
+  }
+  // Replaying the merged update is safe under the position of the last
+  // op merged: nothing else touched the object in between, and setting
+  // keys again to the same values is idempotent.
+  b->o_spos = spos;
+}
+
+void FileStore::_batch_omap_rmkeys(OpBatch *b, coll_t cid,
+				   const ghobject_t &oid,
+				   set<string> &keys,
+				   const SequencerPosition &spos)
+{
+  if (b->omap_op != Transaction::OP_OMAP_RMKEYS ||
+      b->o_cid != cid || b->o_oid != oid) {
+    _flush_op_batch(b, false, true);
+    b->omap_op = Transaction::OP_OMAP_RMKEYS;
+    b->o_cid = cid;
+    b->o_oid = oid;
+    b->o_rm.swap(keys);
+  } else {
+    b->o_rm.insert(keys.begin(), keys.end());
+    b->merged_omap++;
+  }
+  b->o_spos = spos;
+}
+
+/*
+ * Decide whether a failed op may be ignored.  Shared by
+ * _do_transaction and _flush_op_batch so a batched op is judged exactly
+ * as it would have been on its own.
+ */
+bool FileStore::_op_error_ok(int op, int r)
+{
+  bool ok = false;
+
+  if (r == -ENOENT && !(op == Transaction::OP_CLONERANGE ||
+			op == Transaction::OP_CLONE ||
+			op == Transaction::OP_CLONERANGE2 ||
+			op == Transaction::OP_COLL_ADD))
+    // -ENOENT is normally okay
+    // ...including on a replayed OP_RMCOLL with checkpoint mode
+    ok = true;
+  if (r == -ENODATA)
+    ok = true;
+
+  if (op == Transaction::OP_SETALLOCHINT)
+    // Either EOPNOTSUPP or EINVAL most probably.  EINVAL in most
+    // cases means invalid hint size (e.g. too big, not a multiple
+    // of block size, etc) or, at least on xfs, an attempt to set
+    // or change it when the file is not empty.  However,
+    // OP_SETALLOCHINT is advisory, so ignore all errors.
+    ok = true;
+
+  if (replaying && !backend->can_checkpoint()) {
+    if (r == -EEXIST && op == Transaction::OP_MKCOLL) {
+      dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
+      ok = true;
+    }
+    if (r == -EEXIST && op == Transaction::OP_COLL_ADD) {
+      dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
+      ok = true;
+    }
+    if (r == -EEXIST && op == Transaction::OP_COLL_MOVE) {
+      dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
+      ok = true;
+    }
+    if (r == -ERANGE) {
+      dout(10) << "tolerating ERANGE on replay" << dendl;
+      ok = true;
+    }
+    if (r == -ENOENT) {
+      dout(10) << "tolerating ENOENT on replay" << dendl;
+      ok = true;
+    }
+  }
+
+  return ok;
+}
+
+/*
+ * Apply what the batch is holding back.  Errors are judged by
+ * _op_error_ok as they would have been for the original op.
+ */
+void FileStore::_flush_op_batch(OpBatch *b, bool writes, bool omap)
+{
+  if (writes && b->have_write) {
+    int r = _write(b->w_cid, b->w_oid, b->w_off, b->w_bl.length(), b->w_bl,
+		   b->w_fadvise_flags);
+    if (r < 0 && !_op_error_ok(Transaction::OP_WRITE, r)) {
+      derr << "_flush_op_batch write " << b->w_cid << "/" << b->w_oid << " "
+	   << b->w_off << "~" << b->w_bl.length() << " got "
+	   << cpp_strerror(r) << dendl;
+      if (r == -ENOSPC)
+	assert(0 == "ENOSPC handling not implemented");
+      assert(0 == "unexpected error");
+    }
+    b->have_write = false;
+    b->w_bl.clear();
+  }
+  if (omap && b->omap_op) {
+    int r;
+    if (b->omap_op == Transaction::OP_OMAP_SETKEYS)
+      r = _omap_setkeys(b->o_cid, b->o_oid, b->o_set, b->o_spos);
+    else
+      r = _omap_rmkeys(b->o_cid, b->o_oid, b->o_rm, b->o_spos);
+    if (r < 0 && !_op_error_ok(b->omap_op, r)) {
+      derr << "_flush_op_batch omap op " << b->omap_op << " on "
+	   << b->o_cid << "/" << b->o_oid << " (" << b->o_spos << ") got "
+	   << cpp_strerror(r) << dendl;
+      assert(0 == "unexpected error");
+    }
+    b->omap_op = 0;
+    b->o_set.clear();
+    b->o_rm.clear();
+  }
+}
+
 void FileStore::_set_global_replay_guard(coll_t cid,
 					 const SequencerPosition &spos)
 {
@@ -2335,7 +2578,7 @@ int FileStore::_check_replay_guard(int fd, const SequencerPosition& spos)
 
 unsigned FileStore::_do_transaction(
   Transaction& t, uint64_t op_seq, int trans_num,
-  ThreadPool::TPHandle *handle)
+  ThreadPool::TPHandle *handle, OpBatch *batch)
 {
   dout(10) << "_do_transaction on " << &t << dendl;
 
@@ -2353,6 +2596,12 @@ unsigned FileStore::_do_transaction(
     Transaction::Op *op = i.decode_op();
     int r = 0;
 
+    if (batch && !batch->empty() &&
+	op->op != Transaction::OP_WRITE &&
+	op->op != Transaction::OP_OMAP_SETKEYS &&
+	op->op != Transaction::OP_OMAP_RMKEYS)
+      _flush_op_batch(batch);
+
     _inject_failure();
 
     switch (op->op) {
@@ -2381,8 +2630,12 @@ unsigned FileStore::_do_transaction(
         bufferlist bl;
         i.decode_bl(bl);
         tracepoint(objectstore, write_enter, osr_name, off, len);
-        if (_check_replay_guard(cid, oid, spos) > 0)
-          r = _write(cid, oid, off, len, bl, fadvise_flags);
+        if (_check_replay_guard(cid, oid, spos) > 0) {
+	  if (batch)
+	    _batch_write(batch, cid, oid, off, len, bl, fadvise_flags);
+	  else
+	    r = _write(cid, oid, off, len, bl, fadvise_flags);
+	}
         tracepoint(objectstore, write_exit, r);
       }
       break;
@@ -2691,7 +2944,10 @@ unsigned FileStore::_do_transaction(
         map<string, bufferlist> aset;
         i.decode_attrset(aset);
         tracepoint(objectstore, omap_setkeys_enter, osr_name);
-        r = _omap_setkeys(cid, oid, aset, spos);
+	if (batch)
+	  _batch_omap_setkeys(batch, cid, oid, aset, spos);
+	else
+	  r = _omap_setkeys(cid, oid, aset, spos);
         tracepoint(objectstore, omap_setkeys_exit, r);
       }
       break;
@@ -2703,7 +2959,10 @@ unsigned FileStore::_do_transaction(
         set<string> keys;
         i.decode_keyset(keys);
         tracepoint(objectstore, omap_rmkeys_enter, osr_name);
-        r = _omap_rmkeys(cid, oid, keys, spos);
+	if (batch)
+	  _batch_omap_rmkeys(batch, cid, oid, keys, spos);
+	else
+	  r = _omap_rmkeys(cid, oid, keys, spos);
         tracepoint(objectstore, omap_rmkeys_exit, r);
       }
       break;
@@ -2770,48 +3029,7 @@ unsigned FileStore::_do_transaction(
     }
 
     if (r < 0) {
-      bool ok = false;
-
-      if (r == -ENOENT && !(op->op == Transaction::OP_CLONERANGE ||
-			    op->op == Transaction::OP_CLONE ||
-			    op->op == Transaction::OP_CLONERANGE2 ||
-			    op->op == Transaction::OP_COLL_ADD))
-	// -ENOENT is normally okay
-	// ...including on a replayed OP_RMCOLL with checkpoint mode
-	ok = true;
-      if (r == -ENODATA)
-	ok = true;
-
-      if (op->op == Transaction::OP_SETALLOCHINT)
-        // Either EOPNOTSUPP or EINVAL most probably.  EINVAL in most
-        // cases means invalid hint size (e.g. too big, not a multiple
-        // of block size, etc) or, at least on xfs, an attempt to set
-        // or change it when the file is not empty.  However,
-        // OP_SETALLOCHINT is advisory, so ignore all errors.
-        ok = true;
-
-      if (replaying && !backend->can_checkpoint()) {
-	if (r == -EEXIST && op->op == Transaction::OP_MKCOLL) {
-	  dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
-	  ok = true;
-	}
-	if (r == -EEXIST && op->op == Transaction::OP_COLL_ADD) {
-	  dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
-	  ok = true;
-	}
-	if (r == -EEXIST && op->op == Transaction::OP_COLL_MOVE) {
-	  dout(10) << "tolerating EEXIST during journal replay since checkpoint is not enabled" << dendl;
-	  ok = true;
-	}
-	if (r == -ERANGE) {
-	  dout(10) << "tolerating ERANGE on replay" << dendl;
-	  ok = true;
-	}
-	if (r == -ENOENT) {
-	  dout(10) << "tolerating ENOENT on replay" << dendl;
-	  ok = true;
-	}
-      }
+      bool ok = _op_error_ok(op->op, r);
 
       if (!ok) {
 	const char *msg = "unexpected error code";
@@ -4897,7 +5115,12 @@ ObjectMap::ObjectMapIterator FileStore::get_omap_iterator(coll_t c,
       return ObjectMap::ObjectMapIterator();
     }
   }
-  return object_map->get_iterator(hoid);
+  ObjectMap::ObjectMapIterator iter = object_map->get_iterator(hoid);
+  if (iter && omap_prefetch)
+    iter = ObjectMap::ObjectMapIterator(
+      new PrefetchingObjectMapIterator(
+	iter, &omap_prefetch_wq, g_conf->filestore_omap_prefetch_max_batch));
+  return iter;
 }
 
 int FileStore::_collection_hint_expected_num_objs(coll_t c, uint32_t pg_num,
@@ -4907,18 +5130,16 @@ int FileStore::_collection_hint_expected_num_objs(coll_t c, uint32_t pg_num,
   dout(15) << __func__ << " collection: " << c << " pg number: "
      << pg_num << " expected number of objects: " << expected_num_objs << dendl;
 
-  if (!collection_empty(c) && !replaying) {
-    dout(0) << "Failed to give an expected number of objects hint to collection : "
-      << c << ", only empty collection can take such type of hint. " << dendl;
-    return 0;
-  }
-
   int ret;
   Index index;
   ret = get_index(c, &index);
   if (ret < 0)
     return ret;
-  // Pre-hash the collection
+  // Pre-hash the collection, or pre-split it if it is already populated.
+  // The index counts the objects under its write lock and only lays out
+  // a fresh tree when there are none, which is what used to require an
+  // empty collection here; a replayed hint finds the tree already split.
+  RWLock::WLocker l((index.index)->access_lock);
   ret = index->pre_hash_collection(pg_num, expected_num_objs);
   dout(10) << "pre_hash_collection " << c << " = " << ret << dendl;
   if (ret < 0)
@@ -5388,6 +5609,8 @@ const char** FileStore::get_tracked_conf_keys() const
     "filestore_queue_max_bytes",
     "filestore_queue_committing_max_ops",
     "filestore_queue_committing_max_bytes",
+    "filestore_op_batch_max_ops",
+    "filestore_op_batch_max_bytes",
     "filestore_commit_timeout",
     "filestore_dump_file",
     "filestore_kill_at",
@@ -5421,6 +5644,8 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
       changed.count("filestore_queue_max_bytes") ||
       changed.count("filestore_queue_committing_max_ops") ||
       changed.count("filestore_queue_committing_max_bytes") ||
+      changed.count("filestore_op_batch_max_ops") ||
+      changed.count("filestore_op_batch_max_bytes") ||
       changed.count("filestore_kill_at") ||
       changed.count("filestore_fail_eio") ||
       changed.count("filestore_sloppy_crc") ||
@@ -5434,6 +5659,8 @@ void FileStore::handle_conf_change(const struct md_config_t *conf,
     m_filestore_queue_max_bytes = conf->filestore_queue_max_bytes;
     m_filestore_queue_committing_max_ops = conf->filestore_queue_committing_max_ops;
     m_filestore_queue_committing_max_bytes = conf->filestore_queue_committing_max_bytes;
+    m_filestore_op_batch_max_ops = conf->filestore_op_batch_max_ops;
+    m_filestore_op_batch_max_bytes = conf->filestore_op_batch_max_bytes;
     m_filestore_kill_at.set(conf->filestore_kill_at);
     m_filestore_fail_eio = conf->filestore_fail_eio;
     m_filestore_fadvise = conf->filestore_fadvise;
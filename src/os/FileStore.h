@@ -115,6 +115,16 @@ public:
     perf_tracker.update_from_perfcounters(*logger);
     return perf_tracker.get_cur_stats();
   }
+  PerfCounters *get_perf_counters() {
+    return logger;
+  }
+  /// hold back the op threads, e.g. so that a test can queue a batch
+  void pause_op_threads() {
+    op_tp.pause();
+  }
+  void unpause_op_threads() {
+    op_tp.unpause();
+  }
 
 private:
   string internal_name;         ///< internal name, used to name the perfcounter instance
@@ -198,6 +208,18 @@ private:
   public:
     Sequencer *parent;
     Mutex apply_lock;  // for apply mutual exclusion
+
+    /**
+     * op batching (see FileStore::_do_op)
+     *
+     * op_wq has one entry for this sequencer per queued op.  When a
+     * pass applies n ops at once, the next n - 1 entries it gets to
+     * have nothing left to do; batched counts those.  applying is the
+     * number of ops the current pass applied, for _finish_op.  Both
+     * are protected by apply_lock.
+     */
+    unsigned batched;
+    unsigned applying;
     
     /// get_max_uncompleted
     bool _get_max_uncompleted(
@@ -266,6 +288,21 @@ private:
       assert(apply_lock.is_locked());
       return q.front();
     }
+    /// the first ops in the queue, at most max_ops of them and (unless
+    /// there is only one) max_bytes in total
+    void peek_queue(unsigned max_ops, uint64_t max_bytes, vector<Op*> *ops) {
+      assert(apply_lock.is_locked());
+      Mutex::Locker l(qlock);
+      uint64_t bytes = 0;
+      for (list<Op*>::iterator p = q.begin();
+	   p != q.end() && ops->size() < max_ops;
+	   ++p) {
+	if (!ops->empty() && bytes + (*p)->bytes > max_bytes)
+	  break;
+	bytes += (*p)->bytes;
+	ops->push_back(*p);
+      }
+    }
 
     Op *dequeue(list<Context*> *to_queue) {
       assert(to_queue);
@@ -314,7 +351,8 @@ private:
     OpSequencer()
       : qlock("FileStore::OpSequencer::qlock", false, false),
 	parent(0),
-	apply_lock("FileStore::OpSequencer::apply_lock", false, false) {}
+	apply_lock("FileStore::OpSequencer::apply_lock", false, false),
+	batched(0), applying(0) {}
     ~OpSequencer() {
       assert(q.empty());
     }
@@ -369,6 +407,59 @@ private:
     }
   } op_wq;
 
+  /// read-ahead for omap iterators, see PrefetchingObjectMapIterator
+  ThreadPool omap_prefetch_tp;
+  ContextWQ omap_prefetch_wq;
+  bool omap_prefetch;
+
+  /**
+   * writes and omap updates held back while applying a batch of ops
+   *
+   * Adjacent writes to the same object that extend one another become
+   * a single write (and a single WBThrottle entry), and adjacent
+   * OP_OMAP_SETKEYS or OP_OMAP_RMKEYS on the same object become a
+   * single KeyValueDB transaction.  A pending write and a pending omap
+   * update are independent of each other, so ops alternating between
+   * the two still merge; any other op flushes both before it is
+   * applied.
+   */
+  struct OpBatch {
+    uint64_t max_bytes;       ///< cap on a merged write
+
+    bool have_write;
+    coll_t w_cid;
+    ghobject_t w_oid;
+    uint64_t w_off;
+    bufferlist w_bl;
+    uint32_t w_fadvise_flags;
+
+    int omap_op;              ///< OP_OMAP_SETKEYS, OP_OMAP_RMKEYS or 0
+    coll_t o_cid;
+    ghobject_t o_oid;
+    map<string, bufferlist> o_set;
+    set<string> o_rm;
+    SequencerPosition o_spos; ///< of the last merged op
+
+    unsigned merged_writes, merged_omap;
+
+    OpBatch(uint64_t max_bytes)
+      : max_bytes(max_bytes), have_write(false), w_off(0),
+	w_fadvise_flags(0), omap_op(0), merged_writes(0), merged_omap(0) {}
+    bool empty() const {
+      return !have_write && !omap_op;
+    }
+  };
+  void _batch_write(OpBatch *b, coll_t cid, const ghobject_t& oid,
+		    uint64_t off, size_t len, bufferlist& bl,
+		    uint32_t fadvise_flags);
+  void _batch_omap_setkeys(OpBatch *b, coll_t cid, const ghobject_t &oid,
+			   map<string, bufferlist> &aset,
+			   const SequencerPosition &spos);
+  void _batch_omap_rmkeys(OpBatch *b, coll_t cid, const ghobject_t &oid,
+			  set<string> &keys,
+			  const SequencerPosition &spos);
+  void _flush_op_batch(OpBatch *b, bool writes = true, bool omap = true);
+
   void _do_op(OpSequencer *o, ThreadPool::TPHandle &handle);
   void _finish_op(OpSequencer *o);
   Op *build_op(list<Transaction*>& tls,
@@ -467,13 +558,14 @@ public:
 
   int _do_transactions(
     list<Transaction*> &tls, uint64_t op_seq,
-    ThreadPool::TPHandle *handle);
+    ThreadPool::TPHandle *handle, OpBatch *batch = NULL);
   int do_transactions(list<Transaction*> &tls, uint64_t op_seq) {
     return _do_transactions(tls, op_seq, 0);
   }
   unsigned _do_transaction(
     Transaction& t, uint64_t op_seq, int trans_num,
-    ThreadPool::TPHandle *handle);
+    ThreadPool::TPHandle *handle, OpBatch *batch = NULL);
+  bool _op_error_ok(int op, int r);
 
   int queue_transactions(Sequencer *osr, list<Transaction*>& tls,
 			 TrackedOpRef op = TrackedOpRef(),
@@ -714,6 +806,8 @@ private:
   int m_filestore_queue_max_bytes;
   int m_filestore_queue_committing_max_ops;
   int m_filestore_queue_committing_max_bytes;
+  int m_filestore_op_batch_max_ops;
+  int m_filestore_op_batch_max_bytes;
   bool m_filestore_do_dump;
   std::ofstream m_filestore_dump;
   JSONFormatter m_filestore_dump_fmt;
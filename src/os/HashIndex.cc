@@ -294,13 +294,18 @@ int HashIndex::_split(
   CollectionIndex* dest) {
   assert(collection_version() == dest->collection_version());
   unsigned mkdirred = 0;
-  return col_split_level(
+  clear_dir_cache();
+  static_cast<HashIndex*>(dest)->clear_dir_cache();
+  int r = col_split_level(
     *this,
     *static_cast<HashIndex*>(dest),
     vector<string>(),
     bits,
     match,
     &mkdirred);
+  clear_dir_cache();
+  static_cast<HashIndex*>(dest)->clear_dir_cache();
+  return r;
 }
 
 int HashIndex::_init() {
@@ -315,7 +320,7 @@ int HashIndex::_created(const vector<string> &path,
 			const string &mangled_name) {
   subdir_info_s info;
   int r;
-  r = get_info(path, &info);
+  r = get_info_cached(path, &info);
   if (r < 0)
     return r;
   info.objs++;
@@ -341,7 +346,7 @@ int HashIndex::_remove(const vector<string> &path,
   if (r < 0)
     return r;
   subdir_info_s info;
-  r = get_info(path, &info);
+  r = get_info_cached(path, &info);
   if (r < 0)
     return r;
   info.objs--;
@@ -364,6 +369,15 @@ int HashIndex::_lookup(const ghobject_t &oid,
 		       int *exists_out) {
   vector<string> path_comp;
   get_path_components(oid, &path_comp);
+  if (dir_cache_max) {
+    int r = lookup_cached(path_comp, path);
+    if (r == 0)
+      return get_mangled_name(*path, oid, mangled_name, exists_out);
+    if (r == -ENOENT)
+      return r;
+    // e.g. a directory without info; walk it the slow way
+    path->clear();
+  }
   vector<string>::iterator next = path_comp.begin();
   int exists;
   while (1) {
@@ -398,26 +412,196 @@ int HashIndex::_collection_list_partial(const ghobject_t &start,
   return list_by_hash(path, end, sort_bitwise, max_count, next, ls);
 }
 
+int HashIndex::lookup_cached(const vector<string> &path_comp,
+			     vector<string> *path) {
+  cached_dir_s dir;
+  int r = get_cached_dir(*path, &dir);
+  if (r < 0)
+    return r;
+  for (vector<string>::const_iterator next = path_comp.begin();
+       next != path_comp.end();
+       ++next) {
+    if (!(dir.children & (1 << hex_to_int((*next)[0]))))
+      break;
+    path->push_back(*next);
+    r = get_cached_dir(*path, &dir);
+    if (r == -ENOENT) {
+      path->pop_back();
+      break;
+    }
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+int HashIndex::get_cached_dir(const vector<string> &path, cached_dir_s *out) {
+  string key = get_dir_cache_key(path);
+  {
+    Mutex::Locker l(dir_cache_lock);
+    map<string, cached_dir_s>::iterator p = dir_cache.find(key);
+    if (p != dir_cache.end()) {
+      *out = p->second;
+      return 0;
+    }
+  }
+
+  int exists;
+  int r = path_exists(path, &exists);
+  if (r < 0)
+    return r;
+  if (!exists)
+    return -ENOENT;
+  cached_dir_s dir;
+  r = get_info(path, &dir.info);
+  if (r < 0)
+    return r;
+  vector<string> subdirs;
+  r = list_subdirs(path, &subdirs);
+  if (r < 0)
+    return r;
+  for (vector<string>::iterator i = subdirs.begin();
+       i != subdirs.end();
+       ++i) {
+    if (i->length() == 1 && isxdigit((*i)[0]) && !islower((*i)[0]))
+      dir.children |= 1 << hex_to_int((*i)[0]);
+  }
+
+  Mutex::Locker l(dir_cache_lock);
+  if (dir_cache.size() >= dir_cache_max)
+    dir_cache.clear();
+  dir_cache[key] = dir;
+  *out = dir;
+  return 0;
+}
+
+int HashIndex::get_info_cached(const vector<string> &path,
+			       subdir_info_s *info) {
+  if (!dir_cache_max)
+    return get_info(path, info);
+  cached_dir_s dir;
+  int r = get_cached_dir(path, &dir);
+  if (r == -ENOENT)
+    return get_info(path, info);  // for the error
+  if (r < 0)
+    return r;
+  *info = dir.info;
+  return 0;
+}
+
 int HashIndex::prep_delete() {
+  clear_dir_cache();
   return recursive_remove(vector<string>());
 }
 
+/// key for the per-subdir totals of count_objects
+static string subdir_key(const vector<string> &path)
+{
+  string key;
+  for (vector<string>::const_iterator i = path.begin(); i != path.end(); ++i) {
+    key += '/';
+    key += *i;
+  }
+  return key;
+}
+
+int HashIndex::count_objects(vector<string> &path, uint64_t *count,
+			     map<string, uint64_t> *totals) {
+  subdir_info_s info;
+  int r = get_info(path, &info);
+  if (r < 0)
+    return r;
+  uint64_t here = info.objs;
+  vector<string> subdirs;
+  r = list_subdirs(path, &subdirs);
+  if (r < 0)
+    return r;
+  for (vector<string>::iterator i = subdirs.begin(); i != subdirs.end(); ++i) {
+    path.push_back(*i);
+    r = count_objects(path, &here, totals);
+    if (r < 0)
+      return r;
+    path.pop_back();
+  }
+  if (totals)
+    (*totals)[subdir_key(path)] = here;
+  *count += here;
+  return 0;
+}
+
+int HashIndex::pre_split_populated(vector<string> &path, double expected,
+				   map<string, uint64_t> &totals) {
+  subdir_info_s info;
+  int r = get_info(path, &info);
+  if (r < 0)
+    return r;
+  subdir_info_s want = info;
+  want.objs = expected;
+  if (info.objs && must_split(want)) {
+    r = initiate_split(path, info);
+    if (r < 0)
+      return r;
+    r = complete_split(path, info);
+    if (r < 0)
+      return r;
+    // the split moved the objects here into new subdirs
+    uint64_t moved = 0;
+    r = count_objects(path, &moved, &totals);
+    if (r < 0)
+      return r;
+  }
+  // and whatever the split created.  the objects already here show how
+  // the expected ones spread over the subdirs, unless there are too few
+  // of them to tell; then assume they spread evenly
+  vector<string> subdirs;
+  r = list_subdirs(path, &subdirs);
+  if (r < 0)
+    return r;
+  uint64_t total = totals[subdir_key(path)];
+  for (vector<string>::iterator i = subdirs.begin(); i != subdirs.end(); ++i) {
+    path.push_back(*i);
+    double sub_expected = expected / 16;
+    if (total >= 16)
+      sub_expected = expected * totals[subdir_key(path)] / total;
+    r = pre_split_populated(path, sub_expected, totals);
+    if (r < 0)
+      return r;
+    path.pop_back();
+  }
+  return 0;
+}
+
 int HashIndex::_pre_hash_collection(uint32_t pg_num, uint64_t expected_num_objs) {
   int ret;
   vector<string> path;
   subdir_info_s root_info;
-  // Make sure there is neither objects nor sub-folders
-  // in this collection
   ret = get_info(path, &root_info);
   if (ret < 0)
     return ret;
+  clear_dir_cache();
+
+  uint64_t num_objs = 0;
+  map<string, uint64_t> totals;
+  ret = count_objects(path, &num_objs, &totals);
+  if (ret < 0)
+    return ret;
+  if (num_objs) {
+    // already populated: split where the objects are, in proportion
+    if (merge_threshold > 0 || expected_num_objs <= num_objs)
+      return 0;
+    ret = pre_split_populated(path, expected_num_objs, totals);
+    clear_dir_cache();
+    return ret;
+  }
 
   // Do the folder splitting first
   ret = pre_split_folder(pg_num, expected_num_objs);
   if (ret < 0)
     return ret;
   // Initialize the folder info starting from root
-  return init_split_folder(path, 0);
+  ret = init_split_folder(path, 0);
+  clear_dir_cache();
+  return ret;
 }
 
 int HashIndex::pre_split_folder(uint32_t pg_num, uint64_t expected_num_objs)
@@ -574,6 +758,7 @@ int HashIndex::recursive_remove(const vector<string> &path) {
 }
 
 int HashIndex::start_col_split(const vector<string> &path) {
+  clear_dir_cache();
   bufferlist bl;
   InProgressOp op_tag(InProgressOp::COL_SPLIT, path);
   op_tag.encode(bl);
@@ -584,6 +769,7 @@ int HashIndex::start_col_split(const vector<string> &path) {
 }
 
 int HashIndex::start_split(const vector<string> &path) {
+  clear_dir_cache();
   bufferlist bl;
   InProgressOp op_tag(InProgressOp::SPLIT, path);
   op_tag.encode(bl);
@@ -594,6 +780,7 @@ int HashIndex::start_split(const vector<string> &path) {
 }
 
 int HashIndex::start_merge(const vector<string> &path) {
+  clear_dir_cache();
   bufferlist bl;
   InProgressOp op_tag(InProgressOp::MERGE, path);
   op_tag.encode(bl);
@@ -604,6 +791,7 @@ int HashIndex::start_merge(const vector<string> &path) {
 }
 
 int HashIndex::end_split_or_merge(const vector<string> &path) {
+  clear_dir_cache();
   return remove_attr_path(vector<string>(), IN_PROGRESS_OP_TAG);
 }
 
@@ -622,7 +810,19 @@ int HashIndex::set_info(const vector<string> &path, const subdir_info_s &info) {
   bufferlist buf;
   assert(path.size() == (unsigned)info.hash_level);
   info.encode(buf);
-  return add_attr_path(path, SUBDIR_ATTR, buf);
+  int r = add_attr_path(path, SUBDIR_ATTR, buf);
+  if (dir_cache_max) {
+    Mutex::Locker l(dir_cache_lock);
+    map<string, cached_dir_s>::iterator p =
+      dir_cache.find(get_dir_cache_key(path));
+    if (p != dir_cache.end()) {
+      if (r < 0 || p->second.info.subdirs != info.subdirs)
+	dir_cache.erase(p);  // reload the subdirs next time
+      else
+	p->second.info = info;
+    }
+  }
+  return r;
 }
 
 bool HashIndex::must_merge(const subdir_info_s &info) {
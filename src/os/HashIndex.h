@@ -17,6 +17,7 @@
 
 #include "include/buffer.h"
 #include "include/encoding.h"
+#include "common/Mutex.h"
 #include "LFNIndex.h"
 
 extern string reverse_hexdigit_bits_string(string l);
@@ -46,6 +47,10 @@ extern string reverse_hexdigit_bits_string(string l);
  * Subdirectories are created when the number of objects in a directory
  * exceed (abs(merge_threshhold)) * 16 * split_multiplier.  The number of objects in a directory 
  * is encoded as subdir_info_s in an xattr on the directory.
+ *
+ * The subdir_info_s and subdirs of recently used directories are cached
+ * so that lookups don't have to stat each level of the path.  The
+ * cache is dropped whenever a split or merge changes the tree.
  */
 class HashIndex : public LFNIndex {
 private:
@@ -95,6 +100,19 @@ private:
     }
   };
 
+  /// What we know about a directory; see get_cached_dir()
+  struct cached_dir_s {
+    subdir_info_s info;
+    uint16_t children;   ///< bit n set if subdir with hex digit n exists
+    cached_dir_s() : children(0) {}
+  };
+
+  /// Max directories cached, 0 to disable the cache
+  size_t dir_cache_max;
+  Mutex dir_cache_lock;
+  /// Keyed by the path components concatenated, e.g. "2D0"
+  map<string, cached_dir_s> dir_cache;
+
   /// Encodes in progress split or merge
   struct InProgressOp {
     static const int SPLIT = 0;
@@ -139,10 +157,13 @@ public:
     int merge_at,          ///< [in] Merge threshhold.
     int split_multiple,	   ///< [in] Split threshhold.
     uint32_t index_version,///< [in] Index version
-    double retry_probability=0) ///< [in] retry probability
+    double retry_probability=0, ///< [in] retry probability
+    size_t dir_cache_size=0) ///< [in] directories to cache
     : LFNIndex(collection, base_path, index_version, retry_probability),
       merge_threshold(merge_at),
-      split_multiplier(split_multiple) {}
+      split_multiplier(split_multiple),
+      dir_cache_max(dir_cache_size),
+      dir_cache_lock("HashIndex::dir_cache_lock") {}
 
   /// @see CollectionIndex
   uint32_t collection_version() { return index_version; }
@@ -182,7 +203,8 @@ protected:
 
   /**
    * Pre-hash the collection to create folders according to the expected number
-   * of objects in this collection.
+   * of objects in this collection.  If it already has objects, split the
+   * directories that would otherwise split as it grows to that size.
    */
   int _pre_hash_collection(
       uint32_t pg_num,
@@ -218,6 +240,37 @@ private:
   int end_split_or_merge(
     const vector<string> &path ///< [in] path to split or merged
     ); ///< @return Error Code, 0 on success
+  /// Cached info and subdirs of path; loaded if need be
+  int get_cached_dir(
+    const vector<string> &path, ///< [in] Path to look up
+    cached_dir_s *out           ///< [out] What we know of it
+    ); ///< @return -ENOENT if path does not exist, Error Code, 0 on success
+
+  /// Like get_info, but from the cache if we can
+  int get_info_cached(
+    const vector<string> &path, ///< [in] Path to look up
+    subdir_info_s *info         ///< [out] Info of path
+    ); ///< @return Error Code, 0 on success
+
+  /// Lookup path for an object using cached directories only
+  int lookup_cached(
+    const vector<string> &path_comp, ///< [in] Full path components for oid
+    vector<string> *path             ///< [out] Deepest existing directory
+    ); ///< @return -ENOENT if the collection is gone, Error Code, 0 on success
+
+  /// Drop all cached directories, before and after changing the tree
+  void clear_dir_cache() {
+    Mutex::Locker l(dir_cache_lock);
+    dir_cache.clear();
+  }
+
+  static string get_dir_cache_key(const vector<string> &path) {
+    string key;
+    for (vector<string>::const_iterator i = path.begin(); i != path.end(); ++i)
+      key += *i;
+    return key;
+  }
+
   /// Gets info from the xattr on the subdir represented by path
   int get_info(
     const vector<string> &path, ///< [in] Path from which to read attribute.
@@ -279,6 +332,20 @@ private:
   /// according to the given expected object number.
   int pre_split_folder(uint32_t pg_num, uint64_t expected_num_objs);
 
+  /// Count objects in path and below
+  int count_objects(
+    vector<string> &path, ///< [in] Path to count
+    uint64_t *count,      ///< [in,out] Incremented by the count
+    map<string, uint64_t> *totals = NULL ///< [out] Count under each subdir, by path
+    ); ///< @return Error Code, 0 on success
+
+  /// Split path and below for the number of objects expected there
+  int pre_split_populated(
+    vector<string> &path, ///< [in] Path to split
+    double expected,      ///< [in] Objects expected under path
+    map<string, uint64_t> &totals ///< [in,out] Counts from count_objects
+    ); ///< @return Error Code, 0 on success
+
   /// Initialize the folder (dir info) with the given hash
   /// level and number of its subdirs.
   int init_split_folder(vector<string> &path, uint32_t hash_level);
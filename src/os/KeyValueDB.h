@@ -60,10 +60,39 @@ public:
       const string &prefix ///< [in] Prefix by which to remove keys
       ) = 0;
 
+    /**
+     * Removes keys in [start, end) under exactly prefix
+     *
+     * Like rmkeys_by_prefix, this removes the keys that are in the db
+     * when it is called, not ones set earlier in the same transaction.
+     * Unlike it, sub-prefixes (prefix + "x") are not touched, so the
+     * range is contiguous in the underlying store.
+     */
+    virtual void rm_range(
+      const string &prefix, ///< [in] Prefix of the keys to remove
+      const string &start,  ///< [in] First key to remove
+      const string &end     ///< [in] Key past the last to remove; "" for all
+      ) = 0;
+
     virtual ~TransactionImpl() {}
   };
   typedef ceph::shared_ptr< TransactionImpl > Transaction;
 
+  /**
+   * first raw key that does not begin with prefix, or "" if there is none
+   *
+   * Raw keys under a prefix and all its sub-prefixes lie in
+   * [prefix, past_raw_prefix(prefix)).
+   */
+  static string past_raw_prefix(const string &prefix) {
+    string limit = prefix;
+    while (!limit.empty() && (unsigned char)limit[limit.length() - 1] == 0xff)
+      limit.erase(limit.length() - 1);
+    if (!limit.empty())
+      limit[limit.length() - 1]++;
+    return limit;
+  }
+
   /// create a new instance
   static KeyValueDB *create(CephContext *cct, const string& type,
 			    const string& dir);
@@ -71,6 +100,14 @@ public:
   /// test whether we can successfully initialize; may have side effects (e.g., create)
   static int test_init(const string& type, const string& dir);
   virtual int init(string option_str="") = 0;
+  /**
+   * Keep keys under the given prefixes apart from the rest, tuned on their
+   * own; must be called before the store is opened.  See
+   * filestore_rocksdb_column_families for the format.
+   */
+  virtual int set_column_families(const string &spec) {
+    return spec.empty() ? 0 : -EOPNOTSUPP;
+  }
   virtual int open(ostream &out) = 0;
   virtual int create_and_open(ostream &out) = 0;
 
@@ -133,10 +133,14 @@ int StripObjectMap::lookup_strip_header(const coll_t &cid,
     if (caches.lookup(oid, &p)) {
       if (p.first == cid) {
         *strip_header = p.second;
+        if (logger)
+          logger->inc(l_os_kv_header_cache_hit);
         return 0;
       }
     }
   }
+  if (logger)
+    logger->inc(l_os_kv_header_cache_miss);
   Header header = lookup_header(cid, oid);
 
   if (!header) {
@@ -290,6 +294,84 @@ int StripObjectMap::get_with_header(const StripObjectHeaderRef header,
   return 0;
 }
 
+void StripObjectMap::lookup_cached_strips(const StripObjectHeaderRef header,
+                                          set<string> *keys,
+                                          map<string, bufferlist> *out,
+                                          bool copy)
+{
+  if (!header->header)
+    return;
+  uint64_t hits = 0;
+  for (set<string>::iterator i = keys->begin(); i != keys->end(); ) {
+    bufferlist bl;
+    if (!strip_cache.lookup(make_pair(header->header->seq, *i), &bl)) {
+      ++i;
+      continue;
+    }
+    if (copy) {
+      // callers such as _zero modify strips in place
+      bufferptr bp(bl.length());
+      bl.copy(0, bl.length(), bp.c_str());
+      (*out)[*i].append(bp);
+    } else {
+      (*out)[*i].swap(bl);
+    }
+    keys->erase(i++);
+    ++hits;
+  }
+  if (logger) {
+    logger->inc(l_os_kv_strip_cache_hit, hits);
+    logger->inc(l_os_kv_strip_cache_miss, keys->size());
+  }
+}
+
+void StripObjectMap::add_cached_strips(const StripObjectHeaderRef header,
+                                       const map<string, bufferlist> &strips,
+                                       uint64_t gen)
+{
+  Mutex::Locker l(lock);
+  if (gen != strip_cache_gen || !header->header)
+    return;
+  for (map<string, bufferlist>::const_iterator i = strips.begin();
+       i != strips.end(); ++i)
+    strip_cache.add(make_pair(header->header->seq, i->first), i->second);
+}
+
+void StripObjectMap::update_cached_strips(
+    const map<strip_id, bufferlist> &updates)
+{
+  if (updates.empty())
+    return;
+
+  // written strips are copied out of the client's message buffers, and
+  // caching those pieces would pin the whole messages; the cache is
+  // bounded by entries, so give each strip a buffer of its own
+  map<strip_id, bufferlist> own;
+  for (map<strip_id, bufferlist>::const_iterator i = updates.begin();
+       i != updates.end(); ++i) {
+    const bufferlist &bl = i->second;
+    if (!bl.length() ||
+	(bl.buffers().size() == 1 &&
+	 bl.buffers().front().raw_length() == bl.length())) {
+      own[i->first] = bl;
+    } else {
+      bufferptr bp(bl.length());
+      bl.copy(0, bl.length(), bp.c_str());
+      own[i->first].append(bp);
+    }
+  }
+
+  Mutex::Locker l(lock);
+  ++strip_cache_gen;
+  for (map<strip_id, bufferlist>::iterator i = own.begin();
+       i != own.end(); ++i) {
+    if (i->second.length())
+      strip_cache.add(i->first, i->second);
+    else
+      strip_cache.clear(i->first);
+  }
+}
+
 // ========= KeyValueStore::BufferTransaction Implementation ============
 
 int KeyValueStore::BufferTransaction::lookup_cached_header(
@@ -356,6 +438,10 @@ int KeyValueStore::BufferTransaction::get_buffer_keys(
     }
   }
 
+  if (!need_lookup.empty() && prefix == OBJECT_STRIP_PREFIX)
+    store->backend->lookup_cached_strips(strip_header, &need_lookup, out,
+                                         true);
+
   if (!need_lookup.empty()) {
     int r = store->backend->get_values_with_header(strip_header, prefix,
                                                    need_lookup, out);
@@ -379,6 +465,9 @@ void KeyValueStore::BufferTransaction::set_buffer_keys(
   map<pair<string, string>, bufferlist> &uid_buffers = buffers[uid];
   for (map<string, bufferlist>::iterator iter = values.begin();
        iter != values.end(); ++iter) {
+    if (prefix == OBJECT_STRIP_PREFIX)
+      strip_updates[make_pair(strip_header->header->seq, iter->first)] =
+        iter->second;
     uid_buffers[make_pair(prefix, iter->first)].swap(iter->second);
   }
 }
@@ -390,6 +479,10 @@ int KeyValueStore::BufferTransaction::remove_buffer_keys(
   uniq_id uid = make_pair(strip_header->cid, strip_header->oid);
   map< uniq_id, map<pair<string, string>, bufferlist> >::iterator obj_it = buffers.find(uid);
   set<string> buffered_keys;
+  if (prefix == OBJECT_STRIP_PREFIX) {
+    for (set<string>::const_iterator iter = keys.begin(); iter != keys.end(); ++iter)
+      strip_updates[make_pair(strip_header->header->seq, *iter)] = bufferlist();
+  }
   if ( obj_it != buffers.end() ) {
     // TODO: Avoid use empty bufferlist to indicate the key is removed
     for (set<string>::iterator iter = keys.begin(); iter != keys.end(); ++iter) {
@@ -484,6 +577,8 @@ int KeyValueStore::BufferTransaction::submit_transaction()
   }
 
   r = store->backend->submit_transaction_sync(t);
+  if (r == 0)
+    store->backend->update_cached_strips(strip_updates);
   for (list<Context*>::iterator it = finishes.begin(); it != finishes.end(); ++it) {
     (*it)->complete(r);
   }
@@ -569,6 +664,10 @@ KeyValueStore::KeyValueStore(const std::string &base,
   plb.add_time_avg(l_os_commit_lat, "commit_latency", "Commit latency");
   plb.add_time_avg(l_os_apply_lat, "apply_latency", "Apply latency");
   plb.add_time_avg(l_os_queue_lat, "queue_transaction_latency_avg", "Store operation queue latency");
+  plb.add_u64_counter(l_os_kv_header_cache_hit, "header_cache_hit", "Strip header cache hits");
+  plb.add_u64_counter(l_os_kv_header_cache_miss, "header_cache_miss", "Strip header cache misses");
+  plb.add_u64_counter(l_os_kv_strip_cache_hit, "strip_cache_hit", "Strip cache hits");
+  plb.add_u64_counter(l_os_kv_strip_cache_miss, "strip_cache_miss", "Strip cache misses");
 
   perf_logger = plb.create_perf_counters();
 
@@ -952,9 +1051,17 @@ int KeyValueStore::mount()
 
     }
 
-    if (superblock.backend == "rocksdb")
+    if (superblock.backend == "rocksdb") {
       store->init(g_conf->keyvaluestore_rocksdb_options);
-    else
+      ret = store->set_column_families(
+	g_conf->keyvaluestore_rocksdb_column_families);
+      if (ret < 0) {
+	derr << "KeyValueStore::mount bad rocksdb column families: "
+	     << cpp_strerror(ret) << dendl;
+	delete store;
+	goto close_current_fd;
+      }
+    } else
       store->init();
     stringstream err;
     if (store->open(err)) {
@@ -996,6 +1103,7 @@ int KeyValueStore::mount()
     }
 
     default_strip_size = m_keyvaluestore_strip_size;
+    dbomap->logger = perf_logger;
     backend.reset(dbomap);
   }
 
@@ -1697,10 +1805,19 @@ int KeyValueStore::_generic_read(StripObjectMap::StripObjectHeaderRef header,
   }
 
 
-  int r = backend->get_values_with_header(header, OBJECT_STRIP_PREFIX, keys, &out);
-  r = check_get_rc(header->cid, header->oid, r, out.size() == keys.size());
+  backend->lookup_cached_strips(header, &keys, &out, false);
+
+  map<string, bufferlist> fetched;
+  uint64_t gen = backend->get_strip_cache_gen();
+  int r = backend->get_values_with_header(header, OBJECT_STRIP_PREFIX, keys,
+                                          &fetched);
+  r = check_get_rc(header->cid, header->oid, r, fetched.size() == keys.size());
   if (r < 0)
     return r;
+  backend->add_cached_strips(header, fetched, gen);
+  for (map<string, bufferlist>::iterator i = fetched.begin();
+       i != fetched.end(); ++i)
+    out[i->first].swap(i->second);
 
   for (vector<StripObjectMap::StripExtent>::iterator iter = extents.begin();
        iter != extents.end(); ++iter) {
@@ -2897,6 +3014,7 @@ const char** KeyValueStore::get_tracked_conf_keys() const
     "keyvaluestore_queue_max_bytes",
     "keyvaluestore_strip_size",
     "keyvaluestore_dump_file",
+    "keyvaluestore_strip_cache_size",
     NULL
   };
   return KEYS;
@@ -2926,6 +3044,8 @@ void KeyValueStore::handle_conf_change(const struct md_config_t *conf,
       dump_stop();
     }
   }
+  if (changed.count("keyvaluestore_strip_cache_size") && backend)
+    backend->set_strip_cache_size(conf->keyvaluestore_strip_cache_size);
 }
 
 int KeyValueStore::check_get_rc(const coll_t cid, const ghobject_t& oid, int r, bool is_equal_size)
@@ -38,6 +38,7 @@ using namespace std;
 #include "GenericObjectMap.h"
 #include "KeyValueDB.h"
 #include "common/random_cache.hpp"
+#include "common/simple_cache.hpp"
 
 #include "include/uuid.h"
 
@@ -123,6 +124,30 @@ class StripObjectMap: public GenericObjectMap {
     set<string> *keys
     );
 
+  // -- strip cache --
+  // Strips are cached by the seq of the header they were read or written
+  // through, which is never reused and survives renames; clones give both
+  // objects new headers, so they simply start out uncached.
+  typedef pair<uint64_t, string> strip_id;  // (header seq, strip key)
+
+  /// move cached strips for keys to out; a copy if the caller will modify them
+  void lookup_cached_strips(const StripObjectHeaderRef header,
+                            set<string> *keys, map<string, bufferlist> *out,
+                            bool copy);
+  /// bumped by every update, so reads can tell whether what they fetched is stale
+  uint64_t get_strip_cache_gen() {
+    Mutex::Locker l(lock);
+    return strip_cache_gen;
+  }
+  /// cache strips read from the db, unless an update raced with the read
+  void add_cached_strips(const StripObjectHeaderRef header,
+                         const map<string, bufferlist> &strips, uint64_t gen);
+  /// apply committed strips; an empty bufferlist means the strip is gone
+  void update_cached_strips(const map<strip_id, bufferlist> &updates);
+  void set_strip_cache_size(size_t size) {
+    strip_cache.set_size(size);
+  }
+
   Mutex lock;
   void invalidate_cache(const coll_t &c, const ghobject_t &oid) {
     Mutex::Locker l(lock);
@@ -130,9 +155,14 @@ class StripObjectMap: public GenericObjectMap {
   }
 
   RandomCache<ghobject_t, pair<coll_t, StripObjectHeaderRef> > caches;
+  SimpleLRU<strip_id, bufferlist> strip_cache;
+  uint64_t strip_cache_gen;
+  PerfCounters *logger;
   StripObjectMap(KeyValueDB *db): GenericObjectMap(db),
                                   lock("StripObjectMap::lock"),
-                                  caches(g_conf->keyvaluestore_header_cache_size)
+                                  caches(g_conf->keyvaluestore_header_cache_size),
+                                  strip_cache(g_conf->keyvaluestore_strip_cache_size),
+                                  strip_cache_gen(0), logger(NULL)
   {}
 };
 
@@ -258,6 +288,9 @@ class KeyValueStore : public ObjectStore,
 
     list<Context*> finishes;
 
+    // strips set or removed by this transaction, for the strip cache
+    map<StripObjectMap::strip_id, bufferlist> strip_updates;
+
     KeyValueStore *store;
 
     KeyValueDB::Transaction t;
@@ -156,16 +156,38 @@ void KineticStore::KineticTransactionImpl::rmkey(const string &prefix,
 void KineticStore::KineticTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
   dout(20) << "kinetic rmkeys_by_prefix " << prefix << dendl;
-  KeyValueDB::Iterator it = db->get_iterator(prefix);
-  for (it->seek_to_first();
+  KeyValueDB::WholeSpaceIterator it = db->get_iterator();
+  for (it->seek_to_first(prefix);
        it->valid();
        it->next()) {
-    string key = combine_strings(prefix, it->key());
+    // keys under sub-prefixes too, so rebuild each key from its own prefix
+    pair<string, string> raw = it->raw_key();
+    if (raw.first.compare(0, prefix.length(), prefix) != 0)
+      break;
+    string key = combine_strings(raw.first, raw.second);
     ops.push_back(KineticOp(KINETIC_OP_DELETE, key));
     dout(30) << "kinetic rm key by prefix: " << key << dendl;
   }
 }
 
+void KineticStore::KineticTransactionImpl::rm_range(const string &prefix,
+						     const string &start,
+						     const string &end)
+{
+  dout(20) << "kinetic rm_range " << prefix << " " << start << "~" << end
+	   << dendl;
+  KeyValueDB::WholeSpaceIterator it = db->get_iterator();
+  for (it->lower_bound(prefix, start);
+       it->valid();
+       it->next()) {
+    pair<string, string> raw = it->raw_key();
+    if (raw.first != prefix || (!end.empty() && raw.second >= end))
+      break;
+    ops.push_back(KineticOp(KINETIC_OP_DELETE,
+			    combine_strings(prefix, raw.second)));
+  }
+}
+
 int KineticStore::get(
     const string &prefix,
     const std::set<string> &keys,
@@ -140,6 +140,8 @@ int LevelDBStore::submit_transaction(KeyValueDB::Transaction t)
   utime_t lat = ceph_clock_now(g_ceph_context) - start;
   logger->inc(l_leveldb_txns);
   logger->tinc(l_leveldb_submit_latency, lat);
+  if (s.ok())
+    compact_removed(_t);
   return s.ok() ? 0 : -1;
 }
 
@@ -154,9 +156,27 @@ int LevelDBStore::submit_transaction_sync(KeyValueDB::Transaction t)
   utime_t lat = ceph_clock_now(g_ceph_context) - start;
   logger->inc(l_leveldb_txns);
   logger->tinc(l_leveldb_submit_sync_latency, lat);
+  if (s.ok())
+    compact_removed(_t);
   return s.ok() ? 0 : -1;
 }
 
+void LevelDBStore::compact_removed(const LevelDBTransactionImpl *t)
+{
+  // the removed keys linger as tombstones that every read and compaction
+  // of the range has to skip until a compaction reaches them
+  uint64_t min_keys = cct->_conf->leveldb_compact_on_rm_range;
+  if (!min_keys)
+    return;
+  for (list<pair<pair<string, string>, uint64_t> >::const_iterator p =
+	 t->removed.begin();
+       p != t->removed.end();
+       ++p) {
+    if (p->second >= min_keys && !p->first.second.empty())
+      compact_range_async(p->first.first, p->first.second);
+  }
+}
+
 void LevelDBStore::LevelDBTransactionImpl::set(
   const string &prefix,
   const string &k,
@@ -179,13 +199,33 @@ void LevelDBStore::LevelDBTransactionImpl::rmkey(const string &prefix,
 
 void LevelDBStore::LevelDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
-  KeyValueDB::Iterator it = db->get_iterator(prefix);
-  for (it->seek_to_first();
-       it->valid();
-       it->next()) {
-    string key = combine_strings(prefix, it->key());
-    bat.Delete(key);
+  // keys under sub-prefixes too, so work on raw keys: recombining a split
+  // key with the shorter prefix would name a different key
+  rm_raw_range(prefix, past_raw_prefix(prefix));
+}
+
+void LevelDBStore::LevelDBTransactionImpl::rm_range(const string &prefix,
+						     const string &start,
+						     const string &end)
+{
+  rm_raw_range(combine_strings(prefix, start),
+	       end.empty() ? past_prefix(prefix) : combine_strings(prefix, end));
+}
+
+void LevelDBStore::LevelDBTransactionImpl::rm_raw_range(const string &start,
+							 const string &end)
+{
+  boost::scoped_ptr<leveldb::Iterator> it(
+    db->db->NewIterator(leveldb::ReadOptions()));
+  uint64_t num = 0;
+  for (it->Seek(leveldb::Slice(start));
+       it->Valid() && (end.empty() || it->key().compare(leveldb::Slice(end)) < 0);
+       it->Next()) {
+    bat.Delete(it->key());
+    ++num;
   }
+  if (num)
+    removed.push_back(make_pair(make_pair(start, end), num));
 }
 
 int LevelDBStore::get(
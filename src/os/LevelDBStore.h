@@ -178,7 +178,11 @@ public:
   public:
     leveldb::WriteBatch bat;
     LevelDBStore *db;
+    /// raw ranges removed by this transaction and how many keys each held
+    list<pair<pair<string, string>, uint64_t> > removed;
     LevelDBTransactionImpl(LevelDBStore *db) : db(db) {}
+    /// remove raw keys in [start, end); end "" for no bound
+    void rm_raw_range(const string &start, const string &end);
     void set(
       const string &prefix,
       const string &k,
@@ -189,8 +193,15 @@ public:
     void rmkeys_by_prefix(
       const string &prefix
       );
+    void rm_range(
+      const string &prefix,
+      const string &start,
+      const string &end);
   };
 
+  /// queue compaction of the big ranges a committed transaction removed
+  void compact_removed(const LevelDBTransactionImpl *t);
+
   KeyValueDB::Transaction get_transaction() {
     return ceph::shared_ptr< LevelDBTransactionImpl >(
       new LevelDBTransactionImpl(this));
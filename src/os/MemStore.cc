@@ -40,6 +40,175 @@ bool operator>(const MemStore::CollectionRef& l,
 }
 
 
+// Object
+
+MemStore::Object::Object()
+  : data_len(0), page_size(g_conf->memstore_page_size)
+{
+  assert(page_size > 0);
+}
+
+void MemStore::Object::read(uint64_t offset, uint64_t len,
+			    bufferlist &bl) const
+{
+  assert(offset + len <= data_len);
+  uint64_t pos = offset;
+  uint64_t end = offset + len;
+  map<uint64_t,bufferptr>::const_iterator p =
+    pages.lower_bound(pos - pos % page_size);
+  while (pos < end) {
+    uint64_t pstart = pos - pos % page_size;
+    if (p != pages.end() && p->first == pstart) {
+      uint64_t n = MIN(pstart + page_size, end) - pos;
+      bl.append(p->second, pos - pstart, n);
+      pos += n;
+      ++p;
+    } else {
+      // hole, up to the next page we have
+      uint64_t n = (p == pages.end() ? end : MIN(p->first, end)) - pos;
+      bufferptr bp(n);
+      bp.zero();
+      bl.append(bp);
+      pos += n;
+    }
+  }
+}
+
+bufferptr& MemStore::Object::get_page_for_write(uint64_t off, bool overwrite)
+{
+  map<uint64_t,bufferptr>::iterator p = pages.find(off);
+  if (p == pages.end()) {
+    bufferptr bp = buffer::create_page_aligned(page_size);
+    if (!overwrite)
+      bp.zero();
+    return pages[off] = bp;
+  }
+  if (p->second.raw_nref() > 1) {
+    // shared with a clone or a reader; copy on write
+    bufferptr bp = buffer::create_page_aligned(page_size);
+    if (!overwrite)
+      bp.copy_in(0, page_size, p->second.c_str());
+    p->second = bp;
+  }
+  return p->second;
+}
+
+void MemStore::Object::write(uint64_t offset, const bufferlist &src)
+{
+  bufferlist bl(src);
+  bufferlist::iterator i = bl.begin();
+  uint64_t pos = offset;
+  uint64_t end = offset + bl.length();
+  while (pos < end) {
+    uint64_t pstart = pos - pos % page_size;
+    uint64_t poff = pos - pstart;
+    uint64_t n = MIN(page_size - poff, end - pos);
+    bufferptr& page = get_page_for_write(pstart, n == page_size);
+    pos += n;
+    while (n) {
+      bufferptr cur = i.get_current_ptr();
+      unsigned k = MIN(n, cur.length());
+      page.copy_in(poff, k, cur.c_str());
+      i.advance(k);
+      poff += k;
+      n -= k;
+    }
+  }
+  if (end > data_len)
+    data_len = end;
+}
+
+void MemStore::Object::zero_in_page(uint64_t offset, uint64_t len)
+{
+  uint64_t pstart = offset - offset % page_size;
+  if (!pages.count(pstart))
+    return;  // already a hole
+  bufferptr& page = get_page_for_write(pstart, false);
+  page.zero(offset - pstart, len);
+}
+
+void MemStore::Object::zero(uint64_t offset, uint64_t len)
+{
+  uint64_t pos = offset;
+  uint64_t end = offset + len;
+  while (pos < end) {
+    uint64_t pstart = pos - pos % page_size;
+    uint64_t n = MIN(pstart + page_size, end) - pos;
+    if (n == page_size)
+      pages.erase(pstart);
+    else
+      zero_in_page(pos, n);
+    pos += n;
+  }
+  if (end > data_len)
+    data_len = end;
+}
+
+void MemStore::Object::truncate(uint64_t size)
+{
+  if (size < data_len) {
+    uint64_t pend = size - size % page_size;
+    if (size % page_size) {
+      zero_in_page(size, page_size - size % page_size);
+      pend += page_size;
+    }
+    pages.erase(pages.lower_bound(pend), pages.end());
+  }
+  data_len = size;
+}
+
+void MemStore::Object::clone_data(const Object &o)
+{
+  data_len = o.data_len;
+  page_size = o.page_size;
+  pages = o.pages;
+}
+
+void MemStore::Object::fiemap(uint64_t offset, uint64_t len,
+			      map<uint64_t,uint64_t> *m) const
+{
+  uint64_t end = offset + len;
+  uint64_t ext_start = 0, ext_end = 0;
+  for (map<uint64_t,bufferptr>::const_iterator p =
+	 pages.lower_bound(offset - offset % page_size);
+       p != pages.end() && p->first < end;
+       ++p) {
+    uint64_t s = MAX(p->first, offset);
+    uint64_t e = MIN(p->first + page_size, end);
+    if (ext_end == s && ext_end > ext_start) {
+      ext_end = e;
+      continue;
+    }
+    if (ext_end > ext_start)
+      (*m)[ext_start] = ext_end - ext_start;
+    ext_start = s;
+    ext_end = e;
+  }
+  if (ext_end > ext_start)
+    (*m)[ext_start] = ext_end - ext_start;
+}
+
+void MemStore::Object::decode(bufferlist::iterator& p)
+{
+  DECODE_START(1, p);
+  bufferlist data;
+  ::decode(data, p);
+  pages.clear();
+  data_len = data.length();
+  // keep it sparse
+  for (uint64_t off = 0; off < data_len; off += page_size) {
+    bufferlist page;
+    page.substr_of(data, off, MIN(page_size, data_len - off));
+    if (!page.is_zero())
+      write(off, page);
+  }
+  ::decode(xattr, p);
+  ::decode(omap_header, p);
+  ::decode(omap, p);
+  DECODE_FINISH(p);
+}
+
+
 int MemStore::peek_journal_fsid(uuid_d *fsid)
 {
   *fsid = uuid_d();
@@ -293,7 +462,7 @@ int MemStore::stat(
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  st->st_size = o->data.length();
+  st->st_size = o->data_len;
   st->st_blksize = 4096;
   st->st_blocks = (st->st_size + st->st_blksize - 1) / st->st_blksize;
   st->st_nlink = 1;
@@ -319,15 +488,15 @@ int MemStore::read(
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (offset >= o->data.length())
+  if (offset >= o->data_len)
     return 0;
   size_t l = len;
   if (l == 0)  // note: len == 0 means read the entire object
-    l = o->data.length();
-  else if (offset + l > o->data.length())
-    l = o->data.length() - offset;
+    l = o->data_len;
+  if (offset + l > o->data_len)
+    l = o->data_len - offset;
   bl.clear();
-  bl.substr_of(o->data, offset, l);
+  o->read(offset, l, bl);
   return bl.length();
 }
 
@@ -344,13 +513,13 @@ int MemStore::fiemap(coll_t cid, const ghobject_t& oid,
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (offset >= o->data.length())
+  if (offset >= o->data_len)
     return 0;
   size_t l = len;
-  if (offset + l > o->data.length())
-    l = o->data.length() - offset;
+  if (offset + l > o->data_len)
+    l = o->data_len - offset;
   map<uint64_t, uint64_t> m;
-  m[offset] = l;
+  o->fiemap(offset, l, &m);
   ::encode(m, bl);
   return 0;  
 }
@@ -985,51 +1154,35 @@ int MemStore::_write(coll_t cid, const ghobject_t& oid,
     c->object_hash[oid] = o;
   }
 
-  int old_size = o->data.length();
-  _write_into_bl(bl, offset, &o->data);
-  used_bytes += (o->data.length() - old_size);
+  uint64_t old_size = o->data_len;
+  o->write(offset, bl);
+  used_bytes += o->data_len - old_size;
 
   return 0;
 }
 
-void MemStore::_write_into_bl(const bufferlist& src, unsigned offset,
-			      bufferlist *dst)
-{
-  unsigned len = src.length();
-
-  // before
-  bufferlist newdata;
-  if (dst->length() >= offset) {
-    newdata.substr_of(*dst, 0, offset);
-  } else {
-    newdata.substr_of(*dst, 0, dst->length());
-    bufferptr bp(offset - dst->length());
-    bp.zero();
-    newdata.append(bp);
-  }
-
-  newdata.append(src);
-
-  // after
-  if (dst->length() > offset + len) {
-    bufferlist tail;
-    tail.substr_of(*dst, offset + len, dst->length() - (offset + len));
-    newdata.append(tail);
-  }
-
-  dst->claim(newdata);
-}
-
 int MemStore::_zero(coll_t cid, const ghobject_t& oid,
 		    uint64_t offset, size_t len)
 {
   dout(10) << __func__ << " " << cid << " " << oid << " " << offset << "~"
 	   << len << dendl;
-  bufferptr bp(len);
-  bp.zero();
-  bufferlist bl;
-  bl.push_back(bp);
-  return _write(cid, oid, offset, len, bl);
+  CollectionRef c = get_collection(cid);
+  if (!c)
+    return -ENOENT;
+  RWLock::WLocker l(c->lock);
+
+  ObjectRef o = c->get_object(oid);
+  if (!o) {
+    // zero implicitly creates a missing object, as write does
+    o.reset(new Object);
+    c->object_map[oid] = o;
+    c->object_hash[oid] = o;
+  }
+
+  uint64_t old_size = o->data_len;
+  o->zero(offset, len);
+  used_bytes += o->data_len - old_size;
+  return 0;
 }
 
 int MemStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size)
@@ -1043,19 +1196,8 @@ int MemStore::_truncate(coll_t cid, const ghobject_t& oid, uint64_t size)
   ObjectRef o = c->get_object(oid);
   if (!o)
     return -ENOENT;
-  if (o->data.length() > size) {
-    bufferlist bl;
-    bl.substr_of(o->data, 0, size);
-    used_bytes -= o->data.length() - size;
-    o->data.claim(bl);
-  } else if (o->data.length() == size) {
-    // do nothing
-  } else {
-    bufferptr bp(size - o->data.length());
-    bp.zero();
-    used_bytes += bp.length();
-    o->data.append(bp);
-  }
+  used_bytes += size - o->data_len;
+  o->truncate(size);
   return 0;
 }
 
@@ -1073,7 +1215,7 @@ int MemStore::_remove(coll_t cid, const ghobject_t& oid)
   c->object_map.erase(oid);
   c->object_hash.erase(oid);
 
-  used_bytes -= o->data.length();
+  used_bytes -= o->data_len;
 
   return 0;
 }
@@ -1146,8 +1288,8 @@ int MemStore::_clone(coll_t cid, const ghobject_t& oldoid,
     c->object_map[newoid] = no;
     c->object_hash[newoid] = no;
   }
-  used_bytes += oo->data.length() - no->data.length();
-  no->data = oo->data;
+  used_bytes += oo->data_len - no->data_len;
+  no->clone_data(*oo);
   no->omap_header = oo->omap_header;
   no->omap = oo->omap;
   no->xattr = oo->xattr;
@@ -1176,16 +1318,16 @@ int MemStore::_clone_range(coll_t cid, const ghobject_t& oldoid,
     c->object_map[newoid] = no;
     c->object_hash[newoid] = no;
   }
-  if (srcoff >= oo->data.length())
+  if (srcoff >= oo->data_len)
     return 0;
-  if (srcoff + len >= oo->data.length())
-    len = oo->data.length() - srcoff;
+  if (srcoff + len >= oo->data_len)
+    len = oo->data_len - srcoff;
   bufferlist bl;
-  bl.substr_of(oo->data, srcoff, len);
+  oo->read(srcoff, len, bl);
 
-  int old_size = no->data.length();
-  _write_into_bl(bl, dstoff, &no->data);
-  used_bytes += (no->data.length() - old_size);
+  uint64_t old_size = no->data_len;
+  no->write(dstoff, bl);
+  used_bytes += no->data_len - old_size;
 
   return len;
 }
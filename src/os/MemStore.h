@@ -25,30 +25,58 @@
 
 class MemStore : public ObjectStore {
 public:
+  /**
+   * Object data is kept as a map of fixed size pages
+   * (memstore_page_size), so that a write only touches the pages it
+   * covers whatever the size of the object.  Pages are refcounted
+   * buffers: clone shares them and reads return them without copying,
+   * and a page that is shared is copied before it is modified.  A
+   * missing page is a hole and reads as zeros; zero and truncate drop
+   * the pages they cover entirely.
+   */
   struct Object {
-    bufferlist data;
+    uint64_t data_len;
+    uint64_t page_size;
+    map<uint64_t,bufferptr> pages;  ///< page offset -> page
     map<string,bufferptr> xattr;
     bufferlist omap_header;
     map<string,bufferlist> omap;
 
+    Object();
+
+    /// read [offset, offset+len), which must be within the object
+    void read(uint64_t offset, uint64_t len, bufferlist &bl) const;
+    void write(uint64_t offset, const bufferlist &bl);
+    void zero(uint64_t offset, uint64_t len);
+    void truncate(uint64_t size);
+    /// replace our data with (shared) copies of o's pages
+    void clone_data(const Object &o);
+    /// extents within [offset, offset+len) that are not holes
+    void fiemap(uint64_t offset, uint64_t len,
+		map<uint64_t,uint64_t> *m) const;
+
+  private:
+    /// the page at offset off, unshared and ready to modify
+    bufferptr& get_page_for_write(uint64_t off, bool overwrite);
+    /// zero [offset, offset+len) within a single page, if present
+    void zero_in_page(uint64_t offset, uint64_t len);
+
+  public:
+    // the encoding is of flat data, as it was before pages
     void encode(bufferlist& bl) const {
       ENCODE_START(1, 1, bl);
+      bufferlist data;
+      read(0, data_len, data);
       ::encode(data, bl);
       ::encode(xattr, bl);
       ::encode(omap_header, bl);
       ::encode(omap, bl);
       ENCODE_FINISH(bl);
     }
-    void decode(bufferlist::iterator& p) {
-      DECODE_START(1, p);
-      ::decode(data, p);
-      ::decode(xattr, p);
-      ::decode(omap_header, p);
-      ::decode(omap, p);
-      DECODE_FINISH(p);
-    }
+    void decode(bufferlist::iterator& p);
     void dump(Formatter *f) const {
-      f->dump_int("data_len", data.length());
+      f->dump_int("data_len", data_len);
+      f->dump_int("pages", pages.size());
       f->dump_int("omap_header_len", omap_header.length());
 
       f->open_array_section("xattrs");
@@ -128,7 +156,7 @@ public:
       for (map<ghobject_t, ObjectRef,ghobject_t::BitwiseComparator>::const_iterator p = object_map.begin();
 	   p != object_map.end();
 	   ++p) {
-        result += p->second->data.length();
+        result += p->second->data_len;
       }
 
       return result;
@@ -197,8 +225,6 @@ private:
 
   void _do_transaction(Transaction& t);
 
-  void _write_into_bl(const bufferlist& src, unsigned offset, bufferlist *dst);
-
   int _touch(coll_t cid, const ghobject_t& oid);
   int _write(coll_t cid, const ghobject_t& oid, uint64_t offset, size_t len,
 	      const bufferlist& bl, uint32_t fadvsie_flags = 0);
@@ -147,6 +147,26 @@ public:
     virtual string key() = 0;
     virtual bufferlist value() = 0;
     virtual int status() = 0;
+
+    /**
+     * Move up to max entries starting at the current position into out
+     * and advance past them.  Implementations which fetch from the
+     * KeyValueDB in chunks anyway may override this to avoid a virtual
+     * call per key.
+     *
+     * @return number of entries added, or -errno
+     */
+    virtual int get_next_batch(size_t max, map<string, bufferlist> *out) {
+      int n = 0;
+      for (; max > 0 && valid(); --max, ++n) {
+	out->insert(out->end(), make_pair(key(), value()));
+	int r = next();
+	if (r < 0)
+	  return r;
+      }
+      int r = status();
+      return r < 0 ? r : n;
+    }
     virtual ~ObjectMapIteratorImpl() {}
   };
   typedef ceph::shared_ptr<ObjectMapIteratorImpl> ObjectMapIterator;
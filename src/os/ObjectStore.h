@@ -57,8 +57,15 @@ enum {
   l_os_j_wr,
   l_os_j_wr_bytes,
   l_os_j_full,
+  l_os_j_compress_in,
+  l_os_j_compress_out,
+  l_os_j_compress_lat,
+  l_os_j_zero_skip,
   l_os_committing,
   l_os_commit,
+  l_os_op_batch,             // FileStore only from here to l_os_commit_len
+  l_os_op_batch_merged_writes,
+  l_os_op_batch_merged_omap,
   l_os_commit_len,
   l_os_commit_lat,
   l_os_oq_max_ops,
@@ -69,6 +76,10 @@ enum {
   l_os_bytes,
   l_os_apply_lat,
   l_os_queue_lat,
+  l_os_kv_header_cache_hit,  // KeyValueStore only from here to l_os_last
+  l_os_kv_header_cache_miss,
+  l_os_kv_strip_cache_hit,
+  l_os_kv_strip_cache_miss,
   l_os_last,
 };
 
@@ -620,10 +631,10 @@ public:
       vector<__le32> &cm,
       vector<__le32> &om) {
 
-      list<bufferptr> list = bl.buffers();
-      std::list<bufferptr>::iterator p;
+      bufferlist::buffers_t bufs = bl.buffers();
+      bufferlist::buffers_t::iterator p;
 
-      for(p = list.begin(); p != list.end(); ++p) {
+      for(p = bufs.begin(); p != bufs.end(); ++p) {
         assert(p->length() % sizeof(Op) == 0);
 
         char* raw_p = p->c_str();
@@ -0,0 +1,166 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "include/intarith.h"
+#include "PrefetchingObjectMapIterator.h"
+
+PrefetchingObjectMapIterator::PrefetchingObjectMapIterator(
+  ObjectMap::ObjectMapIterator inner,
+  ContextWQ *wq,
+  size_t max_batch)
+  : inner(inner), wq(wq), max_batch(MAX(max_batch, 1)),
+    lock("PrefetchingObjectMapIterator::lock"),
+    filling(false), ahead_r(0),
+    pos(cur.end()), r(0), batch(MIN(MIN_BATCH, this->max_batch)),
+    prefetched(false)
+{}
+
+PrefetchingObjectMapIterator::~PrefetchingObjectMapIterator()
+{
+  wait_fill();
+}
+
+void PrefetchingObjectMapIterator::fill_ahead(size_t n)
+{
+  map<string, bufferlist> got;
+  int ret = inner->get_next_batch(n, &got);
+  Mutex::Locker l(lock);
+  ahead.swap(got);
+  ahead_r = ret;
+  filling = false;
+  cond.Signal();
+}
+
+void PrefetchingObjectMapIterator::wait_fill()
+{
+  Mutex::Locker l(lock);
+  while (filling)
+    cond.Wait(lock);
+}
+
+int PrefetchingObjectMapIterator::reset(int seek_r)
+{
+  cur.clear();
+  ahead.clear();
+  prefetched = false;
+  batch = MIN(MIN_BATCH, max_batch);
+  r = seek_r;
+  if (r == 0) {
+    int n = inner->get_next_batch(batch, &cur);
+    if (n < 0)
+      r = n;
+  }
+  pos = cur.begin();
+  return r;
+}
+
+int PrefetchingObjectMapIterator::advance()
+{
+  if (r < 0)
+    return r;
+  cur.clear();
+  int n = 0;
+  if (prefetched) {
+    wait_fill();
+    cur.swap(ahead);
+    n = ahead_r;
+    prefetched = false;
+  } else if (inner->valid()) {
+    n = inner->get_next_batch(batch, &cur);
+  }
+  pos = cur.begin();
+  if (n < 0) {
+    r = n;
+    return r;
+  }
+  if (n > 0 && inner->valid()) {
+    batch = MIN(batch * 2, max_batch);
+    prefetched = true;
+    {
+      Mutex::Locker l(lock);
+      filling = true;
+    }
+    wq->queue(new C_Fill(this, batch));
+  }
+  return 0;
+}
+
+int PrefetchingObjectMapIterator::seek_to_first()
+{
+  wait_fill();
+  return reset(inner->seek_to_first());
+}
+
+int PrefetchingObjectMapIterator::upper_bound(const string &after)
+{
+  wait_fill();
+  return reset(inner->upper_bound(after));
+}
+
+int PrefetchingObjectMapIterator::lower_bound(const string &to)
+{
+  wait_fill();
+  return reset(inner->lower_bound(to));
+}
+
+bool PrefetchingObjectMapIterator::valid()
+{
+  return pos != cur.end();
+}
+
+int PrefetchingObjectMapIterator::next()
+{
+  assert(valid());
+  ++pos;
+  if (pos == cur.end())
+    return advance();
+  return 0;
+}
+
+string PrefetchingObjectMapIterator::key()
+{
+  assert(valid());
+  return pos->first;
+}
+
+bufferlist PrefetchingObjectMapIterator::value()
+{
+  assert(valid());
+  return pos->second;
+}
+
+int PrefetchingObjectMapIterator::status()
+{
+  return r;
+}
+
+int PrefetchingObjectMapIterator::get_next_batch(
+  size_t max,
+  map<string, bufferlist> *out)
+{
+  int n = 0;
+  while (max > 0 && valid()) {
+    map<string, bufferlist>::iterator end = pos;
+    size_t taken = 0;
+    for (; end != cur.end() && taken < max; ++end, ++taken) ;
+    out->insert(pos, end);
+    pos = end;
+    n += taken;
+    max -= taken;
+    if (pos == cur.end()) {
+      int ret = advance();
+      if (ret < 0)
+	return ret;
+    }
+  }
+  return r < 0 ? r : n;
+}
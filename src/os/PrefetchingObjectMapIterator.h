@@ -0,0 +1,92 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef OS_PREFETCHINGOBJECTMAPITERATOR_H
+#define OS_PREFETCHINGOBJECTMAPITERATOR_H
+
+#include <map>
+#include <string>
+
+#include "include/buffer.h"
+#include "include/Context.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/WorkQueue.h"
+#include "ObjectMap.h"
+
+/**
+ * PrefetchingObjectMapIterator
+ *
+ * Wraps an omap iterator and serves it out of batches of entries read
+ * from the wrapped one.  The first batch after a seek is read inline and
+ * kept small, so a short listing costs no more than before.  Once the
+ * caller has walked past a whole batch the scan is assumed to be long:
+ * each following batch is twice the size of the previous one, up to
+ * max_batch, and is read on wq while the caller consumes the current
+ * one.
+ *
+ * The wrapped iterator is only ever touched by one thread at a time;
+ * seeks and destruction wait for an outstanding read-ahead first.
+ */
+class PrefetchingObjectMapIterator :
+  public ObjectMap::ObjectMapIteratorImpl {
+  static const size_t MIN_BATCH = 16;
+
+  ObjectMap::ObjectMapIterator inner;
+  ContextWQ *wq;
+  const size_t max_batch;
+
+  Mutex lock;
+  Cond cond;
+  bool filling;                        ///< read-ahead queued or running
+  map<string, bufferlist> ahead;       ///< result of the read-ahead
+  int ahead_r;                         ///< ... and its return value
+
+  map<string, bufferlist> cur;         ///< batch being consumed
+  map<string, bufferlist>::iterator pos;
+  int r;                               ///< first error seen, if any
+  size_t batch;                        ///< size of the next read
+  bool prefetched;                     ///< ahead holds (or will) the next batch
+
+  struct C_Fill : public Context {
+    PrefetchingObjectMapIterator *it;
+    size_t n;
+    C_Fill(PrefetchingObjectMapIterator *it, size_t n) : it(it), n(n) {}
+    void finish(int) {
+      it->fill_ahead(n);
+    }
+  };
+  void fill_ahead(size_t n);
+  void wait_fill();
+
+  /// read the first batch after inner was repositioned
+  int reset(int seek_r);
+  /// replace cur with the next batch
+  int advance();
+
+public:
+  PrefetchingObjectMapIterator(ObjectMap::ObjectMapIterator inner,
+			       ContextWQ *wq, size_t max_batch);
+  ~PrefetchingObjectMapIterator();
+
+  int seek_to_first();
+  int upper_bound(const string &after);
+  int lower_bound(const string &to);
+  bool valid();
+  int next();
+  string key();
+  bufferlist value();
+  int status();
+  int get_next_batch(size_t max, map<string, bufferlist> *out);
+};
+
+#endif
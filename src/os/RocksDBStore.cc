@@ -14,9 +14,12 @@
 #include "rocksdb/slice.h"
 #include "rocksdb/cache.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/iterator.h"
 #include "rocksdb/utilities/convenience.h"
 using std::string;
 #include "common/perf_counters.h"
+#include "common/admin_socket.h"
+#include "include/str_list.h"
 #include "include/str_map.h"
 #include "KeyValueDB.h"
 #include "RocksDBStore.h"
@@ -106,6 +109,229 @@ int RocksDBStore::init(string _options_str)
   return 0;
 }
 
+int RocksDBStore::parse_cf_options(const string &opt_str,
+				   rocksdb::ColumnFamilyOptions *opt)
+{
+  map<string, string> str_map;
+  int r = get_str_map(opt_str, ",", &str_map);
+  if (r < 0)
+    return r;
+  rocksdb::BlockBasedTableOptions table_opt;
+  bool table = false;
+  for (map<string, string>::iterator it = str_map.begin();
+       it != str_map.end();
+       ++it) {
+    if (it->first == "block_cache_size" || it->first == "bloom_bits") {
+      std::string err;
+      int64_t v = strict_sistrtoll(it->second.c_str(), &err);
+      if (!err.empty() || v < 0)
+	return -EINVAL;
+      if (it->first == "block_cache_size")
+	table_opt.block_cache = rocksdb::NewLRUCache(v);
+      else
+	table_opt.filter_policy.reset(rocksdb::NewBloomFilterPolicy(v));
+      table = true;
+      continue;
+    }
+    string this_opt = it->first + "=" + it->second;
+    rocksdb::Status status =
+      rocksdb::GetColumnFamilyOptionsFromString(*opt, this_opt, opt);
+    if (!status.ok()) {
+      derr << status.ToString() << dendl;
+      return -EINVAL;
+    }
+  }
+  if (table)
+    opt->table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_opt));
+  return 0;
+}
+
+int RocksDBStore::set_column_families(const string &spec)
+{
+  // name:prefix[|prefix...][:option=value[,option=value...]] ...
+  vector<ColumnFamily> parsed;
+  list<string> entries;
+  get_str_list(spec, " \t\n", entries);
+  for (list<string>::iterator p = entries.begin(); p != entries.end(); ++p) {
+    ColumnFamily cf;
+    size_t a = p->find(':');
+    if (a == string::npos)
+      return -EINVAL;
+    size_t b = p->find(':', a + 1);
+    cf.name = p->substr(0, a);
+    list<string> prefixes;
+    get_str_list(p->substr(a + 1, b == string::npos ? string::npos : b - a - 1),
+		 "|", prefixes);
+    cf.prefixes.assign(prefixes.begin(), prefixes.end());
+    if (b != string::npos)
+      cf.options = p->substr(b + 1);
+    if (cf.name.empty() || cf.name == rocksdb::kDefaultColumnFamilyName ||
+	cf.prefixes.empty()) {
+      derr << __func__ << " bad column family '" << *p << "'" << dendl;
+      return -EINVAL;
+    }
+    rocksdb::ColumnFamilyOptions cf_opt;
+    if (parse_cf_options(cf.options, &cf_opt) < 0) {
+      derr << __func__ << " bad options for column family " << cf.name << dendl;
+      return -EINVAL;
+    }
+    parsed.push_back(cf);
+  }
+  cfs.swap(parsed);
+  return 0;
+}
+
+int RocksDBStore::check_column_families()
+{
+  // a key's family follows from its prefix alone; keys written under a
+  // different configuration would be shadowed or duplicated
+  vector<rocksdb::ColumnFamilyHandle*> handles;
+  handles.push_back(db->DefaultColumnFamily());
+  for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p)
+    handles.push_back(p->handle);
+  for (unsigned i = 0; i < handles.size(); ++i) {
+    rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions(), handles[i]);
+    vector<string> probe;
+    if (i > 0) {
+      it->SeekToFirst();
+      if (it->Valid())
+	probe.push_back(it->key().ToString());
+      it->SeekToLast();
+      if (it->Valid())
+	probe.push_back(it->key().ToString());
+    }
+    for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p) {
+      for (vector<string>::iterator q = p->prefixes.begin();
+	   q != p->prefixes.end();
+	   ++q) {
+	it->Seek(rocksdb::Slice(*q));
+	if (it->Valid() && it->key().starts_with(rocksdb::Slice(*q)))
+	  probe.push_back(it->key().ToString());
+      }
+    }
+    delete it;
+    for (vector<string>::iterator k = probe.begin(); k != probe.end(); ++k) {
+      if (get_cf_handle(*k) != handles[i]) {
+	derr << __func__ << " " << path << " holds keys in column family "
+	     << (i ? cfs[i - 1].name : rocksdb::kDefaultColumnFamilyName)
+	     << " that the configured families place elsewhere" << dendl;
+	return -EINVAL;
+      }
+    }
+  }
+  return 0;
+}
+
+int RocksDBStore::open_column_families(rocksdb::Options &opt)
+{
+  set<string> want;
+  want.insert(rocksdb::kDefaultColumnFamilyName);
+  for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p)
+    want.insert(p->name);
+  vector<string> existing;
+  rocksdb::Status status =
+    rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions(opt), path, &existing);
+  if (status.ok()) {
+    for (vector<string>::iterator p = existing.begin();
+	 p != existing.end();
+	 ++p) {
+      if (!want.count(*p)) {
+	derr << __func__ << " " << path << " has column family " << *p
+	     << " which is not configured" << dendl;
+	return -EINVAL;
+      }
+    }
+  }
+  opt.create_missing_column_families = true;
+
+  vector<rocksdb::ColumnFamilyDescriptor> descs;
+  descs.push_back(rocksdb::ColumnFamilyDescriptor(
+		    rocksdb::kDefaultColumnFamilyName,
+		    rocksdb::ColumnFamilyOptions(opt)));
+  for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p) {
+    rocksdb::ColumnFamilyOptions cf_opt(opt);
+    int r = parse_cf_options(p->options, &cf_opt);
+    if (r < 0)
+      return r;
+    descs.push_back(rocksdb::ColumnFamilyDescriptor(p->name, cf_opt));
+  }
+  vector<rocksdb::ColumnFamilyHandle*> handles;
+  status = rocksdb::DB::Open(rocksdb::DBOptions(opt), path, descs,
+			     &handles, &db);
+  if (!status.ok()) {
+    derr << status.ToString() << dendl;
+    return -EINVAL;
+  }
+  // the default family is reached through db->DefaultColumnFamily()
+  delete handles[0];
+  for (unsigned i = 0; i < cfs.size(); ++i)
+    cfs[i].handle = handles[i + 1];
+
+  int r = check_column_families();
+  if (r < 0) {
+    for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p) {
+      delete p->handle;
+      p->handle = NULL;
+    }
+    delete db;
+    db = NULL;
+  }
+  return r;
+}
+
+class RocksDBSocketHook : public AdminSocketHook {
+  RocksDBStore *store;
+public:
+  explicit RocksDBSocketHook(RocksDBStore *s) : store(s) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) {
+    Formatter *f = Formatter::create(format, "json-pretty", "json-pretty");
+    store->dump_stats(f);
+    stringstream ss;
+    f->flush(ss);
+    delete f;
+    out.append(ss);
+    return true;
+  }
+};
+
+void RocksDBStore::dump_stats(Formatter *f)
+{
+  static const char *props[] = {
+    "rocksdb.estimate-num-keys",
+    "rocksdb.cur-size-all-mem-tables",
+    "rocksdb.num-immutable-mem-table",
+    "rocksdb.num-files-at-level0",
+    "rocksdb.compaction-pending",
+    "rocksdb.cfstats",
+  };
+  f->open_object_section("rocksdb");
+  f->dump_string("path", path);
+  f->open_array_section("column_families");
+  for (int i = -1; i < (int)cfs.size(); ++i) {
+    rocksdb::ColumnFamilyHandle *h =
+      i < 0 ? db->DefaultColumnFamily() : cfs[i].handle;
+    f->open_object_section("column_family");
+    f->dump_string("name", i < 0 ? rocksdb::kDefaultColumnFamilyName : cfs[i].name);
+    f->open_array_section("prefixes");
+    if (i >= 0) {
+      for (vector<string>::iterator p = cfs[i].prefixes.begin();
+	   p != cfs[i].prefixes.end();
+	   ++p)
+	f->dump_string("prefix", *p);
+    }
+    f->close_section();
+    for (unsigned j = 0; j < sizeof(props) / sizeof(props[0]); ++j) {
+      string v;
+      if (db->GetProperty(h, props[j], &v))
+	f->dump_string(props[j] + strlen("rocksdb."), v);
+    }
+    f->close_section();
+  }
+  f->close_section();
+  f->close_section();
+}
+
 int RocksDBStore::do_open(ostream &out, bool create_if_missing)
 {
   rocksdb::Options opt;
@@ -117,10 +343,16 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
   }
   opt.create_if_missing = create_if_missing;
 
-  status = rocksdb::DB::Open(opt, path, &db);
-  if (!status.ok()) {
-    derr << status.ToString() << dendl;
-    return -EINVAL;
+  if (cfs.empty()) {
+    status = rocksdb::DB::Open(opt, path, &db);
+    if (!status.ok()) {
+      derr << status.ToString() << dendl;
+      return -EINVAL;
+    }
+  } else {
+    r = open_column_families(opt);
+    if (r < 0)
+      return r;
   }
 
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
@@ -136,6 +368,18 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 
+  asok_hook = new RocksDBSocketHook(this);
+  r = cct->get_admin_socket()->register_command(
+    "dump_rocksdb_stats", "dump_rocksdb_stats", asok_hook,
+    "dump rocksdb statistics for each column family");
+  if (r < 0) {
+    // another store in this process got there first
+    lgeneric_dout(cct, 1) << __func__ << " not registering dump_rocksdb_stats: "
+	    << cpp_strerror(r) << dendl;
+    delete asok_hook;
+    asok_hook = NULL;
+  }
+
   if (compact_on_mount) {
     derr << "Compacting rocksdb store..." << dendl;
     compact();
@@ -159,6 +403,8 @@ RocksDBStore::~RocksDBStore()
   close();
   delete logger;
 
+  for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p)
+    delete p->handle;
   // Ensure db is destroyed before dependent db_cache and filterpolicy
   delete db;
 }
@@ -176,6 +422,12 @@ void RocksDBStore::close()
     compact_queue_lock.Unlock();
   }
 
+  if (asok_hook) {
+    cct->get_admin_socket()->unregister_command("dump_rocksdb_stats");
+    delete asok_hook;
+    asok_hook = NULL;
+  }
+
   if (logger)
     cct->get_perfcounters_collection()->remove(logger);
 }
@@ -191,6 +443,8 @@ int RocksDBStore::submit_transaction(KeyValueDB::Transaction t)
   utime_t lat = ceph_clock_now(g_ceph_context) - start;
   logger->inc(l_rocksdb_txns);
   logger->tinc(l_rocksdb_submit_latency, lat);
+  if (s.ok())
+    compact_removed(_t);
   return s.ok() ? 0 : -1;
 }
 
@@ -206,8 +460,26 @@ int RocksDBStore::submit_transaction_sync(KeyValueDB::Transaction t)
   utime_t lat = ceph_clock_now(g_ceph_context) - start;
   logger->inc(l_rocksdb_txns);
   logger->tinc(l_rocksdb_submit_sync_latency, lat);
+  if (s.ok())
+    compact_removed(_t);
   return s.ok() ? 0 : -1;
 }
+void RocksDBStore::compact_removed(const RocksDBTransactionImpl *t)
+{
+  // the removed keys linger as tombstones that every read and compaction
+  // of the range has to skip until a compaction reaches them
+  uint64_t min_keys = cct->_conf->rocksdb_compact_on_rm_range;
+  if (!min_keys)
+    return;
+  for (list<pair<pair<string, string>, uint64_t> >::const_iterator p =
+	 t->removed.begin();
+       p != t->removed.end();
+       ++p) {
+    if (p->second >= min_keys && !p->first.second.empty())
+      compact_range_async(p->first.first, p->first.second);
+  }
+}
+
 int RocksDBStore::get_info_log_level(string info_log_level)
 {
   if (info_log_level == "debug") {
@@ -240,10 +512,11 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const bufferlist &to_set_bl)
 {
   string key = combine_strings(prefix, k);
+  rocksdb::ColumnFamilyHandle *cf = db->get_cf_handle(key);
   //bufferlist::c_str() is non-constant, so we need to make a copy
   bufferlist val = to_set_bl;
-  bat->Delete(rocksdb::Slice(key));
-  bat->Put(rocksdb::Slice(key),
+  bat->Delete(cf, rocksdb::Slice(key));
+  bat->Put(cf, rocksdb::Slice(key),
 	  rocksdb::Slice(val.c_str(), val.length()));
 }
 
@@ -251,18 +524,38 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
   string key = combine_strings(prefix, k);
-  bat->Delete(rocksdb::Slice(k));
+  bat->Delete(db->get_cf_handle(key), rocksdb::Slice(key));
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
-  KeyValueDB::Iterator it = db->get_iterator(prefix);
-  for (it->seek_to_first();
-       it->valid();
-       it->next()) {
-    string key = combine_strings(prefix, it->key());
-    bat->Delete(key);
+  // keys under sub-prefixes too, so work on raw keys: recombining a split
+  // key with the shorter prefix would name a different key
+  rm_raw_range(prefix, past_raw_prefix(prefix));
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rm_range(const string &prefix,
+						     const string &start,
+						     const string &end)
+{
+  rm_raw_range(combine_strings(prefix, start),
+	       end.empty() ? past_prefix(prefix) : combine_strings(prefix, end));
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rm_raw_range(const string &start,
+							 const string &end)
+{
+  rocksdb::Iterator *it = db->new_iterator(rocksdb::ReadOptions());
+  uint64_t num = 0;
+  for (it->Seek(rocksdb::Slice(start));
+       it->Valid() && (end.empty() || it->key().compare(rocksdb::Slice(end)) < 0);
+       it->Next()) {
+    bat->Delete(db->get_cf_handle(it->key().ToString()), it->key());
+    ++num;
   }
+  delete it;
+  if (num)
+    removed.push_back(make_pair(make_pair(start, end), num));
 }
 
 int RocksDBStore::get(
@@ -320,6 +613,8 @@ void RocksDBStore::compact()
 {
   logger->inc(l_rocksdb_compact);
   db->CompactRange(NULL, NULL);
+  for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p)
+    db->CompactRange(p->handle, NULL, NULL);
 }
 
 
@@ -395,6 +690,8 @@ void RocksDBStore::compact_range(const string& start, const string& end)
     rocksdb::Slice cstart(start);
     rocksdb::Slice cend(end);
     db->CompactRange(&cstart, &cend);
+    for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p)
+      db->CompactRange(p->handle, &cstart, &cend);
 }
 RocksDBStore::RocksDBWholeSpaceIteratorImpl::~RocksDBWholeSpaceIteratorImpl()
 {
@@ -491,11 +788,162 @@ string RocksDBStore::past_prefix(const string &prefix)
 }
 
 
+/**
+ * Presents the iterators of several column families as one, in key
+ * order.  Every key lives in exactly one family.
+ */
+class MergingIterator : public rocksdb::Iterator {
+  vector<rocksdb::Iterator*> children;
+  rocksdb::Iterator *cur;
+  bool forward;
+
+  void find_smallest() {
+    cur = NULL;
+    for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	 p != children.end();
+	 ++p) {
+      if ((*p)->Valid() && (!cur || (*p)->key().compare(cur->key()) < 0))
+	cur = *p;
+    }
+  }
+  void find_largest() {
+    cur = NULL;
+    for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	 p != children.end();
+	 ++p) {
+      if ((*p)->Valid() && (!cur || (*p)->key().compare(cur->key()) > 0))
+	cur = *p;
+    }
+  }
+
+public:
+  explicit MergingIterator(const vector<rocksdb::Iterator*> &c)
+    : children(c), cur(NULL), forward(true) {}
+  ~MergingIterator() {
+    for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	 p != children.end();
+	 ++p)
+      delete *p;
+  }
+
+  bool Valid() const {
+    return cur != NULL;
+  }
+  void SeekToFirst() {
+    for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	 p != children.end();
+	 ++p)
+      (*p)->SeekToFirst();
+    forward = true;
+    find_smallest();
+  }
+  void SeekToLast() {
+    for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	 p != children.end();
+	 ++p)
+      (*p)->SeekToLast();
+    forward = false;
+    find_largest();
+  }
+  void Seek(const rocksdb::Slice &target) {
+    for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	 p != children.end();
+	 ++p)
+      (*p)->Seek(target);
+    forward = true;
+    find_smallest();
+  }
+  void Next() {
+    assert(cur);
+    if (!forward) {
+      // the others sit before the current key; move them past it
+      string k = cur->key().ToString();
+      for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	   p != children.end();
+	   ++p) {
+	if (*p != cur)
+	  (*p)->Seek(k);
+      }
+      forward = true;
+    }
+    cur->Next();
+    find_smallest();
+  }
+  void Prev() {
+    assert(cur);
+    if (forward) {
+      // the others sit past the current key; move them before it
+      string k = cur->key().ToString();
+      for (vector<rocksdb::Iterator*>::iterator p = children.begin();
+	   p != children.end();
+	   ++p) {
+	if (*p == cur)
+	  continue;
+	(*p)->Seek(k);
+	if ((*p)->Valid())
+	  (*p)->Prev();
+	else
+	  (*p)->SeekToLast();
+      }
+      forward = false;
+    }
+    cur->Prev();
+    find_largest();
+  }
+  rocksdb::Slice key() const {
+    return cur->key();
+  }
+  rocksdb::Slice value() const {
+    return cur->value();
+  }
+  rocksdb::Status status() const {
+    for (vector<rocksdb::Iterator*>::const_iterator p = children.begin();
+	 p != children.end();
+	 ++p) {
+      if (!(*p)->status().ok())
+	return (*p)->status();
+    }
+    return rocksdb::Status::OK();
+  }
+};
+
+rocksdb::ColumnFamilyHandle *RocksDBStore::get_cf_handle(const string &raw_key)
+{
+  rocksdb::ColumnFamilyHandle *h = db->DefaultColumnFamily();
+  size_t best = 0;
+  for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p) {
+    for (vector<string>::iterator q = p->prefixes.begin();
+	 q != p->prefixes.end();
+	 ++q) {
+      if (q->size() > best && raw_key.compare(0, q->size(), *q) == 0) {
+	h = p->handle;
+	best = q->size();
+      }
+    }
+  }
+  return h;
+}
+
+rocksdb::Iterator *RocksDBStore::new_iterator(const rocksdb::ReadOptions &opt)
+{
+  if (cfs.empty())
+    return db->NewIterator(opt);
+  vector<rocksdb::ColumnFamilyHandle*> handles;
+  handles.push_back(db->DefaultColumnFamily());
+  for (vector<ColumnFamily>::iterator p = cfs.begin(); p != cfs.end(); ++p)
+    handles.push_back(p->handle);
+  vector<rocksdb::Iterator*> iters;
+  rocksdb::Status s = db->NewIterators(opt, handles, &iters);
+  if (!s.ok())
+    return rocksdb::NewErrorIterator(s);
+  return new MergingIterator(iters);
+}
+
 RocksDBStore::WholeSpaceIterator RocksDBStore::_get_iterator()
 {
   return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
     new RocksDBWholeSpaceIteratorImpl(
-      db->NewIterator(rocksdb::ReadOptions())
+      new_iterator(rocksdb::ReadOptions())
     )
   );
 }
@@ -510,7 +958,7 @@ RocksDBStore::WholeSpaceIterator RocksDBStore::_get_snapshot_iterator()
 
   return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
     new RocksDBSnapshotIteratorImpl(db, snapshot,
-      db->NewIterator(options))
+      new_iterator(options))
   );
 }
 
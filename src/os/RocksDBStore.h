@@ -9,6 +9,7 @@
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 #include <memory>
 #include <boost/scoped_ptr.hpp>
 
@@ -20,6 +21,7 @@
 
 #include "common/ceph_context.h"
 class PerfCounters;
+class AdminSocketHook;
 
 enum {
   l_rocksdb_first = 34300,
@@ -43,7 +45,10 @@ namespace rocksdb{
   class Slice;
   class WriteBatch;
   class Iterator;
+  class ColumnFamilyHandle;
   struct Options;
+  struct ColumnFamilyOptions;
+  struct ReadOptions;
 }
 /**
  * Uses RocksDB to implement the KeyValueDB interface
@@ -56,6 +61,31 @@ class RocksDBStore : public KeyValueDB {
   string options_str;
   int do_open(ostream &out, bool create_if_missing);
 
+  /**
+   * A column family holding every key whose prefix starts with one of
+   * prefixes.  Keys matching no family stay in the default one.
+   */
+  struct ColumnFamily {
+    string name;
+    vector<string> prefixes;
+    string options;   ///< per-family rocksdb options
+    rocksdb::ColumnFamilyHandle *handle;
+    ColumnFamily() : handle(NULL) {}
+  };
+  vector<ColumnFamily> cfs;
+
+  /// family for a raw (combined) key
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const string &raw_key);
+  /// iterator over all families, merged into one key order
+  rocksdb::Iterator *new_iterator(const rocksdb::ReadOptions &opt);
+  int parse_cf_options(const string &opt_str, rocksdb::ColumnFamilyOptions *opt);
+  int open_column_families(rocksdb::Options &opt);
+  int check_column_families();
+
+  AdminSocketHook *asok_hook;
+  friend class RocksDBSocketHook;
+  void dump_stats(Formatter *f);
+
   // manage async compactions
   Mutex compact_queue_lock;
   Cond compact_queue_cond;
@@ -87,6 +117,7 @@ public:
   int ParseOptionsFromString(const string opt_str, rocksdb::Options &opt);
   static int _test_init(const string& dir);
   int init(string options_str);
+  int set_column_families(const string &spec);
   /// compact rocksdb for all keys with a given prefix
   void compact_prefix(const string& prefix) {
     compact_range(prefix, past_prefix(prefix));
@@ -108,6 +139,7 @@ public:
     logger(NULL),
     path(path),
     db(NULL),
+    asok_hook(NULL),
     compact_queue_lock("RocksDBStore::compact_thread_lock"),
     compact_queue_stop(false),
     compact_thread(this),
@@ -133,9 +165,13 @@ public:
   public:
     rocksdb::WriteBatch *bat;
     RocksDBStore *db;
+    /// raw ranges removed by this transaction and how many keys each held
+    list<pair<pair<string, string>, uint64_t> > removed;
 
     RocksDBTransactionImpl(RocksDBStore *_db);
     ~RocksDBTransactionImpl();
+    /// remove raw keys in [start, end); end "" for no bound
+    void rm_raw_range(const string &start, const string &end);
     void set(
       const string &prefix,
       const string &k,
@@ -146,8 +182,15 @@ public:
     void rmkeys_by_prefix(
       const string &prefix
       );
+    void rm_range(
+      const string &prefix,
+      const string &start,
+      const string &end);
   };
 
+  /// queue compaction of the big ranges a committed transaction removed
+  void compact_removed(const RocksDBTransactionImpl *t);
+
   KeyValueDB::Transaction get_transaction() {
     return std::shared_ptr< RocksDBTransactionImpl >(
       new RocksDBTransactionImpl(this));
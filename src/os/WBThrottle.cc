@@ -3,11 +3,14 @@
 
 #include "acconfig.h"
 
+#include <sys/stat.h>
+
 #include "os/WBThrottle.h"
 #include "common/perf_counters.h"
 
 WBThrottle::WBThrottle(CephContext *cct) :
   cur_ios(0), cur_size(0),
+  adaptive(false), batch(1), max_delay(0),
   cct(cct),
   logger(NULL),
   stopping(true),
@@ -28,6 +31,12 @@ WBThrottle::WBThrottle(CephContext *cct) :
   b.add_u64(l_wbthrottle_ios_wb, "ios_wb", "Written operations");
   b.add_u64(l_wbthrottle_inodes_dirtied, "inodes_dirtied", "Entries waiting for write");
   b.add_u64(l_wbthrottle_inodes_wb, "inodes_wb", "Written entries");
+  b.add_u64(l_wbthrottle_flush_rate, "flush_rate",
+	    "Measured flush throughput (bytes/sec)");
+  b.add_u64(l_wbthrottle_pacing_rate, "pacing_rate",
+	    "Rate writers are currently paced at (bytes/sec)");
+  b.add_time_avg(l_wbthrottle_flush_lat, "flush_lat", "Object flush latency");
+  b.add_time(l_wbthrottle_stall, "stall", "Time writers spent throttled");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
   for (unsigned i = l_wbthrottle_first + 1; i != l_wbthrottle_last; ++i)
@@ -49,7 +58,11 @@ void WBThrottle::start()
     Mutex::Locker l(lock);
     stopping = false;
   }
-  create();
+  int n = MAX(1, cct->_conf->filestore_wbthrottle_flusher_threads);
+  for (int i = 0; i < n; ++i) {
+    flushers.push_back(new Flusher(this));
+    flushers.back()->create();
+  }
 }
 
 void WBThrottle::stop()
@@ -57,10 +70,16 @@ void WBThrottle::stop()
   {
     Mutex::Locker l(lock);
     stopping = true;
-    cond.Signal();
+    cond.SignalAll();
   }
 
-  join();
+  for (vector<Flusher*>::iterator i = flushers.begin();
+       i != flushers.end();
+       ++i) {
+    (*i)->join();
+    delete *i;
+  }
+  flushers.clear();
 }
 
 const char** WBThrottle::get_tracked_conf_keys() const
@@ -78,6 +97,9 @@ const char** WBThrottle::get_tracked_conf_keys() const
     "filestore_wbthrottle_xfs_ios_hard_limit",
     "filestore_wbthrottle_xfs_inodes_start_flusher",
     "filestore_wbthrottle_xfs_inodes_hard_limit",
+    "filestore_wbthrottle_adaptive",
+    "filestore_wbthrottle_adaptive_batch",
+    "filestore_wbthrottle_adaptive_max_delay",
     NULL
   };
   return KEYS;
@@ -115,7 +137,12 @@ void WBThrottle::set_from_conf()
   } else {
     assert(0 == "invalid value for fs");
   }
-  cond.Signal();
+  adaptive = cct->_conf->filestore_wbthrottle_adaptive;
+  batch = adaptive ? MAX(1, cct->_conf->filestore_wbthrottle_adaptive_batch) : 1;
+  max_delay = cct->_conf->filestore_wbthrottle_adaptive_max_delay;
+  if (!adaptive)
+    paced_until = utime_t();
+  cond.SignalAll();
 }
 
 void WBThrottle::handle_conf_change(const md_config_t *conf,
@@ -130,56 +157,165 @@ void WBThrottle::handle_conf_change(const md_config_t *conf,
   }
 }
 
-bool WBThrottle::get_next_should_flush(
-  boost::tuple<ghobject_t, FDRef, PendingWB> *next)
+bool WBThrottle::get_next_should_flush(vector<wb_t> *next)
 {
   assert(lock.is_locked());
   assert(next);
-  while (!stopping && !beyond_limit())
-         cond.Wait(lock);
-  if (stopping)
-    return false;
-  assert(!pending_wbs.empty());
-  ghobject_t obj(pop_object());
-  
-  ceph::unordered_map<ghobject_t, pair<PendingWB, FDRef> >::iterator i =
-    pending_wbs.find(obj);
-  *next = boost::make_tuple(obj, i->second.second, i->second.first);
-  pending_wbs.erase(i);
-  return true;
-}
+  while (true) {
+    while (!stopping && !beyond_limit())
+      cond.Wait(lock);
+    if (stopping)
+      return false;
+    assert(!pending_wbs.empty());
+    list<ghobject_t>::iterator p = lru.begin();
+    while (next->size() < batch && p != lru.end()) {
+      // an object dirtied again while another flusher has it waits for
+      // that flush to finish, so that clearing stays accurate
+      if (clearing.count(*p)) {
+	++p;
+	continue;
+      }
+      ghobject_t obj(*p++);
+      remove_object(obj);
+      ceph::unordered_map<ghobject_t, pair<PendingWB, FDRef> >::iterator i =
+	pending_wbs.find(obj);
+      const PendingWB &wb = i->second.first;
+      next->push_back(boost::make_tuple(obj, i->second.second, wb));
+      clearing.insert(obj);
 
+      cur_ios -= wb.ios;
+      logger->dec(l_wbthrottle_ios_dirtied, wb.ios);
+      logger->inc(l_wbthrottle_ios_wb, wb.ios);
+      cur_size -= wb.size;
+      logger->dec(l_wbthrottle_bytes_dirtied, wb.size);
+      logger->inc(l_wbthrottle_bytes_wb, wb.size);
+      logger->dec(l_wbthrottle_inodes_dirtied);
+      logger->inc(l_wbthrottle_inodes_wb);
+      pending_wbs.erase(i);
+    }
+    if (!next->empty())
+      return true;
+    // everything dirty is being flushed; wait for one to finish
+    cond.Wait(lock);
+  }
+}
 
-void *WBThrottle::entry()
+void WBThrottle::flush_object(const wb_t &wb)
 {
-  Mutex::Locker l(lock);
-  boost::tuple<ghobject_t, FDRef, PendingWB> wb;
-  while (get_next_should_flush(&wb)) {
-    clearing = wb.get<0>();
-    cur_ios -= wb.get<2>().ios;
-    logger->dec(l_wbthrottle_ios_dirtied, wb.get<2>().ios);
-    logger->inc(l_wbthrottle_ios_wb, wb.get<2>().ios);
-    cur_size -= wb.get<2>().size;
-    logger->dec(l_wbthrottle_bytes_dirtied, wb.get<2>().size);
-    logger->inc(l_wbthrottle_bytes_wb, wb.get<2>().size);
-    logger->dec(l_wbthrottle_inodes_dirtied);
-    logger->inc(l_wbthrottle_inodes_wb);
-    lock.Unlock();
 #ifdef HAVE_FDATASYNC
-    ::fdatasync(**wb.get<1>());
+  ::fdatasync(**wb.get<1>());
 #else
-    ::fsync(**wb.get<1>());
+  ::fsync(**wb.get<1>());
 #endif
 #ifdef HAVE_POSIX_FADVISE
-    if (g_conf->filestore_fadvise && wb.get<2>().nocache) {
-      int fa_r = posix_fadvise(**wb.get<1>(), 0, 0, POSIX_FADV_DONTNEED);
-      assert(fa_r == 0);
-    }
+  if (g_conf->filestore_fadvise && wb.get<2>().nocache) {
+    int fa_r = posix_fadvise(**wb.get<1>(), 0, 0, POSIX_FADV_DONTNEED);
+    assert(fa_r == 0);
+  }
 #endif
+}
+
+void WBThrottle::flush_start(dev_t dev)
+{
+  assert(lock.is_locked());
+  DeviceStats &d = devices[dev];
+  if (d.inflight++ == 0)
+    d.busy_start = ceph_clock_now(cct);
+}
+
+void WBThrottle::flush_finish(dev_t dev, uint64_t bytes, utime_t lat)
+{
+  assert(lock.is_locked());
+  DeviceStats &d = devices[dev];
+  utime_t now = ceph_clock_now(cct);
+  d.busy += now - d.busy_start;
+  d.busy_start = now;
+  d.bytes += bytes;
+  --d.inflight;
+  logger->tinc(l_wbthrottle_flush_lat, lat);
+
+  // sample once we have been busy long enough for the rate to mean
+  // something; small flushes are mostly seek or journal commit time
+  if (d.busy < .1)
+    return;
+  double sample = d.bytes / d.busy;
+  d.rate = d.rate ? d.rate * .7 + sample * .3 : sample;
+  d.busy = 0;
+  d.bytes = 0;
+
+  double total = 0;
+  for (map<dev_t, DeviceStats>::iterator i = devices.begin();
+       i != devices.end();
+       ++i)
+    total += i->second.rate;
+  logger->set(l_wbthrottle_flush_rate, total);
+}
+
+double WBThrottle::get_pacing_rate() const
+{
+  assert(lock.is_locked());
+  if (!adaptive || !beyond_limit())
+    return 0;
+  double rate = 0;
+  for (map<dev_t, DeviceStats>::const_iterator i = devices.begin();
+       i != devices.end();
+       ++i)
+    rate += i->second.rate;
+  if (!rate)
+    return 0;  // nothing measured yet; only the hard limits apply
+
+  // how far we are from the start_flusher towards the hard limits, by
+  // whichever is closest
+  double load = 0;
+  pair<uint64_t, uint64_t> limits[3] = { size_limits, io_limits, fd_limits };
+  uint64_t cur[3] = { cur_size, cur_ios, pending_wbs.size() };
+  for (int i = 0; i < 3; ++i) {
+    if (limits[i].second <= limits[i].first || cur[i] <= limits[i].first)
+      continue;
+    load = MAX(load, (double)(cur[i] - limits[i].first) /
+	       (limits[i].second - limits[i].first));
+  }
+  return rate * MAX(.1, 1 - MIN(load, 1));
+}
+
+void *WBThrottle::entry()
+{
+  Mutex::Locker l(lock);
+  vector<wb_t> wbs;
+  while (get_next_should_flush(&wbs)) {
+    lock.Unlock();
+    // flush in device, inode and offset order to keep writeback as
+    // sequential as we can
+    typedef pair<pair<dev_t, ino_t>, uint64_t> pos_t;
+    vector<pair<pos_t, unsigned> > order;
+    for (unsigned i = 0; i < wbs.size(); ++i) {
+      struct stat st;
+      memset(&st, 0, sizeof(st));
+      if (wbs.size() > 1 || adaptive)
+	::fstat(**wbs[i].get<1>(), &st);
+      order.push_back(make_pair(
+	pos_t(make_pair(st.st_dev, st.st_ino), wbs[i].get<2>().offset), i));
+    }
+    if (order.size() > 1)
+      sort(order.begin(), order.end());
+
+    for (unsigned j = 0; j < order.size(); ++j) {
+      wb_t &wb = wbs[order[j].second];
+      dev_t dev = order[j].first.first.first;
+      lock.Lock();
+      flush_start(dev);
+      lock.Unlock();
+      utime_t start = ceph_clock_now(cct);
+      flush_object(wb);
+      utime_t lat = ceph_clock_now(cct) - start;
+      lock.Lock();
+      flush_finish(dev, wb.get<2>().size, lat);
+      clearing.erase(wb.get<0>());
+      cond.SignalAll();
+      lock.Unlock();
+    }
     lock.Lock();
-    clearing = ghobject_t();
-    cond.Signal();
-    wb = boost::tuple<ghobject_t, FDRef, PendingWB>();
+    wbs.clear();
   }
   return 0;
 }
@@ -207,10 +343,26 @@ void WBThrottle::queue_wb(
   cur_size += len;
   logger->inc(l_wbthrottle_bytes_dirtied, len);
 
-  wbiter->second.first.add(nocache, len, 1);
+  wbiter->second.first.add(nocache, len, 1, offset);
   insert_object(hoid);
+
+  // charge this write against the pacing rate; throttle() holds the
+  // next writer back until it has been paid for
+  double rate = get_pacing_rate();
+  logger->set(l_wbthrottle_pacing_rate, rate);
+  if (rate) {
+    utime_t now = ceph_clock_now(cct);
+    if (paced_until < now)
+      paced_until = now;
+    paced_until += (double)len / rate;
+    utime_t max = now;
+    max += max_delay;
+    if (paced_until > max)
+      paced_until = max;
+  }
+
   if (beyond_limit())
-    cond.Signal();
+    cond.SignalAll();
 }
 
 void WBThrottle::clear()
@@ -235,13 +387,14 @@ void WBThrottle::clear()
   pending_wbs.clear();
   lru.clear();
   rev_lru.clear();
-  cond.Signal();
+  paced_until = utime_t();
+  cond.SignalAll();
 }
 
 void WBThrottle::clear_object(const ghobject_t &hoid)
 {
   Mutex::Locker l(lock);
-  while (clearing == hoid)
+  while (clearing.count(hoid))
     cond.Wait(lock);
   ceph::unordered_map<ghobject_t, pair<PendingWB, FDRef> >::iterator i =
     pending_wbs.find(hoid);
@@ -256,13 +409,29 @@ void WBThrottle::clear_object(const ghobject_t &hoid)
 
   pending_wbs.erase(i);
   remove_object(hoid);
-  cond.Signal();
+  cond.SignalAll();
 }
 
 void WBThrottle::throttle()
 {
   Mutex::Locker l(lock);
-  while (!stopping && beyond_limit()) {
+  utime_t start;
+  while (!stopping) {
+    if (!adaptive) {
+      if (!beyond_limit())
+	break;
+    } else if (!beyond_hard_limit()) {
+      if (!get_pacing_rate() || ceph_clock_now(cct) >= paced_until)
+	break;
+      if (start == utime_t())
+	start = ceph_clock_now(cct);
+      cond.WaitUntil(lock, paced_until);
+      continue;
+    }
+    if (start == utime_t())
+      start = ceph_clock_now(cct);
     cond.Wait(lock);
   }
+  if (start != utime_t())
+    logger->tinc(l_wbthrottle_stall, ceph_clock_now(cct) - start);
 }
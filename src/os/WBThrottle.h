@@ -15,7 +15,9 @@
 #ifndef WBTHROTTLE_H
 #define WBTHROTTLE_H
 
+#include <sys/types.h>
 #include "include/unordered_map.h"
+#include "include/unordered_set.h"
 #include <boost/tuple/tuple.hpp>
 #include "include/memory.h"
 #include "include/buffer.h"
@@ -35,6 +37,10 @@ enum {
   l_wbthrottle_ios_wb,
   l_wbthrottle_inodes_dirtied,
   l_wbthrottle_inodes_wb,
+  l_wbthrottle_flush_rate,
+  l_wbthrottle_pacing_rate,
+  l_wbthrottle_flush_lat,
+  l_wbthrottle_stall,
   l_wbthrottle_last
 };
 
@@ -42,9 +48,16 @@ enum {
  * WBThrottle
  *
  * Tracks, throttles, and flushes outstanding IO
+ *
+ * Flushers start once any start_flusher limit is passed.  Normally
+ * writers then block in throttle() until the flushers bring things back
+ * under those limits.  In adaptive mode writers are instead paced at the
+ * measured flush throughput of the backing devices, scaled down as the
+ * backlog approaches the hard limits, and only block at the hard limits.
  */
-class WBThrottle : Thread, public md_config_obs_t {
-  ghobject_t clearing;
+class WBThrottle : public md_config_obs_t {
+  /// objects being flushed
+  ceph::unordered_set<ghobject_t> clearing;
   /* *_limits.first is the start_flusher limit and
    * *_limits.second is the hard limit
    */
@@ -61,6 +74,32 @@ class WBThrottle : Thread, public md_config_obs_t {
   uint64_t cur_ios;  /// Currently unflushed IOs
   uint64_t cur_size; /// Currently unflushed bytes
 
+  bool adaptive;       /// filestore_wbthrottle_adaptive
+  unsigned batch;      /// objects taken per flush pass, sorted by inode
+  double max_delay;    /// longest a writer is paced for at once
+
+  /**
+   * Flush throughput of one backing device, measured over the time
+   * any flush to it is in progress so that concurrent flushes and idle
+   * time don't skew it.
+   */
+  struct DeviceStats {
+    unsigned inflight;
+    utime_t busy_start;
+    double busy;      ///< seconds busy since the last sample
+    uint64_t bytes;   ///< flushed since the last sample
+    double rate;      ///< bytes/sec, moving average; 0 if unknown
+    DeviceStats() : inflight(0), busy(0), bytes(0), rate(0) {}
+  };
+  map<dev_t, DeviceStats> devices;
+  void flush_start(dev_t dev);
+  void flush_finish(dev_t dev, uint64_t bytes, utime_t lat);
+
+  /// writers may not proceed before this; see queue_wb()
+  utime_t paced_until;
+  /// rate writers are paced at in bytes/sec, 0 if not pacing
+  double get_pacing_rate() const;
+
   /**
    * PendingWB tracks the ios pending on an object.
    */
@@ -69,12 +108,14 @@ class WBThrottle : Thread, public md_config_obs_t {
     bool nocache;
     uint64_t size;
     uint64_t ios;
-    PendingWB() : nocache(true), size(0), ios(0) {}
-    void add(bool _nocache, uint64_t _size, uint64_t _ios) {
+    uint64_t offset;  ///< lowest offset written
+    PendingWB() : nocache(true), size(0), ios(0), offset((uint64_t)-1) {}
+    void add(bool _nocache, uint64_t _size, uint64_t _ios, uint64_t _offset) {
       if (!_nocache)
 	nocache = false; // only nocache if all writes are nocache
       size += _size;
       ios += _ios;
+      offset = MIN(offset, _offset);
     }
   };
 
@@ -100,13 +141,6 @@ class WBThrottle : Thread, public md_config_obs_t {
     lru.erase(iter->second);
     rev_lru.erase(iter);
   }
-  ghobject_t pop_object() {
-    assert(!lru.empty());
-    ghobject_t oid(lru.front());
-    lru.pop_front();
-    rev_lru.erase(oid);
-    return oid;
-  }
   void insert_object(const ghobject_t &oid) {
     assert(rev_lru.find(oid) == rev_lru.end());
     lru.push_back(oid);
@@ -115,10 +149,25 @@ class WBThrottle : Thread, public md_config_obs_t {
 
   ceph::unordered_map<ghobject_t, pair<PendingWB, FDRef> > pending_wbs;
 
-  /// get next flush to perform
+  typedef boost::tuple<ghobject_t, FDRef, PendingWB> wb_t;
+
+  /// get next flushes to perform, adding them to clearing
   bool get_next_should_flush(
-    boost::tuple<ghobject_t, FDRef, PendingWB> *next ///< [out] next to flush
+    vector<wb_t> *next ///< [out] next to flush
     ); ///< @return false if we are shutting down
+
+  /// write back one object, without lock
+  virtual void flush_object(const wb_t &wb);
+
+  class Flusher : public Thread {
+    WBThrottle *wbt;
+  public:
+    Flusher(WBThrottle *wbt) : wbt(wbt) {}
+    void *entry() {
+      return wbt->entry();
+    }
+  };
+  vector<Flusher*> flushers;
 public:
   enum FS {
     BTRFS,
@@ -137,10 +186,15 @@ private:
     else
       return true;
   }
+  bool beyond_hard_limit() const {
+    return cur_ios >= io_limits.second ||
+      pending_wbs.size() >= fd_limits.second ||
+      cur_size >= size_limits.second;
+  }
 
 public:
   WBThrottle(CephContext *cct);
-  ~WBThrottle();
+  virtual ~WBThrottle();
 
   void start();
   void stop();
@@ -174,8 +228,10 @@ public:
   void handle_conf_change(const md_config_t *conf,
 			  const std::set<std::string> &changed);
 
-  /// Thread
+  /// Flusher threads
   void *entry();
+
+  friend class WBThrottleTest;
 };
 
 #endif
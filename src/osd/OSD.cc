@@ -162,6 +162,32 @@ void PGQueueable::RunVis::operator()(PGScrub &op) {
   return pg->scrub(op.epoch_queued, handle);
 }
 
+osd_op_class_t PGQueueable::OpClassVis::operator()(
+  const OpRequestRef &op) const
+{
+  switch (op->get_req()->get_type()) {
+  case MSG_OSD_SUBOP:
+  case MSG_OSD_SUBOPREPLY:
+  case MSG_OSD_REPOP:
+  case MSG_OSD_REPOPREPLY:
+  case MSG_OSD_EC_WRITE:
+  case MSG_OSD_EC_WRITE_REPLY:
+  case MSG_OSD_EC_READ:
+  case MSG_OSD_EC_READ_REPLY:
+    return OSD_OP_CLASS_SUBOP;
+  case MSG_OSD_PG_PUSH:
+  case MSG_OSD_PG_PULL:
+  case MSG_OSD_PG_PUSH_REPLY:
+  case MSG_OSD_PG_SCAN:
+  case MSG_OSD_PG_BACKFILL:
+    return OSD_OP_CLASS_RECOVERY;
+  case MSG_OSD_REP_SCRUB:
+    return OSD_OP_CLASS_SCRUB;
+  default:
+    return OSD_OP_CLASS_CLIENT;
+  }
+}
+
 //Initial features in new superblock.
 //Features here are also automatically upgraded
 CompatSet OSD::get_osd_initial_compat_set() {
@@ -1906,6 +1932,7 @@ int OSD::init()
   update_log_config();
 
   osd_tp.start();
+  osd_op_tp.set_work_stealing(cct->_conf->osd_op_shard_steal);
   osd_op_tp.start();
   recovery_tp.start();
   disk_tp.start();
@@ -2210,6 +2237,8 @@ void OSD::create_logger()
   osd_plb.add_time_avg(l_osd_tier_promote_lat, "osd_tier_promote_lat", "Object promote latency");
   osd_plb.add_time_avg(l_osd_tier_r_lat, "osd_tier_r_lat", "Object proxy read latency");
 
+  osd_plb.add_u64_counter(l_osd_op_wq_steal, "op_wq_steal", "Ops run by a thread from another shard");
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -8199,6 +8228,55 @@ void OSD::enqueue_op(PG *pg, OpRequestRef& op)
   pg->queue_op(op);
 }
 
+OSD::ShardedOpWQ::ShardedOpWQ(uint32_t pnum_shards, OSD *o, time_t ti,
+			       time_t si, ShardedThreadPool* tp)
+  : ShardedThreadPool::ShardedWQ < pair <PGRef, PGQueueable> >(ti, si, tp),
+    osd(o), num_shards(pnum_shards), mclock_logger(NULL)
+{
+  md_config_t *conf = osd->cct->_conf;
+  mClockClientInfo mclock_info[OSD_OP_CLASS_MAX];
+  if (conf->osd_op_queue == "mclock_opclass") {
+    get_mclock_op_class_info(conf, mclock_info);
+    mclock_logger = build_mclock_op_class_perf_counters(osd->cct);
+    osd->cct->get_perfcounters_collection()->add(mclock_logger);
+  } else if (conf->osd_op_queue != "prio") {
+    lgeneric_subdout(osd->cct, osd, -1)
+      << "unknown osd_op_queue '" << conf->osd_op_queue
+      << "', using prio" << dendl;
+  }
+  for(uint32_t i = 0; i < num_shards; i++) {
+    char lock_name[32] = {0};
+    snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
+    char order_lock[32] = {0};
+    snprintf(
+      order_lock, sizeof(order_lock), "%s.%d",
+      "OSD:ShardedOpWQ:order:", i);
+    OpQueue< pair<PGRef, PGQueueable>, entity_inst_t> *q;
+    if (mclock_logger)
+      q = new mClockOpClassQueue< pair<PGRef, PGQueueable> >(
+	mclock_info, classify, conf->osd_op_queue_mclock_cost_unit,
+	mclock_logger);
+    else
+      q = new PrioritizedQueue< pair<PGRef, PGQueueable>, entity_inst_t>(
+	conf->osd_op_pq_max_tokens_per_priority,
+	conf->osd_op_pq_min_cost);
+    ShardData* one_shard = new ShardData(lock_name, order_lock, q);
+    shard_list.push_back(one_shard);
+  }
+}
+
+OSD::ShardedOpWQ::~ShardedOpWQ()
+{
+  while(!shard_list.empty()) {
+    delete shard_list.back();
+    shard_list.pop_back();
+  }
+  if (mclock_logger) {
+    osd->cct->get_perfcounters_collection()->remove(mclock_logger);
+    delete mclock_logger;
+  }
+}
+
 void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb ) {
 
   uint32_t shard_index = thread_index % num_shards;
@@ -8206,19 +8284,39 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb )
   ShardData* sdata = shard_list[shard_index];
   assert(NULL != sdata);
   sdata->sdata_op_ordering_lock.Lock();
-  if (sdata->pqueue.empty()) {
+  if (sdata->pqueue->empty()) {
     sdata->sdata_op_ordering_lock.Unlock();
+    if (steal(shard_index, hb))
+      return;
     osd->cct->get_heartbeat_map()->reset_timeout(hb, 4, 0);
     sdata->sdata_lock.Lock();
+    sdata->num_waiters.inc();
     sdata->sdata_cond.WaitInterval(osd->cct, sdata->sdata_lock, utime_t(2, 0));
+    sdata->num_waiters.dec();
     sdata->sdata_lock.Unlock();
     sdata->sdata_op_ordering_lock.Lock();
-    if(sdata->pqueue.empty()) {
+    if(sdata->pqueue->empty()) {
       sdata->sdata_op_ordering_lock.Unlock();
+      steal(shard_index, hb);
       return;
     }
   }
-  pair<PGRef, PGQueueable> item = sdata->pqueue.dequeue();
+  _process_item(sdata, sdata->pqueue->dequeue(), hb);
+}
+
+/*
+ * Run an item just dequeued from sdata's queue.  Called with
+ * sdata_op_ordering_lock held; drops the lock.
+ *
+ * The caller need not be one of sdata's own threads: per-PG ordering
+ * comes from pg_for_processing and the PG lock, not from which thread
+ * runs the item.
+ */
+void OSD::ShardedOpWQ::_process_item(ShardData *sdata,
+				     pair<PGRef, PGQueueable> item,
+				     heartbeat_handle_d *hb)
+{
+  assert(sdata->sdata_op_ordering_lock.is_locked());
   sdata->pg_for_processing[&*(item.first)].push_back(item.second);
   sdata->sdata_op_ordering_lock.Unlock();
   ThreadPool::TPHandle tp_handle(osd->cct, hb, timeout_interval, 
@@ -8278,6 +8376,42 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb )
   (item.first)->unlock();
 }
 
+/*
+ * Work stealing (see ShardedThreadPool::steal): run one item from
+ * another shard.  Items whose PG is already being processed are passed
+ * over, since we would only block on the PG lock behind the shard's own
+ * threads (this is the hot PG case we are trying to route around).  The
+ * queue hands out a runnable item from the head of one of its classes
+ * without dequeueing anything else, so its scheduling state and the
+ * order of the items left behind are untouched.
+ */
+bool OSD::ShardedOpWQ::_steal_from(uint32_t shard_index,
+				   heartbeat_handle_d *hb)
+{
+  static const unsigned max_scan = 8;
+  ShardData *sdata = shard_list[shard_index];
+  sdata->sdata_op_ordering_lock.Lock();
+  list<pair<PGRef, PGQueueable> > taken;
+  if (!sdata->pqueue->dequeue_head_if(NotInFlight(sdata), max_scan, &taken)) {
+    sdata->sdata_op_ordering_lock.Unlock();
+    return false;
+  }
+  osd->logger->inc(l_osd_op_wq_steal);
+  _process_item(sdata, taken.front(), hb);
+  return true;
+}
+
+bool OSD::ShardedOpWQ::_wake_idle(uint32_t shard_index)
+{
+  ShardData *sdata = shard_list[shard_index];
+  if (!sdata->num_waiters.read())
+    return false;
+  sdata->sdata_lock.Lock();
+  sdata->sdata_cond.SignalOne();
+  sdata->sdata_lock.Unlock();
+  return true;
+}
+
 void OSD::ShardedOpWQ::_enqueue(pair<PGRef, PGQueueable> item) {
 
   uint32_t shard_index = (((item.first)->get_pgid().ps())% shard_list.size());
@@ -8289,10 +8423,10 @@ void OSD::ShardedOpWQ::_enqueue(pair<PGRef, PGQueueable> item) {
   sdata->sdata_op_ordering_lock.Lock();
  
   if (priority >= CEPH_MSG_PRIO_LOW)
-    sdata->pqueue.enqueue_strict(
+    sdata->pqueue->enqueue_strict(
       item.second.get_owner(), priority, item);
   else
-    sdata->pqueue.enqueue(
+    sdata->pqueue->enqueue(
       item.second.get_owner(),
       priority, cost, item);
   sdata->sdata_op_ordering_lock.Unlock();
@@ -8301,6 +8435,8 @@ void OSD::ShardedOpWQ::_enqueue(pair<PGRef, PGQueueable> item) {
   sdata->sdata_cond.SignalOne();
   sdata->sdata_lock.Unlock();
 
+  if (!sdata->num_waiters.read())
+    wake_thief(shard_index);
 }
 
 void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, PGQueueable> item) {
@@ -8318,11 +8454,11 @@ void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, PGQueueable> item) {
   unsigned priority = item.second.get_priority();
   unsigned cost = item.second.get_cost();
   if (priority >= CEPH_MSG_PRIO_LOW)
-    sdata->pqueue.enqueue_strict_front(
+    sdata->pqueue->enqueue_strict_front(
       item.second.get_owner(),
       priority, item);
   else
-    sdata->pqueue.enqueue_front(
+    sdata->pqueue->enqueue_front(
       item.second.get_owner(),
       priority, cost, item);
 
@@ -8331,6 +8467,8 @@ void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, PGQueueable> item) {
   sdata->sdata_cond.SignalOne();
   sdata->sdata_lock.Unlock();
 
+  if (!sdata->num_waiters.read())
+    wake_thief(shard_index);
 }
 
 
@@ -53,6 +53,7 @@ using namespace std;
 #include "common/simple_cache.hpp"
 #include "common/sharedptr_registry.hpp"
 #include "common/PrioritizedQueue.h"
+#include "osd/mClockOpClassQueue.h"
 #include "messages/MOSDOp.h"
 
 #define CEPH_OSD_PROTOCOL    10 /* cluster internal */
@@ -150,6 +151,8 @@ enum {
   l_osd_tier_promote_lat,
   l_osd_tier_r_lat,
 
+  l_osd_op_wq_steal,
+
   l_osd_last,
 };
 
@@ -353,6 +356,15 @@ class PGQueueable {
     void operator()(PGSnapTrim &op);
     void operator()(PGScrub &op);
   };
+  struct OpClassVis : public boost::static_visitor<osd_op_class_t> {
+    osd_op_class_t operator()(const OpRequestRef &op) const;
+    osd_op_class_t operator()(const PGSnapTrim &op) const {
+      return OSD_OP_CLASS_SNAPTRIM;
+    }
+    osd_op_class_t operator()(const PGScrub &op) const {
+      return OSD_OP_CLASS_SCRUB;
+    }
+  };
 public:
   PGQueueable(OpRequestRef op)
     : qvariant(op), cost(op->get_req()->get_cost()),
@@ -382,6 +394,9 @@ public:
   int get_cost() const { return cost; }
   utime_t get_start_time() const { return start_time; }
   entity_inst_t get_owner() const { return owner; }
+  osd_op_class_t get_op_class() const {
+    return boost::apply_visitor(OpClassVis(), qvariant);
+  }
 };
 
 class OSDService {
@@ -1584,46 +1599,52 @@ private:
       Cond sdata_cond;
       Mutex sdata_op_ordering_lock;
       map<PG*, list<PGQueueable> > pg_for_processing;
-      PrioritizedQueue< pair<PGRef, PGQueueable>, entity_inst_t> pqueue;
+      OpQueue< pair<PGRef, PGQueueable>, entity_inst_t> *pqueue;
+      atomic_t num_waiters;  ///< threads idle on sdata_cond
       ShardData(
 	string lock_name, string ordering_lock,
-	uint64_t max_tok_per_prio, uint64_t min_cost)
+	OpQueue< pair<PGRef, PGQueueable>, entity_inst_t> *q)
 	: sdata_lock(lock_name.c_str()),
 	  sdata_op_ordering_lock(ordering_lock.c_str()),
-	  pqueue(max_tok_per_prio, min_cost) {}
+	  pqueue(q) {}
+      ~ShardData() {
+	delete pqueue;
+      }
     };
     
     vector<ShardData*> shard_list;
     OSD *osd;
     uint32_t num_shards;
+    PerfCounters *mclock_logger;  ///< if osd_op_queue is mclock_opclass
+
+    static osd_op_class_t classify(const pair<PGRef, PGQueueable> &item) {
+      return item.second.get_op_class();
+    }
 
   public:
-    ShardedOpWQ(uint32_t pnum_shards, OSD *o, time_t ti, time_t si, ShardedThreadPool* tp):
-      ShardedThreadPool::ShardedWQ < pair <PGRef, PGQueueable> >(ti, si, tp),
-      osd(o), num_shards(pnum_shards) {
-      for(uint32_t i = 0; i < num_shards; i++) {
-	char lock_name[32] = {0};
-	snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
-	char order_lock[32] = {0};
-	snprintf(
-	  order_lock, sizeof(order_lock), "%s.%d",
-	  "OSD:ShardedOpWQ:order:", i);
-	ShardData* one_shard = new ShardData(
-	  lock_name, order_lock,
-	  osd->cct->_conf->osd_op_pq_max_tokens_per_priority, 
-	  osd->cct->_conf->osd_op_pq_min_cost);
-	shard_list.push_back(one_shard);
+    ShardedOpWQ(uint32_t pnum_shards, OSD *o, time_t ti, time_t si,
+		ShardedThreadPool* tp);
+    ~ShardedOpWQ();
+
+    void _process(uint32_t thread_index, heartbeat_handle_d *hb);
+    void _process_item(ShardData *sdata, pair<PGRef, PGQueueable> item,
+		       heartbeat_handle_d *hb);
+
+    struct NotInFlight {
+      ShardData *sdata;
+      NotInFlight(ShardData *sdata) : sdata(sdata) {}
+      bool operator()(const pair<PGRef, PGQueueable> &op) {
+	return !sdata->pg_for_processing.count(&*(op.first));
       }
+    };
+    uint32_t get_num_shards() {
+      return num_shards;
     }
-    
-    ~ShardedOpWQ() {
-      while(!shard_list.empty()) {
-	delete shard_list.back();
-	shard_list.pop_back();
-      }
+    bool has_idle_threads(uint32_t shard_index) {
+      return shard_list[shard_index]->num_waiters.read();
     }
-
-    void _process(uint32_t thread_index, heartbeat_handle_d *hb);
+    bool _steal_from(uint32_t shard_index, heartbeat_handle_d *hb);
+    bool _wake_idle(uint32_t shard_index);
     void _enqueue(pair <PGRef, PGQueueable> item);
     void _enqueue_front(pair <PGRef, PGQueueable> item);
       
@@ -1645,7 +1666,7 @@ private:
 	assert (NULL != sdata);
 	sdata->sdata_op_ordering_lock.Lock();
 	f->open_object_section(lock_name);
-	sdata->pqueue.dump(f);
+	sdata->pqueue->dump(f);
 	f->close_section();
 	sdata->sdata_op_ordering_lock.Unlock();
       }
@@ -1666,7 +1687,7 @@ private:
       sdata = shard_list[shard_index];
       assert(sdata != NULL);
       sdata->sdata_op_ordering_lock.Lock();
-      sdata->pqueue.remove_by_filter(Pred(pg));
+      sdata->pqueue->remove_by_filter(Pred(pg));
       sdata->pg_for_processing.erase(pg);
       sdata->sdata_op_ordering_lock.Unlock();
     }
@@ -1680,7 +1701,7 @@ private:
       assert(dequeued);
       list<pair<PGRef, PGQueueable> > _dequeued;
       sdata->sdata_op_ordering_lock.Lock();
-      sdata->pqueue.remove_by_filter(Pred(pg), &_dequeued);
+      sdata->pqueue->remove_by_filter(Pred(pg), &_dequeued);
       for (list<pair<PGRef, PGQueueable> >::iterator i = _dequeued.begin();
 	   i != _dequeued.end(); ++i) {
 	boost::optional<OpRequestRef> mop = i->second.maybe_get_op();
@@ -1707,7 +1728,7 @@ private:
       ShardData* sdata = shard_list[shard_index];
       assert(NULL != sdata);
       Mutex::Locker l(sdata->sdata_op_ordering_lock);
-      return sdata->pqueue.empty();
+      return sdata->pqueue->empty();
     }
   } op_shardedwq;
 
@@ -795,21 +795,28 @@ void ReplicatedBackend::be_deep_scrub(
     ghobject_t(
       poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard));
   assert(iter);
-  uint64_t keys_scanned = 0;
-  for (iter->seek_to_first(); iter->valid() ; iter->next()) {
-    if (cct->_conf->osd_scan_list_ping_tp_interval &&
-	(keys_scanned % cct->_conf->osd_scan_list_ping_tp_interval == 0)) {
+  uint64_t batch = cct->_conf->osd_scan_list_ping_tp_interval;
+  if (!batch)
+    batch = 100;
+  iter->seek_to_first();
+  while (iter->valid()) {
+    map<string, bufferlist> kvs;
+    if (iter->get_next_batch(batch, &kvs) < 0)
+      break;
+    if (cct->_conf->osd_scan_list_ping_tp_interval)
       handle.reset_tp_timeout();
-    }
-    ++keys_scanned;
 
-    dout(25) << "CRC key " << iter->key() << " value "
-	     << string(iter->value().c_str(), iter->value().length()) << dendl;
+    for (map<string, bufferlist>::iterator i = kvs.begin();
+	 i != kvs.end();
+	 ++i) {
+      dout(25) << "CRC key " << i->first << " value "
+	       << string(i->second.c_str(), i->second.length()) << dendl;
 
-    ::encode(iter->key(), bl);
-    ::encode(iter->value(), bl);
-    oh << bl;
-    bl.clear();
+      ::encode(i->first, bl);
+      ::encode(i->second, bl);
+      oh << bl;
+      bl.clear();
+    }
   }
   if (iter->status() == -EIO) {
     dout(25) << __func__ << "  " << poid << " got "
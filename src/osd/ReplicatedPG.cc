@@ -5041,12 +5041,16 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
           }
 	  iter->upper_bound(start_after);
 	  if (filter_prefix > start_after) iter->lower_bound(filter_prefix);
-	  for (uint64_t i = 0;
-	       i < max_return && iter->valid() &&
-		 iter->key().substr(0, filter_prefix.size()) == filter_prefix;
-	       ++i, iter->next()) {
-	    dout(20) << "Found key " << iter->key() << dendl;
-	    out_set.insert(make_pair(iter->key(), iter->value()));
+	  if (filter_prefix.empty()) {
+	    iter->get_next_batch(max_return, &out_set);
+	  } else {
+	    for (uint64_t i = 0;
+		 i < max_return && iter->valid() &&
+		   iter->key().substr(0, filter_prefix.size()) == filter_prefix;
+		 ++i, iter->next()) {
+	      dout(20) << "Found key " << iter->key() << dendl;
+	      out_set.insert(make_pair(iter->key(), iter->value()));
+	    }
 	  }
 	} // else return empty out_set
 	::encode(out_set, osd_op.outdata);
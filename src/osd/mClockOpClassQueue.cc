@@ -0,0 +1,89 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "osd/mClockOpClassQueue.h"
+#include "common/config.h"
+#include "common/ceph_context.h"
+
+const char *get_osd_op_class_name(osd_op_class_t c)
+{
+  switch (c) {
+  case OSD_OP_CLASS_CLIENT: return "client";
+  case OSD_OP_CLASS_SUBOP: return "subop";
+  case OSD_OP_CLASS_RECOVERY: return "recovery";
+  case OSD_OP_CLASS_SCRUB: return "scrub";
+  case OSD_OP_CLASS_SNAPTRIM: return "snaptrim";
+  default: return "???";
+  }
+}
+
+void get_mclock_op_class_info(md_config_t *conf, mClockClientInfo *info)
+{
+  info[OSD_OP_CLASS_CLIENT] = mClockClientInfo(
+    conf->osd_op_queue_mclock_client_op_res,
+    conf->osd_op_queue_mclock_client_op_wgt,
+    conf->osd_op_queue_mclock_client_op_lim);
+  info[OSD_OP_CLASS_SUBOP] = mClockClientInfo(
+    conf->osd_op_queue_mclock_osd_subop_res,
+    conf->osd_op_queue_mclock_osd_subop_wgt,
+    conf->osd_op_queue_mclock_osd_subop_lim);
+  info[OSD_OP_CLASS_RECOVERY] = mClockClientInfo(
+    conf->osd_op_queue_mclock_recov_res,
+    conf->osd_op_queue_mclock_recov_wgt,
+    conf->osd_op_queue_mclock_recov_lim);
+  info[OSD_OP_CLASS_SCRUB] = mClockClientInfo(
+    conf->osd_op_queue_mclock_scrub_res,
+    conf->osd_op_queue_mclock_scrub_wgt,
+    conf->osd_op_queue_mclock_scrub_lim);
+  info[OSD_OP_CLASS_SNAPTRIM] = mClockClientInfo(
+    conf->osd_op_queue_mclock_snap_res,
+    conf->osd_op_queue_mclock_snap_wgt,
+    conf->osd_op_queue_mclock_snap_lim);
+}
+
+PerfCounters *build_mclock_op_class_perf_counters(CephContext *cct)
+{
+  PerfCountersBuilder b(cct, "mclock_opclass", l_mclock_first, l_mclock_last);
+  b.add_u64_counter(l_mclock_strict, "strict",
+		    "Ops dequeued by strict priority");
+  b.add_u64_counter(l_mclock_client_res, "client_res",
+		    "Client ops dequeued by reservation");
+  b.add_u64_counter(l_mclock_client_wgt, "client_wgt",
+		    "Client ops dequeued by weight");
+  b.add_u64_counter(l_mclock_client_lim, "client_lim",
+		    "Client ops dequeued over limit");
+  b.add_u64_counter(l_mclock_subop_res, "subop_res",
+		    "Subops dequeued by reservation");
+  b.add_u64_counter(l_mclock_subop_wgt, "subop_wgt",
+		    "Subops dequeued by weight");
+  b.add_u64_counter(l_mclock_subop_lim, "subop_lim",
+		    "Subops dequeued over limit");
+  b.add_u64_counter(l_mclock_recovery_res, "recovery_res",
+		    "Recovery ops dequeued by reservation");
+  b.add_u64_counter(l_mclock_recovery_wgt, "recovery_wgt",
+		    "Recovery ops dequeued by weight");
+  b.add_u64_counter(l_mclock_recovery_lim, "recovery_lim",
+		    "Recovery ops dequeued over limit");
+  b.add_u64_counter(l_mclock_scrub_res, "scrub_res",
+		    "Scrubs dequeued by reservation");
+  b.add_u64_counter(l_mclock_scrub_wgt, "scrub_wgt",
+		    "Scrubs dequeued by weight");
+  b.add_u64_counter(l_mclock_scrub_lim, "scrub_lim",
+		    "Scrubs dequeued over limit");
+  b.add_u64_counter(l_mclock_snaptrim_res, "snaptrim_res",
+		    "Snap trims dequeued by reservation");
+  b.add_u64_counter(l_mclock_snaptrim_wgt, "snaptrim_wgt",
+		    "Snap trims dequeued by weight");
+  b.add_u64_counter(l_mclock_snaptrim_lim, "snaptrim_lim",
+		    "Snap trims dequeued over limit");
+  return b.create_perf_counters();
+}
@@ -0,0 +1,211 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+#define CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+
+#include <ostream>
+
+#include "common/mClockQueue.h"
+#include "common/perf_counters.h"
+#include "msg/msg_types.h"
+
+class CephContext;
+class md_config_t;
+
+/// what kind of work an op queue item is, for QoS purposes
+enum osd_op_class_t {
+  OSD_OP_CLASS_CLIENT = 0,  ///< client io
+  OSD_OP_CLASS_SUBOP,       ///< replication of client io from a primary
+  OSD_OP_CLASS_RECOVERY,    ///< recovery and backfill
+  OSD_OP_CLASS_SCRUB,
+  OSD_OP_CLASS_SNAPTRIM,
+  OSD_OP_CLASS_MAX,
+};
+
+const char *get_osd_op_class_name(osd_op_class_t c);
+
+enum {
+  l_mclock_first = 10900,
+  l_mclock_strict,
+  // per op class, in osd_op_class_t order: dequeued by reservation,
+  // by weight, and over limit
+  l_mclock_client_res,
+  l_mclock_client_wgt,
+  l_mclock_client_lim,
+  l_mclock_subop_res,
+  l_mclock_subop_wgt,
+  l_mclock_subop_lim,
+  l_mclock_recovery_res,
+  l_mclock_recovery_wgt,
+  l_mclock_recovery_lim,
+  l_mclock_scrub_res,
+  l_mclock_scrub_wgt,
+  l_mclock_scrub_lim,
+  l_mclock_snaptrim_res,
+  l_mclock_snaptrim_wgt,
+  l_mclock_snaptrim_lim,
+  l_mclock_last,
+};
+
+/// osd_op_queue_mclock_* settings, indexed by osd_op_class_t
+void get_mclock_op_class_info(md_config_t *conf, mClockClientInfo *info);
+
+PerfCounters *build_mclock_op_class_perf_counters(CephContext *cct);
+
+/**
+ * mClock op queue for the OSD's sharded op queue
+ *
+ * Client ops get a reservation, weight and limit per client; recovery,
+ * scrub and snap trim each share one set of tags for the whole class,
+ * so that however many PGs are recovering they cannot crowd out client
+ * io beyond their configured share.  Subops are tagged per primary.
+ *
+ * Costs are converted to mClock units of one op plus one per cost_unit
+ * bytes, so the rates are roughly iops for small ops.
+ */
+template <typename T>
+class mClockOpClassQueue : public OpQueue<T, entity_inst_t> {
+public:
+  typedef osd_op_class_t (*classify_func_t)(const T&);
+
+private:
+  struct client_t {
+    osd_op_class_t op_class;
+    entity_inst_t inst;
+    client_t() : op_class(OSD_OP_CLASS_CLIENT) {}
+    client_t(osd_op_class_t c, const entity_inst_t &i)
+      : op_class(c), inst(i) {}
+    bool operator<(const client_t &o) const {
+      if (op_class != o.op_class)
+	return op_class < o.op_class;
+      return inst < o.inst;
+    }
+    bool operator==(const client_t &o) const {
+      return op_class == o.op_class && inst == o.inst;
+    }
+    friend std::ostream& operator<<(std::ostream &out, const client_t &c) {
+      out << get_osd_op_class_name(c.op_class);
+      if (c.inst != entity_inst_t())
+	out << "." << c.inst;
+      return out;
+    }
+  };
+
+  struct InfoByClass {
+    mClockClientInfo info[OSD_OP_CLASS_MAX];
+    mClockClientInfo operator()(const client_t &c) const {
+      return info[c.op_class];
+    }
+  };
+
+  typedef mClockQueue<T, client_t> Queue;
+
+  Queue queue;
+  classify_func_t classify;
+  uint64_t cost_unit;
+  PerfCounters *logger;
+
+  client_t get_client(const entity_inst_t &cl, const T &item) {
+    osd_op_class_t c = classify(item);
+    if (c == OSD_OP_CLASS_CLIENT || c == OSD_OP_CLASS_SUBOP)
+      return client_t(c, cl);
+    return client_t(c, entity_inst_t());
+  }
+
+  unsigned get_cost(unsigned cost) const {
+    if (!cost_unit)
+      return 1;
+    return 1 + cost / cost_unit;
+  }
+
+  static InfoByClass make_info(const mClockClientInfo *info) {
+    InfoByClass r;
+    for (int i = 0; i < OSD_OP_CLASS_MAX; ++i)
+      r.info[i] = info[i];
+    return r;
+  }
+
+public:
+  /**
+   * @param info QoS settings, indexed by osd_op_class_t
+   * @param classify gives the op class of an item
+   * @param cost_unit bytes of cost charged as one op; 0 to ignore cost
+   * @param logger l_mclock_* counters; may be NULL
+   */
+  mClockOpClassQueue(const mClockClientInfo *info, classify_func_t classify,
+		     uint64_t cost_unit, PerfCounters *logger)
+    : queue(make_info(info)), classify(classify), cost_unit(cost_unit),
+      logger(logger) {}
+
+  unsigned length() const {
+    return queue.length();
+  }
+
+  bool empty() const {
+    return queue.empty();
+  }
+
+  void remove_by_filter(std::function<bool (T)> f,
+			std::list<T> *removed = 0) {
+    queue.remove_by_filter(f, removed);
+  }
+
+  void remove_by_class(entity_inst_t k, std::list<T> *out = 0) {
+    for (int c = 0; c < OSD_OP_CLASS_MAX; ++c)
+      queue.remove_by_class(client_t((osd_op_class_t)c, k), out);
+  }
+
+  void enqueue_strict(entity_inst_t cl, unsigned priority, T item) {
+    queue.enqueue_strict(get_client(cl, item), priority, item);
+  }
+
+  void enqueue_strict_front(entity_inst_t cl, unsigned priority, T item) {
+    queue.enqueue_strict_front(get_client(cl, item), priority, item);
+  }
+
+  void enqueue(entity_inst_t cl, unsigned priority, unsigned cost, T item) {
+    queue.enqueue(get_client(cl, item), priority, get_cost(cost), item);
+  }
+
+  void enqueue_front(entity_inst_t cl, unsigned priority, unsigned cost,
+		     T item) {
+    queue.enqueue_front(get_client(cl, item), priority, get_cost(cost), item);
+  }
+
+  T dequeue() {
+    typename Queue::phase_t phase;
+    client_t cl;
+    T ret = queue.dequeue(&phase, &cl);
+    if (logger) {
+      if (phase == Queue::PHASE_STRICT)
+	logger->inc(l_mclock_strict);
+      else
+	logger->inc(l_mclock_client_res + cl.op_class * 3 +
+		    (phase - Queue::PHASE_RESERVATION));
+    }
+    return ret;
+  }
+
+  bool dequeue_head_if(std::function<bool (T)> f, unsigned max_scan,
+		       std::list<T> *out) {
+    return queue.dequeue_head_if(f, max_scan, out);
+  }
+
+  void dump(Formatter *f) const {
+    f->dump_string("queue", "mclock_opclass");
+    f->dump_unsigned("cost_unit", cost_unit);
+    queue.dump(f);
+  }
+};
+
+#endif
@@ -0,0 +1,213 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Hammer a DBObjectMap with small omap reads and writes from many
+ * threads, to measure contention on its header cache and locks.  Run
+ * it with different --filestore_omap_header_shards values to compare.
+ */
+
+#include <stdlib.h>
+#include <string>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/Thread.h"
+#include "common/Clock.h"
+#include "global/global_init.h"
+#include "os/DBObjectMap.h"
+#include "os/KeyValueDB.h"
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name << " [options]\n"
+       << "  --path <dir>          db directory (default ./object_map_bench)\n"
+       << "  --type <kv>           leveldb (default) or rocksdb\n"
+       << "  --threads <n>         client threads (default 16)\n"
+       << "  --ops <n>             ops per thread (default 20000)\n"
+       << "  --objects <n>         objects, shared by all threads (default 4096)\n"
+       << "  --read-pct <n>        percent of ops that are reads (default 80)\n"
+       << "  --keys <n>            keys per object (default 8)\n"
+       << std::endl;
+  generic_client_usage();
+}
+
+static ghobject_t make_object(int i)
+{
+  ostringstream ss;
+  ss << "obj_" << i;
+  return ghobject_t(hobject_t(sobject_t(ss.str(), CEPH_NOSNAP), "", rand(),
+			      0, ""));
+}
+
+static string make_key(int i)
+{
+  ostringstream ss;
+  ss << "key_" << i;
+  return ss.str();
+}
+
+class Worker : public Thread {
+  ObjectMap *omap;
+  const vector<ghobject_t> &objects;
+  int ops, read_pct, keys;
+public:
+  unsigned seed;
+  double read_lat, write_lat;  // total seconds
+  int reads, writes;
+
+  Worker(ObjectMap *omap, const vector<ghobject_t> &objects,
+	 int ops, int read_pct, int keys, unsigned seed)
+    : omap(omap), objects(objects), ops(ops), read_pct(read_pct), keys(keys),
+      seed(seed), read_lat(0), write_lat(0), reads(0), writes(0) {}
+
+  void *entry() {
+    bufferlist val;
+    val.append(string(64, 'v'));
+    for (int i = 0; i < ops; ++i) {
+      const ghobject_t &oid = objects[rand_r(&seed) % objects.size()];
+      string key = make_key(rand_r(&seed) % keys);
+      utime_t start = ceph_clock_now(g_ceph_context);
+      if ((int)(rand_r(&seed) % 100) < read_pct) {
+	set<string> to_get;
+	to_get.insert(key);
+	map<string, bufferlist> got;
+	omap->get_values(oid, to_get, &got);
+	read_lat += ceph_clock_now(g_ceph_context) - start;
+	++reads;
+      } else {
+	map<string, bufferlist> to_set;
+	to_set[key] = val;
+	omap->set_keys(oid, to_set);
+	write_lat += ceph_clock_now(g_ceph_context) - start;
+	++writes;
+      }
+    }
+    return 0;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  string path = "object_map_bench";
+  string type = "leveldb";
+  int threads = 16;
+  int ops = 20000;
+  int num_objects = 4096;
+  int read_pct = 80;
+  int keys = 8;
+  string val;
+  for (vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &val, "--path", (char*)NULL)) {
+      path = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--type", (char*)NULL)) {
+      type = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--threads", (char*)NULL)) {
+      threads = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      ops = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)NULL)) {
+      num_objects = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--read-pct", (char*)NULL)) {
+      read_pct = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--keys", (char*)NULL)) {
+      keys = atoi(val.c_str());
+    } else {
+      cerr << "unrecognized arg " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (threads < 1 || ops < 1 || num_objects < 1 || keys < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  KeyValueDB *store = KeyValueDB::create(g_ceph_context, type, path);
+  if (!store) {
+    cerr << "unknown kv type " << type << std::endl;
+    return 1;
+  }
+  ostringstream err;
+  if (store->create_and_open(err)) {
+    cerr << "unable to open " << path << ": " << err.str() << std::endl;
+    delete store;
+    return 1;
+  }
+  DBObjectMap omap(store);
+  int r = omap.init();
+  if (r < 0) {
+    cerr << "DBObjectMap init failed: " << r << std::endl;
+    return 1;
+  }
+
+  // populate, so that reads have a header to find
+  vector<ghobject_t> objects;
+  for (int i = 0; i < num_objects; ++i) {
+    objects.push_back(make_object(i));
+    map<string, bufferlist> to_set;
+    for (int k = 0; k < keys; ++k)
+      to_set[make_key(k)].append("initial");
+    omap.set_keys(objects.back(), to_set);
+  }
+  omap.sync();
+
+  cout << "threads " << threads << " ops/thread " << ops
+       << " objects " << num_objects << " read_pct " << read_pct
+       << " header shards " << g_conf->filestore_omap_header_shards
+       << " group commit " << g_conf->filestore_omap_group_commit
+       << std::endl;
+
+  vector<Worker*> workers;
+  for (int i = 0; i < threads; ++i)
+    workers.push_back(new Worker(&omap, objects, ops, read_pct, keys, i + 1));
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < threads; ++i)
+    workers[i]->create();
+  double read_lat = 0, write_lat = 0;
+  int reads = 0, writes = 0;
+  for (int i = 0; i < threads; ++i) {
+    workers[i]->join();
+    read_lat += workers[i]->read_lat;
+    write_lat += workers[i]->write_lat;
+    reads += workers[i]->reads;
+    writes += workers[i]->writes;
+    delete workers[i];
+  }
+  double elapsed = ceph_clock_now(g_ceph_context) - start;
+
+  cout << "elapsed " << elapsed << " s, "
+       << (reads + writes) / elapsed << " ops/s" << std::endl;
+  if (reads)
+    cout << "reads " << reads << " avg lat "
+	 << read_lat / reads * 1000000 << " us" << std::endl;
+  if (writes)
+    cout << "writes " << writes << " avg lat "
+	 << write_lat / writes * 1000000 << " us" << std::endl;
+  return 0;
+}
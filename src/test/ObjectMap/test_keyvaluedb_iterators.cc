@@ -382,6 +382,77 @@ public:
     ASSERT_FALSE(iter->valid());
   }
 
+  /**
+   * Test the transaction's rm_range behavior, bounded and unbounded,
+   * and that it leaves keys under longer prefixes alone.
+   */
+  void RmRange(KeyValueDB *store) {
+    KeyValueDB::Transaction tx = store->get_transaction();
+    tx->rm_range(prefix2, "22", "23");
+    store->submit_transaction_sync(tx);
+
+    deque<string> key_deque;
+    KeyValueDB::WholeSpaceIterator iter = store->get_iterator();
+    iter->seek_to_first();
+
+    key_deque.push_back("11");
+    key_deque.push_back("12");
+    key_deque.push_back("13");
+    validate_prefix(iter, prefix1, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.clear();
+    key_deque.push_back("21");
+    key_deque.push_back("23");
+    validate_prefix(iter, prefix2, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.clear();
+    key_deque.push_back("31");
+    key_deque.push_back("32");
+    key_deque.push_back("33");
+    validate_prefix(iter, prefix3, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+    ASSERT_FALSE(iter->valid());
+
+    clear(store);
+    ASSERT_TRUE(validate_db_clear(store));
+    init(store);
+
+    // no upper bound, with a key under a longer prefix right after
+    string prefix1x = prefix1 + "x";
+    tx = store->get_transaction();
+    tx->set(prefix1x, "11", _gen_val("11"));
+    store->submit_transaction_sync(tx);
+    tx = store->get_transaction();
+    tx->rm_range(prefix1, "12", "");
+    store->submit_transaction_sync(tx);
+
+    iter = store->get_iterator();
+    iter->seek_to_first();
+
+    key_deque.clear();
+    key_deque.push_back("11");
+    validate_prefix(iter, prefix1, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.clear();
+    key_deque.push_back("11");
+    validate_prefix(iter, prefix1x, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    key_deque.clear();
+    key_deque.push_back("21");
+    key_deque.push_back("22");
+    key_deque.push_back("23");
+    validate_prefix(iter, prefix2, key_deque);
+    ASSERT_FALSE(HasFatalFailure());
+
+    tx = store->get_transaction();
+    tx->rmkey(prefix1x, "11");
+    store->submit_transaction_sync(tx);
+  }
+
   /**
    * Test how the leveldb's whole-space iterator behaves when we remove
    * keys from the store while iterating over them.
@@ -471,6 +542,35 @@ TEST_F(RmKeysTest, RmKeysByPrefixMockDB)
   ASSERT_FALSE(HasFatalFailure());
 }
 
+TEST_F(RmKeysTest, RmKeysBySubPrefixLevelDB)
+{
+  // rmkeys_by_prefix also removes keys whose prefix merely begins with it
+  KeyValueDB::Transaction tx = db->get_transaction();
+  tx->set(prefix2 + "x", "1", _gen_val("1"));
+  db->submit_transaction_sync(tx);
+  tx = db->get_transaction();
+  tx->rmkeys_by_prefix(prefix2);
+  db->submit_transaction_sync(tx);
+
+  KeyValueDB::WholeSpaceIterator iter = db->get_iterator();
+  for (iter->seek_to_first(); iter->valid(); iter->next())
+    ASSERT_NE(0, iter->raw_key().first.compare(0, prefix2.length(), prefix2));
+}
+
+TEST_F(RmKeysTest, RmRangeLevelDB)
+{
+  SCOPED_TRACE("LevelDB");
+  RmRange(db.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
+TEST_F(RmKeysTest, RmRangeMockDB)
+{
+  SCOPED_TRACE("Mock DB");
+  RmRange(mock.get());
+  ASSERT_FALSE(HasFatalFailure());
+}
+
 /**
  * If you refer to function RmKeysTest::RmKeysWhileIteratingSnapshot(),
  * you will notice that we seek the iterator to the first key, and then
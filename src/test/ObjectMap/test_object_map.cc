@@ -8,12 +8,18 @@
 #include "test/ObjectMap/KeyValueDBMemory.h"
 #include "os/KeyValueDB.h"
 #include "os/DBObjectMap.h"
+#include "os/PrefetchingObjectMapIterator.h"
 #include "os/HashIndex.h"
 #include "os/LevelDBStore.h"
 #include <sys/types.h>
 #include "global/global_init.h"
 #include "common/ceph_argparse.h"
+#include "common/WorkQueue.h"
+#include "common/Thread.h"
+#include "common/perf_counters.h"
+#include "include/stringify.h"
 #include <dirent.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 #include "stdlib.h"
@@ -745,9 +751,10 @@ TEST_F(ObjectMapTest, OddEvenClone) {
   db->clear(hoid2);
 }
 
-TEST_F(ObjectMapTest, RandomTest) {
+static void random_test(ObjectMapTester &tester, unsigned num_ops)
+{
   tester.def_init();
-  for (unsigned i = 0; i < 5000; ++i) {
+  for (unsigned i = 0; i < num_ops; ++i) {
     unsigned val = rand();
     val <<= 8;
     val %= 100;
@@ -784,3 +791,209 @@ TEST_F(ObjectMapTest, RandomTest) {
     }
   }
 }
+
+TEST_F(ObjectMapTest, RandomTest) {
+  random_test(tester, 5000);
+}
+
+TEST_F(ObjectMapTest, GroupCommitRandomTest) {
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit", "true");
+  random_test(tester, 2000);
+  ASSERT_EQ(0, db->sync());
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit", "false");
+}
+
+/*
+ * Several writers on disjoint objects, so that group commit leaders
+ * actually find followers queued behind them.  Each writer keeps its
+ * own model of the omap of its objects; they are checked against the
+ * store once everybody is done.
+ */
+class GroupCommitWriter : public Thread {
+public:
+  ObjectMap *db;
+  unsigned id;
+  unsigned ops;
+  map<string, map<string, string> > omap;
+
+  GroupCommitWriter(ObjectMap *db, unsigned id, unsigned ops)
+    : db(db), id(id), ops(ops) {}
+
+  ghobject_t oid(const string &name) {
+    return ghobject_t(hobject_t(sobject_t(name, CEPH_NOSNAP)));
+  }
+
+  void *entry() {
+    vector<string> names;
+    for (unsigned i = 0; i < 4; ++i)
+      names.push_back("writer_" + stringify(id) + "_" + stringify(i));
+    for (unsigned i = 0; i < ops; ++i) {
+      const string &name = names[rand() % names.size()];
+      unsigned val = rand() % 100;
+      if (val < 70) {
+	map<string, bufferlist> to_set;
+	for (unsigned j = 0; j < 3; ++j) {
+	  string key = "key_" + num_str(rand() % 50);
+	  string value = name + "_" + num_str(i);
+	  to_set[key].append(value);
+	  omap[name][key] = value;
+	}
+	assert(db->set_keys(oid(name), to_set) == 0);
+      } else if (val < 80) {
+	set<string> to_rm;
+	to_rm.insert("key_" + num_str(rand() % 50));
+	omap[name].erase(*to_rm.begin());
+	assert(db->rm_keys(oid(name), to_rm) == 0);
+      } else if (val < 88) {
+	// rm_range/rmkeys_by_prefix: must not share a KeyValueDB
+	// transaction with what was queued ahead of it
+	db->clear_keys_header(oid(name));
+	omap.erase(name);
+      } else if (val < 95) {
+	const string &target = names[rand() % names.size()];
+	if (target == name)
+	  continue;
+	db->clone(oid(name), oid(target));
+	if (omap.count(name))
+	  omap[target] = omap[name];
+	else
+	  omap.erase(target);
+      } else {
+	// sync submit; the leader must stop waiting for more txns
+	assert(db->sync() == 0);
+      }
+    }
+    return NULL;
+  }
+};
+
+TEST(ObjectMapGroupCommit, ConcurrentWriters) {
+  string path = "test_object_map_group_commit." + stringify(getpid());
+  LevelDBStore *store = new LevelDBStore(g_ceph_context, path);
+  ASSERT_EQ(0, store->create_and_open(cerr));
+  boost::scoped_ptr<DBObjectMap> db(new DBObjectMap(store));
+
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit", "true");
+  // long enough that groups only close early through max_txns or a sync
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit_max_latency",
+				 "0.05");
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit_max_txns", "4");
+
+  PerfCounters *logger = db->get_perf_counters();
+  uint64_t commits = logger->get(l_dbom_group_commit);
+  uint64_t syncs = logger->get(l_dbom_group_commit_sync);
+  uint64_t txns = logger->get(l_dbom_group_commit_txns);
+
+  vector<GroupCommitWriter*> writers;
+  for (unsigned i = 0; i < 8; ++i) {
+    writers.push_back(new GroupCommitWriter(db.get(), i, 300));
+    writers.back()->create();
+  }
+  for (unsigned i = 0; i < writers.size(); ++i)
+    writers[i]->join();
+  ASSERT_EQ(0, db->sync());
+
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit", "false");
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit_max_latency",
+				 "0");
+  g_ceph_context->_conf->set_val("filestore_omap_group_commit_max_txns", "64");
+
+  commits = logger->get(l_dbom_group_commit) - commits;
+  syncs = logger->get(l_dbom_group_commit_sync) - syncs;
+  txns = logger->get(l_dbom_group_commit_txns) - txns;
+  cerr << commits << " group commits, " << txns << " txns, "
+       << syncs << " synced" << std::endl;
+  ASSERT_LT(0u, syncs);
+  // more than one txn per KeyValueDB submit on average
+  ASSERT_LT(commits, txns);
+
+  for (unsigned i = 0; i < writers.size(); ++i) {
+    for (map<string, map<string, string> >::iterator p =
+	   writers[i]->omap.begin();
+	 p != writers[i]->omap.end();
+	 ++p) {
+      bufferlist header;
+      map<string, bufferlist> got;
+      db->get(writers[i]->oid(p->first), &header, &got);
+      ASSERT_EQ(p->second.size(), got.size()) << p->first;
+      for (map<string, string>::iterator q = p->second.begin();
+	   q != p->second.end();
+	   ++q) {
+	ASSERT_TRUE(got.count(q->first)) << p->first << " " << q->first;
+	ASSERT_EQ(q->second,
+		  string(got[q->first].c_str(), got[q->first].length()));
+      }
+    }
+    delete writers[i];
+  }
+  ASSERT_TRUE(db->check(cerr));
+  db.reset();
+  ASSERT_EQ(0, ::system(("rm -rf " + path).c_str()));
+}
+
+TEST_F(ObjectMapTest, PrefetchingIterator) {
+  ghobject_t hoid(hobject_t(sobject_t("foo", CEPH_NOSNAP)));
+  map<string, bufferlist> expected;
+  for (unsigned i = 0; i < 1000; ++i) {
+    bufferlist bl;
+    bl.append(num_str(i * 3));
+    expected[num_str(i)] = bl;
+  }
+  db->set_keys(hoid, expected);
+
+  ThreadPool tp(g_ceph_context, "PrefetchingIterator::tp", 2);
+  ContextWQ wq("PrefetchingIterator::wq", 60, &tp);
+  tp.start();
+
+  {
+    // single steps across several read-aheads
+    PrefetchingObjectMapIterator iter(db->get_iterator(hoid), &wq, 64);
+    ASSERT_EQ(0, iter.seek_to_first());
+    map<string, bufferlist>::iterator e = expected.begin();
+    for (; iter.valid(); ++e, iter.next()) {
+      ASSERT_TRUE(e != expected.end());
+      ASSERT_EQ(e->first, iter.key());
+      bufferlist v = iter.value();
+      ASSERT_TRUE(e->second.contents_equal(v));
+    }
+    ASSERT_TRUE(e == expected.end());
+    ASSERT_EQ(0, iter.status());
+
+    // reposition, possibly while a read-ahead is outstanding
+    ASSERT_EQ(0, iter.upper_bound(num_str(499)));
+    ASSERT_TRUE(iter.valid());
+    ASSERT_EQ(num_str(500), iter.key());
+    for (unsigned i = 0; i < 100; ++i)
+      iter.next();
+    ASSERT_EQ(0, iter.lower_bound(num_str(10)));
+    ASSERT_TRUE(iter.valid());
+    ASSERT_EQ(num_str(10), iter.key());
+    ASSERT_EQ(0, iter.lower_bound(num_str(1000)));
+    ASSERT_FALSE(iter.valid());
+  }
+
+  {
+    // batches which straddle the internal ones
+    PrefetchingObjectMapIterator iter(db->get_iterator(hoid), &wq, 100);
+    ASSERT_EQ(0, iter.upper_bound(num_str(0)));
+    map<string, bufferlist> got;
+    int r;
+    while ((r = iter.get_next_batch(37, &got)) > 0)
+      ASSERT_TRUE(r == 37 || !iter.valid());
+    ASSERT_EQ(0, r);
+    ASSERT_EQ(expected.size() - 1, got.size());
+    ASSERT_EQ(num_str(1), got.begin()->first);
+    ASSERT_EQ(num_str(999), got.rbegin()->first);
+  }
+
+  {
+    // dropped in the middle of a scan
+    PrefetchingObjectMapIterator iter(db->get_iterator(hoid), &wq, 512);
+    iter.seek_to_first();
+    for (unsigned i = 0; i < 40; ++i)
+      iter.next();
+    ASSERT_EQ(num_str(40), iter.key());
+  }
+
+  tp.stop();
+}
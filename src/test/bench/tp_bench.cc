@@ -23,6 +23,10 @@
 #include "common/WorkQueue.h"
 #include "common/Semaphore.h"
 #include "common/Finisher.h"
+#include "common/PrioritizedQueue.h"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Clock.h"
 
 namespace po = boost::program_options;
 using namespace std;
@@ -104,6 +108,262 @@ public:
     ThreadPool::WorkQueue<unsigned>("TestQueue", 100, 100, tp), next(_next) {}
 };
 
+/*
+ * Skewed PG load through a ShardedThreadPool
+ *
+ * This is a model of OSD::ShardedOpWQ: ops are hashed by PG onto a
+ * shard, each shard has its own PrioritizedQueue, and per-PG ordering
+ * comes from pg_for_processing plus a per-PG lock held while the op
+ * runs.  A fraction of the ops go to a single hot PG; the rest are
+ * spread evenly over the others.  Without work stealing the cold PGs
+ * that share a shard with the hot one queue up behind it while other
+ * shards sit idle, which shows up in the cold op tail latency.
+ *
+ * Stealing itself is ShardedThreadPool's; like the OSD queue, this one
+ * only supplies the hooks.
+ */
+struct SkewOp {
+  unsigned pg;
+  utime_t queued;
+  SkewOp(unsigned pg, utime_t queued) : pg(pg), queued(queued) {}
+};
+
+class SkewStats {
+  Mutex lock;
+  vector<double> lat[2];  // cold, hot
+public:
+  SkewStats() : lock("SkewStats::lock") {}
+  void add(bool hot, double l) {
+    Mutex::Locker l_(lock);
+    lat[hot].push_back(l);
+  }
+  static double pct(const vector<double> &v, double p) {
+    if (v.empty())
+      return 0;
+    size_t i = (size_t)(p * (v.size() - 1));
+    return v[i];
+  }
+  void dump(ostream &out) {
+    Mutex::Locker l_(lock);
+    const char *names[2] = { "cold", "hot" };
+    for (int h = 0; h < 2; ++h) {
+      vector<double> &v = lat[h];
+      sort(v.begin(), v.end());
+      out << "  " << names[h] << " ops " << v.size()
+	  << " p50 " << pct(v, 0.5) * 1000000.0
+	  << " p99 " << pct(v, 0.99) * 1000000.0
+	  << " p99.9 " << pct(v, 0.999) * 1000000.0
+	  << " max " << pct(v, 1.0) * 1000000.0 << " us" << std::endl;
+    }
+  }
+};
+
+class SkewedShardedWQ : public ShardedThreadPool::ShardedWQ<SkewOp*> {
+  struct ShardData {
+    Mutex sdata_lock;
+    Cond sdata_cond;
+    Mutex sdata_op_ordering_lock;
+    map<unsigned, list<SkewOp*> > pg_for_processing;
+    PrioritizedQueue<SkewOp*, unsigned> pqueue;
+    atomic_t num_waiters;
+    ShardData(string lock_name, string ordering_lock)
+      : sdata_lock(lock_name.c_str()),
+	sdata_op_ordering_lock(ordering_lock.c_str()),
+	pqueue(100, 1) {}
+  };
+
+  vector<ShardData*> shard_list;
+  vector<Mutex*> pg_locks;
+  uint32_t num_shards;
+  unsigned op_usec;
+  SkewStats *stats;
+  Semaphore *sem;
+  atomic_t steals;
+
+  ShardData *shard_of(unsigned pg) {
+    return shard_list[pg % num_shards];
+  }
+
+  void run(ShardData *sdata, unsigned pg) {
+    pg_locks[pg]->Lock();
+    sdata->sdata_op_ordering_lock.Lock();
+    list<SkewOp*> &l = sdata->pg_for_processing[pg];
+    SkewOp *op = l.front();
+    l.pop_front();
+    if (l.empty())
+      sdata->pg_for_processing.erase(pg);
+    sdata->sdata_op_ordering_lock.Unlock();
+
+    // burn op_usec of cpu with the pg locked, like a real op would
+    utime_t until = ceph_clock_now(NULL);
+    until += utime_t(0, op_usec * 1000);
+    while (ceph_clock_now(NULL) < until) ;
+    pg_locks[pg]->Unlock();
+
+    stats->add(op->pg == 0, (double)(ceph_clock_now(NULL) - op->queued));
+    delete op;
+    sem->Put();
+  }
+
+  void _process_item(ShardData *sdata, SkewOp *op) {
+    unsigned pg = op->pg;
+    sdata->pg_for_processing[pg].push_back(op);
+    sdata->sdata_op_ordering_lock.Unlock();
+    run(sdata, pg);
+  }
+
+  struct NotInFlight {
+    ShardData *sdata;
+    NotInFlight(ShardData *sdata) : sdata(sdata) {}
+    bool operator()(SkewOp *op) {
+      return !sdata->pg_for_processing.count(op->pg);
+    }
+  };
+
+  // ShardedThreadPool work stealing hooks
+  uint32_t get_num_shards() {
+    return num_shards;
+  }
+  bool has_idle_threads(uint32_t shard_index) {
+    return shard_list[shard_index]->num_waiters.read();
+  }
+  bool _steal_from(uint32_t shard_index, heartbeat_handle_d *hb) {
+    ShardData *sdata = shard_list[shard_index];
+    sdata->sdata_op_ordering_lock.Lock();
+    list<SkewOp*> taken;
+    if (!sdata->pqueue.dequeue_head_if(NotInFlight(sdata), 8, &taken)) {
+      sdata->sdata_op_ordering_lock.Unlock();
+      return false;
+    }
+    steals.inc();
+    _process_item(sdata, taken.front());
+    return true;
+  }
+  bool _wake_idle(uint32_t shard_index) {
+    ShardData *sdata = shard_list[shard_index];
+    if (!sdata->num_waiters.read())
+      return false;
+    sdata->sdata_lock.Lock();
+    sdata->sdata_cond.SignalOne();
+    sdata->sdata_lock.Unlock();
+    return true;
+  }
+
+  void _enqueue(SkewOp *op) {
+    uint32_t shard_index = op->pg % num_shards;
+    ShardData *sdata = shard_list[shard_index];
+    sdata->sdata_op_ordering_lock.Lock();
+    sdata->pqueue.enqueue(op->pg, 63, 1, op);
+    sdata->sdata_op_ordering_lock.Unlock();
+    sdata->sdata_lock.Lock();
+    sdata->sdata_cond.SignalOne();
+    sdata->sdata_lock.Unlock();
+    if (!sdata->num_waiters.read())
+      wake_thief(shard_index);
+  }
+  void _enqueue_front(SkewOp *op) {
+    assert(0);
+  }
+
+public:
+  SkewedShardedWQ(uint32_t num_shards, unsigned num_pgs, unsigned op_usec,
+		  SkewStats *stats, Semaphore *sem, ShardedThreadPool *tp)
+    : ShardedThreadPool::ShardedWQ<SkewOp*>(60, 0, tp),
+      num_shards(num_shards), op_usec(op_usec), stats(stats), sem(sem) {
+    for (uint32_t i = 0; i < num_shards; ++i) {
+      stringstream lock_name, order_lock;
+      lock_name << "SkewedShardedWQ::shard." << i;
+      order_lock << "SkewedShardedWQ::ordering." << i;
+      shard_list.push_back(new ShardData(lock_name.str(), order_lock.str()));
+    }
+    for (unsigned i = 0; i < num_pgs; ++i)
+      pg_locks.push_back(new Mutex("SkewedShardedWQ::pg_lock"));
+  }
+  ~SkewedShardedWQ() {
+    for (uint32_t i = 0; i < num_shards; ++i)
+      delete shard_list[i];
+    for (unsigned i = 0; i < pg_locks.size(); ++i)
+      delete pg_locks[i];
+  }
+
+  void _process(uint32_t thread_index, heartbeat_handle_d *hb) {
+    uint32_t shard_index = thread_index % num_shards;
+    ShardData *sdata = shard_list[shard_index];
+    sdata->sdata_op_ordering_lock.Lock();
+    if (sdata->pqueue.empty()) {
+      sdata->sdata_op_ordering_lock.Unlock();
+      if (steal(shard_index, hb))
+	return;
+      sdata->sdata_lock.Lock();
+      sdata->num_waiters.inc();
+      sdata->sdata_cond.WaitInterval(g_ceph_context, sdata->sdata_lock,
+				     utime_t(2, 0));
+      sdata->num_waiters.dec();
+      sdata->sdata_lock.Unlock();
+      sdata->sdata_op_ordering_lock.Lock();
+      if (sdata->pqueue.empty()) {
+	sdata->sdata_op_ordering_lock.Unlock();
+	steal(shard_index, hb);
+	return;
+      }
+    }
+    _process_item(sdata, sdata->pqueue.dequeue());
+  }
+
+  void return_waiting_threads() {
+    for (uint32_t i = 0; i < num_shards; ++i) {
+      ShardData *sdata = shard_list[i];
+      sdata->sdata_lock.Lock();
+      sdata->sdata_cond.Signal();
+      sdata->sdata_lock.Unlock();
+    }
+  }
+  bool is_shard_empty(uint32_t thread_index) {
+    ShardData *sdata = shard_list[thread_index % num_shards];
+    Mutex::Locker l(sdata->sdata_op_ordering_lock);
+    return sdata->pqueue.empty();
+  }
+
+  unsigned get_steals() {
+    return steals.read();
+  }
+};
+
+static void run_skewed(unsigned num_shards, unsigned threads_per_shard,
+		       unsigned num_pgs, double hot_fraction,
+		       unsigned op_usec, unsigned queue_size,
+		       unsigned num_ops, bool steal)
+{
+  SkewStats stats;
+  Semaphore sem;
+  for (unsigned i = 0; i < queue_size; ++i)
+    sem.Put();
+
+  ShardedThreadPool tp(g_ceph_context, "tp_bench_sharded",
+		       num_shards * threads_per_shard);
+  tp.set_work_stealing(steal);
+  SkewedShardedWQ wq(num_shards, num_pgs, op_usec, &stats, &sem, &tp);
+  tp.start();
+
+  utime_t start = ceph_clock_now(NULL);
+  for (unsigned i = 0; i < num_ops; ++i) {
+    sem.Get();
+    unsigned pg = 0;  // the hot one
+    if (num_pgs > 1 && drand48() >= hot_fraction)
+      pg = 1 + lrand48() % (num_pgs - 1);
+    wq.queue(new SkewOp(pg, ceph_clock_now(NULL)));
+  }
+  for (unsigned i = 0; i < queue_size; ++i)
+    sem.Get();
+  double elapsed = ceph_clock_now(NULL) - start;
+  tp.stop();
+
+  cout << (steal ? "work stealing" : "no stealing")
+       << ": " << num_ops / elapsed << " ops/sec, "
+       << wq.get_steals() << " stolen" << std::endl;
+  stats.dump(cout);
+}
+
 int main(int argc, char **argv)
 {
   po::options_description desc("Allowed options");
@@ -117,6 +377,20 @@ int main(int argc, char **argv)
      "num items")
     ("layers", po::value<string>()->default_value(""),
      "layer desc")
+    ("sharded", "run the skewed PG load test through a ShardedThreadPool "
+     "with and without work stealing instead")
+    ("num-shards", po::value<unsigned>()->default_value(5),
+     "sharded: number of shards")
+    ("threads-per-shard", po::value<unsigned>()->default_value(2),
+     "sharded: threads per shard")
+    ("num-pgs", po::value<unsigned>()->default_value(100),
+     "sharded: number of pgs")
+    ("hot-fraction", po::value<double>()->default_value(0.3),
+     "sharded: fraction of ops going to the hot pg")
+    ("op-usec", po::value<unsigned>()->default_value(20),
+     "sharded: cpu time per op")
+    ("num-ops", po::value<unsigned>()->default_value(200000),
+     "sharded: num ops")
     ;
 
   vector<string> ceph_option_strings;
@@ -155,6 +429,21 @@ int main(int argc, char **argv)
     return 1;
   }
 
+  if (vm.count("sharded")) {
+    for (int steal = 0; steal < 2; ++steal) {
+      srand48(0);
+      run_skewed(vm["num-shards"].as<unsigned>(),
+		 vm["threads-per-shard"].as<unsigned>(),
+		 vm["num-pgs"].as<unsigned>(),
+		 vm["hot-fraction"].as<double>(),
+		 vm["op-usec"].as<unsigned>(),
+		 vm["queue-size"].as<unsigned>(),
+		 vm["num-ops"].as<unsigned>(),
+		 steal);
+    }
+    return 0;
+  }
+
   DetailedStatCollector col(1, new JSONFormatter, 0, &cout);
   Semaphore sem;
   for (unsigned i = 0; i < vm["queue-size"].as<unsigned>(); ++i)
@@ -28,19 +28,8 @@ struct T : public Thread {
   }
 };
 
-int main(int argc, const char **argv)
+static double run(int threads, int num)
 {
-  int threads = atoi(argv[1]);
-  int num = atoi(argv[2]);
-
-  cout << threads << " threads, " << num << " lines per thread" << std::endl;
-
-  vector<const char*> args;
-  argv_to_vec(argc, argv, args);
-  env_to_vec(args);
-
-  global_init(NULL, args, CEPH_ENTITY_TYPE_OSD, CODE_ENVIRONMENT_UTILITY, 0);
-
   utime_t start = ceph_clock_now(NULL);
 
   list<T*> ls;
@@ -59,9 +48,9 @@ int main(int argc, const char **argv)
     catch (ceph::FailedAssertion &a) {
       cout << "Failed assert in join(), exit." << std::endl;
       delete t;
-      return -1;
+      exit(1);
     }
-    delete t;    
+    delete t;
   }
 
   utime_t t = ceph_clock_now(NULL);
@@ -74,5 +63,48 @@ int main(int argc, const char **argv)
   utime_t dur = end - start;
 
   cout << dur << std::endl;
+  return (double)threads * num / (double)dur;
+}
+
+void usage(const char *name)
+{
+  cout << "usage: " << name << " <threads> <lines per thread>" << std::endl
+       << "       " << name << " sweep <lines per thread>" << std::endl
+       << "  sweep runs with 1, 2, 4, ... 64 submitting threads" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+  bool sweep = strcmp(argv[1], "sweep") == 0;
+  int threads = sweep ? 64 : atoi(argv[1]);
+  int num = atoi(argv[2]);
+
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_OSD, CODE_ENVIRONMENT_UTILITY, 0);
+
+  if (!sweep) {
+    cout << threads << " threads, " << num << " lines per thread" << std::endl;
+    double rate = run(threads, num);
+    cout << rate << " entries/sec" << std::endl;
+    return 0;
+  }
+
+  vector<pair<int, double> > results;
+  for (int n = 1; n <= threads; n *= 2) {
+    cout << n << " threads, " << num << " lines per thread" << std::endl;
+    results.push_back(make_pair(n, run(n, num)));
+  }
+  cout << "threads\tentries/sec" << std::endl;
+  for (vector<pair<int, double> >::iterator p = results.begin();
+       p != results.end();
+       ++p)
+    cout << p->first << "\t" << p->second << std::endl;
   return 0;
 }
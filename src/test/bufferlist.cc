@@ -177,6 +177,73 @@ TEST(BufferRaw, ostream) {
   EXPECT_GT(stream.str().size(), stream.str().find("len 1 nref 1)"));
 }
 
+TEST(BufferRaw, pool) {
+  buffer::set_pool_enabled(true);
+  //
+  // small buffers: a free followed by an alloc of the same class
+  // is served from this thread's cache
+  //
+  {
+    bufferptr ptr(100);
+  }
+  uint64_t hits = buffer::get_pool_hits();
+  {
+    bufferptr ptr(100);
+    EXPECT_EQ(100u, ptr.length());
+    EXPECT_EQ(0, (long)ptr.c_str() & 15);
+    memset(ptr.c_str(), 'A', ptr.length());
+    bufferptr clone(ptr.clone());
+    EXPECT_EQ(0, clone.cmp(ptr));
+  }
+  EXPECT_LT(hits, buffer::get_pool_hits());
+  //
+  // page multiples come from page aligned slabs
+  //
+  {
+    bufferptr ptr(buffer::create_page_aligned(3 * CEPH_PAGE_SIZE));
+    EXPECT_TRUE(ptr.is_page_aligned());
+  }
+  hits = buffer::get_pool_hits();
+  {
+    bufferptr ptr(buffer::create_aligned(3 * CEPH_PAGE_SIZE, 512));
+    EXPECT_TRUE(ptr.is_page_aligned());
+    EXPECT_EQ(3 * CEPH_PAGE_SIZE, ptr.length());
+  }
+  EXPECT_LT(hits, buffer::get_pool_hits());
+  EXPECT_LT(0u, buffer::get_pool_cached_bytes());
+  //
+  // disabled: allocations bypass the pool entirely
+  //
+  buffer::set_pool_enabled(false);
+  hits = buffer::get_pool_hits();
+  uint64_t misses = buffer::get_pool_misses();
+  {
+    bufferptr small(100);
+    bufferptr pages(buffer::create_page_aligned(CEPH_PAGE_SIZE));
+  }
+  EXPECT_EQ(hits, buffer::get_pool_hits());
+  EXPECT_EQ(misses, buffer::get_pool_misses());
+  buffer::set_pool_enabled(true);
+}
+
+static void *pool_free_in_other_thread(void *arg)
+{
+  bufferlist *bl = static_cast<bufferlist*>(arg);
+  bl->clear();
+  bufferptr ptr(100);
+  return NULL;
+}
+
+TEST(BufferRaw, pool_cross_thread_free) {
+  bufferlist bl;
+  for (int i = 0; i < 100; ++i)
+    bl.append(bufferptr(100));
+  pthread_t t;
+  ASSERT_EQ(0, pthread_create(&t, NULL, pool_free_in_other_thread, &bl));
+  ASSERT_EQ(0, pthread_join(t, NULL));
+  EXPECT_EQ(0u, bl.length());
+}
+
 #ifdef CEPH_HAVE_SPLICE
 class TestRawPipe : public ::testing::Test {
 protected:
@@ -2152,6 +2219,345 @@ TEST(BufferList, crc32c_append_perf) {
   cout << "crc cache hits (adjusted) = " << buffer::get_cached_crc_adjusted() << std::endl;
 }
 
+// build a list of n single byte segments 'a', 'b', ...
+static void make_segments(bufferlist& bl, unsigned n, char first = 'a')
+{
+  for (unsigned i = 0; i < n; ++i) {
+    bufferptr bp(1);
+    bp.c_str()[0] = first + i;
+    bl.push_back(bp);
+  }
+}
+
+static std::string segments_str(const bufferlist::buffers_t& ls)
+{
+  std::string s;
+  for (bufferlist::buffers_t::const_iterator p = ls.begin(); p != ls.end(); ++p)
+    s.append(p->c_str(), p->length());
+  return s;
+}
+
+TEST(BufferList, segments_spill) {
+  const unsigned inline_segs = bufferlist::buffers_t::INLINE_SEGMENTS;
+  bufferptr bp(1);
+  bp.c_str()[0] = 'x';
+  {
+    bufferlist::buffers_t ls;
+    for (unsigned i = 0; i < inline_segs; ++i)
+      ls.push_back(bp);
+    EXPECT_EQ(inline_segs, ls.capacity());
+    EXPECT_EQ(1 + (int)inline_segs, bp.raw_nref());
+    // spill to the heap
+    ls.push_back(bp);
+    EXPECT_LT(inline_segs, ls.capacity());
+    EXPECT_EQ(inline_segs + 1, ls.size());
+    for (unsigned i = 0; i < 100; ++i)
+      ls.push_back(bp);
+    EXPECT_EQ(inline_segs + 101, ls.size());
+    EXPECT_EQ(1 + (int)ls.size(), bp.raw_nref());
+    for (unsigned i = 0; i < ls.size(); ++i)
+      EXPECT_EQ(bp.get_raw(), ls[i].get_raw());
+    {
+      bufferlist::buffers_t copy(ls);
+      EXPECT_EQ(ls.size(), copy.size());
+      EXPECT_EQ(1 + 2 * (int)ls.size(), bp.raw_nref());
+      bufferlist::buffers_t small;
+      small.push_back(bp);
+      small = copy;
+      EXPECT_EQ(ls.size(), small.size());
+    }
+    EXPECT_EQ(1 + (int)ls.size(), bp.raw_nref());
+    // push_back of one of our own elements while reallocating
+    bufferlist::buffers_t own;
+    for (unsigned i = 0; i < inline_segs; ++i)
+      own.push_back(bp);
+    own.push_back(own.front());
+    EXPECT_EQ(bp.get_raw(), own.back().get_raw());
+  }
+  EXPECT_EQ(1, bp.raw_nref());
+  {
+    bufferlist bl;
+    make_segments(bl, 20);
+    EXPECT_EQ((unsigned)20, bl.buffers().size());
+    EXPECT_EQ(0, ::memcmp("abcdefghijklmnopqrst", bl.c_str(), 20));
+  }
+}
+
+TEST(BufferList, segments_insert_erase) {
+  const unsigned inline_segs = bufferlist::buffers_t::INLINE_SEGMENTS;
+  bufferptr x(1);
+  x.c_str()[0] = 'X';
+  for (unsigned n = 1; n <= inline_segs + 2; ++n) {
+    bufferlist bl;
+    make_segments(bl, n);
+    bufferlist::buffers_t ls(bl.buffers());
+    std::string expect = segments_str(ls);
+    for (unsigned pos = 0; pos <= n; ++pos) {
+      bufferlist::buffers_t t(ls);
+      bufferlist::buffers_t::iterator p =
+	t.insert(bufferlist::buffers_t::iterator(&t, pos), x);
+      EXPECT_EQ(pos, p.index());
+      EXPECT_EQ('X', (*p)[0]);
+      std::string e(expect);
+      e.insert(pos, 1, 'X');
+      EXPECT_EQ(e, segments_str(t));
+
+      p = t.erase(p);
+      EXPECT_EQ(pos, p.index());
+      EXPECT_EQ(expect, segments_str(t));
+    }
+    {
+      bufferlist::buffers_t t(ls);
+      bufferlist::buffers_t::iterator p = t.begin();
+      ++p;
+      if (p != t.end()) {
+	p = t.erase(p);
+	std::string e(expect);
+	e.erase(1, 1);
+	EXPECT_EQ(e, segments_str(t));
+	if (p != t.end())
+	  EXPECT_EQ(expect[2], (*p)[0]);
+      }
+      while (!t.empty())
+	t.erase(t.begin());
+      EXPECT_EQ(0u, t.size());
+    }
+  }
+  EXPECT_EQ(1, x.raw_nref());
+}
+
+TEST(BufferList, segments_claim_prepend) {
+  const unsigned inline_segs = bufferlist::buffers_t::INLINE_SEGMENTS;
+  unsigned sizes[] = { 0, 1, inline_segs - 1, inline_segs, inline_segs + 3 };
+  const unsigned nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  for (unsigned i = 0; i < nsizes; ++i) {
+    for (unsigned j = 0; j < nsizes; ++j) {
+      bufferlist to, from;
+      make_segments(to, sizes[i], 'a');
+      make_segments(from, sizes[j], 'A');
+      std::string expect = segments_str(from.buffers()) +
+	segments_str(to.buffers());
+      to.claim_prepend(from);
+      EXPECT_EQ(sizes[i] + sizes[j], to.buffers().size());
+      EXPECT_EQ(sizes[i] + sizes[j], to.length());
+      EXPECT_EQ(expect, segments_str(to.buffers()));
+      EXPECT_EQ(0u, from.buffers().size());
+      EXPECT_EQ(0u, from.length());
+      // both stay usable
+      make_segments(from, inline_segs + 1, '0');
+      EXPECT_EQ(inline_segs + 1, from.length());
+      to.claim_append(from);
+      EXPECT_EQ(sizes[i] + sizes[j] + inline_segs + 1, to.length());
+      bufferlist::iterator p = to.begin();
+      std::string all;
+      p.copy(to.length(), all);
+      EXPECT_EQ(expect + "01234", all);
+    }
+  }
+}
+
+TEST(BufferList, segments_splice) {
+  const unsigned inline_segs = bufferlist::buffers_t::INLINE_SEGMENTS;
+  const unsigned n = inline_segs * 3;
+  std::string all;
+  {
+    bufferlist bl;
+    make_segments(bl, n);
+    all = segments_str(bl.buffers());
+  }
+  for (unsigned off = 0; off < n; ++off) {
+    for (unsigned len = 1; off + len <= n; ++len) {
+      bufferlist bl, claimed;
+      make_segments(bl, n);
+      bl.splice(off, len, &claimed);
+      std::string rest(all);
+      rest.erase(off, len);
+      EXPECT_EQ(n - len, bl.length());
+      EXPECT_EQ(n - len, bl.buffers().size());
+      EXPECT_EQ(rest, segments_str(bl.buffers()));
+      EXPECT_EQ(all.substr(off, len), segments_str(claimed.buffers()));
+    }
+  }
+  // split a segment in the middle of a spilled list
+  {
+    bufferlist bl;
+    make_segments(bl, n);
+    bufferptr big("0123456789", 10);
+    bl.push_back(big);
+    make_segments(bl, 2, 'y');
+    bufferlist claimed;
+    bl.splice(n + 3, 4, &claimed);
+    EXPECT_EQ(all + "012789yz", segments_str(bl.buffers()));
+    EXPECT_EQ(n + 4, bl.buffers().size());  // "012" "789" y z
+    EXPECT_EQ("3456", segments_str(claimed.buffers()));
+  }
+}
+
+TEST(BufferList, segments_swap) {
+  const unsigned inline_segs = bufferlist::buffers_t::INLINE_SEGMENTS;
+  unsigned sizes[] = { 0, 2, inline_segs, inline_segs + 1, inline_segs * 4 };
+  const unsigned nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  for (unsigned i = 0; i < nsizes; ++i) {
+    for (unsigned j = 0; j < nsizes; ++j) {
+      bufferlist a, b;
+      make_segments(a, sizes[i], 'a');
+      make_segments(b, sizes[j], 'A');
+      std::string sa = segments_str(a.buffers());
+      std::string sb = segments_str(b.buffers());
+      a.swap(b);
+      EXPECT_EQ(sb, segments_str(a.buffers()));
+      EXPECT_EQ(sa, segments_str(b.buffers()));
+      EXPECT_EQ(sizes[j], a.length());
+      EXPECT_EQ(sizes[i], b.length());
+      // the lists keep working after the swap
+      a.append('!');
+      b.append('!');
+      std::string out;
+      a.begin().copy(a.length(), out);
+      EXPECT_EQ(sb + "!", out);
+      out.clear();
+      b.begin().copy(b.length(), out);
+      EXPECT_EQ(sa + "!", out);
+
+      bufferlist::buffers_t c(a.buffers()), d(b.buffers());
+      c.swap(d);
+      EXPECT_EQ(segments_str(b.buffers()), segments_str(c));
+      EXPECT_EQ(segments_str(a.buffers()), segments_str(d));
+      c.swap(c);
+      EXPECT_EQ(segments_str(b.buffers()), segments_str(c));
+    }
+  }
+}
+
+TEST(BufferList, segments_iterator_shift) {
+  const unsigned inline_segs = bufferlist::buffers_t::INLINE_SEGMENTS;
+  for (unsigned n = 2; n <= inline_segs + 2; ++n) {
+    // segment iterators keep their index, not their element
+    {
+      bufferlist bl;
+      make_segments(bl, n);
+      bufferlist::buffers_t ls(bl.buffers());
+      bufferlist::buffers_t::iterator p = ls.begin();
+      ++p;
+      EXPECT_EQ('b', (*p)[0]);
+      // appends, even ones that reallocate, leave it in place
+      for (unsigned i = 0; i < inline_segs; ++i)
+	ls.push_back(bufferptr("z", 1));
+      EXPECT_EQ('b', (*p)[0]);
+      ls.push_front(bufferptr("0", 1));
+      EXPECT_EQ('a', (*p)[0]);
+      bufferlist::buffers_t front;
+      front.push_back(bufferptr("1", 1));
+      front.push_back(bufferptr("2", 1));
+      ls.claim_prepend(front);
+      EXPECT_EQ('2', (*p)[0]);
+    }
+    // a bufferlist::iterator survives appends...
+    {
+      bufferlist bl;
+      make_segments(bl, n);
+      bufferlist::iterator p = bl.begin();
+      p.advance(1);
+      make_segments(bl, inline_segs * 2, 'A');
+      EXPECT_EQ('b', *p);
+      EXPECT_EQ(n + inline_segs * 2 - 1, p.get_remaining());
+    }
+    // ...but must be re-seeked after the segments ahead of it change
+    {
+      bufferlist bl;
+      make_segments(bl, n);
+      bufferlist::iterator p = bl.begin();
+      p.advance(1);
+      bufferptr zero("0", 1);
+      bl.push_front(zero);
+      EXPECT_EQ('a', *p);
+      p.seek(2);
+      EXPECT_EQ('b', *p);
+
+      bufferlist front;
+      front.append("12", 2);
+      bl.claim_prepend(front);
+      p.seek(4);
+      EXPECT_EQ('b', *p);
+
+      bl.splice(0, 3);
+      p.seek(1);
+      EXPECT_EQ('b', *p);
+    }
+  }
+}
+
+TEST(BufferList, segments_perf) {
+  // build, walk and claim small multi-segment bufferlists: the shape of
+  // most encoded messages and transactions.  the 64 segment case spills
+  // out of the inline segment storage.
+  const unsigned n = 200000;
+  unsigned segments[] = { 1, 4, 64 };
+  bufferptr bp(16);
+  bp.zero();
+  for (unsigned s = 0; s < sizeof(segments) / sizeof(segments[0]); ++s) {
+    unsigned segs = segments[s];
+    {
+      utime_t start = ceph_clock_now(NULL);
+      for (unsigned i = 0; i < n; ++i) {
+	bufferlist bl;
+	for (unsigned j = 0; j < segs; ++j)
+	  bl.push_back(bp);
+      }
+      utime_t end = ceph_clock_now(NULL);
+      std::cout << "append " << segs << " segments: "
+		<< (double)(end - start) * 1000000000.0 / n << " ns/list"
+		<< std::endl;
+    }
+    bufferlist bl;
+    for (unsigned j = 0; j < segs; ++j)
+      bl.push_back(bp);
+    {
+      unsigned total = 0;
+      utime_t start = ceph_clock_now(NULL);
+      for (unsigned i = 0; i < n; ++i) {
+	for (bufferlist::buffers_t::const_iterator p = bl.buffers().begin();
+	     p != bl.buffers().end();
+	     ++p)
+	  total += p->length();
+      }
+      utime_t end = ceph_clock_now(NULL);
+      EXPECT_EQ(n * bl.length(), total);
+      std::cout << "iterate " << segs << " segments: "
+		<< (double)(end - start) * 1000000000.0 / n << " ns/list"
+		<< std::endl;
+    }
+    {
+      char buf[64 * 16];
+      utime_t start = ceph_clock_now(NULL);
+      for (unsigned i = 0; i < n; ++i) {
+	bufferlist::iterator p = bl.begin();
+	p.copy(bl.length(), buf);
+      }
+      utime_t end = ceph_clock_now(NULL);
+      std::cout << "copy out " << segs << " segments: "
+		<< (double)(end - start) * 1000000000.0 / n << " ns/list"
+		<< std::endl;
+    }
+    {
+      bufferlist a, b;
+      a = bl;
+      utime_t start = ceph_clock_now(NULL);
+      for (unsigned i = 0; i < n; ++i) {
+	bufferlist c;
+	c.claim_append(a);
+	b.claim(c);
+	a.claim(b);
+      }
+      utime_t end = ceph_clock_now(NULL);
+      EXPECT_EQ(bl.length(), a.length());
+      std::cout << "claim " << segs << " segments: "
+		<< (double)(end - start) * 1000000000.0 / n / 3 << " ns/claim"
+		<< std::endl;
+    }
+  }
+}
+
 TEST(BufferList, compare) {
   bufferlist a;
   a.append("A");
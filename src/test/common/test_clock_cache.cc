@@ -0,0 +1,92 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <stdio.h>
+#include "common/clock_cache.hpp"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include <gtest/gtest.h>
+
+TEST(SharedClock, add_lookup_purge) {
+  SharedClock<unsigned int, int> cache(4);
+  bool existed = true;
+  int *value = new int(1);
+  ceph::shared_ptr<int> ptr = cache.add(0, value, &existed);
+  ASSERT_FALSE(existed);
+  ASSERT_EQ(1, *ptr);
+  ASSERT_EQ(ptr, cache.lookup(0));
+
+  // a second add finds the cached value and leaves ours alone
+  int other = 2;
+  ASSERT_EQ(ptr, cache.add(0, &other, &existed));
+  ASSERT_TRUE(existed);
+
+  cache.purge(0);
+  ASSERT_FALSE(cache.lookup(0));
+  // our reference outlives the purge
+  ASSERT_EQ(1, *ptr);
+}
+
+TEST(SharedClock, evict_unreferenced) {
+  unsigned int size = 4;
+  SharedClock<unsigned int, int> cache(size);
+  for (unsigned int i = 0; i < size; ++i)
+    cache.add(i, new int(i));
+  // give everything but key 2 a second chance
+  for (unsigned int i = 0; i < size; ++i) {
+    if (i == 2)
+      continue;
+    ASSERT_TRUE(cache.lookup(i));
+  }
+  cache.add(size, new int(size));
+  ASSERT_FALSE(cache.lookup(2));
+  for (unsigned int i = 0; i <= size; ++i) {
+    if (i == 2)
+      continue;
+    ASSERT_TRUE(cache.lookup(i));
+  }
+}
+
+TEST(SharedClock, set_size) {
+  SharedClock<unsigned int, int> cache(8);
+  for (unsigned int i = 0; i < 8; ++i)
+    cache.add(i, new int(i));
+  cache.set_size(2);
+  unsigned int found = 0;
+  for (unsigned int i = 0; i < 8; ++i)
+    if (cache.lookup(i))
+      ++found;
+  ASSERT_EQ(2u, found);
+  cache.set_size(16);
+  for (unsigned int i = 0; i < 16; ++i)
+    cache.add(i, new int(i));
+  for (unsigned int i = 0; i < 16; ++i)
+    ASSERT_TRUE(cache.lookup(i));
+  cache.clear();
+  ASSERT_FALSE(cache.lookup(0));
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_clock_cache && ./unittest_clock_cache # --gtest_filter=*.* --log-to-stderr=true"
+// End:
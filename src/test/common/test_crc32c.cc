@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "include/types.h"
+#include "include/buffer.h"
 #include "include/crc32c.h"
 #include "include/utime.h"
 #include "common/Clock.h"
@@ -14,6 +15,8 @@
 #include "common/sctp_crc32.h"
 #include "common/crc32c_intel_baseline.h"
 #include "common/crc32c_aarch64.h"
+#include "common/crc32c_intel_pclmul.h"
+#include "arch/intel.h"
 
 TEST(Crc32c, Small) {
   const char *a = "foo bar baz";
@@ -263,3 +266,167 @@ TEST(Crc32c, RangeNull) {
     ASSERT_EQ(crc, *check);
   }
 }
+
+TEST(Crc32c, Zeros) {
+  int len = sizeof(crc_zero_check_table) / sizeof(crc_zero_check_table[0]);
+  uint32_t crc = 1;
+  uint32_t *check = crc_zero_check_table;
+  for (int i = 0 ; i < len; i++, check++) {
+    crc = ceph_crc32c_zeros(crc, len-i);
+    ASSERT_EQ(crc, *check);
+  }
+  ASSERT_EQ(0u, ceph_crc32c_zeros(0, 12345));
+  ASSERT_EQ(1234u, ceph_crc32c_zeros(1234, 0));
+  unsigned big = 4096000;
+  ASSERT_EQ(ceph_crc32c(0xffffffff, NULL, big),
+	    ceph_crc32c_zeros(0xffffffff, big));
+
+  // lengths with bit 29 and up, against 1MB steps checked on a real buffer
+  unsigned step = 1 << 20;
+  unsigned char *z = (unsigned char *)calloc(step, 1);
+  ASSERT_EQ(ceph_crc32c(0xffffffff, z, step),
+	    ceph_crc32c_zeros(0xffffffff, step));
+  free(z);
+  unsigned lens[] = { 1u << 29, (1u << 29) + 3, 1u << 30, 0x80000001,
+		      0xfff00005 };
+  for (unsigned i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    uint32_t slow = 0xffffffff;
+    unsigned left = lens[i];
+    for (; left >= step; left -= step)
+      slow = ceph_crc32c_zeros(slow, step);
+    slow = ceph_crc32c_zeros(slow, left);
+    ASSERT_EQ(slow, ceph_crc32c_zeros(0xffffffff, lens[i]));
+  }
+  // computed bytewise over real zeros
+  ASSERT_EQ(0xfc72d93bu, ceph_crc32c_zeros(0xffffffff, 1u << 29));
+  ASSERT_EQ(0x0e9e882du, ceph_crc32c_zeros(0xffffffff, 0x80000001));
+}
+
+TEST(Crc32c, Combine) {
+  unsigned len = 100000;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (unsigned i = 0; i < len; i++)
+    a[i] = (i * 7 + (i >> 8)) & 0xff;
+  uint32_t whole = ceph_crc32c(1234, a, len);
+  unsigned splits[] = { 0, 1, 3, 8, 17, 4096, 65535, 99999, 100000 };
+  for (unsigned i = 0; i < sizeof(splits) / sizeof(splits[0]); i++) {
+    unsigned s = splits[i];
+    uint32_t crc_a = ceph_crc32c(1234, a, s);
+    uint32_t crc_b = ceph_crc32c(0, a + s, len - s);
+    ASSERT_EQ(whole, ceph_crc32c_combine(crc_a, crc_b, len - s));
+  }
+  free(a);
+}
+
+TEST(Crc32c, Pclmul) {
+  if (!ceph_arch_intel_sse42 || !ceph_arch_intel_pclmul ||
+      !ceph_crc32c_intel_pclmul_exists())
+    return;
+  unsigned len = 3 * 8192 * 2 + 3 * 256 * 3 + 13;
+  unsigned char *a = (unsigned char *)malloc(len + 8);
+  for (unsigned i = 0; i < len + 8; i++)
+    a[i] = (i * 31 + (i >> 5)) & 0xff;
+  unsigned lens[] = { 0, 1, 7, 8, 9, 767, 768, 769, 3 * 8192 - 1, 3 * 8192,
+		      3 * 8192 + 1, len };
+  for (unsigned o = 0; o < 8; o++) {
+    for (unsigned i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+      ASSERT_EQ(ceph_crc32c_intel_baseline(0xffffffff, a + o, lens[i]),
+		ceph_crc32c_intel_pclmul(0xffffffff, a + o, lens[i]));
+      ASSERT_EQ(ceph_crc32c_intel_baseline(1234, a + o, lens[i]),
+		ceph_crc32c_intel_pclmul(1234, a + o, lens[i]));
+    }
+  }
+  ASSERT_EQ(ceph_crc32c_intel_baseline(1, NULL, len),
+	    ceph_crc32c_intel_pclmul(1, NULL, len));
+  free(a);
+}
+
+TEST(Crc32c, PerformanceSegments) {
+  unsigned seglen = 4096;
+  unsigned nseg = 1024;
+  int rounds = 20;
+  bufferlist bl;
+  for (unsigned i = 0; i < nseg; i++) {
+    bufferptr p(seglen);
+    for (unsigned j = 0; j < seglen; j++)
+      p[j] = (i + j) & 0xff;
+    bl.append(p);
+  }
+  unsigned len = bl.length();
+  const unsigned char *flat = (const unsigned char *)bl.c_str();
+  uint32_t expected = ceph_crc32c_intel_baseline(0, flat, len);
+
+  // reset the segments so that the uncached runs start cold
+  bufferlist segs;
+  for (unsigned i = 0; i < nseg; i++) {
+    bufferptr p(seglen);
+    p.copy_in(0, seglen, bl.c_str() + i * seglen);
+    segs.append(p);
+  }
+
+  {
+    utime_t start = ceph_clock_now(NULL);
+    for (int r = 0; r < rounds; r++)
+      ASSERT_EQ(expected, ceph_crc32c_intel_baseline(0, flat, len));
+    utime_t end = ceph_clock_now(NULL);
+    std::cout << "intel baseline = "
+	      << (float)len * rounds / (1024*1024) / (float)(end - start)
+	      << " MB/sec" << std::endl;
+  }
+  {
+    utime_t start = ceph_clock_now(NULL);
+    for (int r = 0; r < rounds; r++)
+      ASSERT_EQ(expected, ceph_crc32c(0, flat, len));
+    utime_t end = ceph_clock_now(NULL);
+    std::cout << "best choice = "
+	      << (float)len * rounds / (1024*1024) / (float)(end - start)
+	      << " MB/sec" << std::endl;
+  }
+  if (ceph_arch_intel_sse42 && ceph_arch_intel_pclmul &&
+      ceph_crc32c_intel_pclmul_exists()) {
+    utime_t start = ceph_clock_now(NULL);
+    for (int r = 0; r < rounds; r++)
+      ASSERT_EQ(expected, ceph_crc32c_intel_pclmul(0, flat, len));
+    utime_t end = ceph_clock_now(NULL);
+    std::cout << "intel pclmul = "
+	      << (float)len * rounds / (1024*1024) / (float)(end - start)
+	      << " MB/sec" << std::endl;
+  }
+  {
+    utime_t start = ceph_clock_now(NULL);
+    ASSERT_EQ(expected, segs.crc32c(0));
+    utime_t end = ceph_clock_now(NULL);
+    std::cout << "bufferlist " << nseg << " segments, cold = "
+	      << (float)len / (1024*1024) / (float)(end - start)
+	      << " MB/sec" << std::endl;
+  }
+  {
+    // each segment is cached with seed 0, so every seed != 0 after the
+    // first segment takes the adjust path
+    uint32_t seeded = ceph_crc32c(1234, flat, len);
+    utime_t start = ceph_clock_now(NULL);
+    for (int r = 0; r < rounds; r++)
+      ASSERT_EQ(seeded, segs.crc32c(1234));
+    utime_t end = ceph_clock_now(NULL);
+    std::cout << "bufferlist " << nseg << " segments, cached+adjusted = "
+	      << (float)len * rounds / (1024*1024) / (float)(end - start)
+	      << " MB/sec" << std::endl;
+  }
+  {
+    // a single ptr spanning a buffer whose halves are already cached
+    bufferptr whole(len);
+    whole.copy_in(0, len, (const char *)flat);
+    bufferlist halves;
+    halves.append(bufferptr(whole, 0, len / 2));
+    halves.append(bufferptr(whole, len / 2, len - len / 2));
+    ASSERT_EQ(expected, halves.crc32c(0));
+    bufferlist all;
+    all.append(whole);
+    utime_t start = ceph_clock_now(NULL);
+    ASSERT_EQ(expected, all.crc32c(0));
+    utime_t end = ceph_clock_now(NULL);
+    std::cout << "bufferlist 1 segment from cached halves = "
+	      << (float)len / (1024*1024) / (float)(end - start)
+	      << " MB/sec" << std::endl;
+  }
+}
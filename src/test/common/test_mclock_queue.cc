@@ -0,0 +1,242 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/mClockQueue.h"
+
+#include <map>
+
+typedef int Klass;
+typedef unsigned Item;
+typedef mClockQueue<Item, Klass> Queue;
+
+static std::map<Klass, mClockClientInfo> infos;
+
+static mClockClientInfo info_for(const Klass &k)
+{
+  std::map<Klass, mClockClientInfo>::iterator p = infos.find(k);
+  if (p == infos.end())
+    return mClockClientInfo();
+  return p->second;
+}
+
+/// an mClockQueue with a clock we control
+class TestQueue : public Queue {
+public:
+  double t;
+  TestQueue() : Queue(info_for), t(1000.0) {}
+  double now() const {
+    return t;
+  }
+};
+
+class mClockQueueTest : public testing::Test
+{
+protected:
+  TestQueue q;
+  virtual void SetUp() {
+    infos.clear();
+  }
+
+  /// run the queue as a server doing ops_per_sec for secs, keeping
+  /// every class backlogged; returns ops served per class
+  std::map<Klass, unsigned> serve(const std::vector<Klass> &classes,
+				  double ops_per_sec, double secs) {
+    std::map<Klass, unsigned> served;
+    for (std::vector<Klass>::const_iterator i = classes.begin();
+	 i != classes.end(); ++i)
+      for (int j = 0; j < 10; ++j)
+	q.enqueue(*i, 0, 1, *i);
+    unsigned n = ops_per_sec * secs;
+    for (unsigned i = 0; i < n; ++i) {
+      Item item = q.dequeue();
+      served[item]++;
+      q.enqueue(item, 0, 1, item);  // stay backlogged
+      q.t += 1.0 / ops_per_sec;
+    }
+    return served;
+  }
+};
+
+TEST_F(mClockQueueTest, capacity) {
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(0u, q.length());
+  q.enqueue_strict(1, 0, 0);
+  q.enqueue(1, 0, 1, 1);
+  q.enqueue(2, 0, 1, 2);
+  EXPECT_FALSE(q.empty());
+  EXPECT_EQ(3u, q.length());
+  q.dequeue();
+  q.dequeue();
+  q.dequeue();
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(0u, q.length());
+}
+
+TEST_F(mClockQueueTest, strict_first) {
+  q.enqueue(1, 0, 1, 100);
+  q.enqueue_strict(1, 10, 1);
+  q.enqueue_strict(1, 20, 2);
+  q.enqueue_strict_front(1, 20, 3);
+  Queue::phase_t phase;
+  EXPECT_EQ(3u, q.dequeue(&phase));
+  EXPECT_EQ(Queue::PHASE_STRICT, phase);
+  EXPECT_EQ(2u, q.dequeue());
+  EXPECT_EQ(1u, q.dequeue());
+  EXPECT_EQ(100u, q.dequeue(&phase));
+  EXPECT_NE(Queue::PHASE_STRICT, phase);
+}
+
+TEST_F(mClockQueueTest, fifo_within_class) {
+  for (unsigned i = 0; i < 50; ++i) {
+    q.enqueue(1, 0, 1, i);
+    q.enqueue(2, 0, 1, 1000 + i);
+  }
+  unsigned next[2] = { 0, 1000 };
+  while (!q.empty()) {
+    Item i = q.dequeue();
+    unsigned &n = next[i >= 1000];
+    EXPECT_EQ(n, i);
+    ++n;
+    q.t += 0.001;
+  }
+}
+
+TEST_F(mClockQueueTest, enqueue_front) {
+  q.enqueue(1, 0, 1, 1);
+  q.enqueue(1, 0, 1, 2);
+  q.enqueue_front(1, 0, 1, 0);
+  EXPECT_EQ(0u, q.dequeue());
+  EXPECT_EQ(1u, q.dequeue());
+  EXPECT_EQ(2u, q.dequeue());
+}
+
+TEST_F(mClockQueueTest, weight) {
+  infos[1] = mClockClientInfo(0, 1, 0);
+  infos[2] = mClockClientInfo(0, 3, 0);
+  std::vector<Klass> classes;
+  classes.push_back(1);
+  classes.push_back(2);
+  std::map<Klass, unsigned> served = serve(classes, 1000, 1);
+  EXPECT_NEAR(250, served[1], 10);
+  EXPECT_NEAR(750, served[2], 10);
+}
+
+TEST_F(mClockQueueTest, reservation) {
+  // class 1 is guaranteed half the server despite its small weight
+  infos[1] = mClockClientInfo(500, 1, 0);
+  infos[2] = mClockClientInfo(0, 99, 0);
+  std::vector<Klass> classes;
+  classes.push_back(1);
+  classes.push_back(2);
+  std::map<Klass, unsigned> served = serve(classes, 1000, 1);
+  EXPECT_GE(served[1], 490u);
+  EXPECT_LE(served[1], 520u);
+}
+
+TEST_F(mClockQueueTest, limit) {
+  infos[1] = mClockClientInfo(0, 100, 100);
+  infos[2] = mClockClientInfo(0, 1, 0);
+  std::vector<Klass> classes;
+  classes.push_back(1);
+  classes.push_back(2);
+  std::map<Klass, unsigned> served = serve(classes, 1000, 1);
+  EXPECT_LE(served[1], 111u);
+  EXPECT_GE(served[2], 889u);
+}
+
+TEST_F(mClockQueueTest, limit_break) {
+  // with nothing else queued an over-limit class is still served
+  infos[1] = mClockClientInfo(0, 1, 1);
+  for (unsigned i = 0; i < 10; ++i)
+    q.enqueue(1, 0, 1, i);
+  Queue::phase_t phase;
+  q.dequeue(&phase);
+  for (unsigned i = 1; i < 10; ++i) {
+    EXPECT_EQ(i, q.dequeue(&phase));
+    EXPECT_EQ(Queue::PHASE_LIMIT_BREAK, phase);
+  }
+  EXPECT_TRUE(q.empty());
+}
+
+static bool is_odd(Item i)
+{
+  return i & 1;
+}
+
+TEST_F(mClockQueueTest, remove_by_filter) {
+  for (unsigned i = 0; i < 20; ++i)
+    q.enqueue(i % 3, 0, 1, i);
+  q.enqueue_strict(0, 10, 21);
+  q.enqueue_strict(0, 10, 22);
+  std::list<Item> removed;
+  q.remove_by_filter(is_odd, &removed);
+  EXPECT_EQ(11u, removed.size());
+  for (std::list<Item>::iterator i = removed.begin(); i != removed.end(); ++i)
+    EXPECT_TRUE(is_odd(*i));
+  EXPECT_EQ(11u, q.length());
+  while (!q.empty())
+    EXPECT_FALSE(is_odd(q.dequeue()));
+}
+
+TEST_F(mClockQueueTest, remove_by_class) {
+  for (unsigned i = 0; i < 20; ++i)
+    q.enqueue(i % 2, 0, 1, i);
+  q.enqueue_strict(1, 10, 101);
+  q.enqueue_strict(0, 10, 100);
+  std::list<Item> removed;
+  q.remove_by_class(1, &removed);
+  EXPECT_EQ(11u, removed.size());
+  EXPECT_EQ(11u, q.length());
+  while (!q.empty())
+    EXPECT_EQ(0u, q.dequeue() % 2);
+}
+
+static bool is_1_or_100(Item i)
+{
+  return i == 1 || i == 100;
+}
+
+static bool any_item(Item i)
+{
+  return true;
+}
+
+TEST_F(mClockQueueTest, dequeue_head_if) {
+  infos[1] = mClockClientInfo(10, 1, 0);
+  infos[2] = mClockClientInfo(0, 2, 0);
+  TestQueue ref;
+  for (unsigned i = 0; i < 20; ++i) {
+    q.enqueue(i % 3, 0, 1, i);
+    ref.enqueue(i % 3, 0, 1, i);
+  }
+  q.enqueue_strict(0, 10, 100);
+  ref.enqueue_strict(0, 10, 100);
+  q.enqueue_strict(0, 10, 101);
+  ref.enqueue_strict(0, 10, 101);
+
+  std::list<Item> taken;
+  // the heads are 100 (strict), 0, 1 and 2
+  EXPECT_TRUE(q.dequeue_head_if(is_odd, 100, &taken));
+  ASSERT_EQ(1u, taken.size());
+  EXPECT_EQ(1u, taken.front());
+  // now 100, 0, 4 and 2; 101 and the rest are not heads
+  EXPECT_FALSE(q.dequeue_head_if(is_odd, 100, &taken));
+  EXPECT_EQ(1u, taken.size());
+  // strict first, and max_scan is honoured
+  EXPECT_TRUE(q.dequeue_head_if(any_item, 1, &taken));
+  EXPECT_EQ(100u, taken.back());
+  EXPECT_FALSE(q.dequeue_head_if(is_odd, 0, &taken));
+  EXPECT_EQ(20u, q.length());
+
+  // the rest comes out as if the taken items had been removed
+  ref.remove_by_filter(is_1_or_100);
+  EXPECT_EQ(ref.length(), q.length());
+  while (!ref.empty()) {
+    ASSERT_FALSE(q.empty());
+    EXPECT_EQ(ref.dequeue(), q.dequeue());
+    q.t += 0.01;
+    ref.t += 0.01;
+  }
+  EXPECT_TRUE(q.empty());
+}
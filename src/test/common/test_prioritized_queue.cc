@@ -246,3 +246,65 @@ TEST_F(PrioritizedQueueTest, remove_by_class) {
   }
   EXPECT_TRUE(items.empty());
 }
+
+template <typename T>
+struct Equal {
+  const T rhs;
+  Equal(const T& v) : rhs(v)
+  {}
+  bool operator()(const T& lhs) const {
+    return lhs == rhs;
+  }
+};
+
+TEST_F(PrioritizedQueueTest, dequeue_head_if) {
+  const unsigned min_cost = 1;
+  const unsigned max_tokens_per_subqueue = 50;
+  // two identical queues; we take an item out of turn from one and
+  // filter the same item out of the other, after which the two must
+  // dequeue identically
+  PQ pq(max_tokens_per_subqueue, min_cost);
+  PQ ref(max_tokens_per_subqueue, min_cost);
+  for (int i = 0; i < item_size; i++) {
+    const Item& item = items[i];
+    Klass k = ITEM_TO_CLASS(item);
+    unsigned priority = item % 3;
+    pq.enqueue(k, priority, item % 7 + 1, item);
+    ref.enqueue(k, priority, item % 7 + 1, item);
+  }
+  // advance the schedulers (tokens, round robin) a bit
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ(ref.dequeue(), pq.dequeue());
+  pq.enqueue_strict(Klass(0), 10, Item(1000));
+  ref.enqueue_strict(Klass(0), 10, Item(1000));
+
+  std::list<Item> taken;
+  // only the heads of classes are candidates: the last item queued is
+  // behind others of its class
+  const Item last = items[item_size - 1];
+  EXPECT_FALSE(pq.dequeue_head_if(Equal<Item>(last), 100, &taken));
+  EXPECT_TRUE(taken.empty());
+  EXPECT_EQ(ref.length(), pq.length());
+
+  // and no more than max_scan heads are looked at
+  EXPECT_FALSE(pq.dequeue_head_if(Greater<Item>(2000), 100, &taken));
+  EXPECT_TRUE(pq.dequeue_head_if(Greater<Item>(0), 1, &taken));
+  ASSERT_EQ(1u, taken.size());
+  EXPECT_EQ(Item(1000), taken.front());  // the strict one comes first
+  ref.remove_by_filter(Equal<Item>(taken.front()));
+  taken.clear();
+
+  // take some normal item and check nothing else moved
+  EXPECT_TRUE(pq.dequeue_head_if(Greater<Item>(item_size / 2), 100, &taken));
+  ASSERT_EQ(1u, taken.size());
+  EXPECT_LT(Item(item_size / 2), taken.front());
+  ref.remove_by_filter(Equal<Item>(taken.front()));
+  EXPECT_EQ(ref.length(), pq.length());
+  while (!ref.empty()) {
+    ASSERT_FALSE(pq.empty());
+    EXPECT_EQ(ref.dequeue(), pq.dequeue());
+  }
+  EXPECT_TRUE(pq.empty());
+  taken.clear();
+  EXPECT_FALSE(pq.dequeue_head_if(Greater<Item>(0), 100, &taken));
+}
@@ -0,0 +1,110 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "include/types.h"
+#include "common/Clock.h"
+#include "common/config.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "messages/MOSDOp.h"
+#include "messages/MOSDOpReply.h"
+#include "messages/MOSDRepOp.h"
+#include "messages/MOSDECSubOpWrite.h"
+#include "msg/MessageFreeList.h"
+
+static double time_decodes(ceph_msg_header &header,
+			   ceph_msg_footer &footer,
+			   const bufferlist &front, const bufferlist &middle,
+			   const bufferlist &data, int num)
+{
+  utime_t start = ceph_clock_now(NULL);
+  for (int i = 0; i < num; ++i) {
+    // decode_message claims these, as it does the messenger's buffers
+    bufferlist f(front), mid(middle), d(data);
+    Message *n = decode_message(g_ceph_context, 0, header, footer, f, mid, d);
+    assert(n);
+    n->put();
+  }
+  utime_t dur = ceph_clock_now(NULL);
+  dur -= start;
+  return (double)dur * 1000000000.0 / num;
+}
+
+/*
+ * Decode the same encoded message over and over the way the messengers
+ * do, and report the time per decode (including the final put()), first
+ * with the global allocator and then with the message free lists.
+ */
+static void run(const char *name, Message *m, int num)
+{
+  m->encode(CEPH_FEATURES_SUPPORTED_DEFAULT, MSG_CRC_ALL);
+  ceph_msg_header header = m->get_header();
+  ceph_msg_footer footer = m->get_footer();
+  bufferlist front = m->get_payload();
+  bufferlist middle = m->get_middle();
+  bufferlist data = m->get_data();
+  m->put();
+
+  message_freelist_enabled = false;
+  double plain = time_decodes(header, footer, front, middle, data, num);
+  message_freelist_enabled = true;
+  double freelist = time_decodes(header, footer, front, middle, data, num);
+  message_freelist_enabled = false;
+  cout << name << "\t" << plain << "\t" << freelist << std::endl;
+}
+
+static MOSDOp *make_osd_op(int len)
+{
+  object_t oid("rbd_data.1014c2ae8944a.0000000000000001");
+  object_locator_t oloc(1);
+  pg_t pgid(7, 1);
+  MOSDOp *m = new MOSDOp(4, 1234, oid, oloc, pgid, 42, CEPH_OSD_FLAG_WRITE, 0);
+  bufferlist bl;
+  bl.append_zero(len);
+  m->write(0, len, bl);
+  return m;
+}
+
+void usage(const char *name)
+{
+  cout << "usage: " << name << " <decodes per type> [data bytes]" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  int num = atoi(argv[1]);
+  int len = argc > 2 ? atoi(argv[2]) : 4096;
+
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_OSD, CODE_ENVIRONMENT_UTILITY, 0);
+
+  cout << num << " decodes per type, " << len << " data bytes" << std::endl;
+  cout << "ns/decode\tmalloc\tfreelist" << std::endl;
+
+  run("osd_op", make_osd_op(len), num);
+
+  MOSDOp *req = make_osd_op(len);
+  MOSDOpReply *reply = new MOSDOpReply(req, 0, 42, CEPH_OSD_FLAG_ACK, true);
+  req->put();
+  run("osd_op_reply", reply, num);
+
+  MOSDRepOp *rep = new MOSDRepOp(osd_reqid_t(), pg_shard_t(1, shard_id_t::NO_SHARD),
+				 spg_t(pg_t(7, 1), shard_id_t::NO_SHARD),
+				 hobject_t(), CEPH_OSD_FLAG_ACK, 42, 1234,
+				 eversion_t(42, 7));
+  rep->get_data().append_zero(len);
+  run("osd_repop", rep, num);
+
+  MOSDECSubOpWrite *ec = new MOSDECSubOpWrite;
+  ec->pgid = spg_t(pg_t(7, 1), shard_id_t(0));
+  ec->map_epoch = 42;
+  run("osd_ec_write", ec, num);
+  return 0;
+}
@@ -19,6 +19,7 @@
 #include <string>
 #include <unistd.h>
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 
@@ -73,16 +74,20 @@ class MessengerClient {
     int msg_len;
     bufferlist data;
     int ops;
+    bool small;
     ClientDispatcher dispatcher;
 
    public:
     Mutex lock;
     Cond cond;
     uint64_t inflight;
+    vector<uint64_t> sent;       // send time of each op, indexed by tid
+    vector<uint64_t> latencies;  // round-trip cycles of each reply
 
-    ClientThread(Messenger *m, int c, ConnectionRef con, int len, int ops, int think_time_us):
+    ClientThread(Messenger *m, int c, ConnectionRef con, int len, int ops, bool small, int think_time_us):
         msgr(m), concurrent(c), conn(con), client_inc(0), oid("object-name"), oloc(1, 1), msg_len(len), ops(ops),
-        dispatcher(think_time_us, this), lock("MessengerBenchmark::ClientThread::lock") {
+        small(small), dispatcher(think_time_us, this), lock("MessengerBenchmark::ClientThread::lock"),
+        inflight(0), sent(ops) {
       m->add_dispatcher_head(&dispatcher);
       bufferptr ptr(msg_len);
       memset(ptr.c_str(), 0, msg_len);
@@ -94,12 +99,18 @@ class MessengerClient {
         if (inflight > uint64_t(concurrent)) {
           cond.Wait(lock);
         }
-        MOSDOp *m = new MOSDOp(client_inc.read(), 0, oid, oloc, pgid, 0, 0, 0);
-        m->write(0, msg_len, data);
+        MOSDOp *m = new MOSDOp(client_inc.read(), i, oid, oloc, pgid, 0, 0, 0);
+        if (small)
+          m->stat();
+        else
+          m->write(0, msg_len, data);
         inflight++;
+        sent[i] = Cycles::rdtsc();
         conn->send_message(m);
         //cerr << __func__ << " send m=" << m << std::endl;
       }
+      while (inflight)
+        cond.Wait(lock);
       lock.Unlock();
       msgr->shutdown();
       return 0;
@@ -124,7 +135,7 @@ class MessengerClient {
       msgrs[i]->wait();
     }
   }
-  void ready(int c, int jobs, int ops, int msg_len) {
+  void ready(int c, int jobs, int ops, int msg_len, bool small) {
     entity_addr_t addr;
     addr.parse(serveraddr.c_str());
     addr.set_nonce(0);
@@ -133,7 +144,7 @@ class MessengerClient {
       msgr->set_default_policy(Messenger::Policy::lossless_client(0, 0));
       entity_inst_t inst(entity_name_t::OSD(0), addr);
       ConnectionRef conn = msgr->get_connection(inst);
-      ClientThread *t = new ClientThread(msgr, c, conn, msg_len, ops, think_time_us);
+      ClientThread *t = new ClientThread(msgr, c, conn, msg_len, ops, small, think_time_us);
       msgrs.push_back(msgr);
       clients.push_back(t);
       msgr->start();
@@ -146,25 +157,42 @@ class MessengerClient {
     for (uint64_t i = 0; i < msgrs.size(); ++i)
       msgrs[i]->wait();
   }
+  void print_latency() {
+    vector<uint64_t> all;
+    for (uint64_t i = 0; i < clients.size(); ++i)
+      all.insert(all.end(), clients[i]->latencies.begin(), clients[i]->latencies.end());
+    if (all.empty())
+      return;
+    sort(all.begin(), all.end());
+    cerr << " Round trip latency p50 " << Cycles::to_nanoseconds(all[all.size() / 2]) / 1000.0
+         << "us p99 " << Cycles::to_nanoseconds(all[all.size() * 99 / 100]) / 1000.0
+         << "us" << std::endl;
+  }
 };
 
 void MessengerClient::ClientDispatcher::ms_fast_dispatch(Message *m) {
+  uint64_t now = Cycles::rdtsc();
+  ceph_tid_t tid = m->get_tid();
   usleep(think_time);
   m->put();
   Mutex::Locker l(thread->lock);
+  if (tid < thread->sent.size())
+    thread->latencies.push_back(now - thread->sent[tid]);
   thread->inflight--;
   thread->cond.Signal();
 }
 
 
 void usage(const string &name) {
-  cerr << "Usage: " << name << " [server ip:port] [numjobs] [concurrency] [ios] [thinktime us] [msg length]" << std::endl;
+  cerr << "Usage: " << name << " [server ip:port] [numjobs] [concurrency] [ios] [thinktime us] [msg length] [mode]" << std::endl;
   cerr << "       [server ip:port]: connect to the ip:port pair" << std::endl;
   cerr << "       [numjobs]: how much client threads spawned and do benchmark" << std::endl;
   cerr << "       [concurrency]: the max inflight messages(like iodepth in fio)" << std::endl;
   cerr << "       [ios]: how much messages sent for each client" << std::endl;
   cerr << "       [thinktime]: sleep time when do fast dispatching(match client logic)" << std::endl;
   cerr << "       [msg length]: message data bytes" << std::endl;
+  cerr << "       [mode]: optional, \"small\" sends data-less stat ops to measure" << std::endl;
+  cerr << "               small message rate (msg length is ignored)" << std::endl;
 }
 
 int main(int argc, char **argv)
@@ -186,6 +214,7 @@ int main(int argc, char **argv)
   int ios = atoi(args[3]);
   int think_time = atoi(args[4]);
   int len = atoi(args[5]);
+  bool small = args.size() > 6 && string(args[6]) == "small";
 
   cerr << " using ms-type " << g_ceph_context->_conf->ms_type << std::endl;
   cerr << "       server ip:port " << args[0] << std::endl;
@@ -193,13 +222,20 @@ int main(int argc, char **argv)
   cerr << "       concurrency " << concurrent << std::endl;
   cerr << "       ios " << ios << std::endl;
   cerr << "       thinktime(us) " << think_time << std::endl;
-  cerr << "       message data bytes " << len << std::endl;
+  if (small)
+    cerr << "       small messages" << std::endl;
+  else
+    cerr << "       message data bytes " << len << std::endl;
   MessengerClient client(g_ceph_context->_conf->ms_type, args[0], think_time);
-  client.ready(concurrent, numjobs, ios, len);
+  client.ready(concurrent, numjobs, ios, len, small);
   uint64_t start = Cycles::rdtsc();
   client.start();
   uint64_t stop = Cycles::rdtsc();
-  cerr << " Total op " << ios << " run time " << Cycles::to_microseconds(stop - start) << "us." << std::endl;
+  uint64_t us = Cycles::to_microseconds(stop - start);
+  cerr << " Total op " << ios << " run time " << us << "us." << std::endl;
+  if (us)
+    cerr << " Rate " << (uint64_t)numjobs * ios * 1000000 / us << " msgs/s" << std::endl;
+  client.print_latency();
 
   return 0;
 }
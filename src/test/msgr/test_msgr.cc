@@ -27,6 +27,7 @@
 #include "msg/Message.h"
 #include "msg/Messenger.h"
 #include "msg/Connection.h"
+#include "msg/async/AsyncMessenger.h"
 #include "messages/MPing.h"
 #include "messages/MCommand.h"
 
@@ -695,6 +696,76 @@ TEST_P(MessengerTest, MessageTest) {
 }
 
 
+class RxBufferDispatcher : public FakeDispatcher {
+ public:
+  bufferptr rx;         ///< last buffer handed out
+  bufferlist received;  ///< data of the last message
+  bool received_in_rx;
+
+  RxBufferDispatcher(): FakeDispatcher(true), received_in_rx(false) {}
+  bool ms_get_rx_buffer(Connection *con, const ceph_msg_header &header,
+                        bufferlist *bl) {
+    Mutex::Locker l(lock);
+    rx = buffer::create_page_aligned(le32_to_cpu(header.data_len));
+    bl->push_back(rx);
+    return true;
+  }
+  void ms_fast_dispatch(Message *m) {
+    {
+      Mutex::Locker l(lock);
+      received = m->get_data();
+      received_in_rx = received.is_contiguous() &&
+        received.buffers().front().c_str() == rx.c_str();
+    }
+    FakeDispatcher::ms_fast_dispatch(m);
+  }
+};
+
+TEST_P(MessengerTest, RxBufferTest) {
+  FakeDispatcher cli_dispatcher(false);
+  RxBufferDispatcher srv_dispatcher;
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  Messenger::Policy p = Messenger::Policy::stateful_server(0, 0);
+  server_msgr->set_policy(entity_name_t::TYPE_CLIENT, p);
+  p = Messenger::Policy::lossless_peer(0, 0);
+  client_msgr->set_policy(entity_name_t::TYPE_OSD, p);
+
+  server_msgr->bind(bind_addr);
+  server_msgr->add_dispatcher_head(&srv_dispatcher);
+  server_msgr->start();
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  // the payload lands in the dispatcher's buffer without being copied
+  ConnectionRef conn = client_msgr->get_connection(server_msgr->get_myinst());
+  bufferlist bl;
+  for (int i = 0; i < 1000; i++)
+    bl.append("abcdefghijklmnopqrstuvwxyz", 1 + i % 26);
+  {
+    MPing *m = new MPing();
+    m->set_data(bl);
+    conn->send_message(m);
+    utime_t t;
+    t += 1000*1000*500;
+    Mutex::Locker l(cli_dispatcher.lock);
+    while (!cli_dispatcher.got_new)
+      cli_dispatcher.cond.WaitInterval(g_ceph_context, cli_dispatcher.lock, t);
+    ASSERT_TRUE(cli_dispatcher.got_new);
+    cli_dispatcher.got_new = false;
+  }
+  {
+    Mutex::Locker l(srv_dispatcher.lock);
+    ASSERT_TRUE(srv_dispatcher.received_in_rx);
+    ASSERT_TRUE(srv_dispatcher.received.contents_equal(bl));
+  }
+  server_msgr->shutdown();
+  client_msgr->shutdown();
+  server_msgr->wait();
+  client_msgr->wait();
+}
+
+
 class SyntheticWorkload;
 
 class SyntheticDispatcher : public Dispatcher {
@@ -1086,6 +1157,144 @@ TEST_P(MessengerTest, SyntheticStressTest1) {
   test_msg.wait_for_done();
 }
 
+static uint64_t async_migrations()
+{
+  WorkerPool *pool;
+  g_ceph_context->lookup_or_create_singleton_object<WorkerPool>(pool, WorkerPool::name);
+  uint64_t migrations = 0;
+  const vector<Worker*> &workers = pool->get_workers();
+  for (vector<Worker*>::const_iterator it = workers.begin(); it != workers.end(); ++it)
+    migrations += (*it)->get_perf_counter()->get(l_msgr_migrations);
+  return migrations;
+}
+
+class C_pin_connection : public EventCallback {
+  AsyncConnectionRef conn;
+  Worker *to;
+  Mutex lock;
+  Cond cond;
+  bool done, moved;
+
+ public:
+  C_pin_connection(AsyncConnectionRef c, Worker *w)
+    : conn(c), to(w), lock("C_pin_connection::lock"), done(false), moved(false) {}
+  void do_request(int id) {
+    bool r = conn->migrate(to);
+    Mutex::Locker l(lock);
+    moved = r;
+    done = true;
+    cond.Signal();
+  }
+  bool wait() {
+    Mutex::Locker l(lock);
+    while (!done)
+      cond.Wait(lock);
+    return moved;
+  }
+};
+
+// migrate only runs on the connection's own worker, and only once it is idle
+static bool pin_connection(AsyncConnectionRef conn, Worker *w)
+{
+  for (int i = 0; i < 1000; ++i) {
+    C_pin_connection *pin = new C_pin_connection(conn, w);
+    EventCallbackRef ref(pin);
+    conn->get_center()->dispatch_event_external(ref);
+    if (pin->wait())
+      return true;
+    usleep(1000);
+  }
+  return false;
+}
+
+TEST_P(MessengerTest, RebalanceTest) {
+  // only async messenger moves connections between workers
+  if (string(GetParam()) != "async")
+    return;
+  WorkerPool *pool;
+  g_ceph_context->lookup_or_create_singleton_object<WorkerPool>(pool, WorkerPool::name);
+  const vector<Worker*> &workers = pool->get_workers();
+  if (workers.size() < 2)
+    return;
+
+  FakeDispatcher cli_dispatcher(false), srv_dispatcher(true);
+  entity_addr_t bind_addr;
+  bind_addr.parse("127.0.0.1");
+  vector<Messenger*> servers;
+  servers.push_back(server_msgr);
+  for (int i = 1; i < 3; ++i) {
+    Messenger *m = Messenger::create(g_ceph_context, string(GetParam()),
+                                     entity_name_t::OSD(i), "server", getpid());
+    m->set_default_policy(Messenger::Policy::stateless_server(0, 0));
+    servers.push_back(m);
+  }
+  for (unsigned i = 0; i < servers.size(); ++i) {
+    servers[i]->bind(bind_addr);
+    servers[i]->add_dispatcher_head(&srv_dispatcher);
+    servers[i]->start();
+  }
+  client_msgr->add_dispatcher_head(&cli_dispatcher);
+  client_msgr->start();
+
+  // all three connections share the first worker
+  vector<AsyncConnectionRef> conns;
+  for (unsigned i = 0; i < servers.size(); ++i) {
+    ConnectionRef conn = client_msgr->get_connection(servers[i]->get_myinst());
+    ASSERT_EQ(conn->send_message(new MPing()), 0);
+    {
+      Mutex::Locker l(cli_dispatcher.lock);
+      while (!cli_dispatcher.got_new)
+        cli_dispatcher.cond.Wait(cli_dispatcher.lock);
+      cli_dispatcher.got_new = false;
+    }
+    conns.push_back(static_cast<AsyncConnection*>(conn.get()));
+    ASSERT_TRUE(pin_connection(conns.back(), workers[0]));
+  }
+
+  // only the first two carry traffic, so one of them has to move
+  AsyncMessenger *msgr = static_cast<AsyncMessenger*>(client_msgr);
+  uint64_t migrations = async_migrations();
+  uint64_t expected = 1;
+  for (int round = 0; round < 100 && async_migrations() == migrations; ++round) {
+    for (unsigned i = 0; i < conns.size(); ++i)
+      conns[i]->take_recent_bytes();
+    expected += 10;
+    for (unsigned i = 0; i < 2; ++i) {
+      for (int j = 0; j < 10; ++j)
+        ASSERT_EQ(conns[i]->send_message(new MPing()), 0);
+      Session *s = static_cast<Session*>(conns[i]->get_priv());
+      CHECK_AND_WAIT_TRUE(s->get_count() >= expected);
+      ASSERT_EQ(expected, s->get_count());
+      s->put();
+    }
+    ASSERT_TRUE(msgr->rebalance_once());
+    // the move is refused while the connection still has acks in flight
+    CHECK_AND_WAIT_TRUE(async_migrations() > migrations);
+  }
+  ASSERT_EQ(migrations + 1, async_migrations());
+  ASSERT_TRUE(conns[0]->get_center() != &workers[0]->center ||
+              conns[1]->get_center() != &workers[0]->center);
+  ASSERT_EQ(&workers[0]->center, conns[2]->get_center());
+
+  // the moved connection still works from its new worker
+  for (unsigned i = 0; i < 2; ++i) {
+    ASSERT_EQ(conns[i]->send_message(new MPing()), 0);
+    Session *s = static_cast<Session*>(conns[i]->get_priv());
+    CHECK_AND_WAIT_TRUE(s->get_count() == expected + 1);
+    ASSERT_EQ(expected + 1, s->get_count());
+    s->put();
+  }
+
+  conns.clear();
+  client_msgr->shutdown();
+  client_msgr->wait();
+  for (unsigned i = 0; i < servers.size(); ++i) {
+    servers[i]->shutdown();
+    servers[i]->wait();
+    if (servers[i] != server_msgr)
+      delete servers[i];
+  }
+}
 
 TEST_P(MessengerTest, SyntheticInjectTest) {
   g_ceph_context->_conf->set_val("ms_inject_socket_failures", "30");
@@ -0,0 +1,176 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Many threads looking up and adding fds in an FDCache, once with the
+ * SharedLRU shards and once with the SharedClock shards.  Size the cache
+ * and the shard count with --filestore_fd_cache_size and
+ * --filestore_fd_cache_shards as usual.
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/Thread.h"
+#include "common/Clock.h"
+#include "global/global_init.h"
+#include "os/FDCache.h"
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name << " [options]\n"
+       << "  --threads <n>         client threads (default 16)\n"
+       << "  --ops <n>             lookups per thread (default 1000000)\n"
+       << "  --objects <n>         objects, shared by all threads (default 1024)\n"
+       << "  --hot-pct <n>         percent of lookups that go to the hottest\n"
+       << "                        tenth of the objects (default 90)\n"
+       << std::endl;
+  generic_client_usage();
+}
+
+class Worker : public Thread {
+  FDCache *cache;
+  const vector<ghobject_t> &objects;
+  int ops, hot_pct, devnull;
+public:
+  unsigned seed;
+  int hits, misses;
+
+  Worker(FDCache *cache, const vector<ghobject_t> &objects,
+	 int ops, int hot_pct, int devnull, unsigned seed)
+    : cache(cache), objects(objects), ops(ops), hot_pct(hot_pct),
+      devnull(devnull), seed(seed), hits(0), misses(0) {}
+
+  void *entry() {
+    size_t hot = MAX(objects.size() / 10, 1);
+    for (int i = 0; i < ops; ++i) {
+      size_t o;
+      if ((int)(rand_r(&seed) % 100) < hot_pct)
+	o = rand_r(&seed) % hot;
+      else
+	o = rand_r(&seed) % objects.size();
+      FDRef fd = cache->lookup(objects[o]);
+      if (fd) {
+	++hits;
+	continue;
+      }
+      ++misses;
+      // what lfn_open does on a miss
+      int newfd = ::dup(devnull);
+      assert(newfd >= 0);
+      bool existed;
+      fd = cache->add(objects[o], newfd, &existed);
+      if (existed)
+	::close(newfd);
+    }
+    return 0;
+  }
+};
+
+static double run(const vector<ghobject_t> &objects, int threads, int ops,
+		  int hot_pct, int devnull, int *hits, int *misses)
+{
+  FDCache cache(g_ceph_context);
+  vector<Worker*> workers;
+  for (int i = 0; i < threads; ++i)
+    workers.push_back(new Worker(&cache, objects, ops, hot_pct, devnull, i + 1));
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < threads; ++i)
+    workers[i]->create();
+  *hits = *misses = 0;
+  for (int i = 0; i < threads; ++i) {
+    workers[i]->join();
+    *hits += workers[i]->hits;
+    *misses += workers[i]->misses;
+    delete workers[i];
+  }
+  return ceph_clock_now(g_ceph_context) - start;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  int threads = 16;
+  int ops = 1000000;
+  int num_objects = 1024;
+  int hot_pct = 90;
+  string val;
+  for (vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &val, "--threads", (char*)NULL)) {
+      threads = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      ops = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)NULL)) {
+      num_objects = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--hot-pct", (char*)NULL)) {
+      hot_pct = atoi(val.c_str());
+    } else {
+      cerr << "unrecognized arg " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (threads < 1 || ops < 1 || num_objects < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int devnull = ::open("/dev/null", O_RDONLY);
+  if (devnull < 0) {
+    cerr << "unable to open /dev/null" << std::endl;
+    return 1;
+  }
+  vector<ghobject_t> objects;
+  for (int i = 0; i < num_objects; ++i) {
+    ostringstream ss;
+    ss << "obj_" << i;
+    objects.push_back(ghobject_t(hobject_t(sobject_t(ss.str(), CEPH_NOSNAP),
+					   "", rand(), 0, "")));
+  }
+
+  cout << "threads " << threads << " ops/thread " << ops
+       << " objects " << num_objects << " hot_pct " << hot_pct
+       << " cache size " << g_conf->filestore_fd_cache_size
+       << " shards " << g_conf->filestore_fd_cache_shards << std::endl;
+
+  const char *types[] = { "false", "true" };
+  for (int t = 0; t < 2; ++t) {
+    g_ceph_context->_conf->set_val("filestore_fd_cache_clock", types[t]);
+    g_ceph_context->_conf->apply_changes(NULL);
+    int hits, misses;
+    double elapsed = run(objects, threads, ops, hot_pct, devnull,
+			 &hits, &misses);
+    cout << (t ? "clock" : "lru  ") << " elapsed " << elapsed << " s, "
+	 << (double)threads * ops / elapsed << " lookups/s, hit rate "
+	 << (double)hits / (hits + misses) << std::endl;
+  }
+  ::close(devnull);
+  return 0;
+}
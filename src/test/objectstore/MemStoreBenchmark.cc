@@ -0,0 +1,179 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Small random writes, zeros and reads into large MemStore objects,
+ * optionally cloning each object now and then so that writes have to
+ * break sharing.  Compare runs with different --memstore_page_size.
+ */
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <string>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/Clock.h"
+#include "global/global_init.h"
+#include "os/ObjectStore.h"
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name << " [options]\n"
+       << "  --path <dir>          store directory (default ./memstore_bench)\n"
+       << "  --objects <n>         objects (default 16)\n"
+       << "  --object-size <n>     bytes per object (default 4M)\n"
+       << "  --io-size <n>         bytes per write/read/zero (default 4096)\n"
+       << "  --ops <n>             ops (default 100000)\n"
+       << "  --read-pct <n>        percent of ops that are reads (default 0)\n"
+       << "  --zero-pct <n>        percent of ops that are zeros (default 0)\n"
+       << "  --clone-every <n>     clone an object every n ops (default 0, never)\n"
+       << std::endl;
+  generic_client_usage();
+}
+
+static ghobject_t make_object(const char *prefix, int i)
+{
+  ostringstream ss;
+  ss << prefix << i;
+  return ghobject_t(hobject_t(sobject_t(ss.str(), CEPH_NOSNAP), "", i, 0, ""));
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  string path = "memstore_bench";
+  int num_objects = 16;
+  uint64_t object_size = 4 << 20;
+  uint64_t io_size = 4096;
+  int ops = 100000;
+  int read_pct = 0;
+  int zero_pct = 0;
+  int clone_every = 0;
+  string val;
+  for (vector<const char*>::iterator i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &val, "--path", (char*)NULL)) {
+      path = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)NULL)) {
+      num_objects = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--object-size", (char*)NULL)) {
+      object_size = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--io-size", (char*)NULL)) {
+      io_size = strtoull(val.c_str(), NULL, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)NULL)) {
+      ops = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--read-pct", (char*)NULL)) {
+      read_pct = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--zero-pct", (char*)NULL)) {
+      zero_pct = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--clone-every", (char*)NULL)) {
+      clone_every = atoi(val.c_str());
+    } else {
+      cerr << "unrecognized arg " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (num_objects < 1 || io_size < 1 || object_size < io_size || ops < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  ::mkdir(path.c_str(), 0755);
+  ObjectStore *store = ObjectStore::create(g_ceph_context, "memstore",
+					   path, "");
+  assert(store);
+  if (store->mkfs() < 0 || store->mount() < 0) {
+    cerr << "unable to create memstore in " << path << std::endl;
+    return 1;
+  }
+
+  coll_t cid;
+  vector<ghobject_t> objects;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    store->apply_transaction(t);
+  }
+  bufferlist fill;
+  fill.append(buffer::create_page_aligned(object_size));
+  fill.zero();
+  fill.c_str()[0] = 1;  // not all zeros
+  for (int i = 0; i < num_objects; ++i) {
+    objects.push_back(make_object("obj_", i));
+    ObjectStore::Transaction t;
+    t.write(cid, objects.back(), 0, object_size, fill);
+    store->apply_transaction(t);
+  }
+
+  bufferlist data;
+  data.append(buffer::create_page_aligned(io_size));
+  memset(data.c_str(), 'x', io_size);
+  unsigned seed = 1;
+  int reads = 0, writes = 0, zeros = 0, clones = 0;
+  utime_t start = ceph_clock_now(g_ceph_context);
+  for (int i = 0; i < ops; ++i) {
+    int o = rand_r(&seed) % num_objects;
+    uint64_t off = (rand_r(&seed) % (object_size / io_size)) * io_size;
+    int what = rand_r(&seed) % 100;
+    if (what < read_pct) {
+      bufferlist bl;
+      store->read(cid, objects[o], off, io_size, bl);
+      ++reads;
+      continue;
+    }
+    ObjectStore::Transaction t;
+    if (what < read_pct + zero_pct) {
+      t.zero(cid, objects[o], off, io_size);
+      ++zeros;
+    } else {
+      t.write(cid, objects[o], off, io_size, data);
+      ++writes;
+    }
+    if (clone_every && (i % clone_every) == 0) {
+      // a snapshot; the next writes to objects[o] must unshare pages
+      t.clone(cid, objects[o], make_object("clone_", o));
+      ++clones;
+    }
+    store->apply_transaction(t);
+  }
+  double elapsed = ceph_clock_now(g_ceph_context) - start;
+
+  cout << "objects " << num_objects << " object_size " << object_size
+       << " io_size " << io_size
+       << " page_size " << g_conf->memstore_page_size << std::endl;
+  cout << "elapsed " << elapsed << " s, " << ops / elapsed << " ops/s, "
+       << (double)(reads + writes + zeros) * io_size / elapsed / (1 << 20)
+       << " MB/s" << std::endl;
+  cout << "reads " << reads << " writes " << writes << " zeros " << zeros
+       << " clones " << clones << std::endl;
+
+  store->umount();
+  delete store;
+  return 0;
+}
@@ -74,6 +74,104 @@ TEST(RocksDBOption, interpret) {
   ASSERT_EQ(5, num_high_pri_threads);
 }
 
+TEST(RocksDBOption, column_families) {
+  const string cf_dir("store_test_temp_cf_dir");
+  ASSERT_EQ(0, ::system(("rm -rf " + cf_dir).c_str()));
+
+  const char *prefixes[] = { "_ATTR_", "_HOBJ_", "_SYS_", "_USER_0001",
+			     "_USER_" };
+  const unsigned num_prefixes = sizeof(prefixes) / sizeof(prefixes[0]);
+  {
+    RocksDBStore db(g_ceph_context, cf_dir);
+    ASSERT_EQ(-EINVAL, db.set_column_families("nofamily"));
+    ASSERT_EQ(-EINVAL, db.set_column_families("default:_USER_"));
+    ASSERT_EQ(-EINVAL, db.set_column_families("omap:_USER_:bloom_bits=x"));
+    ASSERT_EQ(0, db.set_column_families(
+		"omap:_USER_|_ATTR_:bloom_bits=10,block_cache_size=1048576 "
+		"meta:_HOBJ_:compaction_style=kCompactionStyleUniversal"));
+    ASSERT_EQ(0, db.init(""));
+    ASSERT_EQ(0, db.create_and_open(cerr));
+
+    set<string> expected;
+    KeyValueDB::Transaction t = db.get_transaction();
+    for (unsigned i = 0; i < num_prefixes; ++i) {
+      for (const char *k = "abc"; *k; ++k) {
+	bufferlist bl;
+	bl.append(string(prefixes[i]) + *k);
+	t->set(prefixes[i], string(1, *k), bl);
+	expected.insert(RocksDBStore::combine_strings(prefixes[i],
+						      string(1, *k)));
+      }
+    }
+    ASSERT_EQ(0, db.submit_transaction_sync(t));
+
+    // the families are merged back into one key order, both ways
+    KeyValueDB::WholeSpaceIterator it = db.get_iterator();
+    set<string>::iterator e = expected.begin();
+    for (it->seek_to_first(); it->valid(); it->next(), ++e) {
+      ASSERT_TRUE(e != expected.end());
+      pair<string, string> k = it->raw_key();
+      ASSERT_EQ(*e, RocksDBStore::combine_strings(k.first, k.second));
+      bufferlist v = it->value();
+      ASSERT_EQ(k.first + k.second, string(v.c_str(), v.length()));
+    }
+    ASSERT_TRUE(e == expected.end());
+    set<string>::reverse_iterator re = expected.rbegin();
+    for (it->seek_to_last(); it->valid(); it->prev(), ++re) {
+      ASSERT_TRUE(re != expected.rend());
+      pair<string, string> k = it->raw_key();
+      ASSERT_EQ(*re, RocksDBStore::combine_strings(k.first, k.second));
+    }
+    ASSERT_TRUE(re == expected.rend());
+    it->lower_bound("_SYS_", "b");
+    ASSERT_TRUE(it->valid());
+    it->prev();
+    ASSERT_EQ(make_pair(string("_SYS_"), string("a")), it->raw_key());
+    it->next();
+    it->next();
+    ASSERT_EQ(make_pair(string("_SYS_"), string("c")), it->raw_key());
+
+    // removal spans families too
+    t = db.get_transaction();
+    t->rmkeys_by_prefix("_USER_");
+    t->rmkey("_HOBJ_", "b");
+    ASSERT_EQ(0, db.submit_transaction_sync(t));
+    unsigned n = 0;
+    it = db.get_iterator();
+    for (it->seek_to_first(); it->valid(); it->next()) {
+      pair<string, string> k = it->raw_key();
+      ASSERT_TRUE(k.first == "_ATTR_" || k.first == "_HOBJ_" ||
+		  k.first == "_SYS_");
+      ASSERT_FALSE(k.first == "_HOBJ_" && k.second == "b");
+      ++n;
+    }
+    ASSERT_EQ(8u, n);
+  }
+  {
+    // meta is not configured any more
+    RocksDBStore db(g_ceph_context, cf_dir);
+    ASSERT_EQ(0, db.set_column_families("omap:_USER_|_ATTR_"));
+    ASSERT_EQ(0, db.init(""));
+    ASSERT_NE(0, db.open(cerr));
+  }
+  {
+    // _SYS_ keys already live in the default family
+    RocksDBStore db(g_ceph_context, cf_dir);
+    ASSERT_EQ(0, db.set_column_families("omap:_USER_|_ATTR_ meta:_HOBJ_|_SYS_"));
+    ASSERT_EQ(0, db.init(""));
+    ASSERT_NE(0, db.open(cerr));
+  }
+  {
+    // adding a family for keys nobody wrote yet is fine
+    RocksDBStore db(g_ceph_context, cf_dir);
+    ASSERT_EQ(0, db.set_column_families(
+		"omap:_USER_|_ATTR_ meta:_HOBJ_ pglog:_PGLOG_"));
+    ASSERT_EQ(0, db.init(""));
+    ASSERT_EQ(0, db.open(cerr));
+  }
+  ASSERT_EQ(0, ::system(("rm -rf " + cf_dir).c_str()));
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -17,6 +17,7 @@
 #include <iostream>
 #include <time.h>
 #include <sys/mount.h>
+#include <dirent.h>
 #include "os/ObjectStore.h"
 #include "os/FileStore.h"
 #include "os/KeyValueStore.h"
@@ -292,6 +293,191 @@ TEST_P(StoreTest, SimpleColPreHashTest) {
   }
 }
 
+/// how deep the HashIndex DIR_* subdirectories under path go
+static int index_depth(const string &path)
+{
+  DIR *dir = ::opendir(path.c_str());
+  if (!dir)
+    return 0;
+  int depth = 0;
+  struct dirent *de;
+  while ((de = ::readdir(dir)) != NULL) {
+    if (strncmp(de->d_name, "DIR_", 4) == 0)
+      depth = MAX(depth, 1 + index_depth(path + "/" + de->d_name));
+  }
+  ::closedir(dir);
+  return depth;
+}
+
+TEST_P(StoreTest, PopulatedColPreHashTest) {
+  // split at 16 objects per directory, and never merge
+  int merge_threshold = g_ceph_context->_conf->filestore_merge_threshold;
+  int split_multiple = g_ceph_context->_conf->filestore_split_multiple;
+  g_ceph_context->_conf->set_val("filestore_merge_threshold", "-1");
+  g_ceph_context->_conf->set_val("filestore_split_multiple", "1");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  uint32_t pg_num = 16;
+  coll_t cid(spg_t(pg_t(3, 15), shard_id_t::NO_SHARD));
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 4);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  set<ghobject_t, ghobject_t::BitwiseComparator> created;
+  for (int i = 0; i < 64; ++i) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "obj_%d", i);
+    ghobject_t hoid(hobject_t(sobject_t(buf, CEPH_NOSNAP), "",
+			      ((uint32_t)rand() << 4) | 3, 15, ""));
+    ObjectStore::Transaction t;
+    t.touch(cid, hoid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    created.insert(hoid);
+  }
+  string cdir = string("store_test_temp_dir/current/") + cid.to_str();
+  int depth = index_depth(cdir);
+  {
+    // a hint for a collection that already has objects
+    ObjectStore::Transaction t;
+    bufferlist hint;
+    uint64_t expected_num_objs = 100000;
+    ::encode(pg_num, hint);
+    ::encode(expected_num_objs, hint);
+    t.collection_hint(cid, ObjectStore::Transaction::COLL_HINT_EXPECTED_NUM_OBJECTS, hint);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  if (GetParam() == string("filestore")) {
+    // 64 objects split twice at 16 per directory; 100000 need more
+    ASSERT_LT(depth, index_depth(cdir));
+  }
+  for (set<ghobject_t, ghobject_t::BitwiseComparator>::iterator i = created.begin();
+       i != created.end();
+       ++i) {
+    struct stat st;
+    ASSERT_EQ(0, store->stat(cid, *i, &st));
+  }
+  vector<ghobject_t> objects;
+  r = store->collection_list(cid, ghobject_t(), ghobject_t::get_max(), true,
+			     INT_MAX, &objects, 0);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(created.size(), objects.size());
+  {
+    ObjectStore::Transaction t;
+    for (set<ghobject_t, ghobject_t::BitwiseComparator>::iterator i = created.begin();
+	 i != created.end();
+	 ++i)
+      t.remove(cid, *i);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+
+  std::ostringstream oss;
+  oss << merge_threshold;
+  g_ceph_context->_conf->set_val("filestore_merge_threshold", oss.str().c_str());
+  oss.str("");
+  oss << split_multiple;
+  g_ceph_context->_conf->set_val("filestore_split_multiple", oss.str().c_str());
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTest, OverwriteReadBackTest) {
+  // small overwrites, zeros and truncates of data that was just read or
+  // written, which stores may serve from a cache
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  string expected(16384, 'a');
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(expected);
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned i = 0; i < 16; ++i) {
+    uint64_t off = (i * 1031) % (expected.size() - 100);
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    if (i % 3 == 0) {
+      t.zero(cid, hoid, off, 100);
+      expected.replace(off, 100, string(100, '\0'));
+    } else {
+      bl.append(string(100, 'b' + i));
+      t.write(cid, hoid, off, bl.length(), bl);
+      expected.replace(off, 100, string(100, 'b' + i));
+    }
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+
+    bufferlist in;
+    r = store->read(cid, hoid, 0, expected.size(), in);
+    ASSERT_EQ((int)expected.size(), r);
+    ASSERT_EQ(expected, string(in.c_str(), in.length()));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.truncate(cid, hoid, 5000);
+    t.truncate(cid, hoid, 9000);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+    expected.resize(5000);
+    expected.resize(9000, '\0');
+
+    bufferlist in;
+    r = store->read(cid, hoid, 0, expected.size(), in);
+    ASSERT_EQ((int)expected.size(), r);
+    ASSERT_EQ(expected, string(in.c_str(), in.length()));
+  }
+  {
+    // the renamed object keeps its data
+    ObjectStore::Transaction t;
+    t.collection_move_rename(cid, hoid, cid, hoid2);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+
+    bufferlist in;
+    r = store->read(cid, hoid2, 0, expected.size(), in);
+    ASSERT_EQ((int)expected.size(), r);
+    ASSERT_EQ(expected, string(in.c_str(), in.length()));
+  }
+  {
+    // and a new object by the old name does not
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append("z");
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+
+    bufferlist in;
+    r = store->read(cid, hoid, 0, 4096, in);
+    ASSERT_EQ(1, r);
+    ASSERT_EQ('z', in[0]);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SimpleObjectTest) {
   int r;
   coll_t cid;
@@ -441,6 +627,120 @@ TEST_P(StoreTest, ManySmallWrite) {
   }
 }
 
+TEST_P(StoreTest, BatchedSmallWrite) {
+  // FileStore op threads apply whatever is queued on the sequencer in one
+  // pass; they are held back while each group is queued, so every group
+  // is applied as a single batch
+  struct RestoreBatchOps {
+    int orig;
+    RestoreBatchOps() : orig(g_ceph_context->_conf->filestore_op_batch_max_ops) {}
+    ~RestoreBatchOps() {
+      g_ceph_context->_conf->set_val("filestore_op_batch_max_ops", stringify(orig));
+      g_ceph_context->_conf->apply_changes(NULL);
+    }
+  } restore;
+  g_ceph_context->_conf->set_val("filestore_op_batch_max_ops", "32");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t a(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  ghobject_t b(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.touch(cid, b);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  FileStore *fs = NULL;
+  uint64_t merged_writes = 0, merged_omap = 0;
+  if (GetParam() == string("filestore")) {
+    fs = static_cast<FileStore*>(store.get());
+    merged_writes = fs->get_perf_counters()->get(l_os_op_batch_merged_writes);
+    merged_omap = fs->get_perf_counters()->get(l_os_op_batch_merged_omap);
+  }
+  bufferlist expected;
+  map<string, bufferlist> expected_omap;
+  for (int group = 0; group < 20; ++group) {
+    // at most 21 transactions, well under filestore_queue_max_ops
+    if (fs)
+      fs->pause_op_threads();
+    for (int i = group * 15; i < (group + 1) * 15; ++i) {
+      ObjectStore::Transaction *t = new ObjectStore::Transaction;
+      bufferlist bl;
+      bufferptr bp(4096);
+      memset(bp.c_str(), 'a' + i % 26, bp.length());
+      bl.append(bp);
+      expected.append(bp);
+      t->write(cid, a, i * 4096, 4096, bl, 0);
+      char key[20];
+      snprintf(key, sizeof(key), "key-%d", i);
+      map<string, bufferlist> to_set;
+      to_set[key] = bl;
+      t->omap_setkeys(cid, b, to_set);
+      expected_omap[key] = bl;
+      if (i % 3 == 2) {
+	// keep the omap updates of the next op separate so both setkeys
+	// and rmkeys merging get exercised
+	ObjectStore::Transaction *t2 = new ObjectStore::Transaction;
+	set<string> to_rm;
+	snprintf(key, sizeof(key), "key-%d", i - 1);
+	to_rm.insert(key);
+	t2->omap_rmkeys(cid, b, to_rm);
+	expected_omap.erase(key);
+	store->queue_transaction_and_cleanup(&osr, t);
+	t = t2;
+      }
+      store->queue_transaction_and_cleanup(&osr, t);
+    }
+    // once this one is journaled, the whole group is on the sequencer
+    C_SaferCond queued;
+    ObjectStore::Transaction *t = new ObjectStore::Transaction;
+    t->touch(cid, a);
+    store->queue_transaction(&osr, t, new ObjectStore::C_DeleteTransaction(t),
+			     &queued);
+    queued.wait();
+    if (fs)
+      fs->unpause_op_threads();
+    osr.flush();
+  }
+  if (fs) {
+    // each transaction carries a single write and a single omap update,
+    // so anything merged was merged across ops sharing one pass
+    ASSERT_LT(merged_writes,
+	      fs->get_perf_counters()->get(l_os_op_batch_merged_writes));
+    ASSERT_LT(merged_omap,
+	      fs->get_perf_counters()->get(l_os_op_batch_merged_omap));
+  }
+  {
+    bufferlist bl;
+    r = store->read(cid, a, 0, expected.length(), bl);
+    ASSERT_EQ((int)expected.length(), r);
+    ASSERT_TRUE(bl.contents_equal(expected));
+  }
+  {
+    bufferlist header;
+    map<string, bufferlist> omap;
+    r = store->omap_get(cid, b, &header, &omap);
+    ASSERT_EQ(0, r);
+    ASSERT_EQ(expected_omap.size(), omap.size());
+    for (map<string, bufferlist>::iterator p = expected_omap.begin();
+	 p != expected_omap.end(); ++p) {
+      ASSERT_TRUE(omap.count(p->first));
+      ASSERT_TRUE(omap[p->first].contents_equal(p->second));
+    }
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, a);
+    t.remove(cid, b);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, SimpleAttrTest) {
   int r;
   coll_t cid;
@@ -845,6 +1145,96 @@ TEST_P(StoreTest, SimpleCloneRangeTest) {
 }
 
 
+TEST_P(StoreTest, SparseWriteZeroTruncate) {
+  int r;
+  coll_t cid;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  hoid.hobj.pool = -1;
+  ghobject_t hoid2(hobject_t(sobject_t("Object 2", CEPH_NOSNAP)));
+  hoid2.hobj.pool = -1;
+
+  // model of the expected contents of hoid
+  string expected(300000, 0);
+  expected.replace(100000, 200000, string(200000, 'a'));
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append(string(200000, 'a'));
+    t.write(cid, hoid, 100000, bl.length(), bl);
+    t.clone(cid, hoid, hoid2);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    // unaligned zero and writes across pages, then shrink and grow
+    ObjectStore::Transaction t;
+    t.zero(cid, hoid, 150001, 140000);
+    expected.replace(150001, 140000, string(140000, 0));
+    bufferlist bl;
+    bl.append(string(10, 'b'));
+    t.write(cid, hoid, 500000, bl.length(), bl);
+    expected.resize(500000, 0);
+    expected.append(string(10, 'b'));
+    t.truncate(cid, hoid, 250003);
+    expected.resize(250003);
+    t.truncate(cid, hoid, 600000);
+    expected.resize(600000, 0);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+  {
+    struct stat st;
+    r = store->stat(cid, hoid, &st);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ((off_t)expected.size(), st.st_size);
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, expected.size(), bl);
+    ASSERT_EQ((int)expected.size(), r);
+    bufferlist exp;
+    exp.append(expected);
+    ASSERT_TRUE(bl.contents_equal(exp));
+  }
+  {
+    // the clone is unchanged, and its extents cover what was written
+    bufferlist bl, exp;
+    exp.append_zero(100000);
+    exp.append(string(200000, 'a'));
+    r = store->read(cid, hoid2, 0, 300000, bl);
+    ASSERT_EQ(300000, r);
+    ASSERT_TRUE(bl.contents_equal(exp));
+
+    bufferlist fm;
+    r = store->fiemap(cid, hoid2, 0, 300000, fm);
+    ASSERT_EQ(0, r);
+    map<uint64_t, uint64_t> m;
+    bufferlist::iterator p = fm.begin();
+    ::decode(m, p);
+    uint64_t covered = 0;
+    for (map<uint64_t, uint64_t>::iterator i = m.begin(); i != m.end(); ++i) {
+      uint64_t s = MAX(i->first, 100000);
+      uint64_t e = MIN(i->first + i->second, 300000);
+      if (e > s)
+	covered += e - s;
+    }
+    ASSERT_EQ(200000u, covered);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = store->apply_transaction(t);
+    ASSERT_EQ(r, 0);
+  }
+}
+
+
 TEST_P(StoreTest, SimpleObjectLongnameTest) {
   int r;
   coll_t cid;
@@ -0,0 +1,194 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include "os/WBThrottle.h"
+#include "common/perf_counters.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include <gtest/gtest.h>
+
+class WBThrottleTest : public WBThrottle {
+public:
+  Mutex flush_lock;
+  ceph::unordered_set<ghobject_t> in_flush;
+  unsigned flushes;
+  bool overlap;  ///< an object was flushed by two flushers at once
+
+  WBThrottleTest(CephContext *cct)
+    : WBThrottle(cct), flush_lock("WBThrottleTest::flush_lock"),
+      flushes(0), overlap(false) {}
+
+  void flush_object(const wb_t &wb) {
+    {
+      Mutex::Locker l(flush_lock);
+      if (!in_flush.insert(wb.get<0>()).second)
+	overlap = true;
+      ++flushes;
+    }
+    usleep(1000);
+    Mutex::Locker l(flush_lock);
+    in_flush.erase(wb.get<0>());
+  }
+
+  double pacing_rate() {
+    Mutex::Locker l(lock);
+    return get_pacing_rate();
+  }
+  uint64_t pacing_rate_counter() {
+    return logger->get(l_wbthrottle_pacing_rate);
+  }
+  void set_device_rate(double rate) {
+    Mutex::Locker l(lock);
+    devices[0].rate = rate;
+  }
+  utime_t get_paced_until() {
+    Mutex::Locker l(lock);
+    return paced_until;
+  }
+  bool idle() {
+    Mutex::Locker l(lock);
+    return pending_wbs.empty() && clearing.empty();
+  }
+};
+
+static FDRef open_fd(const string &name)
+{
+  int fd = ::open(name.c_str(), O_CREAT|O_RDWR, 0644);
+  assert(fd >= 0);
+  ::unlink(name.c_str());
+  return FDRef(new FDCache::FD(fd));
+}
+
+static void set_conf(const char *key, const string &val)
+{
+  g_ceph_context->_conf->set_val(key, val);
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
+TEST(WBThrottle, PacingRate) {
+  // bytes drive the load; ios and inodes stay below start_flusher
+  set_conf("filestore_wbthrottle_xfs_bytes_start_flusher",
+	   stringify(1 << 20));
+  set_conf("filestore_wbthrottle_xfs_bytes_hard_limit",
+	   stringify(11 << 20));
+  set_conf("filestore_wbthrottle_xfs_ios_start_flusher", "1000");
+  set_conf("filestore_wbthrottle_xfs_inodes_start_flusher", "1000");
+  set_conf("filestore_wbthrottle_adaptive", "true");
+  set_conf("filestore_wbthrottle_adaptive_max_delay", "1");
+
+  WBThrottleTest wbt(g_ceph_context);
+  FDRef fd = open_fd("wbthrottle_pacing_rate");
+  ghobject_t oid(hobject_t(sobject_t("pacing", CEPH_NOSNAP)));
+  const double rate = 100 << 20;
+
+  // nothing measured yet, so only the hard limits apply
+  wbt.queue_wb(fd, oid, 0, 2 << 20, false);
+  ASSERT_EQ(0, wbt.pacing_rate());
+  wbt.clear();
+
+  wbt.set_device_rate(rate);
+  wbt.queue_wb(fd, oid, 0, 512 << 10, false);
+  ASSERT_EQ(0, wbt.pacing_rate());
+  ASSERT_EQ(0u, wbt.pacing_rate_counter());
+
+  // halfway from start_flusher to the hard limit
+  utime_t before = ceph_clock_now(g_ceph_context);
+  wbt.queue_wb(fd, oid, 512 << 10, 11 << 19, false);
+  ASSERT_NEAR(rate / 2, wbt.pacing_rate(), 1);
+  ASSERT_EQ((uint64_t)(rate / 2), wbt.pacing_rate_counter());
+  utime_t until = wbt.get_paced_until();
+  ASSERT_GT(until, before);
+  wbt.throttle();
+  ASSERT_GE(ceph_clock_now(g_ceph_context), until);
+
+  // beyond the hard limit writers still get a tenth of the rate
+  wbt.queue_wb(fd, oid, 6 << 20, 6 << 20, false);
+  ASSERT_NEAR(rate / 10, wbt.pacing_rate(), 1);
+
+  // a single huge write holds writers back for at most max_delay
+  before = ceph_clock_now(g_ceph_context);
+  wbt.queue_wb(fd, oid, 12 << 20, 100 << 20, false);
+  until = wbt.get_paced_until();
+  ASSERT_LE((double)(until - before),
+	    1.0 + (double)(ceph_clock_now(g_ceph_context) - before));
+
+  set_conf("filestore_wbthrottle_adaptive", "false");
+  ASSERT_EQ(0, wbt.pacing_rate());
+  ASSERT_EQ(utime_t(), wbt.get_paced_until());
+  wbt.clear();
+
+  set_conf("filestore_wbthrottle_xfs_bytes_start_flusher", "41943040");
+  set_conf("filestore_wbthrottle_xfs_bytes_hard_limit", "419430400");
+  set_conf("filestore_wbthrottle_xfs_ios_start_flusher", "500");
+  set_conf("filestore_wbthrottle_xfs_inodes_start_flusher", "500");
+}
+
+TEST(WBThrottle, ConcurrentFlushers) {
+  // every dirty object is flushed as soon as it is queued
+  set_conf("filestore_wbthrottle_xfs_ios_start_flusher", "1");
+  set_conf("filestore_wbthrottle_flusher_threads", "4");
+  set_conf("filestore_wbthrottle_adaptive", "true");
+  set_conf("filestore_wbthrottle_adaptive_batch", "2");
+
+  WBThrottleTest wbt(g_ceph_context);
+  vector<FDRef> fds;
+  vector<ghobject_t> oids;
+  for (unsigned i = 0; i < 8; ++i) {
+    string name = "wbthrottle_flusher_" + stringify(i);
+    fds.push_back(open_fd(name));
+    oids.push_back(ghobject_t(hobject_t(sobject_t(name, CEPH_NOSNAP))));
+  }
+  wbt.start();
+
+  for (unsigned i = 0; i < 2000; ++i) {
+    unsigned o = i % oids.size();
+    // objects are dirtied again while they are being flushed
+    wbt.queue_wb(fds[o], oids[o], i * 4096, 4096, false);
+    if (i % 50 == 0)
+      usleep(500);
+    if (i % 500 == 250) {
+      // waits for any flush of the object in progress
+      wbt.clear_object(oids[0]);
+      Mutex::Locker l(wbt.flush_lock);
+      ASSERT_FALSE(wbt.in_flush.count(oids[0]));
+    }
+  }
+  while (!wbt.idle())
+    usleep(1000);
+  wbt.stop();
+
+  ASSERT_LT(0u, wbt.flushes);
+  ASSERT_FALSE(wbt.overlap);
+
+  set_conf("filestore_wbthrottle_xfs_ios_start_flusher", "500");
+  set_conf("filestore_wbthrottle_flusher_threads", "1");
+  set_conf("filestore_wbthrottle_adaptive", "false");
+  set_conf("filestore_wbthrottle_adaptive_batch", "16");
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+// Local Variables:
+// compile-command: "cd ../.. ; make unittest_wbthrottle && ./unittest_wbthrottle"
+// End:
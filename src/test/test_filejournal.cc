@@ -301,6 +301,119 @@ TEST(TestFileJournal, ReplaySmall) {
   }
 }
 
+TEST(TestFileJournal, ReplayEncoded) {
+  g_ceph_context->_conf->set_val("journal_ignore_corruption", "false");
+  g_ceph_context->_conf->set_val("journal_write_header_frequency", "0");
+  g_ceph_context->_conf->set_val("journal_compression", "snappy");
+  g_ceph_context->_conf->set_val("journal_zero_skip", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  // all zeros, compressible, zero pages around random data, and too
+  // small for either
+  vector<bufferlist> entries(4);
+  entries[0].append_zero(64 << 10);
+  entries[1].append(string(64 << 10, 'a'));
+  entries[2].append_zero(8192);
+  for (unsigned i = 0; i < 10000; ++i)
+    entries[2].append((char)rand());
+  entries[2].append_zero(4096);
+  entries[3].append("small");
+
+  for (unsigned i = 0 ; i < 3; ++i) {
+    SCOPED_TRACE(subtests[i].description);
+    fsid.generate_random();
+    FileJournal j(fsid, finisher, &sync_cond, path, subtests[i].directio,
+		  subtests[i].aio, subtests[i].faio);
+    ASSERT_EQ(0, j.create());
+    ASSERT_TRUE(j.header.flags & FileJournal::header_t::FLAG_ENTRY_FLAGS);
+    j.make_writeable();
+
+    C_GatherBuilder gb(g_ceph_context, new C_SafeCond(&wait_lock, &cond, &done));
+    for (unsigned e = 0; e < entries.size(); ++e) {
+      bufferlist bl = entries[e];
+      j.submit_entry(e + 1, bl, 0, gb.new_sub());
+    }
+    gb.activate();
+    wait();
+
+    j.close();
+
+    j.open(0);
+
+    bufferlist inbl;
+    uint64_t seq = 0;
+    for (unsigned e = 0; e < entries.size(); ++e) {
+      ASSERT_EQ(true, j.read_entry(inbl, seq));
+      ASSERT_EQ(e + 1, seq);
+      ASSERT_TRUE(inbl.contents_equal(entries[e]));
+      inbl.clear();
+    }
+    ASSERT_TRUE(!j.read_entry(inbl, seq));
+
+    j.make_writeable();
+    j.close();
+  }
+
+  g_ceph_context->_conf->set_val("journal_compression", "");
+  g_ceph_context->_conf->set_val("journal_zero_skip", "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
+TEST(TestFileJournal, EntryFlags) {
+  g_ceph_context->_conf->set_val("journal_ignore_corruption", "false");
+  g_ceph_context->_conf->set_val("journal_write_header_frequency", "0");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  bufferlist zeros;
+  zeros.append_zero(64 << 10);
+
+  for (unsigned i = 0 ; i < 3; ++i) {
+    SCOPED_TRACE(subtests[i].description);
+    fsid.generate_random();
+    {
+      FileJournal j(fsid, finisher, &sync_cond, path, subtests[i].directio,
+		    subtests[i].aio, subtests[i].faio);
+      ASSERT_EQ(0, j.create());
+      ASSERT_FALSE(j.header.flags & FileJournal::header_t::FLAG_ENTRY_FLAGS);
+    }
+
+    // a journal created without entry flags is written as before even
+    // once encoding is turned on
+    g_ceph_context->_conf->set_val("journal_compression", "snappy");
+    g_ceph_context->_conf->set_val("journal_zero_skip", "true");
+    g_ceph_context->_conf->apply_changes(NULL);
+    {
+      FileJournal j(fsid, finisher, &sync_cond, path, subtests[i].directio,
+		    subtests[i].aio, subtests[i].faio);
+      ASSERT_EQ(0, j.open(0));
+      j.make_writeable();
+      bufferlist bl = zeros;
+      j.submit_entry(1, bl, 0, new C_SafeCond(&wait_lock, &cond, &done));
+      wait();
+      j.close();
+
+      ASSERT_EQ(0, j.open(0));
+      ASSERT_FALSE(j.header.flags & FileJournal::header_t::FLAG_ENTRY_FLAGS);
+      bufferlist inbl;
+      uint64_t seq = 0;
+      ASSERT_EQ(true, j.read_entry(inbl, seq));
+      ASSERT_EQ(1u, seq);
+      ASSERT_TRUE(inbl.contents_equal(zeros));
+
+      // refuse a journal with flags we do not know about
+      j.make_writeable();
+      j.header.flags |= 1 << 7;
+      j.write_header_sync();
+      j.close();
+      ASSERT_EQ(-EINVAL, j.open(0));
+      j.close();
+    }
+    g_ceph_context->_conf->set_val("journal_compression", "");
+    g_ceph_context->_conf->set_val("journal_zero_skip", "false");
+    g_ceph_context->_conf->apply_changes(NULL);
+  }
+}
+
 TEST(TestFileJournal, ReplayCorrupt) {
   g_ceph_context->_conf->set_val("journal_ignore_corruption", "true");
   g_ceph_context->_conf->set_val("journal_write_header_frequency", "0");
@@ -634,3 +747,95 @@ TEST(TestFileJournal, ReplayDetectCorruptHeader) {
     ::close(fd);
   }
 }
+
+class C_BenchCommit : public Context {
+  Mutex &lock;
+  Cond &cond;
+  vector<double> &lat;
+  uint64_t &committed;
+  uint64_t seq;
+  utime_t start;
+public:
+  C_BenchCommit(Mutex &lock, Cond &cond, vector<double> &lat,
+		uint64_t &committed, uint64_t seq)
+    : lock(lock), cond(cond), lat(lat), committed(committed), seq(seq),
+      start(ceph_clock_now(g_ceph_context)) {}
+  void finish(int r) {
+    utime_t now = ceph_clock_now(g_ceph_context);
+    Mutex::Locker l(lock);
+    lat.push_back(now - start);
+    committed = MAX(committed, seq);
+    cond.Signal();
+  }
+};
+
+/*
+ * Sweep journal_aio_queue_depth and report throughput and commit
+ * latency percentiles.  Not a functional test; run it with
+ *
+ *   ceph_test_filejournal <path> --gtest_also_run_disabled_tests \
+ *     --gtest_filter=*AioQueueDepthBench*
+ */
+TEST(TestFileJournal, DISABLED_AioQueueDepthBench) {
+  g_ceph_context->_conf->set_val("journal_ignore_corruption", "false");
+  g_ceph_context->_conf->set_val("journal_write_header_frequency", "0");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  const unsigned entries = 20000;
+  const unsigned entry_size = 4096;
+  bufferlist bl;
+  bl.append(buffer::create_page_aligned(entry_size));
+  bl.zero();
+
+  int depths[] = { 0, 1, 2, 4, 8, 16, 32 };
+  for (unsigned d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+    char qd[10];
+    sprintf(qd, "%d", depths[d]);
+    g_ceph_context->_conf->set_val("journal_aio_queue_depth", qd);
+    g_ceph_context->_conf->apply_changes(NULL);
+
+    fsid.generate_random();
+    FileJournal j(fsid, finisher, &sync_cond, path, true, true, true);
+    ASSERT_EQ(0, j.create());
+    j.make_writeable();
+
+    Mutex lock("AioQueueDepthBench::lock");
+    Cond cond;
+    vector<double> lat;
+    lat.reserve(entries);
+    uint64_t committed = 0, trimmed = 0;
+    utime_t start = ceph_clock_now(g_ceph_context);
+    for (uint64_t seq = 1; seq <= entries; ++seq) {
+      // submit_entry claims what it is given
+      bufferlist e(bl);
+      j.submit_entry(seq, e, 0,
+		     new C_BenchCommit(lock, cond, lat, committed, seq));
+      lock.Lock();
+      uint64_t c = committed;
+      lock.Unlock();
+      if (c > trimmed) {
+	j.committed_thru(c);
+	trimmed = c;
+      }
+    }
+    lock.Lock();
+    while (committed < entries)
+      cond.Wait(lock);
+    lock.Unlock();
+    double elapsed = ceph_clock_now(g_ceph_context) - start;
+    j.committed_thru(entries);
+    j.close();
+
+    sort(lat.begin(), lat.end());
+    cout << "queue depth " << depths[d]
+	 << (depths[d] ? "" : " (adaptive)")
+	 << ": " << (double)entries * entry_size / elapsed / (1 << 20)
+	 << " MB/s, " << entries / elapsed << " entries/s, latency us p50 "
+	 << lat[lat.size() / 2] * 1000000
+	 << " p99 " << lat[lat.size() * 99 / 100] * 1000000
+	 << " p99.9 " << lat[lat.size() * 999 / 1000] * 1000000
+	 << std::endl;
+  }
+  g_ceph_context->_conf->set_val("journal_aio_queue_depth", "0");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
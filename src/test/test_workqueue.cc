@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 
 #include "common/WorkQueue.h"
+#include "common/Clock.h"
 #include "global/global_context.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
@@ -57,6 +58,193 @@ TEST(WorkQueue, Resize)
   tp.stop();
 }
 
+struct StealItem {
+  uint32_t shard;
+  bool block;    ///< wait for the gate to open; never stolen
+  bool stolen;
+  StealItem(uint32_t shard, bool block)
+    : shard(shard), block(block), stolen(false) {}
+};
+
+/// one queue per shard; items that block may not be stolen
+class StealWQ : public ShardedThreadPool::ShardedWQ<StealItem*> {
+  struct Shard {
+    Mutex lock;
+    Cond cond;
+    list<StealItem*> q;
+    atomic_t waiters;
+    Shard() : lock("StealWQ::Shard::lock") {}
+  };
+  vector<Shard*> shards;
+
+  Mutex lock;
+  Cond cond;
+  bool gate_open;
+  unsigned started, done, stolen;
+
+  void run(StealItem *i) {
+    Mutex::Locker l(lock);
+    ++started;
+    cond.Signal();
+    while (i->block && !gate_open)
+      cond.Wait(lock);
+    ++done;
+    if (i->stolen)
+      ++stolen;
+    cond.Signal();
+    delete i;
+  }
+
+  void _enqueue(StealItem *i) {
+    Shard *sh = shards[i->shard];
+    sh->lock.Lock();
+    sh->q.push_back(i);
+    sh->cond.Signal();
+    sh->lock.Unlock();
+    if (!sh->waiters.read())
+      wake_thief(i->shard);
+  }
+  void _enqueue_front(StealItem *i) {
+    assert(0);
+  }
+
+public:
+  StealWQ(uint32_t num_shards, ShardedThreadPool *tp)
+    : ShardedThreadPool::ShardedWQ<StealItem*>(60, 0, tp),
+      lock("StealWQ::lock"), gate_open(false),
+      started(0), done(0), stolen(0) {
+    for (uint32_t i = 0; i < num_shards; ++i)
+      shards.push_back(new Shard);
+  }
+  ~StealWQ() {
+    for (uint32_t i = 0; i < shards.size(); ++i)
+      delete shards[i];
+  }
+
+  void _process(uint32_t thread_index, heartbeat_handle_d *hb) {
+    uint32_t s = thread_index % shards.size();
+    Shard *sh = shards[s];
+    sh->lock.Lock();
+    if (sh->q.empty()) {
+      sh->lock.Unlock();
+      if (steal(s, hb))
+	return;
+      sh->lock.Lock();
+      if (sh->q.empty()) {
+	sh->waiters.inc();
+	sh->cond.WaitInterval(g_ceph_context, sh->lock, utime_t(0, 100000000));
+	sh->waiters.dec();
+      }
+      if (sh->q.empty()) {
+	sh->lock.Unlock();
+	return;
+      }
+    }
+    StealItem *i = sh->q.front();
+    sh->q.pop_front();
+    sh->lock.Unlock();
+    run(i);
+  }
+  void return_waiting_threads() {
+    for (uint32_t i = 0; i < shards.size(); ++i) {
+      Mutex::Locker l(shards[i]->lock);
+      shards[i]->cond.Signal();
+    }
+  }
+  bool is_shard_empty(uint32_t thread_index) {
+    Shard *sh = shards[thread_index % shards.size()];
+    Mutex::Locker l(sh->lock);
+    return sh->q.empty();
+  }
+
+  uint32_t get_num_shards() {
+    return shards.size();
+  }
+  bool has_idle_threads(uint32_t shard_index) {
+    return shards[shard_index]->waiters.read();
+  }
+  bool _steal_from(uint32_t shard_index, heartbeat_handle_d *hb) {
+    Shard *sh = shards[shard_index];
+    sh->lock.Lock();
+    if (sh->q.empty() || sh->q.front()->block) {
+      sh->lock.Unlock();
+      return false;
+    }
+    StealItem *i = sh->q.front();
+    sh->q.pop_front();
+    sh->lock.Unlock();
+    i->stolen = true;
+    run(i);
+    return true;
+  }
+  bool _wake_idle(uint32_t shard_index) {
+    Shard *sh = shards[shard_index];
+    if (!sh->waiters.read())
+      return false;
+    Mutex::Locker l(sh->lock);
+    sh->cond.Signal();
+    return true;
+  }
+
+  /// wait up to secs for n items to have started (or finished)
+  bool wait_for(unsigned *what, unsigned n, int secs) {
+    Mutex::Locker l(lock);
+    utime_t until = ceph_clock_now(g_ceph_context);
+    until += utime_t(secs, 0);
+    while (*what < n) {
+      if (ceph_clock_now(g_ceph_context) >= until)
+	return false;
+      cond.WaitUntil(lock, until);
+    }
+    return true;
+  }
+  bool wait_started(unsigned n, int secs) {
+    return wait_for(&started, n, secs);
+  }
+  bool wait_done(unsigned n, int secs) {
+    return wait_for(&done, n, secs);
+  }
+  void open_gate() {
+    Mutex::Locker l(lock);
+    gate_open = true;
+    cond.Signal();
+  }
+  unsigned get_done() {
+    Mutex::Locker l(lock);
+    return done;
+  }
+  unsigned get_stolen() {
+    Mutex::Locker l(lock);
+    return stolen;
+  }
+};
+
+TEST(ShardedThreadPool, WorkStealing)
+{
+  const unsigned n = 10;
+  for (int steal = 0; steal < 2; ++steal) {
+    // one thread per shard; shard 0's is held up by a blocking item
+    ShardedThreadPool tp(g_ceph_context, "steal", 2);
+    tp.set_work_stealing(steal);
+    StealWQ wq(2, &tp);
+    tp.start();
+    wq.queue(new StealItem(0, true));
+    ASSERT_TRUE(wq.wait_started(1, 10));
+    for (unsigned i = 0; i < n; ++i)
+      wq.queue(new StealItem(0, false));
+    if (steal) {
+      // shard 1's thread runs them
+      EXPECT_TRUE(wq.wait_done(n, 10));
+      EXPECT_EQ(n, wq.get_stolen());
+    } else {
+      EXPECT_FALSE(wq.wait_done(1, 1));
+    }
+    wq.open_gate();
+    EXPECT_TRUE(wq.wait_done(n + 1, 10));
+    tp.stop();
+  }
+}
+
 
 int main(int argc, char **argv)
 {
@@ -0,0 +1,71 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Render a binary log (log_binary = true) back into the usual text
+ * format.  Timestamps are printed in the local time zone of the decoder,
+ * so set TZ to match the host that wrote the log if they differ.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <iostream>
+
+#include "common/errno.h"
+#include "log/BinaryFormat.h"
+
+static void usage()
+{
+  cerr << "usage: ceph-log-decode <binary log file> [...]\n"
+       << "       ceph-log-decode -    (read from stdin)" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+  if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0) {
+    usage();
+    return 0;
+  }
+
+  int ret = 0;
+  for (int i = 1; i < argc; i++) {
+    FILE *f;
+    if (strcmp(argv[i], "-") == 0) {
+      f = stdin;
+    } else {
+      f = fopen(argv[i], "r");
+      if (!f) {
+	int r = -errno;
+	cerr << "unable to open " << argv[i] << ": " << cpp_strerror(r)
+	     << std::endl;
+	ret = 1;
+	continue;
+      }
+    }
+    int r = ceph::log::decode_binary_log(f, cout, cerr);
+    if (r < 0) {
+      cerr << "error decoding " << argv[i] << ": " << cpp_strerror(r)
+	   << std::endl;
+      ret = 1;
+    }
+    if (f != stdin)
+      fclose(f);
+  }
+  cout.flush();
+  return ret;
+}
@@ -1913,6 +1913,7 @@ int main(int argc, char **argv)
   string dpath, jpath, pgidstr, op, file, object, objcmd, arg1, arg2, type, format;
   spg_t pgid;
   unsigned epoch = 0;
+  uint64_t expected_num_objs = 0;
   ghobject_t ghobj;
   bool human_readable;
   bool force;
@@ -1928,10 +1929,12 @@ int main(int argc, char **argv)
     ("journal-path", po::value<string>(&jpath),
      "path to journal, mandatory for filestore type")
     ("pgid", po::value<string>(&pgidstr),
-     "PG id, mandatory for info, log, remove, export, rm-past-intervals")
+     "PG id, mandatory for info, log, remove, export, rm-past-intervals, pre-split")
     ("op", po::value<string>(&op),
      "Arg is one of [info, log, remove, export, import, list, fix-lost, list-pgs, rm-past-intervals, set-allow-sharded-objects, dump-journal, dump-super, meta-list, "
-	 "get-osdmap, set-osdmap, get-inc-osdmap, set-inc-osdmap]")
+	 "get-osdmap, set-osdmap, get-inc-osdmap, set-inc-osdmap, pre-split]")
+    ("expected-num-objects", po::value<uint64_t>(&expected_num_objs),
+     "object count to pre-split the PG's directories for, mandatory for pre-split")
     ("epoch", po::value<unsigned>(&epoch),
      "epoch# for get-osdmap and get-inc-osdmap, the current epoch in use if not specified")
     ("file", po::value<string>(&file),
@@ -2298,7 +2301,7 @@ int main(int argc, char **argv)
   // The ops which require --pgid option are checked here and
   // mentioned in the usage for --pgid.
   if ((op == "info" || op == "log" || op == "remove" || op == "export"
-      || op == "rm-past-intervals") && pgidstr.length() == 0) {
+      || op == "rm-past-intervals" || op == "pre-split") && pgidstr.length() == 0) {
     cerr << "Must provide pgid" << std::endl;
     usage(desc);
     ret = 1;
@@ -2576,9 +2579,9 @@ int main(int argc, char **argv)
 
   // If not an object command nor any of the ops handled below, then output this usage
   // before complaining about a bad pgid
-  if (!vm.count("objcmd") && op != "export" && op != "info" && op != "log" && op != "rm-past-intervals") {
+  if (!vm.count("objcmd") && op != "export" && op != "info" && op != "log" && op != "rm-past-intervals" && op != "pre-split") {
     cerr << "Must provide --op (info, log, remove, export, import, list, fix-lost, list-pgs, rm-past-intervals, set-allow-sharded-objects, dump-journal, dump-super, meta-list, "
-      "get-osdmap, set-osdmap, get-inc-osdmap, set-inc-osdmap)"
+      "get-osdmap, set-osdmap, get-inc-osdmap, set-inc-osdmap, pre-split)"
 	 << std::endl;
     usage(desc);
     ret = 1;
@@ -2835,6 +2838,37 @@ int main(int argc, char **argv)
         fs->apply_transaction(*t);
         cout << "Removal succeeded" << std::endl;
       }
+    } else if (op == "pre-split") {
+      if (!expected_num_objs) {
+        cerr << "Must provide --expected-num-objects" << std::endl;
+        ret = -EINVAL;
+        goto out;
+      }
+      OSDMap curmap;
+      bufferlist mapbl;
+      ret = get_osdmap(fs, superblock.current_epoch, curmap, mapbl);
+      if (ret) {
+        cerr << "Can't find local OSDMap" << std::endl;
+        goto out;
+      }
+      const pg_pool_t *pool = curmap.get_pg_pool(pgid.pool());
+      if (!pool) {
+        cerr << "Pool " << pgid.pool() << " not in the local OSDMap" << std::endl;
+        ret = -ENOENT;
+        goto out;
+      }
+
+      // the same hint a pool creation with expected_num_objects gives
+      ObjectStore::Transaction t;
+      bufferlist hint;
+      uint32_t pg_num = pool->get_pg_num();
+      ::encode(pg_num, hint);
+      ::encode(expected_num_objs, hint);
+      t.collection_hint(coll, ObjectStore::Transaction::COLL_HINT_EXPECTED_NUM_OBJECTS, hint);
+      if (!dry_run)
+        ret = fs->apply_transaction(t);
+      if (ret == 0)
+        cout << "Pre-split for " << expected_num_objs << " objects" << std::endl;
     } else {
       assert(!"Should have already checked for valid --op");
     }